@@ -0,0 +1,102 @@
+#include "bufferpool.h"
+#include "common.h"
+#include <new>
+
+CBufferPool::CBufferPool(int nBlockSize, int nPrealloc) :
+	m_nBlockSize(nBlockSize),
+	m_pFree(0),
+	m_nOutstanding(0),
+	m_bClosed(false)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+	for (int i = 0; i < nPrealloc; ++i){
+		CBlock* pBlock = new (new unsigned char[HEADERSIZE + m_nBlockSize]) CBlock();
+		pBlock->m_pPool = this;
+		pBlock->m_pNext = m_pFree;
+		m_pFree = pBlock;
+	}
+}
+
+CBufferPool::~CBufferPool()
+{
+	while (m_pFree){
+		CBlock* pNext = m_pFree->m_pNext;
+		m_pFree->~CBlock();
+		delete[] (unsigned char*) m_pFree;
+		m_pFree = pNext;
+	}
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+// Buffers still in use stay valid, the pool goes away with the last of them
+void CBufferPool::Close(){
+	bool bDelete = false;
+	{
+		CGuard Guard(m_Mutex);
+		m_bClosed = true;
+		bDelete = m_nOutstanding == 0;
+	}
+	if (bDelete){
+		delete this;
+	}
+}
+
+// Returns a buffer of GetBlockSize() bytes holding one reference, or 0 once the pool is closed
+unsigned char* CBufferPool::Acquire(){
+	CBlock* pBlock = 0;
+	{
+		CGuard Guard(m_Mutex);
+		if (m_bClosed){
+			return 0;
+		}
+		pBlock = m_pFree;
+		if (pBlock){
+			m_pFree = pBlock->m_pNext;
+		}
+		++m_nOutstanding;
+	}
+	if (!pBlock){
+		pBlock = new (new unsigned char[HEADERSIZE + m_nBlockSize]) CBlock();
+		pBlock->m_pPool = this;
+	}
+	pBlock->m_pNext = 0;
+	pBlock->m_nRefs.store(1, std::memory_order_relaxed);
+	return (unsigned char*) pBlock + HEADERSIZE;
+}
+
+int CBufferPool::GetBlockSize(){
+	return m_nBlockSize;
+}
+
+CBufferPool::CBlock* CBufferPool::GetBlock(unsigned char* pBuffer){
+	return (CBlock*) (pBuffer - HEADERSIZE);
+}
+
+void CBufferPool::Retain(unsigned char* pBuffer){
+	if (pBuffer){
+		GetBlock(pBuffer)->m_nRefs.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void CBufferPool::Release(unsigned char* pBuffer){
+	if (pBuffer){
+		CBlock* pBlock = GetBlock(pBuffer);
+		if (pBlock->m_nRefs.fetch_sub(1, std::memory_order_acq_rel) == 1){
+			pBlock->m_pPool->Recycle(pBlock);
+		}
+	}
+}
+
+void CBufferPool::Recycle(CBlock* pBlock){
+	bool bDelete = false;
+	{
+		CGuard Guard(m_Mutex);
+		pBlock->m_pNext = m_pFree;
+		m_pFree = pBlock;
+		--m_nOutstanding;
+		bDelete = m_bClosed && m_nOutstanding == 0;
+	}
+	if (bDelete){
+		delete this;
+	}
+}
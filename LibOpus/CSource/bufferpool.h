@@ -0,0 +1,39 @@
+#ifndef _BUFFERPOOL_H_
+#define _BUFFERPOOL_H_
+
+#include "guard.h"
+
+// Fixed-size, reference counted buffers that go back to their pool instead of the heap.
+// Once the pool has grown to the number of buffers a stream keeps in flight, acquiring and
+// releasing them allocates nothing. Buffers may be retained and released on any thread.
+class CBufferPool
+{
+	struct CBlock
+	{
+		CBufferPool* m_pPool;
+		CBlock* m_pNext;
+		std::atomic<int> m_nRefs;
+	};
+	static const int HEADERSIZE = (sizeof(CBlock) + 15) & ~15;	// Keeps the data 16-byte aligned
+
+	pthread_mutex_t m_Mutex;
+	int m_nBlockSize;
+	CBlock* m_pFree;
+	int m_nOutstanding;
+	bool m_bClosed;
+
+	~CBufferPool();
+	static CBlock* GetBlock(unsigned char* pBuffer);
+	void Recycle(CBlock* pBlock);
+
+public:
+	CBufferPool(int nBlockSize, int nPrealloc);
+	void Close();
+	unsigned char* Acquire();
+	int GetBlockSize();
+	static void Retain(unsigned char* pBuffer);
+	static void Release(unsigned char* pBuffer);
+
+};
+
+#endif
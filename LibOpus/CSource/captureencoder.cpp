@@ -0,0 +1,199 @@
+#include "captureencoder.h"
+#include "common.h"
+#include <time.h>
+
+CCaptureEncoder::CCaptureEncoder() :
+	m_bRunning(false),
+	m_Encoder(false),
+	m_pCallback(0),
+	m_pContext(0),
+	m_samplesInPacket(0),
+	m_frameSize(0),
+	m_input(0),
+	m_pPool(0),
+	m_nHeadroom(0),
+	m_nPrefix(0)
+{
+	m_bFinishing = false;
+	m_gain = 0;
+	m_nOverruns = 0;
+	m_iMaxLatencyUs = 0;
+	pthread_mutex_init(&m_Mutex, 0);
+	pthread_cond_init(&m_Cond, 0);
+}
+
+CCaptureEncoder::~CCaptureEncoder()
+{
+	Stop();
+	delete[] m_input;
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+// Packets are encoded into pool buffers behind the headroom and the prefix, such as a network
+// packet header, so the callback gets a complete message that can go out without another copy
+bool CCaptureEncoder::Start(int iSampleRate, int iFramesInPacket, int iFrameSize, int iBitrate, int iAmplifierGain, CBufferPool* pPool, int nHeadroom, const unsigned char* pPrefix, int nPrefix, CaptureEncoderCallback pCallback, void* pContext){
+	if (m_bRunning || !pCallback || iFramesInPacket <= 0 || iFramesInPacket * iFrameSize > 120){
+		return false;
+	}
+	if (nPrefix < 0 || nPrefix > MAXPREFIX || (nPrefix > 0 && !pPrefix) || nHeadroom < 0){
+		return false;
+	}
+	if (!pPool || pPool->GetBlockSize() < nHeadroom + nPrefix + CEncoderOpus::GetMaxPacketSize(iFramesInPacket)){
+		return false;
+	}
+	if (!m_Encoder.Start(iSampleRate, iFramesInPacket, iFrameSize, iBitrate, iAmplifierGain)){
+		return false;
+	}
+	m_pCallback = pCallback;
+	m_pContext = pContext;
+	m_samplesInPacket = iSampleRate * iFrameSize / 1000 * iFramesInPacket;
+	m_frameSize = iFrameSize;
+	m_pPool = pPool;
+	m_nHeadroom = nHeadroom;
+	m_nPrefix = nPrefix;
+	if (nPrefix > 0){
+		memcpy(m_prefix, pPrefix, nPrefix);
+	}
+	delete[] m_input;
+	m_input = new short[m_samplesInPacket];
+	m_Samples.Init(m_samplesInPacket * RINGPACKETS);
+	m_Marks.Init(MAXMARKS);
+	m_gain = iAmplifierGain;
+	m_nOverruns = 0;
+	m_iMaxLatencyUs = 0;
+	m_bFinishing = false;
+	if (pthread_create(&m_Thread, 0, WorkerProc, this) != 0){
+		unsigned char tail[MAXPACKETBYTES];
+		m_Encoder.Stop(tail);
+		return false;
+	}
+	m_bRunning = true;
+	return true;
+}
+
+// Encodes everything pushed so far, reports the flushed tail and waits for the worker to exit
+void CCaptureEncoder::Stop(){
+	if (!m_bRunning){
+		return;
+	}
+	m_bFinishing.store(true, std::memory_order_release);
+	pthread_cond_signal(&m_Cond);
+	pthread_join(m_Thread, 0);
+	m_bRunning = false;
+}
+
+// Applied by the worker before the next packet it encodes
+void CCaptureEncoder::SetGain(int iAmplifierGain){
+	m_gain.store(iAmplifierGain, std::memory_order_relaxed);
+}
+
+// Never blocks. Audio that doesn't fit because the worker fell behind is dropped whole and counted.
+bool CCaptureEncoder::Push(const short* pData, int nData){
+	if (!m_bRunning || !pData || nData <= 0){
+		return false;
+	}
+	if (m_Samples.GetWritable() < (unsigned) nData || m_Marks.GetWritable() == 0){
+		m_nOverruns.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	CMark mark;
+	mark.m_nSamples = nData;
+	mark.m_iTimeUs = Now();
+	m_Samples.Write(pData, nData);
+	m_Marks.Write(&mark, 1);
+	// Signalling without the mutex never blocks on the worker; a wakeup it misses is covered
+	// by its timed wait
+	pthread_cond_signal(&m_Cond);
+	return true;
+}
+
+int CCaptureEncoder::GetOverruns(){
+	return m_nOverruns.load(std::memory_order_relaxed);
+}
+
+int CCaptureEncoder::GetMaxLatency(){
+	return m_iMaxLatencyUs.load(std::memory_order_relaxed);
+}
+
+long long CCaptureEncoder::Now(){
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (long long) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Hands the buffer on, or gives it back when the encoder produced nothing
+void CCaptureEncoder::Deliver(unsigned char* pBuffer, int len, int iLatencyUs, bool bLast){
+	if (len > 0){
+		memcpy(pBuffer + m_nHeadroom, m_prefix, m_nPrefix);
+		m_pCallback(m_pContext, pBuffer, m_nHeadroom + m_nPrefix + len, iLatencyUs, bLast ? 1 : 0);
+		return;
+	}
+	if (pBuffer){
+		CBufferPool::Release(pBuffer);
+	}
+	m_pCallback(m_pContext, 0, 0, iLatencyUs, bLast ? 1 : 0);
+}
+
+void* CCaptureEncoder::WorkerProc(void* pParam){
+	((CCaptureEncoder*) pParam)->Work();
+	return 0;
+}
+
+void CCaptureEncoder::Work(){
+	int gain = m_gain.load(std::memory_order_relaxed);
+	int staged = 0;
+	for (;;){
+		CMark mark;
+		if (m_Marks.Read(&mark, 1) == 0){
+			if (m_bFinishing.load(std::memory_order_acquire)){
+				// Pushes are over, but one may have landed between the read and the flag
+				if (m_Marks.Read(&mark, 1) == 0){
+					break;
+				}
+			}
+			else{
+				struct timespec until;
+				clock_gettime(CLOCK_REALTIME, &until);
+				until.tv_nsec += (long) m_frameSize * 1000000;
+				until.tv_sec += until.tv_nsec / 1000000000;
+				until.tv_nsec %= 1000000000;
+				CGuard Guard(m_Mutex);
+				if (m_Marks.GetReadable() == 0 && !m_bFinishing.load(std::memory_order_acquire)){
+					pthread_cond_timedwait(&m_Cond, &m_Mutex, &until);
+				}
+				continue;
+			}
+		}
+
+		// Samples of a push are in the ring before its mark
+		int remaining = mark.m_nSamples;
+		while (remaining > 0){
+			int count = min(remaining, m_samplesInPacket - staged);
+			m_Samples.Read(m_input + staged, (unsigned) count);
+			staged += count;
+			remaining -= count;
+			if (staged == m_samplesInPacket){
+				staged = 0;
+				gain = m_gain.load(std::memory_order_relaxed);
+				unsigned char* pBuffer = m_pPool->Acquire();
+				int len = pBuffer ? m_Encoder.Encode(m_input, m_samplesInPacket, pBuffer + m_nHeadroom + m_nPrefix, gain) : 0;
+				int latency = (int) (Now() - mark.m_iTimeUs);
+				if (latency > m_iMaxLatencyUs.load(std::memory_order_relaxed)){
+					m_iMaxLatencyUs.store(latency, std::memory_order_relaxed);
+				}
+				Deliver(pBuffer, len, latency, false);
+			}
+		}
+	}
+
+	// Partial packet goes through the encoder's own flush
+	unsigned char* pBuffer = m_pPool->Acquire();
+	unsigned char tail[MAXPACKETBYTES];
+	unsigned char* pOutput = pBuffer ? pBuffer + m_nHeadroom + m_nPrefix : tail;
+	if (staged > 0){
+		m_Encoder.Encode(m_input, staged, pOutput, gain);
+	}
+	int len = m_Encoder.Stop(pOutput);
+	Deliver(pBuffer, pBuffer ? len : 0, 0, true);
+}
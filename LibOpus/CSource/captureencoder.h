@@ -0,0 +1,72 @@
+#ifndef _CAPTUREENCODER_H_
+#define _CAPTUREENCODER_H_
+
+#include "guard.h"
+#include "spscring.h"
+#include "encoderopus.h"
+#include "bufferpool.h"
+
+// Called on the worker for every packet's worth of audio, in capture order. pBuffer comes from the
+// pool given to Start and the callback takes over its reference. It holds the headroom, left
+// unwritten for the caller's own framing, then the prefix and the packet; nBuffer counts all three.
+// pBuffer is null and nBuffer 0 when the encoder produced nothing.
+// iLatencyUs is the time from the push that completed the packet to the packet being ready.
+// The final call has bLast set and carries whatever the encoder flushed.
+typedef void (*CaptureEncoderCallback)(void* pContext, unsigned char* pBuffer, int nBuffer, int iLatencyUs, int bLast);
+
+// Encodes captured audio on its own worker thread. The capture side only copies samples into a
+// lock-free ring, so it never waits for the codec or a lock. Push must be called from one thread
+// (or serial queue) at a time.
+class CCaptureEncoder
+{
+	static const int RINGPACKETS = 8;				// Audio that may queue up before pushes are dropped
+	static const int MAXMARKS = 256;
+	static const unsigned MAXPACKETBYTES = (1 + 1276) * 24;	// 120 ms of 5 ms frames
+	static const int MAXPREFIX = 16;
+
+	// One push, so the worker knows when the samples it encodes arrived
+	struct CMark
+	{
+		int m_nSamples;
+		long long m_iTimeUs;
+	};
+
+	pthread_mutex_t m_Mutex;
+	pthread_cond_t m_Cond;
+	pthread_t m_Thread;
+	bool m_bRunning;
+	std::atomic<bool> m_bFinishing;
+	CEncoderOpus m_Encoder;							// Owned by the worker while it runs
+	CSpscRing<short> m_Samples;
+	CSpscRing<CMark> m_Marks;
+	std::atomic<int> m_gain;
+	std::atomic<int> m_nOverruns;
+	std::atomic<int> m_iMaxLatencyUs;
+	CaptureEncoderCallback m_pCallback;
+	void* m_pContext;
+	int m_samplesInPacket;
+	int m_frameSize;								// Frame duration, ms
+	short* m_input;									// Packet being assembled by the worker
+	CBufferPool* m_pPool;							// Every packet is encoded straight into one of its buffers
+	int m_nHeadroom;
+	int m_nPrefix;
+	unsigned char m_prefix[MAXPREFIX];
+
+	static void* WorkerProc(void* pParam);
+	void Work();
+	void Deliver(unsigned char* pBuffer, int len, int iLatencyUs, bool bLast);
+	static long long Now();
+
+public:
+	CCaptureEncoder();
+	~CCaptureEncoder();
+	bool Start(int iSampleRate, int iFramesInPacket, int iFrameSize, int iBitrate, int iAmplifierGain, CBufferPool* pPool, int nHeadroom, const unsigned char* pPrefix, int nPrefix, CaptureEncoderCallback pCallback, void* pContext);
+	void Stop();
+	void SetGain(int iAmplifierGain);
+	bool Push(const short* pData, int nData);
+	int GetOverruns();
+	int GetMaxLatency();
+
+};
+
+#endif
@@ -0,0 +1,264 @@
+#include "decodeahead.h"
+#include "common.h"
+
+CDecodeAhead::CDecodeAhead() :
+	m_bRunning(false),
+	m_bNotified(false),
+	m_Decoder(false),
+	m_pSlots(0),
+	m_iReadOffset(0),
+	m_pSource(0),
+	m_pSourceContext(0),
+	m_pCallback(0),
+	m_pContext(0),
+	m_sampleRate(0),
+	m_frameSize(0),
+	m_framesInPacket(0),
+	m_samplesInPacket(0),
+	m_iPreroll(0),
+	m_nPreroll(0)
+{
+	m_bStopping = false;
+	m_bSleeping = false;
+	m_iWrite = 0;
+	m_iRead = 0;
+	m_bEnded = false;
+	m_gain = 0;
+	m_bTracking = false;
+	pthread_mutex_init(&m_Mutex, 0);
+	pthread_cond_init(&m_Cond, 0);
+}
+
+CDecodeAhead::~CDecodeAhead()
+{
+	Stop();
+	delete[] m_pSlots;
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+bool CDecodeAhead::Start(unsigned char* pHeader, int nHeader, DecodeAheadSource pSource, void* pSourceContext, DecodeAheadCallback pCallback, void* pContext){
+	if (m_bRunning || !pSource || !m_Decoder.Start(pHeader, nHeader)){
+		return false;
+	}
+	m_pSource = pSource;
+	m_pSourceContext = pSourceContext;
+	m_pCallback = pCallback;
+	m_pContext = pContext;
+	m_sampleRate = m_Decoder.GetSampleRate();
+	m_frameSize = m_Decoder.GetFrameSize();
+	m_framesInPacket = m_Decoder.GetFramesInPacket();
+	m_samplesInPacket = m_sampleRate * m_frameSize / 1000 * m_framesInPacket;
+	delete[] m_pSlots;
+	m_pSlots = new short[SLOTS * m_samplesInPacket];
+	m_iWrite = 0;
+	m_iRead = 0;
+	m_iReadOffset = 0;
+	m_bEnded = false;
+	m_bStopping = false;
+	m_bSleeping = false;
+	m_bNotified = false;
+	m_nPreroll = 0;
+	CGuard Guard(m_Mutex);
+	if (pthread_create(&m_Thread, 0, WorkerProc, this) != 0){
+		m_Decoder.Stop();
+		return false;
+	}
+	m_bRunning = true;
+	return true;
+}
+
+void CDecodeAhead::Stop(){
+	if (!m_bRunning){
+		return;
+	}
+	{
+		CGuard Guard(m_Mutex);
+		m_bStopping = true;
+		m_bRunning = false;
+		pthread_cond_signal(&m_Cond);
+	}
+	pthread_join(m_Thread, 0);
+	m_Decoder.Stop();
+}
+
+// Applied by the worker before the next packet it decodes
+void CDecodeAhead::SetGain(int iAmplifierGain){
+	m_gain.store(iAmplifierGain, std::memory_order_relaxed);
+}
+
+// While tracking, the worker takes packets without decoding them and hands out silence of the
+// same length instead, so playback keeps its pace and position. Meant for streams nobody hears.
+// Once tracking stops, the decoder is reset and the last few skipped packets are decoded again
+// to warm it up before real audio comes out.
+void CDecodeAhead::SetTracking(bool bTracking){
+	m_bTracking.store(bTracking, std::memory_order_relaxed);
+}
+
+// The source has new packets, or has reached the end of the stream
+void CDecodeAhead::Notify(){
+	CGuard Guard(m_Mutex);
+	m_bNotified = true;
+	pthread_cond_signal(&m_Cond);
+}
+
+// Never blocks. Returns the number of samples copied, 0 if the worker is behind,
+// or -1 once the whole stream has been read.
+int CDecodeAhead::Read(short* pOutput, int nOutput){
+	if (!pOutput || nOutput <= 0 || !m_pSlots){
+		return 0;
+	}
+	// Checked first, so a stream that just ended can't be reported before its last samples
+	bool bEnded = m_bEnded.load(std::memory_order_acquire);
+	unsigned iRead = m_iRead.load(std::memory_order_relaxed);
+	unsigned iWrite = m_iWrite.load(std::memory_order_acquire);
+	int read = 0;
+	bool bFreed = false;
+	while (read < nOutput && iRead != iWrite){
+		int slot = (int) (iRead & (SLOTS - 1));
+		int count = min(nOutput - read, m_slotLength[slot] - m_iReadOffset);
+		memcpy(pOutput + read, m_pSlots + slot * m_samplesInPacket + m_iReadOffset, count * sizeof(short));
+		read += count;
+		m_iReadOffset += count;
+		if (m_iReadOffset == m_slotLength[slot]){
+			m_iReadOffset = 0;
+			++iRead;
+			bFreed = true;
+		}
+	}
+	if (bFreed){
+		// Paired with the worker announcing its sleep before it checks for a free slot, so either
+		// it sees the slot or we see it sleeping. Only then is the lock worth taking.
+		m_iRead.store(iRead, std::memory_order_seq_cst);
+		if (m_bSleeping.load(std::memory_order_seq_cst)){
+			CGuard Guard(m_Mutex);
+			pthread_cond_signal(&m_Cond);
+		}
+	}
+	if (read == 0 && bEnded){
+		return -1;
+	}
+	return read;
+}
+
+int CDecodeAhead::GetSampleRate(){
+	return m_sampleRate;
+}
+
+int CDecodeAhead::GetFrameSize(){
+	return m_frameSize;
+}
+
+int CDecodeAhead::GetFramesInPacket(){
+	return m_framesInPacket;
+}
+
+void* CDecodeAhead::WorkerProc(void* pParam){
+	((CDecodeAhead*) pParam)->Work();
+	return 0;
+}
+
+void CDecodeAhead::Work(){
+	int gain = 0;
+	bool bReceived = false;							// Losses before the first packet are not concealed
+	bool bTracked = false;							// Decoder state is stale since packets were skipped
+	while (!m_bStopping.load(std::memory_order_relaxed)){
+		unsigned iWrite = m_iWrite.load(std::memory_order_relaxed);
+		unsigned iRead = m_iRead.load(std::memory_order_acquire);
+		if (iWrite - iRead < (unsigned) SLOTS){
+			// Playback has read everything, a missing packet is not worth waiting for any longer
+			bool bUrgent = iWrite == iRead;
+			int result = m_pSource(m_pSourceContext, m_packet.m_data, MAXPACKETBYTES, bUrgent ? 1 : 0);
+			if (result != OPUS_AHEAD_WAIT){
+				bool bLast = result == OPUS_AHEAD_END;
+				m_packet.m_nData = result > 0 ? result : 0;
+				if (m_packet.m_nData > 0){
+					bReceived = true;
+				}
+				int newGain = m_gain.load(std::memory_order_relaxed);
+				if (newGain != gain){
+					gain = newGain;
+					m_Decoder.SetGain(gain);
+				}
+
+				// A lost packet is concealed, but only once there was something to conceal. At the
+				// end, the empty packet flushes the one the decoder holds back.
+				short* pSlot = m_pSlots + (iWrite & (SLOTS - 1)) * m_samplesInPacket;
+				int decoded = 0;
+				bool bTracking = m_bTracking.load(std::memory_order_relaxed);
+				if (bTracked && !bTracking){
+					Preroll(pSlot);
+				}
+				bTracked = bTracking;
+				if (bReceived || bLast){
+					decoded = Decode(bLast ? 0 : &m_packet, pSlot, bTracking);
+				}
+				if (decoded > 0){
+					m_slotLength[iWrite & (SLOTS - 1)] = decoded;
+					m_iWrite.store(iWrite + 1, std::memory_order_release);
+					if (m_pCallback){
+						m_pCallback(m_pContext);
+					}
+				}
+				if (bLast){
+					m_bEnded.store(true, std::memory_order_release);
+					if (m_pCallback){
+						m_pCallback(m_pContext);
+					}
+					return;
+				}
+				continue;
+			}
+		}
+
+		// Sleeps until playback frees a slot or the source has new packets. A slot freed after
+		// the check above is caught here, see Read.
+		CGuard Guard(m_Mutex);
+		m_bSleeping.store(true, std::memory_order_seq_cst);
+		while (!m_bStopping.load(std::memory_order_relaxed) && !m_bNotified && m_iRead.load(std::memory_order_seq_cst) == iRead){
+			pthread_cond_wait(&m_Cond, &m_Mutex);
+		}
+		m_bSleeping.store(false, std::memory_order_relaxed);
+		m_bNotified = false;
+	}
+}
+
+// Decodes the packet straight into the slot, or a lost one if pPacket is null. While tracking the
+// packet is only taken and the slot filled with as much silence. Returns the number of samples.
+int CDecodeAhead::Decode(CPacket* pPacket, short* pSlot, bool bTracking){
+	unsigned char* pData = pPacket && pPacket->m_nData > 0 ? pPacket->m_data : 0;
+	int nData = pData ? pPacket->m_nData : 0;
+	if (bTracking){
+		int skipped = m_Decoder.Skip(pData, nData);
+		if (pPacket){
+			Remember(pPacket);
+		}
+		memset(pSlot, 0, skipped * sizeof(short));
+		return skipped;
+	}
+	// The decoder holds one packet back, so this is the previous one
+	return m_Decoder.DecodeInto(pData, nData, pSlot, m_samplesInPacket);
+}
+
+// Keeps a copy of a skipped packet for the preroll, in place of the oldest one
+void CDecodeAhead::Remember(CPacket* pPacket){
+	CPacket* pCopy = &m_preroll[m_iPreroll];
+	pCopy->m_nData = pPacket->m_nData;
+	memcpy(pCopy->m_data, pPacket->m_data, pPacket->m_nData);
+	m_iPreroll = (m_iPreroll + 1) % PREROLLPACKETS;
+	if (m_nPreroll < PREROLLPACKETS){
+		++m_nPreroll;
+	}
+}
+
+// Decodes the remembered packets from a clean state and throws the audio away, it was already
+// played as silence. Leaves the decoder holding the last skipped packet, as Skip did. The audio
+// goes to pScratch, which has room for a packet and is overwritten right after.
+void CDecodeAhead::Preroll(short* pScratch){
+	m_Decoder.Reset();
+	for (int i = 0; i < m_nPreroll; ++i){
+		CPacket* pPacket = &m_preroll[(m_iPreroll - m_nPreroll + i + PREROLLPACKETS) % PREROLLPACKETS];
+		m_Decoder.DecodeInto(pPacket->m_nData > 0 ? pPacket->m_data : 0, pPacket->m_nData, pScratch, m_samplesInPacket);
+	}
+	m_nPreroll = 0;
+}
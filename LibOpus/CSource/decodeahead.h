@@ -0,0 +1,84 @@
+#ifndef _DECODEAHEAD_H_
+#define _DECODEAHEAD_H_
+
+#include "guard.h"
+#include "decoderopus.h"
+
+// Called on the worker for the next packet of the stream. Copies it into pBuffer (room for nBuffer
+// bytes) and returns its length, 0 for a lost packet, OPUS_AHEAD_WAIT when it hasn't arrived yet,
+// or OPUS_AHEAD_END once there are no more. bUrgent is set when playback runs out of audio before
+// another packet could be decoded, so a packet that is known to be missing should be given up on.
+typedef int (*DecodeAheadSource)(void* pContext, unsigned char* pBuffer, int nBuffer, int bUrgent);
+
+// Called on the worker thread after decoded audio has become readable, and once more when the end
+// of the stream has been reached, so readers never have to poll.
+typedef void (*DecodeAheadCallback)(void* pContext);
+
+// Decodes a stream on its own worker thread. The worker pulls packets from the source while there
+// is room for them and decodes each one straight into a slot that playback reads from, so Read
+// only copies samples and never waits for the codec or a lock. Reading frees slots and wakes the
+// worker. Notify/SetGain/SetTracking may be called from any thread, Read from a single playback
+// thread.
+class CDecodeAhead
+{
+	static const int MAXPACKETBYTES = 5760;			// Largest packet CDecoderOpus takes
+	static const int SLOTS = 8;						// Packets decoded ahead of playback, a power of two
+	static const int PREROLLPACKETS = 3;			// Skipped packets decoded again before decoding resumes
+
+	struct CPacket
+	{
+		int m_nData;								// 0 for a lost packet
+		unsigned char m_data[MAXPACKETBYTES];
+	};
+
+	pthread_mutex_t m_Mutex;
+	pthread_cond_t m_Cond;
+	pthread_t m_Thread;
+	bool m_bRunning;
+	bool m_bNotified;								// New packets since the worker last asked, under m_Mutex
+	std::atomic<bool> m_bStopping;
+	std::atomic<bool> m_bSleeping;					// Worker waits for a slot or a packet
+	CDecoderOpus m_Decoder;							// Owned by the worker while it runs
+	short* m_pSlots;								// SLOTS packets of audio, decoded in place
+	int m_slotLength[SLOTS];						// Samples in each slot, set before it is published
+	std::atomic<unsigned> m_iWrite;					// Free-running slot counts, only stored by the worker
+	std::atomic<unsigned> m_iRead;					// and by the reader
+	int m_iReadOffset;								// Samples already read from slot m_iRead
+	std::atomic<bool> m_bEnded;						// Last sample of the stream is in a slot
+	std::atomic<int> m_gain;
+	std::atomic<bool> m_bTracking;
+	DecodeAheadSource m_pSource;
+	void* m_pSourceContext;
+	DecodeAheadCallback m_pCallback;
+	void* m_pContext;
+	int m_sampleRate;
+	int m_frameSize;
+	int m_framesInPacket;
+	int m_samplesInPacket;
+	CPacket m_packet;								// Packet being decoded
+	CPacket m_preroll[PREROLLPACKETS];				// Last packets skipped while tracking
+	int m_iPreroll;									// Where the next one goes
+	int m_nPreroll;
+
+	static void* WorkerProc(void* pParam);
+	void Work();
+	int Decode(CPacket* pPacket, short* pSlot, bool bTracking);
+	void Remember(CPacket* pPacket);
+	void Preroll(short* pScratch);
+
+public:
+	CDecodeAhead();
+	~CDecodeAhead();
+	bool Start(unsigned char* pHeader, int nHeader, DecodeAheadSource pSource, void* pSourceContext, DecodeAheadCallback pCallback = 0, void* pContext = 0);
+	void Stop();
+	void SetGain(int iAmplifierGain);
+	void SetTracking(bool bTracking);
+	void Notify();
+	int Read(short* pOutput, int nOutput);
+	int GetSampleRate();
+	int GetFrameSize();
+	int GetFramesInPacket();
+
+};
+
+#endif
@@ -1,14 +1,16 @@
-#include "common.h"
 #include "decoderopus.h"
+#include "common.h"
 #include "amplifier.h"
 
-CDecoderOpus::CDecoderOpus() :
+CDecoderOpus::CDecoderOpus(bool bShared) :
+	m_Owner(bShared),
 	m_pOpus (0),
   m_sampleRate(0),
   m_framesInPacket(0),
   m_samplesInFrame(0),
   m_frameSize(0)
 {
+	memset(m_stats, 0, sizeof(m_stats));
 	pthread_mutex_init(&m_Mutex, 0);
 }
 
@@ -17,7 +19,7 @@ CDecoderOpus::~CDecoderOpus(){
 }
 
 bool CDecoderOpus::Start(unsigned char* pHeader, int nData){
-	CGuard Guard(m_Mutex);
+	COwnerGuard Guard(m_Mutex, m_Owner);
   
   if (!m_pOpus && pHeader){
 		int headerLen = nData;
@@ -48,7 +50,7 @@ bool CDecoderOpus::Start(unsigned char* pHeader, int nData){
 }
 
 void CDecoderOpus::Stop(){
-	CGuard Guard(m_Mutex);
+	COwnerGuard Guard(m_Mutex, m_Owner);
 	if (m_pOpus){
     opus_decoder_destroy(m_pOpus);
     m_pOpus = 0;
@@ -60,42 +62,72 @@ void CDecoderOpus::Stop(){
 }
 
 void CDecoderOpus::SetGain(int iAmplifierGain) {
-  CGuard Guard(m_Mutex);
+  COwnerGuard Guard(m_Mutex, m_Owner);
   if (m_pOpus){
     opus_decoder_ctl(m_pOpus, OPUS_SET_GAIN(iAmplifierGain*256));
   }
 }
 
 int CDecoderOpus::Decode(unsigned char* pData, int nData, short* pOutput){
+	COwnerGuard Guard(m_Mutex, m_Owner);
+	return DecodeInt(pData, nData, pOutput, m_samplesInFrame * m_framesInPacket);
+}
+
+// Decodes straight into pOutput, which has room for nOutput samples, so the audio is written once,
+// where the caller wants it. Returns the number of samples written, or -1 without taking the packet
+// if they wouldn't fit. Room for a whole packet is always enough.
+int CDecoderOpus::DecodeInto(unsigned char* pData, int nData, short* pOutput, int nOutput){
+	COwnerGuard Guard(m_Mutex, m_Owner);
+	if (!pOutput){
+		return 0;
+	}
+	if (NextDecodedSamples() > nOutput){
+		return -1;
+	}
+	// Concealment and FEC make as much audio as they are given room for, so never more than a packet
+	return DecodeInt(pData, nData, pOutput, min(nOutput, m_samplesInFrame * m_framesInPacket));
+}
+
+// Number of samples the next decode call produces: the buffered packet, or a whole packet of concealment
+int CDecoderOpus::NextDecodedSamples(){
+	if (m_prevBufferSize <= 0){
+		return 0;
+	}
+	if (m_prevLost){
+		return m_samplesInFrame * m_framesInPacket;
+	}
+	return PacketSamples(m_prevBuffer, m_prevBufferSize);
+}
+
+int CDecoderOpus::DecodeInt(unsigned char* pData, int nData, short* pOutput, int nCapacity){
   int result = 0;
-	CGuard Guard(m_Mutex);
 	if (m_pOpus){
 
 		int outputLen = 0;
     bool lost = pData == NULL;
+    if (!lost && !Inspect(pData, nData)){
+      // Don't spend decoder time on garbage, conceal it like a lost packet
+      ++m_stats[OPUS_STAT_REJECTED];
+      lost = true;
+    }
     
     if (m_prevBufferSize > 0) {
       if (m_prevLost){
         //cout << "Previous packet lost\n";
         if (!lost) {
-          outputLen = opus_decode(m_pOpus, pData, nData, pOutput, m_samplesInFrame * m_framesInPacket, 1);
+          outputLen = opus_decode(m_pOpus, pData, nData, pOutput, nCapacity, 1);
           //cout << "This packet has data, use FEC: " << outputLen << "\n";
         } else {
-          outputLen = opus_decode(m_pOpus, NULL, 0, pOutput, m_samplesInFrame * m_framesInPacket, 0);
+          outputLen = opus_decode(m_pOpus, NULL, 0, pOutput, nCapacity, 0);
           //cout << "This packet is lost too, use PLC: " << outputLen << "\n";
         }
       } else {
-        outputLen = opus_decode(m_pOpus, m_prevBuffer, m_prevBufferSize, pOutput, m_samplesInFrame * m_framesInPacket, 0);
+        outputLen = opus_decode(m_pOpus, m_prevBuffer, m_prevBufferSize, pOutput, nCapacity, 0);
         //cout << "Decode previous packet: " << outputLen << "\n";
       }
     }
     
-    m_prevLost = lost;
-    if (!lost && nData < MAXPACKETSIZE) {
-      // Save current packet data
-      memcpy(m_prevBuffer, pData, nData);
-      m_prevBufferSize = nData;
-    }
+    Keep(pData, nData, lost);
     
 		if (outputLen > 0){
       result = outputLen;
@@ -108,18 +140,115 @@ int CDecoderOpus::Decode(unsigned char* pData, int nData, short* pOutput){
 
 }
 
+// Holds the packet back until the next call, which decodes it or uses it for FEC
+void CDecoderOpus::Keep(unsigned char* pData, int nData, bool lost){
+  m_prevLost = lost;
+  if (!lost && nData < MAXPACKETSIZE) {
+    // Save current packet data
+    memcpy(m_prevBuffer, pData, nData);
+    m_prevBufferSize = nData;
+  }
+}
+
+// Takes a packet like Decode does, without running the decoder. Returns the number of samples
+// Decode would have produced. The decoder state goes stale, so Reset before decoding again.
+int CDecoderOpus::Skip(unsigned char* pData, int nData){
+  COwnerGuard Guard(m_Mutex, m_Owner);
+  if (!m_pOpus){
+    return 0;
+  }
+  bool lost = pData == NULL;
+  if (!lost && !Inspect(pData, nData)){
+    ++m_stats[OPUS_STAT_REJECTED];
+    lost = true;
+  }
+  int samples = NextDecodedSamples();
+  Keep(pData, nData, lost);
+  return samples;
+}
+
+// Forgets all decoder history, as if no packet had been decoded yet. Gain and stats are kept.
+void CDecoderOpus::Reset(){
+  COwnerGuard Guard(m_Mutex, m_Owner);
+  if (m_pOpus){
+    opus_decoder_ctl(m_pOpus, OPUS_RESET_STATE);
+  }
+  m_prevBufferSize = 0;
+  m_prevLost = false;
+}
+
+// Checks the TOC of a packet without decoding it. Returns the number of samples the packet
+// decodes to, or 0 if it is malformed or doesn't fit into a packet of this stream.
+int CDecoderOpus::Inspect(unsigned char* pData, int nData){
+  if (nData <= 0 || nData >= (int) MAXPACKETSIZE){
+    return 0;
+  }
+  int frames = opus_packet_get_nb_frames(pData, nData);
+  if (frames <= 0){
+    return 0;
+  }
+  int samples = frames * opus_packet_get_samples_per_frame(pData, m_sampleRate);
+  if (samples > m_samplesInFrame * m_framesInPacket){
+    return 0;
+  }
+  
+  int bandwidth = opus_packet_get_bandwidth(pData);
+  if (bandwidth >= OPUS_BANDWIDTH_NARROWBAND && bandwidth <= OPUS_BANDWIDTH_FULLBAND){
+    ++m_stats[OPUS_STAT_NARROWBAND + bandwidth - OPUS_BANDWIDTH_NARROWBAND];
+  }
+  int config = pData[0] >> 3;
+  if (config < 12){
+    ++m_stats[OPUS_STAT_SILK];
+  }
+  else if (config < 16){
+    ++m_stats[OPUS_STAT_HYBRID];
+  }
+  else{
+    ++m_stats[OPUS_STAT_CELT];
+  }
+  return samples;
+}
+
+int CDecoderOpus::GetPacketSamples(unsigned char* pData, int nData){
+  COwnerGuard Guard(m_Mutex, m_Owner);
+  if (!m_pOpus || !pData){
+    return 0;
+  }
+  return PacketSamples(pData, nData);
+}
+
+int CDecoderOpus::PacketSamples(unsigned char* pData, int nData){
+  if (nData <= 0 || nData >= (int) MAXPACKETSIZE){
+    return 0;
+  }
+  int frames = opus_packet_get_nb_frames(pData, nData);
+  if (frames <= 0){
+    return 0;
+  }
+  return frames * opus_packet_get_samples_per_frame(pData, m_sampleRate);
+}
+
+int CDecoderOpus::GetStats(int* pStats, int nStats){
+  COwnerGuard Guard(m_Mutex, m_Owner);
+  int count = min(nStats, (int) OPUS_STAT_COUNT);
+  for (int i = 0; i < count; ++i){
+    pStats[i] = m_stats[i];
+  }
+  return count;
+}
+
 int CDecoderOpus::GetSampleRate(){
-	CGuard Guard(m_Mutex);
+	COwnerGuard Guard(m_Mutex, m_Owner);
 	return m_sampleRate;
 }
 
 int CDecoderOpus::GetFramesInPacket(){
-	CGuard Guard(m_Mutex);
+	COwnerGuard Guard(m_Mutex, m_Owner);
 	return m_framesInPacket;
 }
 
 int CDecoderOpus::GetFrameSize(){
-	CGuard guard(m_Mutex);
+	COwnerGuard Guard(m_Mutex, m_Owner);
 	return m_frameSize;
 }
 
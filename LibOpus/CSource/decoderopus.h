@@ -6,6 +6,7 @@ extern "C"{
 }
 
 #include "guard.h"
+#include "libopus.h"
 #define SAMPLE_RATE 48000
 
 class CDecoderOpus{
@@ -13,6 +14,7 @@ class CDecoderOpus{
 	static const unsigned MAXPACKETSIZE = 5760;	// 120 ms at 48000 Hz
   
 	pthread_mutex_t m_Mutex;
+	COwner m_Owner;
 	OpusDecoder* m_pOpus;
 	int m_sampleRate;								// Number of sample in second
 	int m_framesInPacket;							// Number of frames in each packet
@@ -23,14 +25,26 @@ class CDecoderOpus{
   unsigned char m_prevBuffer[MAXPACKETSIZE]; // More than we need
   int m_prevBufferSize = 0;
   bool m_prevLost = false;
+  int m_stats[OPUS_STAT_COUNT];					// Per-stream packet histogram, see libopus.h
+
+  int Inspect(unsigned char* pData, int nData);
+  int PacketSamples(unsigned char* pData, int nData);
+  int NextDecodedSamples();
+  int DecodeInt(unsigned char* pData, int nData, short* pOutput, int nCapacity);
+  void Keep(unsigned char* pData, int nData, bool lost);
 
 public:
-	CDecoderOpus();
+	CDecoderOpus(bool bShared = true);
 	~CDecoderOpus();
 	bool Start(unsigned char* pHeader, int nData);
 	void Stop();
   void SetGain(int iAmplifierGain);
 	int Decode(unsigned char* pData, int nData, short* output);
+	int DecodeInto(unsigned char* pData, int nData, short* pOutput, int nOutput);
+	int Skip(unsigned char* pData, int nData);
+	void Reset();
+	int GetPacketSamples(unsigned char* pData, int nData);
+	int GetStats(int* pStats, int nStats);
 	int GetSampleRate();
   int GetFramesInPacket();
   int GetFrameSize();
@@ -1,207 +1,257 @@
-#include "encoderopus.h"
-#include "common.h"
-#include "amplifier.h"
-
-CEncoderOpus::CEncoderOpus() :
-  m_pOpus (0),
-  m_pPacketizer(0),
-  m_framesInPacket(0),
-  m_samplesInFrame(0),
-  m_frameCount(0),
-  m_sampleCount(0),
-  m_packets(0),
-  m_packet(0),
-  m_packetLen(0),
-  m_iAmplifierCoef(EQUALITY_COEF)
-{
-	pthread_mutex_init(&m_Mutex, 0);
-}
-
-CEncoderOpus::~CEncoderOpus()
-{
-	pthread_mutex_destroy(&m_Mutex);
-}
-
-bool ValidSampleRate(int sampleRate){
-  return (sampleRate == 8000 || sampleRate == 12000 || sampleRate == 16000 || sampleRate == 24000 || sampleRate == 48000);
-}
-bool ValidFrameSize(int frameSize){
-  return(frameSize == 5 || frameSize == 10 || frameSize == 20 || frameSize == 40 || frameSize == 60);
-}
-
-bool CEncoderOpus::Start(int sampleRate, int framesInPacket, int frameSize, int iBitrate, int iAmplifierGain){
-	m_iAmplifierCoef = transformAmplifierGainToCoef(iAmplifierGain);
-  
-  if (!m_pOpus && ValidSampleRate(sampleRate) && ValidFrameSize(frameSize)){
-    
-		int error = 0;
-		m_pOpus = opus_encoder_create(sampleRate, 1, OPUS_APPLICATION_VOIP, &error);
-		if (m_pOpus){
-			m_framesInPacket = framesInPacket;
-			m_samplesInFrame = sampleRate * frameSize / 1000;
-			m_frameCount = 0;
-			m_sampleCount = 0;
-			int bitrate = iBitrate > 0 ? iBitrate : DEFBITRATE;
-			int complexity = DEFCOMPLEXITY;
-			int lossRate = DEFLOSSRATE;
-			m_packetLen = (1 + MAXFRAMEBYTES) * m_framesInPacket;
-			m_packet = new unsigned char[m_packetLen];
-      
-			if (m_framesInPacket > 1){
-				m_pPacketizer = opus_repacketizer_create();
-				m_packets = new unsigned char*[m_framesInPacket];
-				for (int i = 0; i < m_framesInPacket; ++i)
-					m_packets[i] = new unsigned char[MAXFRAMEBYTES];
-			}
-      
-			opus_encoder_ctl(m_pOpus, OPUS_SET_BANDWIDTH(OPUS_AUTO));
-			opus_encoder_ctl(m_pOpus, OPUS_SET_VBR(1));
-      opus_encoder_ctl(m_pOpus, OPUS_SET_INBAND_FEC(1));
-			if (bitrate > 0){
-				opus_encoder_ctl(m_pOpus, OPUS_SET_BITRATE(bitrate));
-      }
-			if (complexity >= 0){
-				opus_encoder_ctl(m_pOpus, OPUS_SET_COMPLEXITY(complexity));
-      }
-			if (lossRate >= 0){
-				opus_encoder_ctl(m_pOpus, OPUS_SET_PACKET_LOSS_PERC(lossRate));
-      }
-			return true;
-		}
-	}
-	return false;
-
-}
-
-
-int CEncoderOpus::Stop(unsigned char* output){
-	CGuard Guard(m_Mutex);
-  int result = 0;
-	if (m_pOpus){
-		if (m_sampleCount || (m_pPacketizer && m_frameCount)){
-			int outputLen = 0;
-			if (m_sampleCount){
-				memset(m_input + m_sampleCount, 0, (m_samplesInFrame - m_sampleCount) * 2);
-				if (m_pPacketizer){
-					// Negative result designates an error, result of 1 designates DTX (don't transmit)
-					int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, m_packets[m_frameCount], MAXFRAMEBYTES);
-					if (packetLen > 1)
-						opus_repacketizer_cat(m_pPacketizer, m_packets[m_frameCount], packetLen);
-				}
-        else{
-					// Negative result designates an error, result of 1 designates DTX (don't transmit)
-					int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, m_packet, m_packetLen);
-					if (packetLen > 1)
-						outputLen = packetLen;
-				}
-			}
-			if (m_pPacketizer){
-				int frameCount = opus_repacketizer_get_nb_frames(m_pPacketizer);
-				if (frameCount > 0){
-					int packetLen = opus_repacketizer_out(m_pPacketizer, m_packet, m_packetLen);
-					if (packetLen > 0)
-						outputLen = packetLen;
-				}
-			}
-			if (outputLen > 0){
-        memcpy(output, m_packet, outputLen);
-        result = outputLen;
-			}
-		}
-		opus_encoder_destroy(m_pOpus);
-		m_pOpus = 0;
-		if (m_pPacketizer)
-			opus_repacketizer_destroy(m_pPacketizer);
-		m_pPacketizer = 0;
-		if (m_packet){
-			delete[] m_packet;
-    }
-		m_packet = 0;
-		m_packetLen = 0;
-		if (m_packets){
-			for (int i = 0; i < m_framesInPacket; ++i)
-				delete[] m_packets[i];
-			delete[] m_packets;
-			m_packets = 0;
-		}
-		m_framesInPacket = 0;
-		m_samplesInFrame = 0;
-		m_frameCount = 0;
-		m_sampleCount = 0;
-	}
-	return result;
-
-}
-
-int CEncoderOpus::Encode(short* pData, int nData, unsigned char* output, int amplifierGain){
-  m_iAmplifierCoef = transformAmplifierGainToCoef(amplifierGain);
-  CGuard Guard(m_Mutex);
-	int result = 0;
-	if (m_pOpus && pData){
-		
-		if (nData > 0){
-			
-      short* p = pData;
-      if (nData > m_samplesInFrame * m_framesInPacket){
-        nData = m_samplesInFrame * m_framesInPacket;
-      }
-      int amplify = transformAmplifierGainToCoef(amplifierGain);
-      
-      while (nData){
-        int next = m_samplesInFrame - m_sampleCount;
-        if (next > nData){
-          next = nData;
-        }
-        
-        doAmplification(pData + m_sampleCount, p, next, amplify);
-        p += next;
-        m_sampleCount += next;
-        nData -= next;
-        
-        if (m_sampleCount == m_samplesInFrame){
-          int outputLen = 0;
-          m_sampleCount = 0;
-          if (m_pPacketizer){
-            // Negative result designates an error, result of 1 designates DTX (don't transmit)
-            int packetLen = opus_encode(m_pOpus, pData, m_samplesInFrame, m_packets[m_frameCount], MAXFRAMEBYTES);
-            if (packetLen > 1){
-              opus_repacketizer_cat(m_pPacketizer, m_packets[m_frameCount], packetLen);
-            }
-            ++m_frameCount;
-            if (m_frameCount >= m_framesInPacket){
-              int frameCount = opus_repacketizer_get_nb_frames(m_pPacketizer);
-              if (frameCount > 0){
-                packetLen = opus_repacketizer_out(m_pPacketizer, m_packet, m_packetLen);
-                if (packetLen > 0){
-                  outputLen = packetLen;
-                }
-              }
-              opus_repacketizer_init(m_pPacketizer);
-              m_frameCount = 0;
-            }
-          }
-          else{
-            // Negative result designates an error, result of 1 designates DTX (don't transmit)
-            int packetLen = opus_encode(m_pOpus, pData, m_samplesInFrame, m_packet, m_packetLen);
-            if (packetLen > 1){
-              outputLen = packetLen;
-            }
-          }
-          if (outputLen > 0){
-            memcpy(output, m_packet, outputLen);
-            result = outputLen;
-          }
-        }
-      }
-    }
-  }
-  return result;
-}
-
-int CEncoderOpus::GetHeader(int iSampleRate, int iFramesInPacket, int iFrameSize, unsigned char* pOutput){
-  pOutput[0] = iSampleRate & 0xff;
-  pOutput[1] = (iSampleRate >> 8) & 0xff;
-  pOutput[2] = iFramesInPacket & 0xff;
-  pOutput[3] = iFrameSize & 0xff;
-	return 4;
-}
+#include "encoderopus.h"
+#include "common.h"
+#include "amplifier.h"
+
+CEncoderOpus::CEncoderOpus(bool bShared) :
+  m_Owner(bShared),
+  m_pOpus (0),
+  m_iAmplifierCoef(EQUALITY_COEF),
+  m_pPacketizer(0),
+  m_framesInPacket(0),
+  m_samplesInFrame(0),
+  m_frameCount(0),
+  m_sampleCount(0),
+  m_pArena(0),
+  m_nArena(0),
+  m_pOwnArena(0),
+  m_nOwnArena(0),
+  m_frames(0),
+  m_packetLen(0),
+  m_input(0)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+}
+
+CEncoderOpus::~CEncoderOpus()
+{
+	if (m_pOwnArena){
+		delete[] m_pOwnArena;
+	}
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+bool ValidSampleRate(int sampleRate){
+  return (sampleRate == 8000 || sampleRate == 12000 || sampleRate == 16000 || sampleRate == 24000 || sampleRate == 48000);
+}
+bool ValidFrameSize(int frameSize){
+  return(frameSize == 5 || frameSize == 10 || frameSize == 20 || frameSize == 40 || frameSize == 60);
+}
+
+int CEncoderOpus::Align(int nSize){
+	return (nSize + ARENAALIGN - 1) & ~(ARENAALIGN - 1);
+}
+
+// Arena layout: Opus state | repacketizer | frame slots | input frame
+int CEncoderOpus::GetArenaSize(int sampleRate, int framesInPacket, int frameSize){
+	if (!ValidSampleRate(sampleRate) || !ValidFrameSize(frameSize) || framesInPacket <= 0){
+		return 0;
+	}
+	int size = Align(opus_encoder_get_size(1));
+	if (framesInPacket > 1){
+		size += Align(opus_repacketizer_get_size());
+		size += Align(MAXFRAMEBYTES * framesInPacket);
+	}
+	size += Align(sampleRate * frameSize / 1000 * sizeof(short));
+	return size;
+}
+
+bool CEncoderOpus::Start(int sampleRate, int framesInPacket, int frameSize, int iBitrate, int iAmplifierGain, unsigned char* pArena, int nArena){
+	m_iAmplifierCoef = transformAmplifierGainToCoef(iAmplifierGain);
+  
+  int arenaSize = GetArenaSize(sampleRate, framesInPacket, frameSize);
+  if (!m_pOpus && arenaSize > 0){
+    
+    if (pArena){
+      // Caller's memory has to be big enough and aligned the same way as ours
+      if (nArena < arenaSize || ((size_t) pArena & (ARENAALIGN - 1))){
+        return false;
+      }
+      m_pArena = pArena;
+      m_nArena = nArena;
+    }
+    else{
+      // Kept until the encoder is destroyed, so a restart with the same layout doesn't allocate
+      if (m_nOwnArena < arenaSize){
+        if (m_pOwnArena){
+          delete[] m_pOwnArena;
+        }
+        m_pOwnArena = new unsigned char[arenaSize + ARENAALIGN];
+        m_nOwnArena = arenaSize;
+      }
+      m_pArena = m_pOwnArena + (ARENAALIGN - ((size_t) m_pOwnArena & (ARENAALIGN - 1))) % ARENAALIGN;
+      m_nArena = m_nOwnArena;
+    }
+    
+		unsigned char* p = m_pArena;
+		OpusEncoder* pOpus = (OpusEncoder*) p;
+		p += Align(opus_encoder_get_size(1));
+		if (opus_encoder_init(pOpus, sampleRate, 1, OPUS_APPLICATION_VOIP) == OPUS_OK){
+			m_pOpus = pOpus;
+			m_framesInPacket = framesInPacket;
+			m_samplesInFrame = sampleRate * frameSize / 1000;
+			m_frameCount = 0;
+			m_sampleCount = 0;
+			int bitrate = iBitrate > 0 ? iBitrate : DEFBITRATE;
+			int complexity = DEFCOMPLEXITY;
+			int lossRate = DEFLOSSRATE;
+      
+			if (m_framesInPacket > 1){
+				m_pPacketizer = opus_repacketizer_init((OpusRepacketizer*) p);
+				p += Align(opus_repacketizer_get_size());
+				m_frames = p;
+				p += Align(MAXFRAMEBYTES * m_framesInPacket);
+			}
+			m_packetLen = GetMaxPacketSize(m_framesInPacket);
+			m_input = (short*) p;
+      
+			opus_encoder_ctl(m_pOpus, OPUS_SET_BANDWIDTH(OPUS_AUTO));
+			opus_encoder_ctl(m_pOpus, OPUS_SET_VBR(1));
+      opus_encoder_ctl(m_pOpus, OPUS_SET_INBAND_FEC(1));
+			if (bitrate > 0){
+				opus_encoder_ctl(m_pOpus, OPUS_SET_BITRATE(bitrate));
+      }
+			if (complexity >= 0){
+				opus_encoder_ctl(m_pOpus, OPUS_SET_COMPLEXITY(complexity));
+      }
+			if (lossRate >= 0){
+				opus_encoder_ctl(m_pOpus, OPUS_SET_PACKET_LOSS_PERC(lossRate));
+      }
+			return true;
+		}
+		// Nothing was set up in the arena, don't leave it looking like a started encoder
+		m_pArena = 0;
+		m_nArena = 0;
+	}
+	return false;
+
+}
+
+
+int CEncoderOpus::Stop(unsigned char* output){
+	COwnerGuard Guard(m_Mutex, m_Owner);
+  int result = 0;
+	if (m_pOpus){
+		if (m_sampleCount || (m_pPacketizer && m_frameCount)){
+			int outputLen = 0;
+			if (m_sampleCount){
+				memset(m_input + m_sampleCount, 0, (m_samplesInFrame - m_sampleCount) * 2);
+				if (m_pPacketizer){
+					// Negative result designates an error, result of 1 designates DTX (don't transmit)
+					unsigned char* frame = m_frames + m_frameCount * MAXFRAMEBYTES;
+					int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, frame, MAXFRAMEBYTES);
+					if (packetLen > 1)
+						opus_repacketizer_cat(m_pPacketizer, frame, packetLen);
+				}
+        else{
+					// Negative result designates an error, result of 1 designates DTX (don't transmit)
+					int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, output, m_packetLen);
+					if (packetLen > 1)
+						outputLen = packetLen;
+				}
+			}
+			if (m_pPacketizer){
+				int frameCount = opus_repacketizer_get_nb_frames(m_pPacketizer);
+				if (frameCount > 0){
+					int packetLen = opus_repacketizer_out(m_pPacketizer, output, m_packetLen);
+					if (packetLen > 0)
+						outputLen = packetLen;
+				}
+			}
+			if (outputLen > 0){
+        result = outputLen;
+			}
+		}
+		// Opus state and repacketizer live in the arena, there is nothing to destroy
+		m_pOpus = 0;
+		m_pPacketizer = 0;
+		m_frames = 0;
+		m_packetLen = 0;
+		m_input = 0;
+		m_pArena = 0;
+		m_nArena = 0;
+		m_framesInPacket = 0;
+		m_samplesInFrame = 0;
+		m_frameCount = 0;
+		m_sampleCount = 0;
+	}
+	return result;
+
+}
+
+int CEncoderOpus::Encode(short* pData, int nData, unsigned char* output, int amplifierGain){
+  m_iAmplifierCoef = transformAmplifierGainToCoef(amplifierGain);
+  COwnerGuard Guard(m_Mutex, m_Owner);
+	int result = 0;
+	if (m_pOpus && pData){
+		
+		if (nData > 0){
+			
+      short* p = pData;
+      if (nData > m_samplesInFrame * m_framesInPacket){
+        nData = m_samplesInFrame * m_framesInPacket;
+      }
+      int amplify = transformAmplifierGainToCoef(amplifierGain);
+      
+      while (nData){
+        int next = m_samplesInFrame - m_sampleCount;
+        if (next > nData){
+          next = nData;
+        }
+        
+        doAmplification(m_input + m_sampleCount, p, next, amplify);
+        p += next;
+        m_sampleCount += next;
+        nData -= next;
+        
+        if (m_sampleCount == m_samplesInFrame){
+          int outputLen = 0;
+          m_sampleCount = 0;
+          if (m_pPacketizer){
+            // Negative result designates an error, result of 1 designates DTX (don't transmit)
+            unsigned char* frame = m_frames + m_frameCount * MAXFRAMEBYTES;
+            int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, frame, MAXFRAMEBYTES);
+            if (packetLen > 1){
+              opus_repacketizer_cat(m_pPacketizer, frame, packetLen);
+            }
+            ++m_frameCount;
+            if (m_frameCount >= m_framesInPacket){
+              int frameCount = opus_repacketizer_get_nb_frames(m_pPacketizer);
+              if (frameCount > 0){
+                packetLen = opus_repacketizer_out(m_pPacketizer, output, m_packetLen);
+                if (packetLen > 0){
+                  outputLen = packetLen;
+                }
+              }
+              opus_repacketizer_init(m_pPacketizer);
+              m_frameCount = 0;
+            }
+          }
+          else{
+            // Negative result designates an error, result of 1 designates DTX (don't transmit)
+            int packetLen = opus_encode(m_pOpus, m_input, m_samplesInFrame, output, m_packetLen);
+            if (packetLen > 1){
+              outputLen = packetLen;
+            }
+          }
+          if (outputLen > 0){
+            result = outputLen;
+          }
+        }
+      }
+    }
+  }
+  return result;
+}
+
+// Packets are encoded straight into the caller's output, which needs this much room
+int CEncoderOpus::GetMaxPacketSize(int framesInPacket){
+	return (1 + MAXFRAMEBYTES) * framesInPacket;
+}
+
+int CEncoderOpus::GetHeader(int iSampleRate, int iFramesInPacket, int iFrameSize, unsigned char* pOutput){
+  pOutput[0] = iSampleRate & 0xff;
+  pOutput[1] = (iSampleRate >> 8) & 0xff;
+  pOutput[2] = iFramesInPacket & 0xff;
+  pOutput[3] = iFrameSize & 0xff;
+	return 4;
+}
@@ -10,13 +10,14 @@ extern "C"
 class CEncoderOpus
 {
   
-  static const unsigned MAXPACKETSIZE = 2880;	// 60 ms at 48000 Hz
 	static const unsigned MAXFRAMEBYTES = 1276;	// Recommended min size
 	static const int DEFBITRATE = 0;				// [1000, ∞]
 	static const int DEFCOMPLEXITY = 10;			// [1, 10]
 	static const int DEFLOSSRATE = 20;				// [0, 100]
+	static const unsigned ARENAALIGN = 64;			// Cache line
   
 	pthread_mutex_t m_Mutex;
+	COwner m_Owner;
 	OpusEncoder* m_pOpus;
   int m_iAmplifierCoef;
 	OpusRepacketizer* m_pPacketizer;
@@ -24,19 +25,25 @@ class CEncoderOpus
 	int m_samplesInFrame;							// Number of audio samples in each frame
 	int m_frameCount;								// Number of compressed frames that are already in the packet
 	int m_sampleCount;								// Number of buffered samples
-	unsigned char** m_packets;
-	unsigned char* m_packet;
-	int m_packetLen;
-	short m_input[MAXPACKETSIZE];
+	unsigned char* m_pArena;						// All working memory, carved up in Start()
+	int m_nArena;
+	unsigned char* m_pOwnArena;						// Allocated by us when the caller didn't supply one
+	int m_nOwnArena;
+	unsigned char* m_frames;						// m_framesInPacket slots of MAXFRAMEBYTES
+	int m_packetLen;								// Room the output of Encode and Stop must have
+	short* m_input;									// Samples of the frame being filled
 
+	static int Align(int nSize);
   
 public:
-	CEncoderOpus();
+	CEncoderOpus(bool bShared = true);
 	~CEncoderOpus();
-	bool Start(int iSampleRate, int iFramesInPacket, int frameSize, int iBitrate, int iAmplifierGain);
+	bool Start(int iSampleRate, int iFramesInPacket, int frameSize, int iBitrate, int iAmplifierGain, unsigned char* pArena = 0, int nArena = 0);
 	int Stop(unsigned char* output);
 	int Encode(short* pData, int nData, unsigned char* output, int iAmplifierGain);
 	static int GetHeader(int iSampleRate, int iFramesInPacket, int iFrameSize, unsigned char* output);
+	static int GetArenaSize(int iSampleRate, int iFramesInPacket, int iFrameSize);
+	static int GetMaxPacketSize(int iFramesInPacket);
 
 };
 
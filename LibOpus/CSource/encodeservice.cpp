@@ -0,0 +1,448 @@
+#include "encodeservice.h"
+#include "common.h"
+#include <unistd.h>
+
+// The service never runs one stream on two workers at once, so the encoder needs no lock
+CEncodeStream::CEncodeStream() :
+	m_Encoder(false),
+	m_iId(0),
+	m_iWorker(0),
+	m_samplesInPacket(0),
+	m_bScheduled(false),
+	m_bClosing(false),
+	m_bFinished(false),
+	m_nRefs(0),
+	m_nPending(0),
+	m_pHead(0),
+	m_pTail(0),
+	m_pFree(0),
+	m_pPrev(0),
+	m_pNext(0),
+	m_pPrevOpen(0),
+	m_pNextOpen(0)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+}
+
+CEncodeStream::~CEncodeStream()
+{
+	CEncodeJob* lists[2] = { m_pHead, m_pFree };
+	for (int i = 0; i < 2; ++i){
+		CEncodeJob* pJob = lists[i];
+		while (pJob){
+			CEncodeJob* pNext = pJob->m_pNext;
+			delete[] pJob->m_pData;
+			delete pJob;
+			pJob = pNext;
+		}
+	}
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+CEncodeService::CEncodeService() :
+	m_pWorkers(0),
+	m_nWorkers(0),
+	m_nQueued(0),
+	m_bStopping(false),
+	m_pCallback(0),
+	m_pContext(0),
+	m_pOpen(0)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+	pthread_cond_init(&m_Cond, 0);
+}
+
+CEncodeService::~CEncodeService()
+{
+	Stop();
+	pthread_cond_destroy(&m_Cond);
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+bool CEncodeService::Start(int iThreads, EncodeServiceCallback pCallback, void* pContext){
+	if (m_pWorkers || !pCallback){
+		return false;
+	}
+	if (iThreads <= 0){
+		iThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (iThreads < 1){
+		iThreads = 1;
+	}
+	if (iThreads > MAXWORKERS){
+		iThreads = MAXWORKERS;
+	}
+
+	m_pCallback = pCallback;
+	m_pContext = pContext;
+	m_bStopping = false;
+	m_nQueued = 0;
+	m_nWorkers = iThreads;
+	m_pWorkers = new CWorker[m_nWorkers];
+	for (int i = 0; i < m_nWorkers; ++i){
+		CWorker* pWorker = &m_pWorkers[i];
+		pWorker->m_pService = this;
+		pWorker->m_iIndex = i;
+		pWorker->m_pHead = 0;
+		pWorker->m_pTail = 0;
+		pthread_mutex_init(&pWorker->m_Mutex, 0);
+	}
+	for (int i = 0; i < m_nWorkers; ++i){
+		if (pthread_create(&m_pWorkers[i].m_Thread, 0, WorkerProc, &m_pWorkers[i]) != 0){
+			// Only the threads that did start have to be joined, the rest of the locks go here
+			for (int j = i; j < m_nWorkers; ++j){
+				pthread_mutex_destroy(&m_pWorkers[j].m_Mutex);
+			}
+			m_nWorkers = i;
+			Stop();
+			return false;
+		}
+	}
+	return true;
+}
+
+void CEncodeService::Stop(){
+	if (!m_pWorkers){
+		return;
+	}
+	{
+		CGuard Guard(m_Mutex);
+		m_bStopping = true;
+	}
+	pthread_cond_broadcast(&m_Cond);
+	for (int i = 0; i < m_nWorkers; ++i){
+		pthread_join(m_pWorkers[i].m_Thread, 0);
+	}
+
+	// Workers have drained every queued job; flush streams the client never closed
+	while (m_pOpen){
+		Finish(m_pOpen, m_pWorkers[0].m_output);
+	}
+
+	for (int i = 0; i < m_nWorkers; ++i){
+		pthread_mutex_destroy(&m_pWorkers[i].m_Mutex);
+	}
+	delete[] m_pWorkers;
+	m_pWorkers = 0;
+	m_nWorkers = 0;
+}
+
+int CEncodeService::Open(int iSampleRate, int iFramesInPacket, int iFrameSize, int iBitrate, int iAmplifierGain){
+	if (!m_pWorkers || iFramesInPacket <= 0 || iFramesInPacket * iFrameSize > 120){
+		return 0;
+	}
+	CEncodeStream* p = new CEncodeStream();
+	if (!p->m_Encoder.Start(iSampleRate, iFramesInPacket, iFrameSize, iBitrate, iAmplifierGain)){
+		delete p;
+		return 0;
+	}
+	p->m_samplesInPacket = iSampleRate * iFrameSize / 1000 * iFramesInPacket;
+	int id = m_Streams.Allocate(p);
+	p->m_iId = id;
+	p->m_iWorker = id % m_nWorkers;
+
+	CGuard Guard(m_Mutex);
+	p->m_pNextOpen = m_pOpen;
+	if (m_pOpen){
+		m_pOpen->m_pPrevOpen = p;
+	}
+	m_pOpen = p;
+	return id;
+}
+
+bool CEncodeService::Encode(int iStream, const short* pData, int nData, int iAmplifierGain){
+	if (!pData || nData <= 0){
+		return false;
+	}
+	CEncodeStream* p = Acquire(iStream);
+	if (!p){
+		return false;
+	}
+	bool bRejected = false;
+	bool bSchedule = false;
+	{
+		CGuard Guard(p->m_Mutex);
+		bRejected = p->m_bClosing || nData > p->m_samplesInPacket || p->m_nPending >= CEncodeStream::MAXPENDINGJOBS;
+		if (!bRejected){
+			CEncodeJob* pJob = AllocateJob(p);
+			pJob->m_nData = nData;
+			pJob->m_iAmplifierGain = iAmplifierGain;
+			memcpy(pJob->m_pData, pData, pJob->m_nData * sizeof(short));
+			if (p->m_pTail){
+				p->m_pTail->m_pNext = pJob;
+			}
+			else{
+				p->m_pHead = pJob;
+			}
+			p->m_pTail = pJob;
+			++p->m_nPending;
+			if (!p->m_bScheduled){
+				p->m_bScheduled = true;
+				bSchedule = true;
+			}
+		}
+	}
+	// Once queued the stream belongs to the workers, so it is handed over outside of its lock
+	if (bSchedule){
+		Schedule(p, p->m_iWorker);
+	}
+	Release(p);
+	return !bRejected;
+}
+
+bool CEncodeService::Close(int iStream){
+	CEncodeStream* p = Acquire(iStream);
+	if (!p){
+		return false;
+	}
+	bool bRejected = false;
+	bool bSchedule = false;
+	{
+		CGuard Guard(p->m_Mutex);
+		bRejected = p->m_bClosing;
+		if (!bRejected){
+			p->m_bClosing = true;
+			CEncodeJob* pJob = AllocateJob(p);
+			pJob->m_bClose = true;
+			if (p->m_pTail){
+				p->m_pTail->m_pNext = pJob;
+			}
+			else{
+				p->m_pHead = pJob;
+			}
+			p->m_pTail = pJob;
+			++p->m_nPending;
+			if (!p->m_bScheduled){
+				p->m_bScheduled = true;
+				bSchedule = true;
+			}
+		}
+	}
+	if (bSchedule){
+		Schedule(p, p->m_iWorker);
+	}
+	Release(p);
+	return !bRejected;
+}
+
+int CEncodeService::GetThreadCount(){
+	return m_nWorkers;
+}
+
+void* CEncodeService::WorkerProc(void* pParam){
+	CWorker* pWorker = (CWorker*) pParam;
+	pWorker->m_pService->Work(pWorker);
+	return 0;
+}
+
+void CEncodeService::Work(CWorker* pWorker){
+	for (;;){
+		CEncodeStream* p = Pop(pWorker);
+		if (!p){
+			p = Steal(pWorker);
+		}
+		if (p){
+			Run(p, pWorker);
+			continue;
+		}
+		CGuard Guard(m_Mutex);
+		while (!m_nQueued && !m_bStopping){
+			pthread_cond_wait(&m_Cond, &m_Mutex);
+		}
+		if (!m_nQueued && m_bStopping){
+			break;
+		}
+	}
+}
+
+void CEncodeService::Schedule(CEncodeStream* pStream, int iWorker){
+	CWorker* pWorker = &m_pWorkers[iWorker];
+	{
+		// Counted before it becomes visible, so a thief can't take it off the count first
+		CGuard Guard(m_Mutex);
+		++m_nQueued;
+		CGuard WorkerGuard(pWorker->m_Mutex);
+		pStream->m_iWorker = iWorker;
+		pStream->m_pNext = 0;
+		pStream->m_pPrev = pWorker->m_pTail;
+		if (pWorker->m_pTail){
+			pWorker->m_pTail->m_pNext = pStream;
+		}
+		else{
+			pWorker->m_pHead = pStream;
+		}
+		pWorker->m_pTail = pStream;
+	}
+	// Any idle worker will do, it steals the stream if the owner is busy
+	pthread_cond_signal(&m_Cond);
+}
+
+CEncodeStream* CEncodeService::Pop(CWorker* pWorker){
+	CEncodeStream* p = 0;
+	{
+		CGuard Guard(pWorker->m_Mutex);
+		p = pWorker->m_pHead;
+		if (p){
+			pWorker->m_pHead = p->m_pNext;
+			if (pWorker->m_pHead){
+				pWorker->m_pHead->m_pPrev = 0;
+			}
+			else{
+				pWorker->m_pTail = 0;
+			}
+		}
+	}
+	if (p){
+		CGuard Guard(m_Mutex);
+		--m_nQueued;
+	}
+	return p;
+}
+
+CEncodeStream* CEncodeService::Steal(CWorker* pWorker){
+	for (int i = 1; i < m_nWorkers; ++i){
+		CWorker* pVictim = &m_pWorkers[(pWorker->m_iIndex + i) % m_nWorkers];
+		CEncodeStream* p = 0;
+		{
+			CGuard Guard(pVictim->m_Mutex);
+			p = pVictim->m_pTail;
+			if (p){
+				pVictim->m_pTail = p->m_pPrev;
+				if (pVictim->m_pTail){
+					pVictim->m_pTail->m_pNext = 0;
+				}
+				else{
+					pVictim->m_pHead = 0;
+				}
+			}
+		}
+		if (p){
+			CGuard Guard(m_Mutex);
+			--m_nQueued;
+			return p;
+		}
+	}
+	return 0;
+}
+
+void CEncodeService::Run(CEncodeStream* p, CWorker* pWorker){
+	for (int i = 0; i < MAXBATCH; ++i){
+		CEncodeJob* pJob = 0;
+		{
+			CGuard Guard(p->m_Mutex);
+			pJob = p->m_pHead;
+			if (!pJob){
+				p->m_bScheduled = false;
+				return;
+			}
+			p->m_pHead = pJob->m_pNext;
+			if (!p->m_pHead){
+				p->m_pTail = 0;
+			}
+			--p->m_nPending;
+		}
+
+		if (pJob->m_bClose){
+			// Nothing can be submitted after the close job, so the stream is done
+			pJob->m_pNext = p->m_pFree;
+			p->m_pFree = pJob;
+			Finish(p, pWorker->m_output);
+			return;
+		}
+
+		int len = p->m_Encoder.Encode(pJob->m_pData, pJob->m_nData, pWorker->m_output, pJob->m_iAmplifierGain);
+		if (len > 0){
+			m_pCallback(m_pContext, p->m_iId, pWorker->m_output, len, 0);
+		}
+
+		CGuard Guard(p->m_Mutex);
+		pJob->m_pNext = p->m_pFree;
+		p->m_pFree = pJob;
+	}
+
+	// Batch is used up, let other streams of this worker have their turn
+	bool bSchedule = false;
+	{
+		CGuard Guard(p->m_Mutex);
+		bSchedule = p->m_pHead != 0;
+		if (!bSchedule){
+			p->m_bScheduled = false;
+		}
+	}
+	if (bSchedule){
+		Schedule(p, pWorker->m_iIndex);
+	}
+}
+
+void CEncodeService::Finish(CEncodeStream* p, unsigned char* pOutput){
+	int id = p->m_iId;
+	int len = p->m_Encoder.Stop(pOutput);
+	{
+		// Streams the client never closed are flushed by Stop(), nothing may be queued after that
+		CGuard Guard(p->m_Mutex);
+		p->m_bClosing = true;
+	}
+	{
+		CGuard Guard(m_Mutex);
+		if (p->m_pPrevOpen){
+			p->m_pPrevOpen->m_pNextOpen = p->m_pNextOpen;
+		}
+		else{
+			m_pOpen = p->m_pNextOpen;
+		}
+		if (p->m_pNextOpen){
+			p->m_pNextOpen->m_pPrevOpen = p->m_pPrevOpen;
+		}
+	}
+	m_pCallback(m_pContext, id, pOutput, len, 1);
+
+	// The id is only handed out again once the client has seen the last packet
+	m_Streams.Release(id);
+	bool bDelete = false;
+	{
+		CGuard Guard(m_Mutex);
+		p->m_bFinished = true;
+		bDelete = !p->m_nRefs;
+	}
+	if (bDelete){
+		delete p;
+	}
+}
+
+// Looks the stream up and keeps it alive until Release(), even if a worker finishes it meanwhile
+CEncodeStream* CEncodeService::Acquire(int iStream){
+	CGuard Guard(m_Mutex);
+	CEncodeStream* p = m_Streams.Get(iStream);
+	if (p){
+		++p->m_nRefs;
+	}
+	return p;
+}
+
+void CEncodeService::Release(CEncodeStream* p){
+	bool bDelete = false;
+	{
+		CGuard Guard(m_Mutex);
+		bDelete = !--p->m_nRefs && p->m_bFinished;
+	}
+	if (bDelete){
+		delete p;
+	}
+}
+
+// Called with the stream locked
+CEncodeJob* CEncodeService::AllocateJob(CEncodeStream* p){
+	CEncodeJob* pJob = p->m_pFree;
+	if (pJob){
+		p->m_pFree = pJob->m_pNext;
+	}
+	else{
+		pJob = new CEncodeJob();
+		pJob->m_pData = new short[p->m_samplesInPacket];
+	}
+	pJob->m_pNext = 0;
+	pJob->m_nData = 0;
+	pJob->m_iAmplifierGain = 0;
+	pJob->m_bClose = false;
+	return pJob;
+}
@@ -0,0 +1,105 @@
+#ifndef _ENCODESERVICE_H_
+#define _ENCODESERVICE_H_
+
+#include "guard.h"
+#include "contexts.h"
+#include "encoderopus.h"
+
+// Called from a worker thread for every packet produced by a stream. Packets of one stream
+// are always reported in submission order and never concurrently. The final call for a stream
+// has bLast set (nPacket may be 0), after which the stream id is no longer valid.
+typedef void (*EncodeServiceCallback)(void* pContext, int iStream, const unsigned char* pPacket, int nPacket, int bLast);
+
+class CEncodeService;
+
+// PCM submitted for one stream and waiting for a worker
+struct CEncodeJob
+{
+	CEncodeJob* m_pNext;
+	short* m_pData;
+	int m_nData;
+	int m_iAmplifierGain;
+	bool m_bClose;
+};
+
+class CEncodeStream
+{
+	friend class CEncodeService;
+
+	static const int MAXPENDINGJOBS = 16;		// Encode() fails when a stream falls this far behind
+
+	pthread_mutex_t m_Mutex;
+	CEncoderOpus m_Encoder;
+	int m_iId;
+	int m_iWorker;									// Worker the stream was last queued on
+	int m_samplesInPacket;
+	bool m_bScheduled;								// Stream is queued on a worker or being encoded
+	bool m_bClosing;
+	bool m_bFinished;								// Last packet was reported, deleted once unused
+	int m_nRefs;									// Encode and Close calls still using the stream
+	int m_nPending;
+	CEncodeJob* m_pHead;							// Pending jobs, in submission order
+	CEncodeJob* m_pTail;
+	CEncodeJob* m_pFree;							// Recycled jobs
+	CEncodeStream* m_pPrev;							// Links in a worker queue
+	CEncodeStream* m_pNext;
+	CEncodeStream* m_pPrevOpen;						// Links in the list of open streams
+	CEncodeStream* m_pNextOpen;
+
+public:
+	CEncodeStream();
+	~CEncodeStream();
+};
+
+class CEncodeService
+{
+	static const int MAXWORKERS = 64;
+	static const int MAXBATCH = 4;					// Jobs encoded before a stream goes back to the queue
+	static const unsigned MAXPACKETBYTES = (1 + 1276) * 24;	// 120 ms of 5 ms frames
+
+	struct CWorker
+	{
+		CEncodeService* m_pService;
+		int m_iIndex;
+		pthread_t m_Thread;
+		pthread_mutex_t m_Mutex;
+		CEncodeStream* m_pHead;						// Owner takes from the head, thieves from the tail
+		CEncodeStream* m_pTail;
+		unsigned char m_output[MAXPACKETBYTES];
+	};
+
+	pthread_mutex_t m_Mutex;
+	pthread_cond_t m_Cond;
+	CWorker* m_pWorkers;
+	int m_nWorkers;
+	int m_nQueued;									// Streams sitting in worker queues
+	bool m_bStopping;
+	EncodeServiceCallback m_pCallback;
+	void* m_pContext;
+	CContexts<CEncodeStream> m_Streams;
+	CEncodeStream* m_pOpen;
+
+	static void* WorkerProc(void* pParam);
+	void Work(CWorker* pWorker);
+	void Schedule(CEncodeStream* pStream, int iWorker);
+	CEncodeStream* Pop(CWorker* pWorker);
+	CEncodeStream* Steal(CWorker* pWorker);
+	void Run(CEncodeStream* pStream, CWorker* pWorker);
+	void Finish(CEncodeStream* pStream, unsigned char* pOutput);
+	CEncodeJob* AllocateJob(CEncodeStream* pStream);
+	CEncodeStream* Acquire(int iStream);
+	void Release(CEncodeStream* pStream);
+
+public:
+	CEncodeService();
+	~CEncodeService();
+	bool Start(int iThreads, EncodeServiceCallback pCallback, void* pContext);
+	void Stop();
+	int Open(int iSampleRate, int iFramesInPacket, int iFrameSize, int iBitrate, int iAmplifierGain);
+	bool Encode(int iStream, const short* pData, int nData, int iAmplifierGain);
+	bool Close(int iStream);
+	int GetThreadCount();
+
+};
+
+#endif
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <pthread.h>
+#include <assert.h>
+#include <atomic>
 
 class CGuard
 {
@@ -16,3 +18,58 @@ public:
 		pthread_mutex_unlock(&m_Mutex);
 	}
 };
+
+// Threading mode of a codec object. Shared objects lock their mutex on every call; single-owner
+// objects are driven by one thread or serial queue at a time and skip the lock. Debug builds
+// assert that calls into a single-owner object never overlap.
+class COwner
+{
+	friend class COwnerGuard;
+	bool m_bShared;
+#ifndef NDEBUG
+	std::atomic<bool> m_bBusy;
+#endif
+public:
+	COwner(bool bShared) :
+		m_bShared(bShared)
+	{
+#ifndef NDEBUG
+		m_bBusy = false;
+#endif
+	}
+	bool IsShared()
+	{
+		return m_bShared;
+	}
+};
+
+class COwnerGuard
+{
+	pthread_mutex_t& m_Mutex;
+	COwner& m_Owner;
+public:
+	COwnerGuard(pthread_mutex_t& Mutex, COwner& Owner) :
+		m_Mutex(Mutex),
+		m_Owner(Owner)
+	{
+		if (m_Owner.m_bShared)
+			pthread_mutex_lock(&m_Mutex);
+#ifndef NDEBUG
+		else
+		{
+			bool bBusy = m_Owner.m_bBusy.exchange(true);
+			assert(!bBusy && "Single-owner codec used from two threads at once");
+			(void) bBusy;
+		}
+#endif
+	}
+	~COwnerGuard()
+	{
+		if (m_Owner.m_bShared)
+			pthread_mutex_unlock(&m_Mutex);
+#ifndef NDEBUG
+		else
+			m_Owner.m_bBusy = false;
+#endif
+	}
+};
@@ -1,12 +1,19 @@
 
 #include "contexts.h"
 
+#include "bufferpool.h"
+#include "captureencoder.h"
+#include "decodeahead.h"
 #include "decoderopus.h"
 #include "encoderopus.h"
+#include "encodeservice.h"
+#include "repacketizer.h"
 #include "libopus.h"
 
 static CContexts<CDecoderOpus> g_Decoders;
 static CContexts<CEncoderOpus> g_Encoders;
+static CContexts<CEncodeService> g_EncodeServices;
+static CContexts<CRepacketizer> g_Repacketizers;
 
 #ifdef __X86__
 extern "C"
@@ -30,6 +37,34 @@ extern "C"
     return g_Encoders.Allocate(p);
   }
   
+  /**
+   * Same as encoder_opus_nativeStart, but all codec buffers are placed in the caller's memory,
+   * which has to stay valid until encoder_opus_nativeStop. The arena must be 64-byte aligned
+   * and at least encoder_opus_nativeGetArenaSize bytes long.
+   */
+  int encoder_opus_nativeStartInArena(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain, unsigned char* arena, int len){
+    if (!arena){
+      return 0;
+    }
+    CEncoderOpus* p = new CEncoderOpus();
+    if (!p->Start(sampleRate, framesInPacket, frameSize, bitrate, amplifierGain, arena, len)){
+      delete p;
+      return 0;
+    }
+    return g_Encoders.Allocate(p);
+  }
+  
+  int encoder_opus_nativeGetArenaSize(int sampleRate, int framesInPacket, int frameSize){
+    return CEncoderOpus::GetArenaSize(sampleRate, framesInPacket, frameSize);
+  }
+  
+  /**
+   * Room the output of encode and stop calls needs; packets are encoded straight into it
+   */
+  int encoder_opus_nativeGetMaxPacketSize(int framesInPacket){
+    return CEncoderOpus::GetMaxPacketSize(framesInPacket);
+  }
+  
   int encoder_opus_nativeStop(int id, unsigned char* output){
     CEncoderOpus* p = g_Encoders.Release(id);
     if (p){
@@ -52,6 +87,106 @@ extern "C"
     return CEncoderOpus::GetHeader(sampleRate, framesInPacket, frameSize, output);
   }
   
+  /**
+   * Encodes many streams at once on a pool of worker threads. Packets are delivered
+   * through the callback, in order for each stream; threads <= 0 uses one thread per core.
+   * Encode takes at most one packet of PCM per call and fails on anything longer.
+   */
+  int encoder_opus_serviceStart(int threads, encoder_opus_service_callback callback, void* context){
+    CEncodeService* p = new CEncodeService();
+    if (!p->Start(threads, callback, context)){
+      delete p;
+      return 0;
+    }
+    return g_EncodeServices.Allocate(p);
+  }
+  
+  void encoder_opus_serviceStop(int service){
+    CEncodeService* p = g_EncodeServices.Release(service);
+    if (p){
+      p->Stop();
+      delete p;
+    }
+  }
+  
+  int encoder_opus_serviceOpen(int service, int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain){
+    CEncodeService* p = g_EncodeServices.Get(service);
+    if (p){
+      return p->Open(sampleRate, framesInPacket, frameSize, bitrate, amplifierGain);
+    }
+    return 0;
+  }
+  
+  int encoder_opus_serviceEncode(int service, int stream, short* data, int len, int amplifierGain){
+    CEncodeService* p = g_EncodeServices.Get(service);
+    if (p){
+      return p->Encode(stream, data, len, amplifierGain) ? 1 : 0;
+    }
+    return 0;
+  }
+  
+  int encoder_opus_serviceClose(int service, int stream){
+    CEncodeService* p = g_EncodeServices.Get(service);
+    if (p){
+      return p->Close(stream) ? 1 : 0;
+    }
+    return 0;
+  }
+  
+  /**
+   * Changes the number of frames per packet of an encoded stream without decoding it.
+   * Push packets in the old layout, then Pull until it returns 0; Flush returns the
+   * remaining frames as a shorter packet at the end of the stream.
+   */
+  int repacketizer_opus_nativeStart(unsigned char* header, int len, int framesInPacket){
+    CRepacketizer* p = new CRepacketizer();
+    if (!p->Start(header, len, framesInPacket)){
+      delete p;
+      return 0;
+    }
+    return g_Repacketizers.Allocate(p);
+  }
+  
+  void repacketizer_opus_nativeStop(int id){
+    CRepacketizer* p = g_Repacketizers.Release(id);
+    if (p){
+      p->Stop();
+      delete p;
+    }
+  }
+  
+  int repacketizer_opus_nativeGetHeader(int id, unsigned char* output){
+    CRepacketizer* p = g_Repacketizers.Get(id);
+    if (p){
+      return p->GetHeader(output);
+    }
+    return 0;
+  }
+  
+  int repacketizer_opus_nativePush(int id, unsigned char* data, int len){
+    CRepacketizer* p = g_Repacketizers.Get(id);
+    if (p){
+      return p->Push(data, len) ? 1 : 0;
+    }
+    return 0;
+  }
+  
+  int repacketizer_opus_nativePull(int id, unsigned char* output, int len){
+    CRepacketizer* p = g_Repacketizers.Get(id);
+    if (p){
+      return p->Pull(output, len);
+    }
+    return 0;
+  }
+  
+  int repacketizer_opus_nativeFlush(int id, unsigned char* output, int len){
+    CRepacketizer* p = g_Repacketizers.Get(id);
+    if (p){
+      return p->Flush(output, len);
+    }
+    return 0;
+  }
+  
   /**
    * com.loudtalks.platform.audio.Decoderopus
    */
@@ -89,6 +224,14 @@ extern "C"
     return 0;
   }
   
+  int decoder_opus_nativeDecodeInto(int id, unsigned char* data, int len, short* output, int outputLen){
+    CDecoderOpus* p = g_Decoders.Get(id);
+    if (p){
+      return p->DecodeInto(data, len, output, outputLen);
+    }
+    return 0;
+  }
+  
   int decoder_opus_nativeGetSampleRate(int id){
     CDecoderOpus* p = g_Decoders.Get(id);
     if (p){
@@ -113,4 +256,301 @@ extern "C"
     }
     return 0;
   }
+  
+  /**
+   * Number of samples the packet decodes to, from its TOC alone, or 0 if it is malformed
+   */
+  int decoder_opus_nativeGetPacketSamples(int id, unsigned char* data, int len){
+    CDecoderOpus* p = g_Decoders.Get(id);
+    if (p){
+      return p->GetPacketSamples(data, len);
+    }
+    return 0;
+  }
+  
+  /**
+   * Fills stats with up to len OPUS_STAT_* counters of the decoded packets
+   */
+  int decoder_opus_nativeGetStats(int id, int* stats, int len){
+    CDecoderOpus* p = g_Decoders.Get(id);
+    if (p){
+      return p->GetStats(stats, len);
+    }
+    return 0;
+  }
+  
+  /**
+   * Single-owner codecs, used through the object pointer without any locking
+   */
+  void* encoder_opus_directStart(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain){
+    CEncoderOpus* p = new CEncoderOpus(false);
+    if (!p->Start(sampleRate, framesInPacket, frameSize, bitrate, amplifierGain)){
+      delete p;
+      return 0;
+    }
+    return p;
+  }
+  
+  int encoder_opus_directStop(void* encoder, unsigned char* output){
+    CEncoderOpus* p = (CEncoderOpus*) encoder;
+    if (p){
+      int pRemaining = p->Stop(output);
+      delete p;
+      return pRemaining;
+    }
+    return 0;
+  }
+  
+  int encoder_opus_directEncode(void* encoder, short* data, int len, unsigned char* output, int amplifierGain){
+    CEncoderOpus* p = (CEncoderOpus*) encoder;
+    if (p){
+      return p->Encode(data, len, output, amplifierGain);
+    }
+    return 0;
+  }
+  
+  void* decoder_opus_directStart(unsigned char* header, int len){
+    CDecoderOpus* p = new CDecoderOpus(false);
+    if (!p->Start(header, len)){
+      delete p;
+      return 0;
+    }
+    return p;
+  }
+  
+  void decoder_opus_directStop(void* decoder){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      p->Stop();
+      delete p;
+    }
+  }
+  
+  void decoder_opus_directSetGain(void* decoder, int amplifierGain){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      p->SetGain(amplifierGain);
+    }
+  }
+  
+  int decoder_opus_directDecode(void* decoder, unsigned char* data, int len, short* output){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->Decode(data, len, output);
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directDecodeInto(void* decoder, unsigned char* data, int len, short* output, int outputLen){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->DecodeInto(data, len, output, outputLen);
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directGetSampleRate(void* decoder){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->GetSampleRate();
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directGetFrameSize(void* decoder){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->GetFrameSize();
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directGetFramesInPacket(void* decoder){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->GetFramesInPacket();
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directGetPacketSamples(void* decoder, unsigned char* data, int len){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->GetPacketSamples(data, len);
+    }
+    return 0;
+  }
+  
+  int decoder_opus_directGetStats(void* decoder, int* stats, int len){
+    CDecoderOpus* p = (CDecoderOpus*) decoder;
+    if (p){
+      return p->GetStats(stats, len);
+    }
+    return 0;
+  }
+  
+  /**
+   * Decode-ahead decoders, used through the object pointer
+   */
+  void* decoder_opus_aheadStart(unsigned char* header, int len, decoder_opus_ahead_source source, void* sourceContext, decoder_opus_ahead_callback callback, void* context){
+    CDecodeAhead* p = new CDecodeAhead();
+    if (!p->Start(header, len, source, sourceContext, callback, context)){
+      delete p;
+      return 0;
+    }
+    return p;
+  }
+  
+  void decoder_opus_aheadStop(void* decoder){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      p->Stop();
+      delete p;
+    }
+  }
+  
+  void decoder_opus_aheadSetGain(void* decoder, int amplifierGain){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      p->SetGain(amplifierGain);
+    }
+  }
+  
+  void decoder_opus_aheadSetTracking(void* decoder, int tracking){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      p->SetTracking(tracking != 0);
+    }
+  }
+  
+  void decoder_opus_aheadNotify(void* decoder){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      p->Notify();
+    }
+  }
+  
+  int decoder_opus_aheadRead(void* decoder, short* output, int outputLen){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      return p->Read(output, outputLen);
+    }
+    return 0;
+  }
+  
+  int decoder_opus_aheadGetSampleRate(void* decoder){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      return p->GetSampleRate();
+    }
+    return 0;
+  }
+  
+  int decoder_opus_aheadGetFrameSize(void* decoder){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      return p->GetFrameSize();
+    }
+    return 0;
+  }
+  
+  int decoder_opus_aheadGetFramesInPacket(void* decoder){
+    CDecodeAhead* p = (CDecodeAhead*) decoder;
+    if (p){
+      return p->GetFramesInPacket();
+    }
+    return 0;
+  }
+  
+  /**
+   * Capture encoders, used through the object pointer
+   */
+  void* encoder_opus_captureStart(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain, void* pool, int headroom, const unsigned char* prefix, int prefixLen, encoder_opus_capture_callback callback, void* context){
+    CCaptureEncoder* p = new CCaptureEncoder();
+    if (!p->Start(sampleRate, framesInPacket, frameSize, bitrate, amplifierGain, (CBufferPool*) pool, headroom, prefix, prefixLen, callback, context)){
+      delete p;
+      return 0;
+    }
+    return p;
+  }
+  
+  void encoder_opus_captureStop(void* encoder){
+    CCaptureEncoder* p = (CCaptureEncoder*) encoder;
+    if (p){
+      p->Stop();
+      delete p;
+    }
+  }
+  
+  void encoder_opus_captureSetGain(void* encoder, int amplifierGain){
+    CCaptureEncoder* p = (CCaptureEncoder*) encoder;
+    if (p){
+      p->SetGain(amplifierGain);
+    }
+  }
+  
+  int encoder_opus_capturePush(void* encoder, short* data, int len){
+    CCaptureEncoder* p = (CCaptureEncoder*) encoder;
+    if (p){
+      return p->Push(data, len) ? 1 : 0;
+    }
+    return 0;
+  }
+  
+  int encoder_opus_captureGetOverruns(void* encoder){
+    CCaptureEncoder* p = (CCaptureEncoder*) encoder;
+    if (p){
+      return p->GetOverruns();
+    }
+    return 0;
+  }
+  
+  int encoder_opus_captureGetMaxLatency(void* encoder){
+    CCaptureEncoder* p = (CCaptureEncoder*) encoder;
+    if (p){
+      return p->GetMaxLatency();
+    }
+    return 0;
+  }
+  
+  /**
+   * Buffer pools
+   */
+  void* buffer_pool_nativeCreate(int bufferSize, int prealloc){
+    if (bufferSize <= 0 || prealloc < 0){
+      return 0;
+    }
+    return new CBufferPool(bufferSize, prealloc);
+  }
+  
+  void buffer_pool_nativeDestroy(void* pool){
+    CBufferPool* p = (CBufferPool*) pool;
+    if (p){
+      p->Close();
+    }
+  }
+  
+  unsigned char* buffer_pool_nativeAcquire(void* pool){
+    CBufferPool* p = (CBufferPool*) pool;
+    if (p){
+      return p->Acquire();
+    }
+    return 0;
+  }
+  
+  int buffer_pool_nativeGetBufferSize(void* pool){
+    CBufferPool* p = (CBufferPool*) pool;
+    if (p){
+      return p->GetBlockSize();
+    }
+    return 0;
+  }
+  
+  void buffer_pool_nativeRetain(unsigned char* buffer){
+    CBufferPool::Retain(buffer);
+  }
+  
+  void buffer_pool_nativeRelease(unsigned char* buffer){
+    CBufferPool::Release(buffer);
+  }
 }
@@ -12,18 +12,116 @@
 #define OPUS_MAX_FRAMES_PER_PACKET   10
 #define OPUS_MAX_DECODED_PACKET      2*6400
 #define OPUS_MAX_ENCODED_PACKET      2048
+#define OPUS_MAX_PACKET_PREFIX       16    // Longest prefix encoder_opus_captureStart accepts
+
+// Decoder packet statistics, indexes into the array filled by decoder_opus_nativeGetStats
+#define OPUS_STAT_NARROWBAND         0
+#define OPUS_STAT_MEDIUMBAND         1
+#define OPUS_STAT_WIDEBAND           2
+#define OPUS_STAT_SUPERWIDEBAND      3
+#define OPUS_STAT_FULLBAND           4
+#define OPUS_STAT_SILK               5
+#define OPUS_STAT_HYBRID             6
+#define OPUS_STAT_CELT               7
+#define OPUS_STAT_REJECTED           8
+#define OPUS_STAT_COUNT              9
+
+// Returned by a decoder_opus_ahead_source instead of a packet length
+#define OPUS_AHEAD_WAIT              -1    // The next packet hasn't arrived yet
+#define OPUS_AHEAD_END               -2    // No more packets
 extern "C"
 {
+  typedef void (*encoder_opus_service_callback)(void* context, int stream, const unsigned char* packet, int len, int last);
+  typedef int (*decoder_opus_ahead_source)(void* context, unsigned char* buffer, int len, int urgent);
+  typedef void (*decoder_opus_ahead_callback)(void* context);
+  typedef void (*encoder_opus_capture_callback)(void* context, unsigned char* buffer, int len, int latencyUs, int last);
+  
   int encoder_opus_nativeStart(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain);
+  int encoder_opus_nativeStartInArena(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain, unsigned char* arena, int len);
+  int encoder_opus_nativeGetArenaSize(int sampleRate, int framesInPacket, int frameSize);
+  int encoder_opus_nativeGetMaxPacketSize(int framesInPacket);
+  // Stop and Encode write a whole packet straight into output, which must have room for
+  // encoder_opus_nativeGetMaxPacketSize(framesInPacket) bytes, 1277 per frame. The same goes for
+  // the direct encoder below.
   int encoder_opus_nativeStop(int id, unsigned char* output);
   int encoder_opus_nativeEncode(int id, short* data, int len, unsigned char* output, int amplifierGain);
   int encoder_opus_nativeGetHeader(int sampleRate, int framesInPacket, int frameSize, unsigned char* output);
+  int encoder_opus_serviceStart(int threads, encoder_opus_service_callback callback, void* context);
+  void encoder_opus_serviceStop(int service);
+  int encoder_opus_serviceOpen(int service, int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain);
+  int encoder_opus_serviceEncode(int service, int stream, short* data, int len, int amplifierGain);
+  int encoder_opus_serviceClose(int service, int stream);
+  int repacketizer_opus_nativeStart(unsigned char* header, int len, int framesInPacket);
+  void repacketizer_opus_nativeStop(int id);
+  int repacketizer_opus_nativeGetHeader(int id, unsigned char* output);
+  int repacketizer_opus_nativePush(int id, unsigned char* data, int len);
+  int repacketizer_opus_nativePull(int id, unsigned char* output, int len);
+  int repacketizer_opus_nativeFlush(int id, unsigned char* output, int len);
   int decoder_opus_nativeStart(unsigned char* header, int len);
   void decoder_opus_nativeSetGain(int id, int amplifierGain);
   void decoder_opus_nativeStop(int id);
   int decoder_opus_nativeDecode(int id, unsigned char* data, int len, short* output);
+  // Decodes into output, which holds outputLen samples, and returns how many were written. Returns
+  // -1 without taking the packet if they don't fit; room for a whole packet always does.
+  int decoder_opus_nativeDecodeInto(int id, unsigned char* data, int len, short* output, int outputLen);
   int decoder_opus_nativeGetSampleRate(int id);
   int decoder_opus_nativeGetFrameSize(int id);
   int decoder_opus_nativeGetFramesInPacket(int id);
+  int decoder_opus_nativeGetPacketSamples(int id, unsigned char* data, int len);
+  int decoder_opus_nativeGetStats(int id, int* stats, int len);
+  
+  // Single-owner codecs: no handle table and no locking. The caller must never use one
+  // codec from two threads at the same time (a serial queue is fine).
+  void* encoder_opus_directStart(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain);
+  int encoder_opus_directStop(void* encoder, unsigned char* output);
+  int encoder_opus_directEncode(void* encoder, short* data, int len, unsigned char* output, int amplifierGain);
+  void* decoder_opus_directStart(unsigned char* header, int len);
+  void decoder_opus_directStop(void* decoder);
+  void decoder_opus_directSetGain(void* decoder, int amplifierGain);
+  int decoder_opus_directDecode(void* decoder, unsigned char* data, int len, short* output);
+  int decoder_opus_directDecodeInto(void* decoder, unsigned char* data, int len, short* output, int outputLen);
+  int decoder_opus_directGetSampleRate(void* decoder);
+  int decoder_opus_directGetFrameSize(void* decoder);
+  int decoder_opus_directGetFramesInPacket(void* decoder);
+  int decoder_opus_directGetPacketSamples(void* decoder, unsigned char* data, int len);
+  int decoder_opus_directGetStats(void* decoder, int* stats, int len);
+  
+  // Decode-ahead: a worker thread pulls packets from source while it has room for their audio and
+  // decodes them in place, see CDecodeAhead. Read never blocks and only copies; call it from one
+  // playback thread. Notify wakes the worker when the source has new packets. The optional
+  // callback runs on the worker whenever there is new audio to read, and once at the end.
+  void* decoder_opus_aheadStart(unsigned char* header, int len, decoder_opus_ahead_source source, void* sourceContext, decoder_opus_ahead_callback callback, void* context);
+  void decoder_opus_aheadStop(void* decoder);
+  void decoder_opus_aheadSetGain(void* decoder, int amplifierGain);
+  // Tracking decoders skip packets and produce silence instead, see CDecodeAhead::SetTracking
+  void decoder_opus_aheadSetTracking(void* decoder, int tracking);
+  void decoder_opus_aheadNotify(void* decoder);
+  int decoder_opus_aheadRead(void* decoder, short* output, int outputLen);
+  int decoder_opus_aheadGetSampleRate(void* decoder);
+  int decoder_opus_aheadGetFrameSize(void* decoder);
+  int decoder_opus_aheadGetFramesInPacket(void* decoder);
+  
+  // Capture encoders: pushed audio is only copied into a lock-free ring and encoded on a worker
+  // thread, which reports each packet with its capture-to-packet latency. Push from one thread
+  // (or serial queue) at a time. Stop encodes what is left and reports the last packet first.
+  // Every packet is encoded straight into a buffer from the pool, behind headroom bytes that are
+  // left for the caller and the prefix (up to OPUS_MAX_PACKET_PREFIX bytes, may be empty). Pool
+  // buffers need room for all three, see encoder_opus_nativeGetMaxPacketSize. The callback gets
+  // the whole buffer and has to release it.
+  void* encoder_opus_captureStart(int sampleRate, int framesInPacket, int frameSize, int bitrate, int amplifierGain, void* pool, int headroom, const unsigned char* prefix, int prefixLen, encoder_opus_capture_callback callback, void* context);
+  void encoder_opus_captureStop(void* encoder);
+  void encoder_opus_captureSetGain(void* encoder, int amplifierGain);
+  int encoder_opus_capturePush(void* encoder, short* data, int len);
+  int encoder_opus_captureGetOverruns(void* encoder);
+  int encoder_opus_captureGetMaxLatency(void* encoder);
+  
+  // Pools of fixed-size, reference counted buffers for PCM and packets. A released buffer goes
+  // back to its pool; a destroyed pool lives on until its last outstanding buffer is released.
+  void* buffer_pool_nativeCreate(int bufferSize, int prealloc);
+  void buffer_pool_nativeDestroy(void* pool);
+  unsigned char* buffer_pool_nativeAcquire(void* pool);
+  int buffer_pool_nativeGetBufferSize(void* pool);
+  void buffer_pool_nativeRetain(unsigned char* buffer);
+  void buffer_pool_nativeRelease(unsigned char* buffer);
 }
 #endif
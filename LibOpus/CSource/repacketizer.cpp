@@ -0,0 +1,166 @@
+#include "repacketizer.h"
+#include "encoderopus.h"
+#include "common.h"
+
+CRepacketizer::CRepacketizer() :
+	m_pPacketizer(0),
+	m_sampleRate(0),
+	m_frameSize(0),
+	m_inFramesInPacket(0),
+	m_outFramesInPacket(0),
+	m_frames(0),
+	m_frameLens(0),
+	m_capacity(0),
+	m_first(0),
+	m_count(0)
+{
+	pthread_mutex_init(&m_Mutex, 0);
+}
+
+CRepacketizer::~CRepacketizer()
+{
+	Stop();
+	pthread_mutex_destroy(&m_Mutex);
+}
+
+bool CRepacketizer::Start(unsigned char* pHeader, int nHeader, int iFramesInPacket){
+	CGuard Guard(m_Mutex);
+	if (m_pPacketizer || !pHeader || nHeader < 4){
+		return false;
+	}
+	int sampleRate = ((int) pHeader[0] & 0xff) + (((int) pHeader[1] & 0xff) << 8);
+	int framesInPacket = (int) pHeader[2] & 0xff;
+	int frameSize = (int) pHeader[3] & 0xff;
+	if ((sampleRate == 8000 || sampleRate == 12000 || sampleRate == 16000 || sampleRate == 24000 || sampleRate == 48000) &&
+		(framesInPacket > 0) && (framesInPacket * frameSize <= 120) &&
+		(iFramesInPacket > 0) && (iFramesInPacket * frameSize <= 120) &&
+		(frameSize == 5 || frameSize == 10 || frameSize == 20 || frameSize == 40 || frameSize == 60)){
+		m_pPacketizer = opus_repacketizer_create();
+		if (m_pPacketizer){
+			m_sampleRate = sampleRate;
+			m_frameSize = frameSize;
+			m_inFramesInPacket = framesInPacket;
+			m_outFramesInPacket = iFramesInPacket;
+			// A whole input packet has to fit next to a partially filled output packet
+			m_capacity = framesInPacket + iFramesInPacket;
+			m_frames = new unsigned char[m_capacity * MAXFRAMEBYTES];
+			m_frameLens = new int[m_capacity];
+			m_first = 0;
+			m_count = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CRepacketizer::Stop(){
+	CGuard Guard(m_Mutex);
+	if (m_pPacketizer){
+		opus_repacketizer_destroy(m_pPacketizer);
+		m_pPacketizer = 0;
+		delete[] m_frames;
+		m_frames = 0;
+		delete[] m_frameLens;
+		m_frameLens = 0;
+		m_capacity = 0;
+		m_first = 0;
+		m_count = 0;
+	}
+}
+
+int CRepacketizer::GetHeader(unsigned char* pOutput){
+	CGuard Guard(m_Mutex);
+	if (m_pPacketizer){
+		return CEncoderOpus::GetHeader(m_sampleRate, m_outFramesInPacket, m_frameSize, pOutput);
+	}
+	return 0;
+}
+
+bool CRepacketizer::Push(unsigned char* pData, int nData){
+	CGuard Guard(m_Mutex);
+	if (!m_pPacketizer || !pData || nData <= 0){
+		return false;
+	}
+	int nFrames = opus_packet_get_nb_frames(pData, nData);
+	if (nFrames <= 0 || nFrames > m_capacity - m_count){
+		return false;
+	}
+
+	if (nFrames == 1 && nData <= (int) MAXFRAMEBYTES){
+		// Already a single frame, only the padding has to go
+		int slot = (m_first + m_count) % m_capacity;
+		unsigned char* frame = m_frames + slot * MAXFRAMEBYTES;
+		memcpy(frame, pData, nData);
+		int len = opus_packet_unpad(frame, nData);
+		if (len <= 0){
+			return false;
+		}
+		m_frameLens[slot] = len;
+		++m_count;
+		return true;
+	}
+
+	opus_repacketizer_init(m_pPacketizer);
+	if (opus_repacketizer_cat(m_pPacketizer, pData, nData) != OPUS_OK){
+		return false;
+	}
+	for (int i = 0; i < nFrames; ++i){
+		int slot = (m_first + m_count + i) % m_capacity;
+		int len = opus_repacketizer_out_range(m_pPacketizer, i, i + 1, m_frames + slot * MAXFRAMEBYTES, MAXFRAMEBYTES);
+		if (len <= 0){
+			return false;
+		}
+		m_frameLens[slot] = len;
+	}
+	m_count += nFrames;
+	return true;
+}
+
+int CRepacketizer::Pull(unsigned char* pOutput, int nOutput){
+	CGuard Guard(m_Mutex);
+	if (m_pPacketizer && pOutput && m_count >= m_outFramesInPacket){
+		return Emit(false, pOutput, nOutput);
+	}
+	return 0;
+}
+
+int CRepacketizer::Flush(unsigned char* pOutput, int nOutput){
+	CGuard Guard(m_Mutex);
+	if (m_pPacketizer && pOutput && m_count > 0){
+		return Emit(true, pOutput, nOutput);
+	}
+	return 0;
+}
+
+// Called with the mutex held. Frames that cannot share a packet with the previous ones
+// (the encoder switched mode or bandwidth) end the packet early and start the next one.
+// Unless bPartial is set only a full packet is emitted.
+int CRepacketizer::Emit(bool bPartial, unsigned char* pOutput, int nOutput){
+	for (;;){
+		int nFrames = min(m_count, m_outFramesInPacket);
+		if (nFrames == 0 || (!bPartial && nFrames < m_outFramesInPacket)){
+			return 0;
+		}
+		opus_repacketizer_init(m_pPacketizer);
+		int nJoined = 0;
+		for (; nJoined < nFrames; ++nJoined){
+			int slot = (m_first + nJoined) % m_capacity;
+			if (opus_repacketizer_cat(m_pPacketizer, m_frames + slot * MAXFRAMEBYTES, m_frameLens[slot]) != OPUS_OK){
+				break;
+			}
+		}
+		if (nJoined == 0){
+			// Frame is unusable on its own, drop it and go on with the ones behind it
+			m_first = (m_first + 1) % m_capacity;
+			--m_count;
+			continue;
+		}
+		int len = opus_repacketizer_out(m_pPacketizer, pOutput, nOutput);
+		if (len > 0){
+			m_first = (m_first + nJoined) % m_capacity;
+			m_count -= nJoined;
+			return len;
+		}
+		return 0;
+	}
+}
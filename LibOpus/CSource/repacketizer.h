@@ -0,0 +1,43 @@
+#ifndef _REPACKETIZER_H_
+#define _REPACKETIZER_H_
+
+extern "C"
+{
+#include "opus.h"
+}
+
+#include "guard.h"
+
+// Converts a stream of Opus packets to a different number of frames per packet without
+// decoding it, e.g. 1x60 ms into 2x60 ms for relaying or archiving.
+class CRepacketizer
+{
+	static const unsigned MAXFRAMEBYTES = 1277;		// TOC byte and the largest frame
+
+	pthread_mutex_t m_Mutex;
+	OpusRepacketizer* m_pPacketizer;
+	int m_sampleRate;
+	int m_frameSize;								// Frame duration, ms
+	int m_inFramesInPacket;
+	int m_outFramesInPacket;
+	unsigned char* m_frames;						// Circular buffer of single frame packets
+	int* m_frameLens;
+	int m_capacity;									// Number of frame slots
+	int m_first;
+	int m_count;
+
+	int Emit(bool bPartial, unsigned char* pOutput, int nOutput);
+
+public:
+	CRepacketizer();
+	~CRepacketizer();
+	bool Start(unsigned char* pHeader, int nHeader, int iFramesInPacket);
+	void Stop();
+	int GetHeader(unsigned char* pOutput);
+	bool Push(unsigned char* pData, int nData);
+	int Pull(unsigned char* pOutput, int nOutput);
+	int Flush(unsigned char* pOutput, int nOutput);
+
+};
+
+#endif
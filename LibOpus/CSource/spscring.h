@@ -0,0 +1,111 @@
+#ifndef _SPSCRING_H_
+#define _SPSCRING_H_
+
+#include <string.h>
+#include <atomic>
+
+// Lock-free ring for exactly one writer thread and one reader thread. Neither side ever
+// blocks or takes a lock, so the reader can live on a real-time audio thread.
+template<typename T>
+class CSpscRing
+{
+	T* m_pData;
+	unsigned m_nCapacity;							// Power of two
+	unsigned m_nMask;
+	std::atomic<unsigned> m_iWrite;					// Free-running, only stored by the writer
+	std::atomic<unsigned> m_iRead;					// Free-running, only stored by the reader
+
+	CSpscRing(const CSpscRing&);
+	CSpscRing& operator=(const CSpscRing&);
+
+public:
+	CSpscRing() :
+		m_pData(0),
+		m_nCapacity(0),
+		m_nMask(0)
+	{
+		m_iWrite = 0;
+		m_iRead = 0;
+	}
+
+	~CSpscRing()
+	{
+		delete[] m_pData;
+	}
+
+	// Not thread safe, call before either side starts
+	bool Init(unsigned nCapacity)
+	{
+		unsigned n = 1;
+		while (n < nCapacity && n < 0x80000000u)
+		{
+			n <<= 1;
+		}
+		delete[] m_pData;
+		m_pData = new T[n];
+		m_nCapacity = n;
+		m_nMask = n - 1;
+		m_iWrite = 0;
+		m_iRead = 0;
+		return true;
+	}
+
+	unsigned GetCapacity()
+	{
+		return m_nCapacity;
+	}
+
+	// Writer side
+	unsigned GetWritable()
+	{
+		return m_nCapacity - (m_iWrite.load(std::memory_order_relaxed) - m_iRead.load(std::memory_order_acquire));
+	}
+
+	unsigned Write(const T* pData, unsigned nData)
+	{
+		unsigned iWrite = m_iWrite.load(std::memory_order_relaxed);
+		unsigned n = m_nCapacity - (iWrite - m_iRead.load(std::memory_order_acquire));
+		if (n > nData)
+		{
+			n = nData;
+		}
+		unsigned iStart = iWrite & m_nMask;
+		unsigned nFirst = m_nCapacity - iStart;
+		if (nFirst > n)
+		{
+			nFirst = n;
+		}
+		memcpy(m_pData + iStart, pData, nFirst * sizeof(T));
+		memcpy(m_pData, pData + nFirst, (n - nFirst) * sizeof(T));
+		m_iWrite.store(iWrite + n, std::memory_order_release);
+		return n;
+	}
+
+	// Reader side
+	unsigned GetReadable()
+	{
+		return m_iWrite.load(std::memory_order_acquire) - m_iRead.load(std::memory_order_relaxed);
+	}
+
+	unsigned Read(T* pOutput, unsigned nOutput)
+	{
+		unsigned iRead = m_iRead.load(std::memory_order_relaxed);
+		unsigned n = m_iWrite.load(std::memory_order_acquire) - iRead;
+		if (n > nOutput)
+		{
+			n = nOutput;
+		}
+		unsigned iStart = iRead & m_nMask;
+		unsigned nFirst = m_nCapacity - iStart;
+		if (nFirst > n)
+		{
+			nFirst = n;
+		}
+		memcpy(pOutput, m_pData + iStart, nFirst * sizeof(T));
+		memcpy(pOutput + nFirst, m_pData, (n - nFirst) * sizeof(T));
+		m_iRead.store(iRead + n, std::memory_order_release);
+		return n;
+	}
+};
+
+#endif
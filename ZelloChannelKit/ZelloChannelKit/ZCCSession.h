@@ -19,6 +19,7 @@ NS_ASSUME_NONNULL_BEGIN
 @class ZCCLocationInfo;
 @class ZCCOutgoingVoiceConfiguration;
 @class ZCCOutgoingVoiceStream;
+@class ZCCStreamArbiter;
 
 /**
  * Callback for receiving the location that the Zello channels client is sending to the channel
@@ -140,6 +141,15 @@ typedef NS_ENUM(NSInteger, ZCCReconnectReason) {
  */
 @property (atomic) NSTimeInterval requestTimeout;
 
+/**
+ * @abstract Limits how many incoming voice streams are decoded at once
+ *
+ * @discussion Assign the same <code>ZCCStreamArbiter</code> to the sessions of all the channels you
+ * monitor, and only the most important of their streams are decoded at any time. Defaults to
+ * <code>nil</code>, which decodes every incoming stream.
+ */
+@property (atomic, strong, nullable) ZCCStreamArbiter *streamArbiter;
+
 /**
  * @abstract Unavailable default initializer; use a more specific one
  *
@@ -25,6 +25,7 @@
 #import "ZCCProtocol.h"
 #import "ZCCSocket.h"
 #import "ZCCSocketFactory.h"
+#import "ZCCStreamArbiter.h"
 #import "ZCCStreamParams.h"
 #import "ZCCVoiceStreamsManager.h"
 
@@ -116,6 +117,7 @@ static void LogWarningForDevelopmentToken(NSString *token) {
 
 @implementation ZCCSession {
   NSTimeInterval _requestTimeout;
+  ZCCStreamArbiter *_streamArbiter;
 }
 
 - (instancetype)initWithURL:(NSURL *)url authToken:(NSString *)token username:(NSString *)username password:(NSString *)password channel:(NSString *)channel callbackQueue:(dispatch_queue_t)queue {
@@ -211,6 +213,21 @@ static void LogWarningForDevelopmentToken(NSString *token) {
   }];
 }
 
+- (ZCCStreamArbiter *)streamArbiter {
+  __block ZCCStreamArbiter *arbiter;
+  [self.runner runSync:^{
+    arbiter = self->_streamArbiter;
+  }];
+  return arbiter;
+}
+
+- (void)setStreamArbiter:(ZCCStreamArbiter *)arbiter {
+  [self.runner runSync:^{
+    self->_streamArbiter = arbiter;
+    self.streamsManager.arbiter = arbiter;
+  }];
+}
+
 #pragma mark - Public Methods
 
 - (void)disconnect {
@@ -16,6 +16,7 @@
 #import <ZelloChannelKit/ZCCOutgoingVoiceConfiguration.h>
 #import <ZelloChannelKit/ZCCOutgoingVoiceStream.h>
 #import <ZelloChannelKit/ZCCSession.h>
+#import <ZelloChannelKit/ZCCStreamArbiter.h>
 #import <ZelloChannelKit/ZCCStreamState.h>
 #import <ZelloChannelKit/ZCCTypes.h>
 #import <ZelloChannelKit/ZCCVoiceStream.h>
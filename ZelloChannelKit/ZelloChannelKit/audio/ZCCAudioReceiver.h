@@ -8,6 +8,9 @@
 
 @protocol ZCCAudioReceiver;
 
+/// Returned by the decodeInto/concealInto delegate methods once the stream has no more audio
+static const NSInteger ZCCAudioReceiverEndOfStream = -1;
+
 @protocol ZCCAudioReceiverDelegate <NSObject>
 
 - (NSData *)dataForReceiver:(id<ZCCAudioReceiver>)receiver;
@@ -17,6 +20,16 @@
 - (void)receiverDidEndPlayback:(id<ZCCAudioReceiver>)receiver;
 - (void)receiver:(id<ZCCAudioReceiver>)receiver didEncounterError:(NSError *)error;
 
+@optional
+/**
+ * Decodes the next packet straight into buffer instead of returning it from -dataForReceiver:.
+ * Audio that doesn't fit is kept and written by the next call. Returns the number of bytes
+ * written, 0 if no packet is available yet, or ZCCAudioReceiverEndOfStream.
+ */
+- (NSInteger)receiver:(id<ZCCAudioReceiver>)receiver decodeInto:(void *)buffer length:(NSUInteger)length;
+/// Same as -receiver:decodeInto:length:, but generates concealment audio for a missing packet
+- (NSInteger)receiver:(id<ZCCAudioReceiver>)receiver concealInto:(void *)buffer length:(NSUInteger)length;
+
 @end
 
 @protocol ZCCAudioReceiver <NSObject>
@@ -32,4 +45,11 @@
 - (void)stop;
 - (void)pause;
 - (void)resume;
+
+@optional
+/**
+ * Called by the delegate, on any thread, when -dataForReceiver: has new audio to hand out.
+ * Receivers that pull audio on their own schedule wait for this instead of polling.
+ */
+- (void)dataDidBecomeAvailable;
 @end
@@ -0,0 +1,59 @@
+//
+//  ZCCBufferPool.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Pool of fixed-size buffers for PCM and encoded packets. Data objects made by the pool wrap a
+ * buffer without copying it, and the buffer goes back to the pool when the data is deallocated,
+ * so a stream that keeps a steady number of buffers in flight stops allocating them.
+ *
+ * Buffers may be released on any thread, and may outlive the pool.
+ */
+@interface ZCCBufferPool : NSObject
+
+@property (nonatomic, readonly) NSUInteger bufferLength;
+
+/**
+ * The libopus pool behind this one, for native code that fills buffers itself. Buffers it hands
+ * out are wrapped with -dataWithBuffer:length: like any other.
+ */
+@property (nonatomic, readonly) void *nativePool;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+- (instancetype)initWithBufferLength:(NSUInteger)length preallocate:(NSUInteger)count NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Returns a buffer of bufferLength bytes. Hand it to -dataWithBuffer:length: or give it back
+ * with -releaseBuffer:.
+ */
+- (nullable void *)acquireBuffer;
+
+/**
+ * Wraps a buffer returned by -acquireBuffer without copying it. The data takes over the buffer.
+ */
+- (NSData *)dataWithBuffer:(void *)buffer length:(NSUInteger)length;
+
+/**
+ * Same as -dataWithBuffer:length:, for consumers that write into the buffer, such as a transport
+ * framing a packet where it is.
+ */
+- (NSMutableData *)mutableDataWithBuffer:(void *)buffer length:(NSUInteger)length;
+
+- (void)releaseBuffer:(void *)buffer;
+
+/**
+ * Copies bytes into a pooled buffer. Falls back to a plain NSData when they don't fit.
+ */
+- (NSData *)dataWithBytes:(const void *)bytes length:(NSUInteger)length;
+
+@end
+
+NS_ASSUME_NONNULL_END
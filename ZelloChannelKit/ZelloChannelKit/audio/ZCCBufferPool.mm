@@ -0,0 +1,70 @@
+//
+//  ZCCBufferPool.mm
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import "libopus.h"
+#import "ZCCBufferPool.h"
+
+@implementation ZCCBufferPool {
+  void *_pool;
+}
+
+- (instancetype)initWithBufferLength:(NSUInteger)length preallocate:(NSUInteger)count {
+  self = [super init];
+  if (self) {
+    _bufferLength = length;
+    _pool = buffer_pool_nativeCreate((int32_t)length, (int32_t)count);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // Buffers still wrapped in data objects keep the native pool alive
+  buffer_pool_nativeDestroy(_pool);
+}
+
+- (void *)nativePool {
+  return _pool;
+}
+
+- (void *)acquireBuffer {
+  return buffer_pool_nativeAcquire(_pool);
+}
+
+- (NSData *)dataWithBuffer:(void *)buffer length:(NSUInteger)length {
+  if (length == 0) {
+    buffer_pool_nativeRelease((unsigned char *)buffer);
+    return [NSData data];
+  }
+  return [[NSData alloc] initWithBytesNoCopy:buffer length:length deallocator:^(void *bytes, NSUInteger bytesLength) {
+    buffer_pool_nativeRelease((unsigned char *)bytes);
+  }];
+}
+
+- (NSMutableData *)mutableDataWithBuffer:(void *)buffer length:(NSUInteger)length {
+  if (length == 0) {
+    buffer_pool_nativeRelease((unsigned char *)buffer);
+    return [NSMutableData data];
+  }
+  return [[NSMutableData alloc] initWithBytesNoCopy:buffer length:length deallocator:^(void *bytes, NSUInteger bytesLength) {
+    buffer_pool_nativeRelease((unsigned char *)bytes);
+  }];
+}
+
+- (void)releaseBuffer:(void *)buffer {
+  buffer_pool_nativeRelease((unsigned char *)buffer);
+}
+
+- (NSData *)dataWithBytes:(const void *)bytes length:(NSUInteger)length {
+  void *buffer = length <= self.bufferLength ? [self acquireBuffer] : NULL;
+  if (!buffer) {
+    return [NSData dataWithBytes:bytes length:length];
+  }
+  memcpy(buffer, bytes, length);
+  return [self dataWithBuffer:buffer length:length];
+}
+
+@end
@@ -22,9 +22,11 @@
 @property (nonatomic, strong) ZCCPlayer *passThroughPlayer;
 
 @property (nonatomic) BOOL prepared;
+@property (nonatomic) BOOL playing;
 @property (nonatomic) BOOL stopped;
 @property (atomic) BOOL paused;
 @property (nonatomic) BOOL readLoopRunning;
+@property (nonatomic) NSTimeInterval packetDuration;
 @end
 
 @implementation ZCCCustomAudioReceiver {
@@ -136,6 +138,7 @@
 
     AudioStreamBasicDescription description = [ZCCAudioUtils audioStreamBasicDescriptionWithChannels:channels sampleRate:sampleRate];
     [self.receiver prepareWithAudioDescription:description stream:stream];
+    self.packetDuration = (double)duration / 1000.0;
     self.prepared = YES;
 
     // If we have a pass-through player, set it up and defer readiness to it
@@ -159,6 +162,7 @@
       return; // We'll pass audio as we play it
     }
 
+    self.playing = YES;
     self.readLoopRunning = YES;
     [self startReadingAudio];
 
@@ -168,32 +172,53 @@
 
 - (void)startReadingAudio {
   [self.runner runAsync:^{
-    self.readLoopRunning = NO;
-    if (self.stopped || self.paused) {
-      return;
-    }
-    ZCCIncomingVoiceStream *stream = self.stream;
-    if (!stream) {
-      return;
-    }
+    [self readAudio];
+  }];
+}
 
-    NSData *audio = [self.delegate dataForReceiver:self];
-    if (!audio) {
-      // Delay until the next run loop
-      // TODO: Wait for a more data ready event
-      self.readLoopRunning = YES;
-      [self startReadingAudio];
-      return;
-    }
+/**
+ * Hands the receiver everything the decoder has ready. While audio keeps coming we look again
+ * one packet later; once the decoder runs dry the loop stops until -dataDidBecomeAvailable.
+ *
+ * @warning Only call from QueueRunner
+ */
+- (void)readAudio {
+  self.readLoopRunning = NO;
+  if (self.stopped || self.paused) {
+    return;
+  }
+  ZCCIncomingVoiceStream *stream = self.stream;
+  if (!stream) {
+    return;
+  }
+
+  BOOL delivered = NO;
+  NSData *audio;
+  while ((audio = [self.delegate dataForReceiver:self]) != nil) {
     if ([audio isEqualToData:ZCCPlayer.stopCookie]) {
       [self stopImpl];
+      return;
     }
 
-    // Decoder layer reuses the buffer it passes us. We need to copy to make sure we don't overwrite
-    // the buffer before the receiver gets the data.
-    [self.receiver receiveAudio:[audio copy] stream:stream];
+    // Decoder hands out pooled buffers it never reuses while we hold them, so no copy is needed
+    [self.receiver receiveAudio:audio stream:stream];
+    delivered = YES;
+  }
+  if (delivered) {
     self.readLoopRunning = YES;
-    [self startReadingAudio];
+    [self.runner run:^{
+      [self readAudio];
+    } after:self.packetDuration];
+  }
+}
+
+- (void)dataDidBecomeAvailable {
+  [self.runner runAsync:^{
+    if (self.passThroughPlayer || !self.playing || self.stopped || self.paused || self.readLoopRunning) {
+      return;
+    }
+    self.readLoopRunning = YES;
+    [self readAudio];
   }];
 }
 
@@ -250,7 +275,7 @@
 - (NSData *)dataForReceiver:(id<ZCCAudioReceiver>)player {
   NSData *audio = [self.delegate dataForReceiver:self];
   if (audio && ![audio isEqualToData:ZCCPlayer.stopCookie]) {
-    [self.receiver receiveAudio:[audio copy] stream:self.stream];
+    [self.receiver receiveAudio:audio stream:self.stream];
   }
   return audio;
 }
@@ -7,6 +7,7 @@
 //
 
 #import "ZCCCustomAudioSource.h"
+#import "ZCCBufferPool.h"
 #import "ZCCCustomAudioSourceReceiver.h"
 #import "ZCCOutgoingVoiceConfiguration.h"
 
@@ -22,11 +23,16 @@
 /// The number of bytes of audio data the encoder expects to get at a time
 @property (nonatomic) NSUInteger delegateBufferLength;
 
-@property (nonatomic, strong) NSMutableData *buffer;
+/// Buffers of delegateBufferLength bytes, handed to the encoder without a copy
+@property (nonatomic, strong) ZCCBufferPool *pool;
 
 @end
 
-@implementation ZCCCustomAudioSource
+@implementation ZCCCustomAudioSource {
+  // Pooled buffer being filled, only touched on our queue
+  unsigned char *_pending;
+  NSUInteger _pendingLength;
+}
 
 @synthesize delegate;
 @synthesize level;
@@ -36,29 +42,51 @@
   if (self) {
     _source = configuration.source;
     _stream = stream;
-    _buffer = [[NSMutableData alloc] init];
   }
   return self;
 }
 
+- (void)dealloc {
+  if (_pending) {
+    [_pool releaseBuffer:_pending];
+  }
+}
+
 - (void)voiceSourceDidProvideAudio:(NSData *)audioData {
   NSData *audio = [audioData copy]; // Defensive copy
   [self runAsync:^{
-    [self.buffer appendData:audio];
-    while (self.buffer.length >= self.delegateBufferLength) {
-      NSRange bufferRange = NSMakeRange(0, self.delegateBufferLength);
-      NSData *toSend = [self.buffer subdataWithRange:bufferRange];
-      [self.buffer replaceBytesInRange:bufferRange withBytes:nil length:0];
-      [self.delegate audioSource:self didProduceData:toSend];
+    const unsigned char *bytes = (const unsigned char *)audio.bytes;
+    NSUInteger remaining = audio.length;
+    while (remaining > 0) {
+      if (!self->_pending) {
+        self->_pending = (unsigned char *)[self.pool acquireBuffer];
+        self->_pendingLength = 0;
+        if (!self->_pending) {
+          return;
+        }
+      }
+      NSUInteger count = MIN(remaining, self.delegateBufferLength - self->_pendingLength);
+      memcpy(self->_pending + self->_pendingLength, bytes, count);
+      self->_pendingLength += count;
+      bytes += count;
+      remaining -= count;
+      if (self->_pendingLength == self.delegateBufferLength) {
+        NSData *toSend = [self.pool dataWithBuffer:self->_pending length:self->_pendingLength];
+        self->_pending = NULL;
+        [self.delegate audioSource:self didProduceData:toSend];
+      }
     }
   }];
 }
 
 - (void)voiceSourceDidStop {
   [self runAsync:^{
-    if (self.buffer.length > 0) {
-      [self.delegate audioSource:self didProduceData:self.buffer];
-      self.buffer.length = 0;
+    if (self->_pending) {
+      NSData *toSend = [self.pool dataWithBuffer:self->_pending length:self->_pendingLength];
+      self->_pending = NULL;
+      if (toSend.length > 0) {
+        [self.delegate audioSource:self didProduceData:toSend];
+      }
     }
   }];
 }
@@ -70,6 +98,7 @@
     const NSUInteger bytesPerSample = 2;
     self.sampleRate = sampleRate;
     self.delegateBufferLength = count * channels * bytesPerSample;
+    self.pool = [[ZCCBufferPool alloc] initWithBufferLength:self.delegateBufferLength preallocate:2];
     [self.delegate audioSourceDidBecomeReady:self];
   }];
 }
@@ -91,6 +91,7 @@ static void AQPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ, Audio
   AudioQueueRef _queue;
   unsigned char *_tailBuffer;
   volatile NSUInteger _tailSize;
+  NSUInteger _tailOffset;
   NSInteger _volume;
 }
 
@@ -135,93 +136,127 @@ static void AQPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ, Audio
 
 - (void)handleBufferCompleteForQueue:(AudioQueueRef)inAQ buffer:(AudioQueueBufferRef)inCompleteAQBuffer {
   [self.runner runAsync:^{
-    if (!self.prepared) {
-      return;
-    }
+    [self fillBuffer:inCompleteAQBuffer queue:inAQ writePos:0 retries:0];
+  }];
+}
 
-    id<ZCCAudioReceiverDelegate> delegate = self.delegate;
-    if (!delegate) {
-      [self stop];
-      return;
-    }
-    
-    UInt32 writePos = 0;
-    // Use any tail first
-    if (self->_tailSize > 0) {
-      NSUInteger actual = MIN(self->_tailSize, self.queueBufferSize);
-      memcpy((unsigned char *)inCompleteAQBuffer->mAudioData, self->_tailBuffer, (size_t)actual);
-      writePos += actual;
-      if (actual < self->_tailSize) {
-        self->_tailSize -= actual;
-        // Keep the rest of the tail
-        memmove(self->_tailBuffer, self->_tailBuffer + actual, (size_t)self->_tailSize);
-      } else {
-        self->_tailSize = 0;
-      }
-    }
-    int retries = 0;
-    // Still need more data
-    while (writePos < self.queueBufferSize) {
-      NSData *data = [delegate dataForReceiver:self];
-      // Missing packet
-      if (!data || data.length == 0) {
-        if (!self.stopping) {
-          if (self.totalBuffers > 0) {
-            ++self.missedBuffers;
-            // Try up to kNumberBuffers - 1 times getting the data
-            // Until all audio queue buffers are played the playback won't stutter
-            if (retries < kNumberBuffers - 1) {
-              ++retries;
-              [NSThread sleepForTimeInterval:self.packetDuration / 2];
-              continue;
-            }
-            // Use PLC data if available
-            data = [delegate PLCDataForReceiver:self];
-          }
-          // Play silence
-          if (!data || data.length == 0) {
-            memset(inCompleteAQBuffer->mAudioData, 0, (size_t)self.queueBufferSize);
-            inCompleteAQBuffer->mAudioDataByteSize = (UInt32)self.queueBufferSize;
-            AudioQueueEnqueueBuffer(inAQ, inCompleteAQBuffer, 0, NULL);
+/// @warning Only call from the runner
+- (void)fillBuffer:(AudioQueueBufferRef)inCompleteAQBuffer queue:(AudioQueueRef)inAQ writePos:(UInt32)writePos retries:(int)retries {
+  if (!self.prepared) {
+    return;
+  }
+
+  id<ZCCAudioReceiverDelegate> delegate = self.delegate;
+  if (!delegate) {
+    [self stop];
+    return;
+  }
+  
+  unsigned char *output = (unsigned char *)inCompleteAQBuffer->mAudioData;
+  // Still need more data
+  while (writePos < self.queueBufferSize) {
+    NSUInteger space = self.queueBufferSize - writePos;
+    NSInteger written = [self readFromDelegate:delegate into:output + writePos length:space];
+    // Missing packet
+    if (written == 0) {
+      if (!self.stopping) {
+        if (self.totalBuffers > 0) {
+          ++self.missedBuffers;
+          // Try up to kNumberBuffers - 1 times getting the data
+          // Until all audio queue buffers are played the playback won't stutter
+          if (retries < kNumberBuffers - 1) {
+            // The buffer stays ours until it is enqueued, so come back to it later instead of
+            // sleeping on the runner
+            UInt32 filled = writePos;
+            [self.runner run:^{
+              [self fillBuffer:inCompleteAQBuffer queue:inAQ writePos:filled retries:retries + 1];
+            } after:self.packetDuration / 2];
             return;
           }
-        } else {
-          return;
+          // Use PLC data if available
+          written = [self concealFromDelegate:delegate into:output + writePos length:space];
         }
-      }
-
-      if (data == [ZCCPlayer stopCookie]) {
-        if (self.stopping) {
+        // Play silence
+        if (written <= 0) {
+          memset(inCompleteAQBuffer->mAudioData, 0, (size_t)self.queueBufferSize);
+          inCompleteAQBuffer->mAudioDataByteSize = (UInt32)self.queueBufferSize;
+          AudioQueueEnqueueBuffer(inAQ, inCompleteAQBuffer, 0, NULL);
           return;
         }
-        [self stop];
-        break;
+      } else {
+        return;
       }
+    }
 
-      NSUInteger actual = MIN([data length], (NSUInteger)(self.queueBufferSize - writePos));
-      
-      // Save the tail
-      if (actual < [data length]) {
-        self->_tailSize = [data length] - actual;
-        memcpy(self->_tailBuffer, (unsigned char *)[data bytes] + actual, (size_t)self->_tailSize);
+    if (written == ZCCAudioReceiverEndOfStream) {
+      if (self.stopping) {
+        return;
       }
-
-      memcpy((unsigned char *)inCompleteAQBuffer->mAudioData + writePos, [data bytes], actual);
-      writePos += actual;
-    }
-    if (writePos == 0) {
-      return;
-    }
-    inCompleteAQBuffer->mAudioDataByteSize = writePos;
-    AudioQueueEnqueueBuffer(inAQ, inCompleteAQBuffer, 0, NULL);
-    
-    self.totalBuffers++;
-    self.totalPlayed += writePos;
-    [self saveLevel];
-    if (self.level > -1) {
-      self.overloadedBuffers++;
+      [self stop];
+      break;
     }
-  }];
+
+    writePos += (UInt32)written;
+  }
+  if (writePos == 0) {
+    return;
+  }
+  inCompleteAQBuffer->mAudioDataByteSize = writePos;
+  AudioQueueEnqueueBuffer(inAQ, inCompleteAQBuffer, 0, NULL);
+  
+  self.totalBuffers++;
+  self.totalPlayed += writePos;
+  [self saveLevel];
+  if (self.level > -1) {
+    self.overloadedBuffers++;
+  }
+}
+
+// Called on the runner. Returns the number of bytes written, 0 for a missing packet or ZCCAudioReceiverEndOfStream
+- (NSInteger)readFromDelegate:(id<ZCCAudioReceiverDelegate>)delegate into:(unsigned char *)buffer length:(NSUInteger)length {
+  // Use any tail first
+  if (_tailSize > 0) {
+    NSUInteger actual = MIN(_tailSize, length);
+    memcpy(buffer, _tailBuffer + _tailOffset, (size_t)actual);
+    _tailOffset += actual;
+    _tailSize -= actual;
+    return (NSInteger)actual;
+  }
+  // Decoder writes into the queue buffer itself and keeps its own overflow
+  if ([delegate respondsToSelector:@selector(receiver:decodeInto:length:)]) {
+    return [delegate receiver:self decodeInto:buffer length:length];
+  }
+  NSData *data = [delegate dataForReceiver:self];
+  if (!data || data.length == 0) {
+    return 0;
+  }
+  if (data == [ZCCPlayer stopCookie]) {
+    return ZCCAudioReceiverEndOfStream;
+  }
+  return [self copyData:data into:buffer length:length];
+}
+
+- (NSInteger)concealFromDelegate:(id<ZCCAudioReceiverDelegate>)delegate into:(unsigned char *)buffer length:(NSUInteger)length {
+  if ([delegate respondsToSelector:@selector(receiver:concealInto:length:)]) {
+    return [delegate receiver:self concealInto:buffer length:length];
+  }
+  NSData *data = [delegate PLCDataForReceiver:self];
+  if (!data || data.length == 0) {
+    return 0;
+  }
+  return [self copyData:data into:buffer length:length];
+}
+
+- (NSInteger)copyData:(NSData *)data into:(unsigned char *)buffer length:(NSUInteger)length {
+  NSUInteger actual = MIN(data.length, length);
+  // Save the tail, it is only written when the previous one has been used up
+  if (actual < data.length) {
+    _tailOffset = 0;
+    _tailSize = data.length - actual;
+    memcpy(_tailBuffer, (const unsigned char *)data.bytes + actual, (size_t)_tailSize);
+  }
+  memcpy(buffer, data.bytes, (size_t)actual);
+  return (NSInteger)actual;
 }
 
 - (void)handleQueueStopped:(AudioQueueRef)inAQ {
@@ -319,6 +354,7 @@ static void AQPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ, Audio
     self.bufferSize = 2 * self.samplesPerPacket * self->_streamDescription.mBytesPerFrame;
     self->_tailBuffer = (unsigned char *)malloc((size_t)self.bufferSize);
     self->_tailSize = 0;
+    self->_tailOffset = 0;
     self.totalPlayed = 0;
     self.missedBuffers = 0;
     self.totalBuffers = 0;
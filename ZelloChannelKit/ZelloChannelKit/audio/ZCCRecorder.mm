@@ -9,6 +9,7 @@
 #import <AVFoundation/AVFoundation.h>
 #import "ZCCRecorder.h"
 #import "ZCCAudioUtils.h"
+#import "ZCCBufferPool.h"
 #import "ZCCQueueRunner.h"
 #import "ZCCWeakReference.h"
 
@@ -26,6 +27,8 @@
 @property (atomic) NSUInteger nChannels;
 @property (atomic) NSUInteger totalRecorded;
 @property (atomic) NSUInteger totalSent;
+/// Buffers of bufferSize bytes, recycled once the encoder is done with them
+@property (atomic, strong) ZCCBufferPool *pool;
 
 /// Weak self reference, used in the audio queue callbacks
 @property (atomic, strong) ZCCWeakReference<id<ZCCInterruptableAudioEndpoint>> *selfRef;
@@ -132,7 +135,7 @@ static void AQInputPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ,
       self.offset += inBuffer->mAudioDataByteSize;
 
       if (self.offset >= self.bufferSize) {
-        [self.delegate audioSource:self didProduceData:[NSData dataWithBytes:self->_buffer length:(NSUInteger)self.bufferSize]];
+        [self.delegate audioSource:self didProduceData:[self.pool dataWithBytes:self->_buffer length:(NSUInteger)self.bufferSize]];
         self.totalSent += self.bufferSize;
         self.offset -= self.bufferSize;
         if (self.offset > 0) {
@@ -193,6 +196,7 @@ static void AQInputPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ,
     self.queueBufferSize = MAX(80u, self.bufferSize / 4);
 
     self->_buffer = (unsigned char *)malloc(2 * self.bufferSize);
+    self.pool = [[ZCCBufferPool alloc] initWithBufferLength:self.bufferSize preallocate:2];
     self.offset = 0;
     self.totalSent = 0;
     self.totalRecorded = 0;
@@ -279,7 +283,7 @@ static void AQInputPropertyChangedHandler(void *inUserData, AudioQueueRef inAQ,
     // zero ending bytes
     if (_buffer != NULL) {
       memset(_buffer + self.offset, 0, self.bufferSize - self.offset);
-      [self.delegate audioSource:self didProduceData:[NSData dataWithBytes:_buffer length:self.bufferSize]];
+      [self.delegate audioSource:self didProduceData:[self.pool dataWithBytes:_buffer length:self.bufferSize]];
       self.totalSent += self.bufferSize;
       self.offset = 0;
     }
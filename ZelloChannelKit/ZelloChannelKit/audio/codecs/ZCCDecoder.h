@@ -15,10 +15,12 @@
 @protocol ZCCDecoderDelegate <NSObject>
 
 /**
- * Pulls a packet of data from the decoder's source(?) Listener should return Player.stopCookie
- * if the source is finished.
+ * Pulls the next packet of data from the decoder's source, or nil if it hasn't arrived yet.
+ * A packet that later ones have already overtaken is only given up on when skipMissing is set,
+ * and comes back as -getMissingPacket. Listener should return Player.stopCookie if the source is
+ * finished. May be called on any thread, but never concurrently.
  */
-- (NSData *)dataForDecoder:(ZCCDecoder *)decoder;
+- (NSData *)dataForDecoder:(ZCCDecoder *)decoder skipMissing:(BOOL)skipMissing;
 - (void)decoderDidBecomeReady:(ZCCDecoder *)decoder;
 - (void)decoderDidStart:(ZCCDecoder *)decoder;
 - (void)decoderDidStop:(ZCCDecoder *)decoder;
@@ -42,6 +44,11 @@
 
 - (void)setPacketDuration:(NSUInteger)duration;
 - (NSData *)getMissingPacket;
+/**
+ * Called by the delegate whenever -dataForDecoder:skipMissing: has new packets (or the stop
+ * cookie) to hand out. Wakes up receivers that wait for -dataDidBecomeAvailable instead of polling.
+ */
+- (void)packetsAvailable;
 - (void)prepareAsync:(NSData *)header withPlaybackAmplifierGain:(NSInteger)gain;
 - (void)start;
 - (void)stop;
@@ -34,6 +34,13 @@ static NSData *missingPacket = [NSData dataWithBytesNoCopy:(unsigned char[]){0}
   return missingPacket;
 }
 
+- (void)packetsAvailable {
+  id<ZCCAudioReceiver> player = self.player;
+  if ([player respondsToSelector:@selector(dataDidBecomeAvailable)]) {
+    [player dataDidBecomeAvailable];
+  }
+}
+
 - (void)prepareAsync:(NSData *)header withPlaybackAmplifierGain:(NSInteger)gain {
   [self doesNotRecognizeSelector:_cmd];
 }
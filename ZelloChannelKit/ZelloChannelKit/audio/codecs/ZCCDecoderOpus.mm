@@ -10,43 +10,77 @@
 #import "ZCCDecoderOpus.h"
 #import "ZCCCodec.h"
 #import "ZCCErrors.h"
+#import "ZCCBufferPool.h"
 #import "ZCCPlayer.h"
+#import "ZCCWeakReference.h"
+
+// Runs on the decode-ahead worker. The decoder is only looked up on another queue: a reference
+// taken here could turn out to be the last one, and -dealloc can't stop the worker from the worker.
+static void DecodedAudioAvailable(void *context) {
+  ZCCWeakReference<ZCCDecoderOpus *> *selfRef = (__bridge ZCCWeakReference *)context;
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), ^{
+    id<ZCCAudioReceiver> player = selfRef.obj.player;
+    if ([player respondsToSelector:@selector(dataDidBecomeAvailable)]) {
+      [player dataDidBecomeAvailable];
+    }
+  });
+}
 
 @interface ZCCDecoderOpus () {
   NSInteger _gain;
-  short *_outBuffer;
+  // Nobody hears the stream at volume 0, so the worker only keeps time instead of decoding
+  BOOL _tracking;
+  // Audio handed out as NSData lives in pooled buffers, so receivers can keep it without a copy
+  ZCCBufferPool *_pcmPool;
+  // Handed to the worker, which can outlive our last strong reference until -dealloc stops it
+  ZCCWeakReference<ZCCDecoderOpus *> *_selfRef;
+  // Decode-ahead opus decoder. Set once in -prepareAsync:, before the player can read from it,
+  // and only freed in -dealloc, so the playback path reads it without taking decoderSync.
+  void *_decoder;
 }
 @property (atomic) NSInteger framesPerPacket;
 @property (atomic) NSInteger frameSize;
-@property (atomic) NSInteger counter;
-@property (atomic) NSInteger decoderId;
-@property (atomic) BOOL decodedLastPacket;
+@property (atomic) NSUInteger samplesPerPacket;
+@property (atomic) BOOL finished;
 @property (atomic, strong) NSObject *decoderSync;
+- (int)copyPacketForWorker:(unsigned char *)buffer length:(int)length urgent:(BOOL)urgent;
 @end
 
+// Runs on the decode-ahead worker whenever it has room for another packet. As in
+// DecodedAudioAvailable, the last reference to the decoder must not go away on the worker.
+static int PacketForWorker(void *context, unsigned char *buffer, int len, int urgent) {
+  ZCCWeakReference<ZCCDecoderOpus *> *selfRef = (__bridge ZCCWeakReference *)context;
+  ZCCDecoderOpus *decoder = selfRef.obj;
+  if (!decoder) {
+    return OPUS_AHEAD_WAIT;
+  }
+  int result = [decoder copyPacketForWorker:buffer length:len urgent:urgent != 0];
+  dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0), ^{
+    (void)decoder;
+  });
+  return result;
+}
+
 @implementation ZCCDecoderOpus
 
 - (instancetype)initWithPlayer:(ZCCPlayer *)player {
   self = [super initWithPlayer:player];
   if (self) {
-    self.decodedLastPacket = NO;
-    self.decoderId = 0;
+    self.finished = NO;
+    _decoder = NULL;
     self.decoderSync = [[NSObject alloc] init];
     _gain = 0;
-    _outBuffer = (short *)malloc(OPUS_MAX_DECODED_PACKET);
+    _pcmPool = [[ZCCBufferPool alloc] initWithBufferLength:OPUS_MAX_DECODED_PACKET preallocate:4];
+    _selfRef = [ZCCWeakReference weakReferenceToObject:self];
   }
   return self;
 }
 
 - (void)dealloc {
   @synchronized(self.decoderSync) {
-    if (self.decoderId > 0) {
-      decoder_opus_nativeStop((int32_t)self.decoderId);
-      self.decoderId = 0;
-    }
-    if (_outBuffer) {
-      free(_outBuffer);
-      _outBuffer = NULL;
+    if (_decoder) {
+      decoder_opus_aheadStop(_decoder);
+      _decoder = NULL;
     }
   }
 }
@@ -71,97 +105,85 @@
   @synchronized(self.decoderSync) {
     self.started = YES;
     _gain = gainIn;
-    self.decoderId = decoder_opus_nativeStart((unsigned char *)[header bytes], (int32_t)[header length]);
-    if (self.decoderId <= 0) {
+    _decoder = decoder_opus_aheadStart((unsigned char *)[header bytes], (int32_t)[header length], PacketForWorker, (__bridge void *)_selfRef, DecodedAudioAvailable, (__bridge void *)_selfRef);
+    if (!_decoder) {
       NSError *error = [NSError errorWithDomain:ZCCErrorDomain code:ZCCErrorCodeDecoderOpus userInfo:nil];
       [self.delegate decoder:self didEncounterError:error];
       return;
     }
-    decoder_opus_nativeSetGain((int32_t)self.decoderId, (int32_t)_gain);
-    sampleRate = decoder_opus_nativeGetSampleRate((int32_t)self.decoderId);
-    self.framesPerPacket = decoder_opus_nativeGetFramesInPacket((int32_t)self.decoderId);
-    self.frameSize = decoder_opus_nativeGetFrameSize((int32_t)self.decoderId);
+    decoder_opus_aheadSetGain(_decoder, (int32_t)_gain);
+    decoder_opus_aheadSetTracking(_decoder, _tracking ? 1 : 0);
+    sampleRate = decoder_opus_aheadGetSampleRate(_decoder);
+    self.framesPerPacket = decoder_opus_aheadGetFramesInPacket(_decoder);
+    self.frameSize = decoder_opus_aheadGetFrameSize(_decoder);
+    self.samplesPerPacket = (NSUInteger)(sampleRate * self.frameSize / 1000 * self.framesPerPacket);
   }
   [self.player prepareWith:1 sampleRate:sampleRate bitsPerSample:16 packetDuration:self.frameSize * self.framesPerPacket];
 }
 
-- (NSData *)dataForReceiver:(ZCCPlayer *)player {
-  NSData *data = nil;
-
-  id<ZCCDecoderDelegate> delegate = self.delegate;
-  while (self.started && data == nil) {
-    data = [delegate dataForDecoder:self];
-
-    if (data == nil || (NSNull *)data == [NSNull null]) {
-      return nil;
+/**
+ * Wakes up the worker, which takes the new packets as it has room for their audio, see
+ * -copyPacketForWorker:length:urgent:.
+ */
+- (void)packetsAvailable {
+  @synchronized(self.decoderSync) {
+    if (!_decoder || self.finished) {
+      return;
     }
+    decoder_opus_aheadNotify(_decoder);
+  }
+}
 
-    if (data == [ZCCPlayer stopCookie]) {
-      // Grab the last decoded packet (if any)
-      if (!self.decodedLastPacket) {
-        self.decodedLastPacket = YES;
-        NSInteger decoded = 0;
-        @synchronized(self.decoderSync) {
-          if (self.decoderId > 0) {
-            decoded = decoder_opus_nativeDecode((int32_t)self.decoderId, nil, 0, _outBuffer);
-            if (decoded > 0) {
-              return [NSData dataWithBytesNoCopy:_outBuffer length:(NSUInteger)decoded * 2 freeWhenDone:NO];
-            }
-          }
-        }
-      }
-      return data;
-    }
-    if (data.length == 0) {
-      return nil;
-    }
-    if (data.length == 1 && data == [self getMissingPacket]) {
-      // Lost packet
-      data = nil;
-      if (self.counter == 0) {
-        // Don't make use of compensation packets until at least
-        // one valid packet is received
-        continue;
-      }
-      // OPUS decoder generates compensation data when it
-      // receives null packet
-      return [self PLCDataForReceiver:player];
-    }
+/**
+ * Copies the next packet from our delegate into the worker's buffer. Packets stay in the
+ * delegate's jitter buffer until the worker has room for them, and a missing one is only given up
+ * on once playback has nothing else left, so late and reordered packets can still be put in place.
+ * Returns the packet length, 0 for a lost packet, OPUS_AHEAD_WAIT or OPUS_AHEAD_END.
+ */
+- (int)copyPacketForWorker:(unsigned char *)buffer length:(int)length urgent:(BOOL)urgent {
+  if (self.finished) {
+    return OPUS_AHEAD_END;
   }
-  if (!self.started) {
-    return nil;
+  NSData *data = [self.delegate dataForDecoder:self skipMissing:urgent];
+  if (data == nil || (NSNull *)data == [NSNull null]) {
+    return OPUS_AHEAD_WAIT;
   }
-  ++self.counter;
-  @try {
-    NSInteger decoded = 0;
-    @synchronized(self.decoderSync) {
-      if (self.decoderId > 0) {
-        decoded = decoder_opus_nativeDecode((int32_t)self.decoderId, (unsigned char *)[data bytes], (int32_t)data.length, _outBuffer);
-        if (decoded > 0) {
-          return [NSData dataWithBytesNoCopy:_outBuffer length:(NSUInteger)decoded * 2 freeWhenDone:NO];
-        }
-      }
-    }
-  } @catch (NSException *e) {
-    // What throws exceptions to here? -dataWithBytesNoCopy:length:freeWhenDone: isn't documented to...
-    NSDictionary *info = @{ZCCExceptionKey:e};
-    NSError *error = [NSError errorWithDomain:ZCCErrorDomain code:ZCCErrorCodeDecoderUnknown userInfo:info];
-    [delegate decoder:self didEncounterError:error];
+  if (data == [ZCCPlayer stopCookie]) {
+    // Worker flushes the decoder and the player sees the end once it has read everything
+    self.finished = YES;
+    return OPUS_AHEAD_END;
+  }
+  if (data == [self getMissingPacket] || data.length == 0 || data.length > (NSUInteger)length) {
+    // Lost packet, the worker generates compensation data for it
+    return 0;
   }
+  memcpy(buffer, data.bytes, data.length);
+  return (int)data.length;
+}
 
-  return nil;
+- (NSData *)dataForReceiver:(ZCCPlayer *)player {
+  return [self pooledAudioConcealing:NO];
 }
 
 - (NSData *)PLCDataForReceiver:(ZCCPlayer *)player {
+  return [self pooledAudioConcealing:YES];
+}
+
+/// One packet at a time, which is what receivers pulling NSData have always been given
+- (NSData *)pooledAudioConcealing:(BOOL)conceal {
   @try {
-    NSInteger decoded = 0;
-    @synchronized(self.decoderSync) {
-      if (self.decoderId > 0) {
-        decoded = decoder_opus_nativeDecode((int32_t)self.decoderId, NULL, 0, _outBuffer);
-        if (decoded > 0) {
-          return [NSData dataWithBytesNoCopy:_outBuffer length:(NSUInteger)decoded * 2 freeWhenDone:NO];
-        }
-      }
+    short *buffer = (short *)[_pcmPool acquireBuffer];
+    if (!buffer) {
+      return nil;
+    }
+    NSUInteger samples = MIN(self.samplesPerPacket, (NSUInteger)(OPUS_MAX_DECODED_PACKET / 2));
+    NSInteger decoded = conceal ? [self concealInto:buffer samples:samples] : [self decodeInto:buffer samples:samples];
+    if (decoded > 0) {
+      return [_pcmPool dataWithBuffer:buffer length:(NSUInteger)decoded * 2];
+    }
+    [_pcmPool releaseBuffer:buffer];
+    if (decoded == ZCCAudioReceiverEndOfStream && !conceal) {
+      return [ZCCPlayer stopCookie];
     }
   } @catch (NSException *e) {
     // What throws exceptions to here? -dataWithBytesNoCopy:length:freeWhenDone: isn't documented to...
@@ -169,9 +191,52 @@
     NSError *error = [NSError errorWithDomain:ZCCErrorDomain code:ZCCErrorCodeDecoderUnknown userInfo:info];
     [self.delegate decoder:self didEncounterError:error];
   }
+
   return nil;
 }
 
+- (NSInteger)receiver:(id<ZCCAudioReceiver>)receiver decodeInto:(void *)buffer length:(NSUInteger)length {
+  NSInteger decoded = [self decodeInto:(short *)buffer samples:length / 2];
+  return decoded > 0 ? decoded * 2 : decoded;
+}
+
+- (NSInteger)receiver:(id<ZCCAudioReceiver>)receiver concealInto:(void *)buffer length:(NSUInteger)length {
+  NSInteger concealed = [self concealInto:(short *)buffer samples:length / 2];
+  return concealed > 0 ? concealed * 2 : concealed;
+}
+
+/**
+ * Copies audio the worker has already decoded into buffer. Never decodes, waits or takes a lock, so
+ * it costs the playback path no more than the copy. Returns the number of samples written, 0 if the
+ * worker is behind, or ZCCAudioReceiverEndOfStream.
+ */
+- (NSInteger)decodeInto:(short *)buffer samples:(NSUInteger)samples {
+  if (!self.started || !_decoder) {
+    return 0;
+  }
+  NSInteger read = decoder_opus_aheadRead(_decoder, buffer, (int32_t)samples);
+  return read < 0 ? ZCCAudioReceiverEndOfStream : read;
+}
+
+/**
+ * Playback gave up waiting for the next packet. The worker conceals missing packets itself as
+ * soon as playback has read everything, so there is nothing to wait for here: this only picks up
+ * audio that came in since, and silence is played otherwise.
+ */
+- (NSInteger)concealInto:(short *)buffer samples:(NSUInteger)samples {
+  return [self decodeInto:buffer samples:samples];
+}
+
+- (void)setVolume:(NSInteger)volume {
+  [super setVolume:volume];
+  @synchronized(self.decoderSync) {
+    _tracking = volume <= 0;
+    if (_decoder) {
+      decoder_opus_aheadSetTracking(_decoder, _tracking ? 1 : 0);
+    }
+  }
+}
+
 - (void)setGain:(NSInteger)gain {
   @synchronized(self.decoderSync) {
     if (gain > 40) {
@@ -182,8 +247,8 @@
     }
     if (gain != _gain) {
       _gain = gain;
-      if (self.decoderId > 0) {
-        decoder_opus_nativeSetGain((int32_t)self.decoderId, (int32_t)_gain);
+      if (_decoder) {
+        decoder_opus_aheadSetGain(_decoder, (int32_t)_gain);
       }
     }
   }
@@ -29,6 +29,12 @@
 @property (atomic) NSUInteger frameSize;
 @property (atomic, strong) id<ZCCAudioSource> recorder;
 @property (atomic, weak) id<ZCCEncoderDelegate> delegate;
+/// Put in front of every packet handed to the delegate, so packets arrive ready to send. Set it
+/// before -prepareAsync:. At most 16 bytes.
+@property (atomic, copy) NSData *packetPrefix;
+/// Bytes left unwritten in front of the prefix, for the transport to frame packets in place. The
+/// delegate gets them as the start of every packet, in NSMutableData. Set it before -prepareAsync:.
+@property (atomic) NSUInteger packetHeadroom;
 
 @property (atomic, readonly) NSString *name;
 @property (atomic, readonly) NSData *header;
@@ -9,14 +9,39 @@
 #import "libopus.h"
 #import "ZCCEncoderOpus.h"
 #import "ZCCAudioSource.h"
+#import "ZCCBufferPool.h"
 #import "ZCCCodec.h"
+#import "ZCCWeakReference.h"
 
-@interface ZCCEncoderOpus ()
+@interface ZCCEncoderOpus () {
+  // Capture encoder, fed without a lock. Set in -prepareAsync: before the recorder starts and
+  // cleared in -audioSourceDidStop:, which runs on the same serial queue as the audio callbacks.
+  void *_encoder;
+  // Handed to the worker, which can outlive our last strong reference until the encoder is stopped
+  ZCCWeakReference<ZCCEncoderOpus *> *_selfRef;
+}
 @property (atomic) NSInteger gainInternal;
-@property (atomic) NSInteger encoderId;
 @property (atomic, strong) NSObject *encoderSync;
+// Packets are encoded straight into its buffers, sized in -prepareAsync:
+@property (nonatomic, strong) ZCCBufferPool *packetPool;
+- (void)deliverPacket:(unsigned char *)buffer length:(int)len last:(BOOL)last;
 @end
 
+// Runs on the capture encoder's worker, including once for the last packet while stopping
+static void CapturedPacketEncoded(void *context, unsigned char *buffer, int len, int latencyUs, int last) {
+  ZCCEncoderOpus *encoder = ((__bridge ZCCWeakReference *)context).obj;
+  if (encoder) {
+    [encoder deliverPacket:buffer length:len last:(last != 0)];
+    // Ours may be the last reference by now. -dealloc stops the worker, which can't be done from
+    // the worker itself, so the reference is let go on another queue.
+    dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+      (void)encoder;
+    });
+  } else if (buffer) {
+    buffer_pool_nativeRelease(buffer);
+  }
+}
+
 @implementation ZCCEncoderOpus
 @synthesize sampleRate;
 
@@ -50,12 +75,22 @@
     self.bitrate = ZCCEncoderOpus.defaultBitRate;
     self.gainInternal = 0;
     self.frameSize = ZCCEncoderOpus.defaultFrameSize;
-    self.encoderId = 0;
+    _encoder = NULL;
     self.encoderSync = [[NSObject alloc] init];
+    _selfRef = [ZCCWeakReference weakReferenceToObject:self];
   }
   return self;
 }
 
+- (void)dealloc {
+  @synchronized(self.encoderSync) {
+    if (_encoder) {
+      encoder_opus_captureStop(_encoder);
+      _encoder = NULL;
+    }
+  }
+}
+
 - (NSString *)getName {
   return ZCCCodecNameOpus;
 }
@@ -93,9 +128,16 @@
     self.framesPerPacket = maxFramesInPacket;
   }
 
+  NSData *prefix = self.packetPrefix;
+  NSUInteger headroom = self.packetHeadroom;
+  NSUInteger bufferLength = headroom + prefix.length + (NSUInteger)encoder_opus_nativeGetMaxPacketSize((int32_t)self.framesPerPacket);
+  if (self.packetPool.bufferLength != bufferLength) {
+    self.packetPool = [[ZCCBufferPool alloc] initWithBufferLength:bufferLength preallocate:4];
+  }
+
   @synchronized(self.encoderSync) {
-    self.encoderId = encoder_opus_nativeStart((int32_t)self.sampleRate, (int32_t)self.framesPerPacket, (int32_t)self.frameSize, (int32_t)self.bitrate, (int32_t)self.gainInternal);
-    if (self.encoderId <= 0) {
+    _encoder = encoder_opus_captureStart((int32_t)self.sampleRate, (int32_t)self.framesPerPacket, (int32_t)self.frameSize, (int32_t)self.bitrate, (int32_t)self.gainInternal, self.packetPool.nativePool, (int32_t)headroom, (const unsigned char *)prefix.bytes, (int32_t)prefix.length, CapturedPacketEncoded, (__bridge void *)_selfRef);
+    if (!_encoder) {
       [self.delegate encoderDidEncounterError:self];
       return;
     }
@@ -126,6 +168,11 @@
     gainIn = -40;
   }
   self.gainInternal = gainIn;
+  @synchronized(self.encoderSync) {
+    if (_encoder) {
+      encoder_opus_captureSetGain(_encoder, (int32_t)gainIn);
+    }
+  }
 }
 
 - (NSUInteger)getBufferSampleCount {
@@ -136,46 +183,39 @@
   return self.frameSize; // Doesn't work for 2.5 ms frames, but we intentionally don't support 2.5 ms frames
 }
 
-#pragma mark - ZCCRecorderDelegate
+#pragma mark - Capture encoder
 
-- (void)audioSource:(id<ZCCAudioSource>)source didProduceData:(NSData *)data {
-  NSInteger outlen = 0;
-  unsigned char *temp = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
-  @synchronized(self.encoderSync) {
-    if (self.encoderId <= 0) {
-      if (temp) {
-        free(temp);
-      }
-      return;
-    }
-    outlen = encoder_opus_nativeEncode((int32_t)self.encoderId, (short *)[data bytes], (int32_t)data.length / 2, temp, (int32_t)self.gainInternal);
-  }
+- (void)deliverPacket:(unsigned char *)buffer length:(int)len last:(BOOL)last {
   id<ZCCEncoderDelegate> delegate = self.delegate;
-  if (outlen > 0) {
-    [delegate encoder:self didProduceData:[NSData dataWithBytes:temp length:(NSUInteger)outlen]];
-  } else {
+  if (len > 0) {
+    // The data takes over the buffer the packet was encoded into, and the transport may write to it
+    [delegate encoder:self didProduceData:[self.packetPool mutableDataWithBuffer:buffer length:(NSUInteger)len]];
+  } else if (!last) {
     [delegate encoderDidEncounterError:self];
   }
-  if (temp) {
-    free(temp);
+}
+
+#pragma mark - ZCCRecorderDelegate
+
+- (void)audioSource:(id<ZCCAudioSource>)source didProduceData:(NSData *)data {
+  // Only copies into the encoder's ring, the worker encodes and delivers the packet
+  if (_encoder) {
+    encoder_opus_capturePush(_encoder, (short *)[data bytes], (int32_t)data.length / 2);
   }
 }
 
 - (void)audioSourceDidStop:(id<ZCCAudioSource>)source {
-  unsigned char *temp = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
-  NSInteger tail = 0;
-
+  void *encoder = NULL;
   @synchronized(self.encoderSync) {
-    if (self.encoderId > 0) {
-      tail = encoder_opus_nativeStop((int32_t)self.encoderId, temp);
-      self.encoderId = 0;
-    }
-  }
-  if (tail > 0) {
-    [self.delegate encoder:self didProduceData:[NSData dataWithBytes:temp length:(NSUInteger)tail]];
+    encoder = _encoder;
+    _encoder = NULL;
   }
-  if (temp) {
-    free(temp);
+  if (encoder) {
+#ifdef DEBUG
+    NSLog(@"[ZCC] Capture encoder max latency %d us, %d overruns", encoder_opus_captureGetMaxLatency(encoder), encoder_opus_captureGetOverruns(encoder));
+#endif
+    // Encodes what is left and delivers the last packet before returning
+    encoder_opus_captureStop(encoder);
   }
   [super audioSourceDidStop:source];
 }
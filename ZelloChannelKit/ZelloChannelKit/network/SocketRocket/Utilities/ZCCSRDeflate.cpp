@@ -0,0 +1,319 @@
+//
+//  ZCCSRDeflate.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCSRDeflate.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+namespace {
+
+// A sync flush ends with an empty stored block. RFC 7692 leaves it out of the message.
+const uint8_t FlushTail[4] = { 0x00, 0x00, 0xFF, 0xFF };
+const size_t MinBufferSize = 1024;
+const int MemLevel = 8;
+
+struct Buffer {
+    uint8_t *bytes;
+    size_t capacity;
+};
+
+bool grow(Buffer &buffer, size_t limit) {
+    size_t capacity = buffer.capacity ? buffer.capacity * 2 : MinBufferSize;
+    if (capacity > limit) {
+        capacity = limit;
+    }
+    if (capacity <= buffer.capacity) {
+        return false;
+    }
+    uint8_t *bytes = (uint8_t *)realloc(buffer.bytes, capacity);
+    if (!bytes) {
+        return false;
+    }
+    buffer.bytes = bytes;
+    buffer.capacity = capacity;
+    return true;
+}
+
+inline bool isSpace(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// Next `;` or `,` separated token with surrounding blanks removed
+const char *nextToken(const char *p, const char **start, size_t *length) {
+    while (isSpace(*p)) {
+        p++;
+    }
+    *start = p;
+    while (*p && *p != ';' && *p != ',') {
+        p++;
+    }
+    const char *end = p;
+    while (end > *start && isSpace(end[-1])) {
+        end--;
+    }
+    *length = (size_t)(end - *start);
+    return p;
+}
+
+bool tokenIs(const char *token, size_t length, const char *name) {
+    return strlen(name) == length && strncmp(token, name, length) == 0;
+}
+
+// Value of `name=value` or `name="value"`, -1 if missing or not a number
+int parseWindowBits(const char *value, size_t length) {
+    if (length >= 2 && value[0] == '"' && value[length - 1] == '"') {
+        value++;
+        length -= 2;
+    }
+    if (length == 0 || length > 2) {
+        return -1;
+    }
+    int bits = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (value[i] < '0' || value[i] > '9') {
+            return -1;
+        }
+        bits = bits * 10 + (value[i] - '0');
+    }
+    return bits;
+}
+
+}
+
+struct ZCCSRDeflate {
+    ZCCSRDeflateParameters parameters;
+    z_stream deflater;
+    z_stream inflater;
+    bool canCompress;
+    Buffer compressed;
+    Buffer inflated;
+};
+
+size_t ZCCSRDeflateWriteOffer(char *buffer, size_t capacity, uint8_t windowBits) {
+    int length;
+    if (windowBits >= ZCCSRDeflateMaxWindowBits) {
+        // Lets the server ask for a smaller client window
+        length = snprintf(buffer, capacity, "permessage-deflate; client_max_window_bits");
+    } else {
+        if (windowBits < ZCCSRDeflateMinWindowBits) {
+            windowBits = ZCCSRDeflateMinWindowBits;
+        }
+        length = snprintf(buffer, capacity, "permessage-deflate; client_max_window_bits=%d; server_max_window_bits=%d", windowBits, windowBits);
+    }
+    if (length < 0 || (size_t)length >= capacity) {
+        return 0;
+    }
+    return (size_t)length;
+}
+
+ZCCSRDeflateNegotiation ZCCSRDeflateParseResponse(const char *header, uint8_t windowBits, ZCCSRDeflateParameters *parameters) {
+    if (windowBits < ZCCSRDeflateMinWindowBits) {
+        windowBits = ZCCSRDeflateMinWindowBits;
+    } else if (windowBits > ZCCSRDeflateMaxWindowBits) {
+        windowBits = ZCCSRDeflateMaxWindowBits;
+    }
+    parameters->clientMaxWindowBits = windowBits;
+    parameters->serverMaxWindowBits = ZCCSRDeflateMaxWindowBits;
+    parameters->clientNoContextTakeover = false;
+    parameters->serverNoContextTakeover = false;
+
+    if (!header) {
+        return ZCCSRDeflateNegotiationDeclined;
+    }
+    const char *token;
+    size_t length;
+    const char *p = nextToken(header, &token, &length);
+    if (length == 0 && *p == '\0') {
+        return ZCCSRDeflateNegotiationDeclined;
+    }
+    if (!tokenIs(token, length, "permessage-deflate")) {
+        // Nothing else was offered
+        return ZCCSRDeflateNegotiationInvalid;
+    }
+
+    bool seenClientBits = false;
+    bool seenServerBits = false;
+    while (*p == ';') {
+        p = nextToken(p + 1, &token, &length);
+        const char *equals = (const char *)memchr(token, '=', length);
+        size_t nameLength = equals ? (size_t)(equals - token) : length;
+        while (nameLength > 0 && isSpace(token[nameLength - 1])) {
+            nameLength--;
+        }
+        const char *value = 0;
+        size_t valueLength = 0;
+        if (equals) {
+            value = equals + 1;
+            valueLength = length - (size_t)(value - token);
+            while (valueLength > 0 && isSpace(*value)) {
+                value++;
+                valueLength--;
+            }
+        }
+
+        if (tokenIs(token, nameLength, "client_no_context_takeover") && !equals && !parameters->clientNoContextTakeover) {
+            parameters->clientNoContextTakeover = true;
+        } else if (tokenIs(token, nameLength, "server_no_context_takeover") && !equals && !parameters->serverNoContextTakeover) {
+            parameters->serverNoContextTakeover = true;
+        } else if (tokenIs(token, nameLength, "client_max_window_bits") && equals && !seenClientBits) {
+            int bits = parseWindowBits(value, valueLength);
+            if (bits < 8 || bits > windowBits) {
+                return ZCCSRDeflateNegotiationInvalid;
+            }
+            // zlib can't compress with a 256 byte window, so such a server only gets uncompressed messages
+            parameters->clientMaxWindowBits = (uint8_t)bits;
+            seenClientBits = true;
+        } else if (tokenIs(token, nameLength, "server_max_window_bits") && equals && !seenServerBits) {
+            int bits = parseWindowBits(value, valueLength);
+            if (bits < 8 || bits > windowBits) {
+                return ZCCSRDeflateNegotiationInvalid;
+            }
+            parameters->serverMaxWindowBits = (uint8_t)bits;
+            seenServerBits = true;
+        } else {
+            return ZCCSRDeflateNegotiationInvalid;
+        }
+    }
+    if (*p != '\0') {
+        // A second extension, or permessage-deflate twice
+        return ZCCSRDeflateNegotiationInvalid;
+    }
+    return ZCCSRDeflateNegotiationAccepted;
+}
+
+ZCCSRDeflate *ZCCSRDeflateCreate(const ZCCSRDeflateParameters *parameters, int level) {
+    ZCCSRDeflate *context = (ZCCSRDeflate *)calloc(1, sizeof(ZCCSRDeflate));
+    if (!context) {
+        return 0;
+    }
+    context->parameters = *parameters;
+    // Any window up to 32 KB inflates what the server sends
+    if (inflateInit2(&context->inflater, -ZCCSRDeflateMaxWindowBits) != Z_OK) {
+        free(context);
+        return 0;
+    }
+    context->canCompress = parameters->clientMaxWindowBits >= ZCCSRDeflateMinWindowBits &&
+        deflateInit2(&context->deflater, level, Z_DEFLATED, -(int)parameters->clientMaxWindowBits, MemLevel, Z_DEFAULT_STRATEGY) == Z_OK;
+    return context;
+}
+
+void ZCCSRDeflateDestroy(ZCCSRDeflate *context) {
+    if (!context) {
+        return;
+    }
+    if (context->canCompress) {
+        deflateEnd(&context->deflater);
+    }
+    inflateEnd(&context->inflater);
+    free(context->compressed.bytes);
+    free(context->inflated.bytes);
+    free(context);
+}
+
+bool ZCCSRDeflateCompress(ZCCSRDeflate *context, const uint8_t *bytes, size_t length, const uint8_t **output, size_t *outputLength) {
+    // Nothing to gain for an empty message
+    if (!context->canCompress || length == 0 || length > UINT_MAX) {
+        return false;
+    }
+    z_stream &z = context->deflater;
+    Buffer &buffer = context->compressed;
+    z.next_in = (Bytef *)bytes;
+    z.avail_in = (uInt)length;
+
+    size_t used = 0;
+    for (;;) {
+        if (used == buffer.capacity && !grow(buffer, (size_t)UINT_MAX)) {
+            // Throwing away the history only means later messages can't refer to it
+            deflateReset(&z);
+            return false;
+        }
+        z.next_out = buffer.bytes + used;
+        z.avail_out = (uInt)(buffer.capacity - used);
+        int result = deflate(&z, Z_SYNC_FLUSH);
+        used = buffer.capacity - z.avail_out;
+        if (result != Z_OK && result != Z_BUF_ERROR) {
+            deflateReset(&z);
+            return false;
+        }
+        // Room left over means the flush is complete
+        if (z.avail_in == 0 && z.avail_out > 0) {
+            break;
+        }
+    }
+
+    if (used < sizeof(FlushTail) || memcmp(buffer.bytes + used - sizeof(FlushTail), FlushTail, sizeof(FlushTail)) != 0) {
+        deflateReset(&z);
+        return false;
+    }
+    if (context->parameters.clientNoContextTakeover) {
+        deflateReset(&z);
+    }
+    *output = buffer.bytes;
+    *outputLength = used - sizeof(FlushTail);
+    return true;
+}
+
+ZCCSRDeflateResult ZCCSRDeflateDecompress(ZCCSRDeflate *context, const uint8_t *bytes, size_t length, size_t maxLength, const uint8_t **output, size_t *outputLength) {
+    if (length > UINT_MAX) {
+        return ZCCSRDeflateResultTooBig;
+    }
+    z_stream &z = context->inflater;
+    Buffer &buffer = context->inflated;
+    // One byte past the limit tells a message that is too big from one that fits exactly
+    size_t limit = maxLength < (size_t)UINT_MAX ? maxLength + 1 : (size_t)UINT_MAX;
+
+    size_t used = 0;
+    bool ended = false;
+    for (int part = 0; part < 2 && !ended; part++) {
+        z.next_in = part == 0 ? (Bytef *)bytes : (Bytef *)FlushTail;
+        z.avail_in = part == 0 ? (uInt)length : (uInt)sizeof(FlushTail);
+        for (;;) {
+            if (used == buffer.capacity && !grow(buffer, limit)) {
+                inflateReset(&z);
+                return used >= limit ? ZCCSRDeflateResultTooBig : ZCCSRDeflateResultInvalid;
+            }
+            z.next_out = buffer.bytes + used;
+            z.avail_out = (uInt)(buffer.capacity - used);
+            int result = inflate(&z, Z_SYNC_FLUSH);
+            used = buffer.capacity - z.avail_out;
+            if (used > maxLength) {
+                inflateReset(&z);
+                return ZCCSRDeflateResultTooBig;
+            }
+            if (result == Z_STREAM_END) {
+                // The server ended the stream with a final block; whatever follows starts a new one
+                ended = true;
+                break;
+            }
+            if (result != Z_OK && result != Z_BUF_ERROR) {
+                inflateReset(&z);
+                return ZCCSRDeflateResultInvalid;
+            }
+            if (z.avail_in == 0 && z.avail_out > 0) {
+                break;
+            }
+        }
+    }
+
+    if (ended && !context->parameters.serverNoContextTakeover) {
+        // Keep the window, the next message may still refer to it
+        Bytef window[1 << ZCCSRDeflateMaxWindowBits];
+        uInt windowLength = sizeof(window);
+        inflateGetDictionary(&z, window, &windowLength);
+        inflateReset(&z);
+        inflateSetDictionary(&z, window, windowLength);
+    } else if (ended || context->parameters.serverNoContextTakeover) {
+        inflateReset(&z);
+    }
+    *output = buffer.bytes;
+    *outputLength = used;
+    return ZCCSRDeflateResultOK;
+}
@@ -0,0 +1,94 @@
+//
+//  ZCCSRDeflate.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCSRDeflate_h
+#define ZCCSRDeflate_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// permessage-deflate (RFC 7692) negotiation and message compression on top of zlib
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    ZCCSRDeflateRsv = 0x40,     // RSV1 marks the first frame of a compressed message
+    ZCCSRDeflateMinWindowBits = 9,
+    ZCCSRDeflateMaxWindowBits = 15
+};
+
+typedef struct {
+    uint8_t clientMaxWindowBits;    // Window our compressor may use
+    uint8_t serverMaxWindowBits;    // Window the server compresses with
+    bool clientNoContextTakeover;
+    bool serverNoContextTakeover;
+} ZCCSRDeflateParameters;
+
+typedef enum {
+    ZCCSRDeflateNegotiationDeclined = 0,
+    ZCCSRDeflateNegotiationAccepted,
+    ZCCSRDeflateNegotiationInvalid
+} ZCCSRDeflateNegotiation;
+
+typedef enum {
+    ZCCSRDeflateResultOK = 0,
+    ZCCSRDeflateResultInvalid,
+    ZCCSRDeflateResultTooBig
+} ZCCSRDeflateResult;
+
+/**
+ Write the Sec-WebSocket-Extensions offer as a NUL terminated string.
+
+ @param windowBits Largest window, between `ZCCSRDeflateMinWindowBits` and `ZCCSRDeflateMaxWindowBits`,
+                   for both directions. The server may pick smaller ones.
+
+ @return The offer length, or 0 if it doesn't fit.
+ */
+size_t ZCCSRDeflateWriteOffer(char *buffer, size_t capacity, uint8_t windowBits);
+
+/**
+ Check the server's Sec-WebSocket-Extensions response against the offer.
+
+ @param header NUL terminated header value, or NULL if the server sent none.
+ */
+ZCCSRDeflateNegotiation ZCCSRDeflateParseResponse(const char *header, uint8_t windowBits, ZCCSRDeflateParameters *parameters);
+
+typedef struct ZCCSRDeflate ZCCSRDeflate;
+
+/**
+ Compression state of one connection. Not thread safe.
+
+ @param level zlib compression level, 1-9, or -1 for the default.
+ */
+ZCCSRDeflate *ZCCSRDeflateCreate(const ZCCSRDeflateParameters *parameters, int level);
+void ZCCSRDeflateDestroy(ZCCSRDeflate *context);
+
+/**
+ Compress a whole message.
+
+ @param output Set to the compressed payload, which stays valid until the next call to compress.
+
+ @return false if the message should be sent uncompressed instead.
+ */
+bool ZCCSRDeflateCompress(ZCCSRDeflate *context, const uint8_t *bytes, size_t length, const uint8_t **output, size_t *outputLength);
+
+/**
+ Decompress a whole message.
+
+ @param maxLength Messages that inflate to more than this are rejected.
+ @param output    Set to the message, which stays valid until the next call to decompress.
+ */
+ZCCSRDeflateResult ZCCSRDeflateDecompress(ZCCSRDeflate *context, const uint8_t *bytes, size_t length, size_t maxLength, const uint8_t **output, size_t *outputLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCSRDeflate_h */
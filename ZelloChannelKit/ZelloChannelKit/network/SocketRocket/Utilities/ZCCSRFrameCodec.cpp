@@ -0,0 +1,408 @@
+//
+//  ZCCSRFrameCodec.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCSRFrameCodec.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define ZCCSR_MASK_VECTOR_SIZE 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ZCCSR_MASK_VECTOR_SIZE 16
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ZCCSR_MASK_VECTOR_SIZE 16
+#endif
+
+namespace {
+
+const uint8_t FinMask = 0x80;
+const uint8_t RsvMask = 0x70;
+const uint8_t OpCodeMask = 0x0F;
+const uint8_t MaskMask = 0x80;
+const uint8_t PayloadLenMask = 0x7F;
+
+enum ParserState : uint8_t {
+    ParserStateHeader = 0,
+    ParserStatePayload,
+    ParserStateFailed
+};
+
+inline bool isKnownOpcode(uint8_t opcode) {
+    return opcode <= 0x2 || (opcode >= 0x8 && opcode <= 0xA);
+}
+
+// Mask key repeated over a word, rotated so its first byte applies to the byte at `offset`
+inline uint64_t maskWord(const uint8_t *maskKey, size_t offset) {
+    uint8_t key[sizeof(uint64_t)];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = maskKey[(offset + i) & 3];
+    }
+    uint64_t word;
+    memcpy(&word, key, sizeof(word));
+    return word;
+}
+
+inline void maskCopyWord(uint8_t *dst, const uint8_t *src, uint64_t key) {
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    word ^= key;
+    memcpy(dst, &word, sizeof(word));
+}
+
+// dst and src are either the same buffer or don't overlap
+size_t maskCopy(uint8_t *dst, const uint8_t *src, size_t length, const uint8_t *maskKey, size_t offset) {
+    size_t i = 0;
+    size_t head = (size_t)(0 - (uintptr_t)dst) & (sizeof(uint64_t) - 1);
+    if (head > length) {
+        head = length;
+    }
+    for (; i < head; i++) {
+        dst[i] = src[i] ^ maskKey[(offset + i) & 3];
+    }
+    // From here on dst is word aligned and the key lines up with it
+    uint64_t key = maskWord(maskKey, offset + i);
+
+#ifdef ZCCSR_MASK_VECTOR_SIZE
+    for (; i + sizeof(uint64_t) <= length && ((uintptr_t)(dst + i) & (ZCCSR_MASK_VECTOR_SIZE - 1)) != 0; i += sizeof(uint64_t)) {
+        maskCopyWord(dst + i, src + i, key);
+    }
+#if defined(__AVX2__)
+    const __m256i keyVector = _mm256_set1_epi64x((long long)key);
+    for (; i + ZCCSR_MASK_VECTOR_SIZE <= length; i += ZCCSR_MASK_VECTOR_SIZE) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_store_si256((__m256i *)(dst + i), _mm256_xor_si256(v, keyVector));
+    }
+#elif defined(__SSE2__)
+    const __m128i keyVector = _mm_set1_epi64x((long long)key);
+    // Two vectors per iteration keep both load ports busy
+    for (; i + 2 * ZCCSR_MASK_VECTOR_SIZE <= length; i += 2 * ZCCSR_MASK_VECTOR_SIZE) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(src + i + ZCCSR_MASK_VECTOR_SIZE));
+        _mm_store_si128((__m128i *)(dst + i), _mm_xor_si128(v0, keyVector));
+        _mm_store_si128((__m128i *)(dst + i + ZCCSR_MASK_VECTOR_SIZE), _mm_xor_si128(v1, keyVector));
+    }
+    for (; i + ZCCSR_MASK_VECTOR_SIZE <= length; i += ZCCSR_MASK_VECTOR_SIZE) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_store_si128((__m128i *)(dst + i), _mm_xor_si128(v, keyVector));
+    }
+#else
+    const uint8x16_t keyVector = vreinterpretq_u8_u64(vdupq_n_u64(key));
+    for (; i + 2 * ZCCSR_MASK_VECTOR_SIZE <= length; i += 2 * ZCCSR_MASK_VECTOR_SIZE) {
+        uint8x16_t v0 = vld1q_u8(src + i);
+        uint8x16_t v1 = vld1q_u8(src + i + ZCCSR_MASK_VECTOR_SIZE);
+        vst1q_u8(dst + i, veorq_u8(v0, keyVector));
+        vst1q_u8(dst + i + ZCCSR_MASK_VECTOR_SIZE, veorq_u8(v1, keyVector));
+    }
+    for (; i + ZCCSR_MASK_VECTOR_SIZE <= length; i += ZCCSR_MASK_VECTOR_SIZE) {
+        vst1q_u8(dst + i, veorq_u8(vld1q_u8(src + i), keyVector));
+    }
+#endif
+#endif
+
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        maskCopyWord(dst + i, src + i, key);
+    }
+    for (; i < length; i++) {
+        dst[i] = src[i] ^ maskKey[(offset + i) & 3];
+    }
+    return (offset + length) & 3;
+}
+
+inline ZCCSRFrameEvent fail(ZCCSRFrameParser *parser, ZCCSRFrameError error) {
+    parser->error = error;
+    parser->state = ParserStateFailed;
+    return ZCCSRFrameEventError;
+}
+
+}
+
+const char *ZCCSRFrameErrorDescription(ZCCSRFrameError error) {
+    switch (error) {
+        case ZCCSRFrameErrorNone:
+            return "";
+        case ZCCSRFrameErrorReservedBits:
+            return "Server used RSV bits";
+        case ZCCSRFrameErrorUnknownOpcode:
+            return "Unknown opcode";
+        case ZCCSRFrameErrorUnexpectedContinuation:
+            return "cannot continue a message";
+        case ZCCSRFrameErrorExpectedContinuation:
+            return "all data frames after the initial data frame must have opcode 0";
+        case ZCCSRFrameErrorFragmentedControl:
+            return "Fragmented control frames not allowed";
+        case ZCCSRFrameErrorControlTooBig:
+            return "Control frames cannot have payloads larger than 125 bytes";
+        case ZCCSRFrameErrorMasked:
+            return "Client must receive unmasked data";
+        case ZCCSRFrameErrorUnmasked:
+            return "Server must receive masked data";
+        case ZCCSRFrameErrorLengthTooBig:
+            return "Frame is too big";
+    }
+    return "Invalid frame";
+}
+
+bool ZCCSRFrameIsControlOpcode(uint8_t opcode) {
+    return (opcode & 0x8) != 0;
+}
+
+size_t ZCCSRFrameHeaderLength(const uint8_t *bytes) {
+    size_t length = ZCCSRFrameMinHeaderLength;
+    uint8_t payloadLength = bytes[1] & PayloadLenMask;
+    if (payloadLength == 126) {
+        length += sizeof(uint16_t);
+    } else if (payloadLength == 127) {
+        length += sizeof(uint64_t);
+    }
+    if (bytes[1] & MaskMask) {
+        length += 4;
+    }
+    return length;
+}
+
+size_t ZCCSRFrameParseHeader(const uint8_t *bytes, size_t length, ZCCSRFrameHeader *header) {
+    if (length < ZCCSRFrameMinHeaderLength) {
+        return 0;
+    }
+    size_t headerLength = ZCCSRFrameHeaderLength(bytes);
+    if (length < headerLength) {
+        return 0;
+    }
+
+    header->fin = (bytes[0] & FinMask) != 0;
+    header->rsv = bytes[0] & RsvMask;
+    header->opcode = bytes[0] & OpCodeMask;
+    header->masked = (bytes[1] & MaskMask) != 0;
+    header->headerLength = (uint8_t)headerLength;
+
+    size_t offset = ZCCSRFrameMinHeaderLength;
+    uint64_t payloadLength = bytes[1] & PayloadLenMask;
+    if (payloadLength == 126) {
+        payloadLength = ((uint64_t)bytes[2] << 8) | bytes[3];
+        offset += sizeof(uint16_t);
+    } else if (payloadLength == 127) {
+        payloadLength = 0;
+        for (size_t i = 0; i < sizeof(uint64_t); i++) {
+            payloadLength = (payloadLength << 8) | bytes[offset + i];
+        }
+        offset += sizeof(uint64_t);
+    }
+    header->payloadLength = payloadLength;
+
+    if (header->masked) {
+        memcpy(header->maskKey, bytes + offset, sizeof(header->maskKey));
+    } else {
+        memset(header->maskKey, 0, sizeof(header->maskKey));
+    }
+    return headerLength;
+}
+
+ZCCSRFrameError ZCCSRFrameCheckHeader(const ZCCSRFrameHeader *header, uint8_t messageOpcode, bool fromServer, uint8_t allowedRsv) {
+    if (header->rsv & ~allowedRsv) {
+        return ZCCSRFrameErrorReservedBits;
+    }
+    if (!isKnownOpcode(header->opcode)) {
+        return ZCCSRFrameErrorUnknownOpcode;
+    }
+    if (header->masked == fromServer) {
+        return fromServer ? ZCCSRFrameErrorMasked : ZCCSRFrameErrorUnmasked;
+    }
+    // The most significant bit of a 64-bit length must be 0
+    if ((header->payloadLength >> 63) != 0 || (uint64_t)(size_t)header->payloadLength != header->payloadLength) {
+        return ZCCSRFrameErrorLengthTooBig;
+    }
+    if (ZCCSRFrameIsControlOpcode(header->opcode)) {
+        if (!header->fin) {
+            return ZCCSRFrameErrorFragmentedControl;
+        }
+        if (header->payloadLength > ZCCSRFrameMaxControlPayloadLength) {
+            return ZCCSRFrameErrorControlTooBig;
+        }
+        return ZCCSRFrameErrorNone;
+    }
+    if (header->opcode == 0 && messageOpcode == 0) {
+        return ZCCSRFrameErrorUnexpectedContinuation;
+    }
+    if (header->opcode != 0 && messageOpcode != 0) {
+        return ZCCSRFrameErrorExpectedContinuation;
+    }
+    return ZCCSRFrameErrorNone;
+}
+
+size_t ZCCSRFrameHeaderSize(uint64_t payloadLength, bool masked) {
+    size_t size = ZCCSRFrameMinHeaderLength;
+    if (payloadLength > UINT16_MAX) {
+        size += sizeof(uint64_t);
+    } else if (payloadLength >= 126) {
+        size += sizeof(uint16_t);
+    }
+    if (masked) {
+        size += 4;
+    }
+    return size;
+}
+
+size_t ZCCSRFrameWriteHeader(uint8_t *buffer, bool fin, uint8_t rsv, uint8_t opcode, uint64_t payloadLength, const uint8_t *maskKey) {
+    buffer[0] = (fin ? FinMask : 0) | (rsv & RsvMask) | (opcode & OpCodeMask);
+    buffer[1] = maskKey ? MaskMask : 0;
+
+    size_t length = ZCCSRFrameMinHeaderLength;
+    if (payloadLength < 126) {
+        buffer[1] |= (uint8_t)payloadLength;
+    } else if (payloadLength <= UINT16_MAX) {
+        buffer[1] |= 126;
+        buffer[2] = (uint8_t)(payloadLength >> 8);
+        buffer[3] = (uint8_t)payloadLength;
+        length += sizeof(uint16_t);
+    } else {
+        buffer[1] |= 127;
+        for (size_t i = 0; i < sizeof(uint64_t); i++) {
+            buffer[length + i] = (uint8_t)(payloadLength >> (8 * (sizeof(uint64_t) - 1 - i)));
+        }
+        length += sizeof(uint64_t);
+    }
+
+    if (maskKey) {
+        memcpy(buffer + length, maskKey, 4);
+        length += 4;
+    }
+    return length;
+}
+
+size_t ZCCSRFrameMask(uint8_t *bytes, size_t length, const uint8_t *maskKey, size_t offset) {
+    return maskCopy(bytes, bytes, length, maskKey, offset);
+}
+
+size_t ZCCSRFrameMaskCopy(uint8_t *dst, const uint8_t *src, size_t length, const uint8_t *maskKey, size_t offset) {
+    return maskCopy(dst, src, length, maskKey, offset);
+}
+
+size_t ZCCSRFrameWriteControl(uint8_t *buffer, uint8_t opcode, const uint8_t *payload, size_t length, const uint8_t *maskKey) {
+    if (length > ZCCSRFrameMaxControlPayloadLength) {
+        return 0;
+    }
+    size_t headerLength = ZCCSRFrameWriteHeader(buffer, true, 0, opcode, length, maskKey);
+    if (length > 0) {
+        if (maskKey) {
+            maskCopy(buffer + headerLength, payload, length, maskKey, 0);
+        } else {
+            memcpy(buffer + headerLength, payload, length);
+        }
+    }
+    return headerLength + length;
+}
+
+size_t ZCCSRFrameWriteClose(uint8_t *buffer, uint16_t code, const char *reason, size_t reasonLength, const uint8_t *maskKey) {
+    uint8_t payload[ZCCSRFrameMaxControlPayloadLength];
+    payload[0] = (uint8_t)(code >> 8);
+    payload[1] = (uint8_t)code;
+
+    size_t maxReasonLength = sizeof(payload) - sizeof(uint16_t);
+    if (!reason) {
+        reasonLength = 0;
+    } else if (reasonLength > maxReasonLength) {
+        // Don't leave half of a character behind
+        reasonLength = maxReasonLength;
+        while (reasonLength > 0 && ((uint8_t)reason[reasonLength] & 0xC0) == 0x80) {
+            reasonLength--;
+        }
+    }
+    if (reasonLength > 0) {
+        memcpy(payload + sizeof(uint16_t), reason, reasonLength);
+    }
+    return ZCCSRFrameWriteControl(buffer, 0x8, payload, sizeof(uint16_t) + reasonLength, maskKey);
+}
+
+bool ZCCSRFrameCloseCodeIsValid(int code) {
+    if (code >= 1000 && code <= 1011) {
+        return code != 1004 && code != 1005 && code != 1006;
+    }
+    return code >= 3000 && code <= 4999;
+}
+
+void ZCCSRFrameParserInit(ZCCSRFrameParser *parser, bool fromServer, uint8_t allowedRsv) {
+    memset(parser, 0, sizeof(*parser));
+    parser->fromServer = fromServer;
+    parser->allowedRsv = allowedRsv;
+    parser->state = ParserStateHeader;
+}
+
+ZCCSRFrameEvent ZCCSRFrameParserFeed(ZCCSRFrameParser *parser, uint8_t *bytes, size_t length, size_t *consumed, uint8_t **payload, size_t *payloadLength) {
+    *consumed = 0;
+    if (parser->state == ParserStateFailed) {
+        return ZCCSRFrameEventError;
+    }
+
+    if (parser->state == ParserStatePayload) {
+        if (parser->remaining == 0) {
+            const ZCCSRFrameHeader &header = parser->header;
+            if (!ZCCSRFrameIsControlOpcode(header.opcode)) {
+                parser->messageOpcode = header.fin ? 0 : (header.opcode ? header.opcode : parser->messageOpcode);
+            }
+            parser->state = ParserStateHeader;
+            return ZCCSRFrameEventEnd;
+        }
+        if (length == 0) {
+            return ZCCSRFrameEventNone;
+        }
+        size_t n = parser->remaining < length ? (size_t)parser->remaining : length;
+        if (parser->header.masked) {
+            parser->maskOffset = ZCCSRFrameMask(bytes, n, parser->header.maskKey, parser->maskOffset);
+        }
+        parser->remaining -= n;
+        *consumed = n;
+        *payload = bytes;
+        *payloadLength = n;
+        return ZCCSRFrameEventPayload;
+    }
+
+    size_t headerLength = 0;
+    if (parser->buffered == 0) {
+        // Usually the whole header is there and is decoded straight from the input
+        headerLength = ZCCSRFrameParseHeader(bytes, length, &parser->header);
+        if (headerLength == 0) {
+            memcpy(parser->buffer, bytes, length);
+            parser->buffered = (uint8_t)length;
+            *consumed = length;
+            return ZCCSRFrameEventNone;
+        }
+        *consumed = headerLength;
+    } else {
+        size_t used = 0;
+        while (used < length) {
+            size_t needed = parser->buffered < ZCCSRFrameMinHeaderLength ? (size_t)ZCCSRFrameMinHeaderLength : ZCCSRFrameHeaderLength(parser->buffer);
+            size_t n = needed - parser->buffered;
+            if (n > length - used) {
+                n = length - used;
+            }
+            memcpy(parser->buffer + parser->buffered, bytes + used, n);
+            parser->buffered += (uint8_t)n;
+            used += n;
+            headerLength = ZCCSRFrameParseHeader(parser->buffer, parser->buffered, &parser->header);
+            if (headerLength) {
+                break;
+            }
+        }
+        *consumed = used;
+        if (headerLength == 0) {
+            return ZCCSRFrameEventNone;
+        }
+        parser->buffered = 0;
+    }
+
+    ZCCSRFrameError error = ZCCSRFrameCheckHeader(&parser->header, parser->messageOpcode, parser->fromServer, parser->allowedRsv);
+    if (error != ZCCSRFrameErrorNone) {
+        return fail(parser, error);
+    }
+    parser->remaining = parser->header.payloadLength;
+    parser->maskOffset = 0;
+    parser->state = ParserStatePayload;
+    return ZCCSRFrameEventHeader;
+}
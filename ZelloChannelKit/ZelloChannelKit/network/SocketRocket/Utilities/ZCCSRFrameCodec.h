@@ -0,0 +1,175 @@
+//
+//  ZCCSRFrameCodec.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCSRFrameCodec_h
+#define ZCCSRFrameCodec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// RFC 6455 frame encoding and decoding on plain byte spans. Nothing here allocates or
+// depends on Foundation, so it builds for any platform and frames can be parsed in place.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    ZCCSRFrameMinHeaderLength = 2,
+    ZCCSRFrameMaxHeaderLength = 14,
+    ZCCSRFrameMaxControlPayloadLength = 125,
+    ZCCSRFrameMaxControlFrameLength = ZCCSRFrameMaxHeaderLength + ZCCSRFrameMaxControlPayloadLength
+};
+
+typedef struct {
+    bool fin;
+    uint8_t rsv;                // RSV1-3 as they appear in the first byte
+    uint8_t opcode;             // 0 for continuation frames
+    bool masked;
+    uint8_t maskKey[4];
+    uint8_t headerLength;
+    uint64_t payloadLength;
+} ZCCSRFrameHeader;
+
+typedef enum {
+    ZCCSRFrameErrorNone = 0,
+    ZCCSRFrameErrorReservedBits,
+    ZCCSRFrameErrorUnknownOpcode,
+    ZCCSRFrameErrorUnexpectedContinuation,
+    ZCCSRFrameErrorExpectedContinuation,
+    ZCCSRFrameErrorFragmentedControl,
+    ZCCSRFrameErrorControlTooBig,
+    ZCCSRFrameErrorMasked,
+    ZCCSRFrameErrorUnmasked,
+    ZCCSRFrameErrorLengthTooBig
+} ZCCSRFrameError;
+
+/**
+ Human readable reason for closing the connection with a protocol error.
+ */
+const char *ZCCSRFrameErrorDescription(ZCCSRFrameError error);
+
+bool ZCCSRFrameIsControlOpcode(uint8_t opcode);
+
+/**
+ Length of the whole header, as announced by its first two bytes.
+ */
+size_t ZCCSRFrameHeaderLength(const uint8_t *bytes);
+
+/**
+ Decode a frame header.
+
+ @return The header length, or 0 if `length` bytes don't hold the whole header yet.
+ */
+size_t ZCCSRFrameParseHeader(const uint8_t *bytes, size_t length, ZCCSRFrameHeader *header);
+
+/**
+ Protocol checks for a received frame header.
+
+ @param header        The decoded header.
+ @param messageOpcode Opcode of the fragmented message in progress, 0 if there is none.
+ @param fromServer    YES on the client side, where payloads must not be masked.
+ @param allowedRsv    RSV bits that a negotiated extension has given a meaning to.
+ */
+ZCCSRFrameError ZCCSRFrameCheckHeader(const ZCCSRFrameHeader *header, uint8_t messageOpcode, bool fromServer, uint8_t allowedRsv);
+
+/**
+ Space needed for the header of a frame with this payload.
+ */
+size_t ZCCSRFrameHeaderSize(uint64_t payloadLength, bool masked);
+
+/**
+ Encode a frame header.
+
+ @param buffer  Must have room for `ZCCSRFrameHeaderSize()` bytes.
+ @param rsv     RSV bits as they appear in the first byte, 0 unless an extension uses them.
+ @param maskKey Four byte key, or NULL for an unmasked frame.
+
+ @return The header length.
+ */
+size_t ZCCSRFrameWriteHeader(uint8_t *buffer, bool fin, uint8_t rsv, uint8_t opcode, uint64_t payloadLength, const uint8_t *maskKey);
+
+/**
+ XOR bytes with a mask key in place. Masking and unmasking are the same operation.
+
+ @param offset Number of payload bytes already masked with this key, so a payload can be masked in pieces.
+
+ @return The offset to pass for the next piece.
+ */
+size_t ZCCSRFrameMask(uint8_t *bytes, size_t length, const uint8_t *maskKey, size_t offset);
+
+/**
+ Copy and mask in a single pass. `dst` and `src` must not overlap.
+
+ @return The offset to pass for the next piece.
+ */
+size_t ZCCSRFrameMaskCopy(uint8_t *dst, const uint8_t *src, size_t length, const uint8_t *maskKey, size_t offset);
+
+/**
+ Encode a whole control frame.
+
+ @param buffer Must have room for `ZCCSRFrameMaxControlFrameLength` bytes.
+
+ @return The frame length, or 0 if the payload is longer than a control frame allows.
+ */
+size_t ZCCSRFrameWriteControl(uint8_t *buffer, uint8_t opcode, const uint8_t *payload, size_t length, const uint8_t *maskKey);
+
+/**
+ Encode a close frame. A UTF-8 reason that doesn't fit is cut at a character boundary.
+
+ @param buffer Must have room for `ZCCSRFrameMaxControlFrameLength` bytes.
+
+ @return The frame length.
+ */
+size_t ZCCSRFrameWriteClose(uint8_t *buffer, uint16_t code, const char *reason, size_t reasonLength, const uint8_t *maskKey);
+
+bool ZCCSRFrameCloseCodeIsValid(int code);
+
+typedef enum {
+    ZCCSRFrameEventNone = 0,    // All input was consumed, feed more
+    ZCCSRFrameEventHeader,      // A new frame started, see `header`
+    ZCCSRFrameEventPayload,     // Part of the payload, pointing into the input and already unmasked
+    ZCCSRFrameEventEnd,         // The frame is complete
+    ZCCSRFrameEventError        // The stream is invalid, see `error`. The parser stays failed.
+} ZCCSRFrameEvent;
+
+/**
+ Incremental frame parser. Embed it anywhere and set it up with `ZCCSRFrameParserInit()`;
+ fields may be read but are only written by the parser.
+ */
+typedef struct {
+    ZCCSRFrameHeader header;    // Frame being parsed
+    ZCCSRFrameError error;
+    uint8_t messageOpcode;      // Fragmented message in progress, 0 if none
+    bool fromServer;
+    uint8_t allowedRsv;
+    uint8_t state;
+    uint8_t buffered;
+    uint8_t buffer[ZCCSRFrameMaxHeaderLength];
+    uint64_t remaining;
+    size_t maskOffset;
+} ZCCSRFrameParser;
+
+void ZCCSRFrameParserInit(ZCCSRFrameParser *parser, bool fromServer, uint8_t allowedRsv);
+
+/**
+ Parse the next piece of the stream. Call it again with the rest of the input until it
+ returns `ZCCSRFrameEventNone`; it can report the end of an empty frame without consuming anything.
+
+ @param bytes         Received bytes. Masked payloads are unmasked in place.
+ @param consumed      Set to the number of bytes used from `bytes`.
+ @param payload       Set for `ZCCSRFrameEventPayload`.
+ @param payloadLength Set for `ZCCSRFrameEventPayload`.
+ */
+ZCCSRFrameEvent ZCCSRFrameParserFeed(ZCCSRFrameParser *parser, uint8_t *bytes, size_t length, size_t *consumed, uint8_t **payload, size_t *payloadLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCSRFrameCodec_h */
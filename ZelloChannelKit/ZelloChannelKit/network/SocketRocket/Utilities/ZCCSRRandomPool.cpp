@@ -0,0 +1,133 @@
+//
+//  ZCCSRRandomPool.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCSRRandomPool.h"
+
+#include <string.h>
+
+namespace {
+
+// "expand 32-byte k"
+const uint32_t Sigma[4] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+const size_t BlockSize = 64;
+
+inline uint32_t rotl(uint32_t value, int count) {
+    return (value << count) | (value >> (32 - count));
+}
+
+inline void quarterRound(uint32_t *x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = rotl(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = rotl(x[b] ^ x[c], 7);
+}
+
+inline uint32_t load32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline void store32(uint8_t *p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+// RFC 7539 block function
+void chachaBlock(const uint32_t key[8], uint32_t counter, const uint32_t nonce[3], uint8_t *output) {
+    uint32_t input[16];
+    memcpy(input, Sigma, sizeof(Sigma));
+    memcpy(input + 4, key, 8 * sizeof(uint32_t));
+    input[12] = counter;
+    input[13] = nonce[0];
+    input[14] = nonce[1];
+    input[15] = nonce[2];
+
+    uint32_t x[16];
+    memcpy(x, input, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        quarterRound(x, 0, 4, 8, 12);
+        quarterRound(x, 1, 5, 9, 13);
+        quarterRound(x, 2, 6, 10, 14);
+        quarterRound(x, 3, 7, 11, 15);
+        quarterRound(x, 0, 5, 10, 15);
+        quarterRound(x, 1, 6, 11, 12);
+        quarterRound(x, 2, 7, 8, 13);
+        quarterRound(x, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < 16; i++) {
+        store32(output + 4 * i, x[i] + input[i]);
+    }
+}
+
+void wipe(void *bytes, size_t length) {
+    // Keep the compiler from dropping stores to memory that isn't read again
+    volatile uint8_t *p = (volatile uint8_t *)bytes;
+    while (length--) {
+        *p++ = 0;
+    }
+}
+
+void refill(ZCCSRRandomPool *pool) {
+    // Every refill runs under a new key, so the counter and nonce can always start at zero
+    static const uint32_t nonce[3] = { 0, 0, 0 };
+    for (uint32_t block = 0; block < ZCCSRRandomPoolBlocks; block++) {
+        chachaBlock(pool->key, block, nonce, pool->buffer + block * BlockSize);
+    }
+    for (int i = 0; i < 8; i++) {
+        pool->key[i] = load32(pool->buffer + 4 * i);
+    }
+    wipe(pool->buffer, ZCCSRRandomPoolSeedLength);
+    pool->position = ZCCSRRandomPoolSeedLength;
+}
+
+}
+
+void ZCCSRRandomPoolInit(ZCCSRRandomPool *pool) {
+    memset(pool, 0, sizeof(*pool));
+    pool->position = ZCCSRRandomPoolBufferSize;
+}
+
+void ZCCSRRandomPoolSeed(ZCCSRRandomPool *pool, uint8_t *seed) {
+    for (int i = 0; i < 8; i++) {
+        pool->key[i] = load32(seed + 4 * i);
+    }
+    wipe(seed, ZCCSRRandomPoolSeedLength);
+    wipe(pool->buffer, sizeof(pool->buffer));
+    pool->position = ZCCSRRandomPoolBufferSize;
+    pool->generated = 0;
+    pool->seeded = true;
+}
+
+bool ZCCSRRandomPoolNeedsSeed(const ZCCSRRandomPool *pool) {
+    return !pool->seeded || pool->generated >= ZCCSRRandomPoolReseedInterval;
+}
+
+bool ZCCSRRandomPoolRead(ZCCSRRandomPool *pool, uint8_t *bytes, size_t length) {
+    if (ZCCSRRandomPoolNeedsSeed(pool)) {
+        return false;
+    }
+    pool->generated += length;
+    while (length > 0) {
+        if (pool->position == ZCCSRRandomPoolBufferSize) {
+            refill(pool);
+        }
+        size_t available = ZCCSRRandomPoolBufferSize - pool->position;
+        size_t count = length < available ? length : available;
+        memcpy(bytes, pool->buffer + pool->position, count);
+        wipe(pool->buffer + pool->position, count);
+        pool->position += count;
+        bytes += count;
+        length -= count;
+    }
+    return true;
+}
+
+void ZCCSRRandomPoolWipe(ZCCSRRandomPool *pool) {
+    wipe(pool, sizeof(*pool));
+    pool->position = ZCCSRRandomPoolBufferSize;
+}
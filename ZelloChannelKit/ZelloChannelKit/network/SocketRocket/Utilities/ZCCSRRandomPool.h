@@ -0,0 +1,72 @@
+//
+//  ZCCSRRandomPool.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCSRRandomPool_h
+#define ZCCSRRandomPool_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Buffered ChaCha20 generator for frame mask keys. The system RNG only provides the seed;
+// keys are then handed out from a keystream refilled in bulk, with no system call per frame.
+//
+// Each refill replaces the ChaCha20 key with the first 32 bytes it generates, and bytes are
+// wiped as soon as they're handed out, so a captured state reveals nothing already used.
+// A fresh seed is required after `ZCCSRRandomPoolReseedInterval` bytes of output.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    ZCCSRRandomPoolSeedLength = 32,
+    ZCCSRRandomPoolBlocks = 16,             // ChaCha20 blocks generated per refill
+    ZCCSRRandomPoolBufferSize = ZCCSRRandomPoolBlocks * 64
+};
+
+#define ZCCSRRandomPoolReseedInterval (1024 * 1024)
+
+/**
+ Embed it anywhere and set it up with `ZCCSRRandomPoolInit()`. Not thread safe.
+ */
+typedef struct {
+    uint32_t key[8];
+    uint8_t buffer[ZCCSRRandomPoolBufferSize];
+    size_t position;            // Next unused byte in `buffer`
+    size_t generated;           // Bytes handed out since the last seed
+    bool seeded;
+} ZCCSRRandomPool;
+
+/**
+ The pool starts out unseeded.
+ */
+void ZCCSRRandomPoolInit(ZCCSRRandomPool *pool);
+
+/**
+ Key the generator with `ZCCSRRandomPoolSeedLength` bytes from the system RNG, which are wiped
+ afterwards. Any buffered output is discarded.
+ */
+void ZCCSRRandomPoolSeed(ZCCSRRandomPool *pool, uint8_t *seed);
+
+bool ZCCSRRandomPoolNeedsSeed(const ZCCSRRandomPool *pool);
+
+/**
+ @return false, without writing anything, if the pool needs a seed first.
+ */
+bool ZCCSRRandomPoolRead(ZCCSRRandomPool *pool, uint8_t *bytes, size_t length);
+
+/**
+ Erase the key and buffered output. The pool needs a seed again afterwards.
+ */
+void ZCCSRRandomPoolWipe(ZCCSRRandomPool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCSRRandomPool_h */
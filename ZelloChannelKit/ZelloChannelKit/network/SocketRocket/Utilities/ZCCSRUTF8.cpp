@@ -0,0 +1,126 @@
+//
+//  ZCCSRUTF8.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCSRUTF8.h"
+
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+const uint8_t ContinuationLower = 0x80;
+const uint8_t ContinuationUpper = 0xBF;
+
+// Index of the first byte at or after `i` that isn't ASCII, or `length`
+inline size_t skipASCII(const uint8_t *bytes, size_t i, size_t length) {
+#if defined(__AVX2__)
+    for (; i + 32 <= length; i += 32) {
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)(bytes + i)));
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#elif defined(__SSE2__)
+    for (; i + 32 <= length; i += 32) {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(bytes + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(bytes + i + 16));
+        unsigned mask = (unsigned)_mm_movemask_epi8(v0) | ((unsigned)_mm_movemask_epi8(v1) << 16);
+        if (mask != 0) {
+            return i + (size_t)__builtin_ctz(mask);
+        }
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 32 <= length; i += 32) {
+        uint8x16_t v = vorrq_u8(vld1q_u8(bytes + i), vld1q_u8(bytes + i + 16));
+        if (vmaxvq_u8(v) >= 0x80) {
+            break;
+        }
+    }
+#endif
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            break;
+        }
+    }
+    while (i < length && bytes[i] < 0x80) {
+        i++;
+    }
+    return i;
+}
+
+}
+
+void ZCCSRUTF8StateInit(ZCCSRUTF8State *state) {
+    state->needed = 0;
+    state->lower = ContinuationLower;
+    state->upper = ContinuationUpper;
+}
+
+bool ZCCSRUTF8Validate(ZCCSRUTF8State *state, const uint8_t *bytes, size_t length) {
+    uint8_t needed = state->needed;
+    uint8_t lower = state->lower;
+    uint8_t upper = state->upper;
+
+    size_t i = 0;
+    while (i < length) {
+        if (needed == 0) {
+            // Most text frames are JSON, which is mostly ASCII
+            if (bytes[i] < 0x80) {
+                i = skipASCII(bytes, i + 1, length);
+                continue;
+            }
+            uint8_t lead = bytes[i++];
+            lower = ContinuationLower;
+            upper = ContinuationUpper;
+            if (lead >= 0xC2 && lead <= 0xDF) {
+                needed = 1;
+            } else if (lead >= 0xE0 && lead <= 0xEF) {
+                needed = 2;
+                if (lead == 0xE0) {
+                    lower = 0xA0;       // Overlong
+                } else if (lead == 0xED) {
+                    upper = 0x9F;       // Surrogates
+                }
+            } else if (lead >= 0xF0 && lead <= 0xF4) {
+                needed = 3;
+                if (lead == 0xF0) {
+                    lower = 0x90;       // Overlong
+                } else if (lead == 0xF4) {
+                    upper = 0x8F;       // Above U+10FFFF
+                }
+            } else {
+                return false;
+            }
+        } else {
+            uint8_t b = bytes[i++];
+            if (b < lower || b > upper) {
+                return false;
+            }
+            needed--;
+            lower = ContinuationLower;
+            upper = ContinuationUpper;
+        }
+    }
+
+    state->needed = needed;
+    state->lower = lower;
+    state->upper = upper;
+    return true;
+}
+
+bool ZCCSRUTF8IsComplete(const ZCCSRUTF8State *state) {
+    return state->needed == 0;
+}
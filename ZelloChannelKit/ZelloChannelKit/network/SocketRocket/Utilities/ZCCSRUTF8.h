@@ -0,0 +1,48 @@
+//
+//  ZCCSRUTF8.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCSRUTF8_h
+#define ZCCSRUTF8_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Progress of an incremental UTF-8 validation, so a text message can be checked piece by piece
+ as its frames arrive without rescanning anything.
+ */
+typedef struct {
+    uint8_t needed;             // Continuation bytes still expected for the current character
+    uint8_t lower;              // Range allowed for the next continuation byte
+    uint8_t upper;
+} ZCCSRUTF8State;
+
+void ZCCSRUTF8StateInit(ZCCSRUTF8State *state);
+
+/**
+ Validate the next piece of a UTF-8 string. A character may be split between pieces.
+
+ @return NO as soon as the bytes can't be part of valid UTF-8. Overlong forms, surrogates and
+         code points above U+10FFFF are rejected.
+ */
+bool ZCCSRUTF8Validate(ZCCSRUTF8State *state, const uint8_t *bytes, size_t length);
+
+/**
+ Whether the string validated so far doesn't end in the middle of a character.
+ */
+bool ZCCSRUTF8IsComplete(const ZCCSRUTF8State *state);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCSRUTF8_h */
@@ -0,0 +1,91 @@
+//
+//  ZCCSRWriteBuffer.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCSRWriteBuffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const size_t MinCapacity = 4096;
+// An empty buffer bigger than this is freed, so one large message doesn't pin its memory
+const size_t RetainedCapacity = 64 * 1024;
+
+}
+
+void ZCCSRWriteBufferInit(ZCCSRWriteBuffer *buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void ZCCSRWriteBufferDestroy(ZCCSRWriteBuffer *buffer) {
+    free(buffer->bytes);
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+uint8_t *ZCCSRWriteBufferReserve(ZCCSRWriteBuffer *buffer, size_t length) {
+    if (buffer->capacity - buffer->end >= length) {
+        return buffer->bytes + buffer->end;
+    }
+
+    size_t pending = buffer->end - buffer->start;
+    if (length > SIZE_MAX - pending) {
+        return 0;
+    }
+    if (buffer->capacity - pending >= length) {
+        // The stream lags behind by only a little, moving it to the front is enough
+        memmove(buffer->bytes, buffer->bytes + buffer->start, pending);
+    } else {
+        size_t capacity = buffer->capacity > MinCapacity ? buffer->capacity : MinCapacity;
+        while (capacity < pending + length) {
+            capacity = capacity <= SIZE_MAX / 2 ? capacity * 2 : pending + length;
+        }
+        uint8_t *bytes = (uint8_t *)malloc(capacity);
+        if (!bytes) {
+            return 0;
+        }
+        if (pending > 0) {
+            memcpy(bytes, buffer->bytes + buffer->start, pending);
+        }
+        free(buffer->bytes);
+        buffer->bytes = bytes;
+        buffer->capacity = capacity;
+    }
+    buffer->start = 0;
+    buffer->end = pending;
+    return buffer->bytes + buffer->end;
+}
+
+void ZCCSRWriteBufferCommit(ZCCSRWriteBuffer *buffer, size_t length) {
+    buffer->end += length;
+}
+
+bool ZCCSRWriteBufferAppend(ZCCSRWriteBuffer *buffer, const uint8_t *bytes, size_t length) {
+    uint8_t *space = ZCCSRWriteBufferReserve(buffer, length);
+    if (!space) {
+        return false;
+    }
+    if (length > 0) {
+        memcpy(space, bytes, length);
+    }
+    ZCCSRWriteBufferCommit(buffer, length);
+    return true;
+}
+
+void ZCCSRWriteBufferConsume(ZCCSRWriteBuffer *buffer, size_t length) {
+    buffer->start += length;
+    if (buffer->start < buffer->end) {
+        return;
+    }
+    buffer->start = 0;
+    buffer->end = 0;
+    if (buffer->capacity > RetainedCapacity) {
+        free(buffer->bytes);
+        buffer->bytes = 0;
+        buffer->capacity = 0;
+    }
+}
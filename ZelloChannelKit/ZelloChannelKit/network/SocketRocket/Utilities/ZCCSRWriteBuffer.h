@@ -0,0 +1,67 @@
+//
+//  ZCCSRWriteBuffer.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCSRWriteBuffer_h
+#define ZCCSRWriteBuffer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Contiguous queue of outgoing bytes. Frames are assembled directly at its end and everything
+// pending goes to the stream in a single write, however many frames have queued up.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Embed it anywhere and set it up with `ZCCSRWriteBufferInit()`; fields may be read but are
+ only written by the functions below.
+ */
+typedef struct {
+    uint8_t *bytes;
+    size_t capacity;
+    size_t start;               // First byte not yet written to the stream
+    size_t end;                 // End of the queued bytes
+} ZCCSRWriteBuffer;
+
+void ZCCSRWriteBufferInit(ZCCSRWriteBuffer *buffer);
+void ZCCSRWriteBufferDestroy(ZCCSRWriteBuffer *buffer);
+
+/**
+ Room for `length` more bytes at the end of the queue. Nothing is queued until `ZCCSRWriteBufferCommit()`.
+
+ @return NULL if the memory can't be allocated.
+ */
+uint8_t *ZCCSRWriteBufferReserve(ZCCSRWriteBuffer *buffer, size_t length);
+
+/**
+ Queue `length` bytes written to the space returned by `ZCCSRWriteBufferReserve()`.
+ */
+void ZCCSRWriteBufferCommit(ZCCSRWriteBuffer *buffer, size_t length);
+
+bool ZCCSRWriteBufferAppend(ZCCSRWriteBuffer *buffer, const uint8_t *bytes, size_t length);
+
+/**
+ Drop bytes the stream has accepted from the front of the queue.
+ */
+void ZCCSRWriteBufferConsume(ZCCSRWriteBuffer *buffer, size_t length);
+
+static inline const uint8_t *ZCCSRWriteBufferPendingBytes(const ZCCSRWriteBuffer *buffer) {
+    return buffer->bytes + buffer->start;
+}
+
+static inline size_t ZCCSRWriteBufferPendingLength(const ZCCSRWriteBuffer *buffer) {
+    return buffer->end - buffer->start;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCSRWriteBuffer_h */
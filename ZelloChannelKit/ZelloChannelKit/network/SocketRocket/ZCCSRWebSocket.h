@@ -57,6 +57,11 @@ extern NSString *const ZCCSRWebSocketErrorDomain;
  */
 extern NSString *const ZCCSRHTTPResponseErrorKey;
 
+/**
+ Room that `sendDataInPlace:headroom:error:` needs in front of the payload for the frame header.
+ */
+extern NSUInteger const ZCCSRWebSocketFrameHeadroom;
+
 @protocol ZCCSRWebSocketDelegate;
 
 ///--------------------------------------
@@ -122,6 +127,18 @@ extern NSString *const ZCCSRHTTPResponseErrorKey;
  */
 @property (nonatomic, assign, readonly) BOOL allowsUntrustedSSLCertificates;
 
+/**
+ Offer the permessage-deflate extension (RFC 7692) when connecting. If the server accepts it, text messages
+ are compressed both ways; binary messages are always sent as they are. Must be set before calling `open`.
+ */
+@property (nonatomic, assign) BOOL compressionEnabled;
+
+/**
+ Largest compression window to offer, from 9 (512 bytes) to 15 (32 KB, the default). A smaller window
+ saves memory on both ends at some cost in compression. Must be set before calling `open`.
+ */
+@property (nonatomic, assign) NSUInteger compressionWindowBits;
+
 ///--------------------------------------
 #pragma mark - Constructors
 ///--------------------------------------
@@ -306,6 +323,22 @@ extern NSString *const ZCCSRHTTPResponseErrorKey;
  */
 - (BOOL)sendDataNoCopy:(nullable NSData *)data error:(NSError **)error NS_SWIFT_NAME(send(dataNoCopy:));
 
+/**
+ Send binary data that was built behind room for the frame header. The header is written into that room and
+ the payload is masked where it is. When nothing is waiting to go out ahead of it, the frame is written to the
+ stream straight from the buffer; only what the stream doesn't take right away is copied. The socket takes over
+ the buffer, which is modified and must not be used again.
+
+ @param buffer   `headroom` bytes, followed by the data to send.
+ @param headroom At least `ZCCSRWebSocketFrameHeadroom`.
+ @param error On input, a pointer to variable for an `NSError` object.
+ If an error occurs, this pointer is set to an `NSError` object containing information about the error.
+ You may specify `nil` to ignore the error information.
+
+ @return `YES` if the data was scheduled to send, otherwise - `NO`.
+ */
+- (BOOL)sendDataInPlace:(NSMutableData *)buffer headroom:(NSUInteger)headroom error:(NSError **)error NS_SWIFT_NAME(send(dataInPlace:headroom:));
+
 /**
  Send Ping message to the server with optional data.
 
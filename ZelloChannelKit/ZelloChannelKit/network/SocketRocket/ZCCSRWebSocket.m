@@ -11,14 +11,6 @@
 
 #import "ZCCSRWebSocket.h"
 
-#if TARGET_OS_IPHONE
-#define HAS_ICU
-#endif
-
-#ifdef HAS_ICU
-#import <unicode/utf8.h>
-#endif
-
 #import <os/lock.h>
 
 #import "ZCCSRDelegateController.h"
@@ -35,7 +27,11 @@
 #import "ZCCSRRandom.h"
 #import "ZCCSRLog.h"
 #import "ZCCSRMutex.h"
-#import "ZCCSRSIMDHelpers.h"
+#import "ZCCSRFrameCodec.h"
+#import "ZCCSRUTF8.h"
+#import "ZCCSRDeflate.h"
+#import "ZCCSRWriteBuffer.h"
+#import "ZCCSRRandomPool.h"
 #import "NSURLRequest+ZCCSRWebSocketPrivate.h"
 #import "NSRunLoop+ZCCSRWebSocketPrivate.h"
 #import "ZCCSRConstants.h"
@@ -50,24 +46,16 @@ __attribute__((used)) static void importCategories(void)
     import_NSRunLoop_ZCCSRWebSocket();
 }
 
-typedef struct {
-    BOOL fin;
-    //  BOOL rsv1;
-    //  BOOL rsv2;
-    //  BOOL rsv3;
-    uint8_t opcode;
-    BOOL masked;
-    uint64_t payload_length;
-} frame_header;
-
 static NSString *const SRWebSocketAppendToSecKeyString = @"258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
-static inline int32_t validate_dispatch_data_partial_string(NSData *data);
-
 static uint8_t const SRWebSocketProtocolVersion = 13;
 
+// Bound on what a compressed message may inflate to
+static size_t const SRMaxInflatedMessageLength = 16 * 1024 * 1024;
+
 NSString *const ZCCSRWebSocketErrorDomain = @"SRWebSocketErrorDomain";
 NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
+NSUInteger const ZCCSRWebSocketFrameHeadroom = ZCCSRFrameMaxHeaderLength;
 
 @interface ZCCSRWebSocket ()  <NSStreamDelegate>
 
@@ -96,14 +84,18 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     dispatch_data_t _readBuffer;
     NSUInteger _readBufferOffset;
 
-    dispatch_data_t _outputBuffer;
-    NSUInteger _outputBufferOffset;
+    ZCCSRWriteBuffer _outputBuffer;
+    ZCCSRRandomPool _maskKeyPool;
 
     uint8_t _currentFrameOpcode;
     size_t _currentFrameCount;
     size_t _readOpCount;
-    uint32_t _currentStringScanPosition;
+    ZCCSRUTF8State _currentStringState;
     NSMutableData *_currentFrameData;
+    BOOL _currentMessageCompressed;
+
+    // Set once the server has accepted permessage-deflate
+    ZCCSRDeflate *_deflate;
 
     NSString *_closeReason;
 
@@ -127,6 +119,7 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     int _closeCode;
 
     BOOL _isPumping;
+    BOOL _isWritingScheduled;
 
     NSMutableSet<NSArray *> *_scheduledRunloops; // Set<[RunLoop, Mode]>. TODO: (nlutsenko) Fix clowntown
 
@@ -159,6 +152,7 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     _requestRequiresSSL = ZCCSRURLRequiresSSL(_url);
 
     _readyState = SR_CONNECTING;
+    _compressionWindowBits = ZCCSRDeflateMaxWindowBits;
 
     _propertyLock = OS_UNFAIR_LOCK_INIT;
     _kvoLock = ZCCSRMutexInitRecursive();
@@ -170,7 +164,8 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     _delegateController = [[ZCCSRDelegateController alloc] init];
 
     _readBuffer = dispatch_data_empty;
-    _outputBuffer = dispatch_data_empty;
+    ZCCSRWriteBufferInit(&_outputBuffer);
+    ZCCSRRandomPoolInit(&_maskKeyPool);
 
     _currentFrameData = [[NSMutableData alloc] init];
 
@@ -267,6 +262,10 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
         _receivedHTTPHeaders = NULL;
     }
 
+    ZCCSRDeflateDestroy(_deflate);
+    ZCCSRWriteBufferDestroy(&_outputBuffer);
+    ZCCSRRandomPoolWipe(&_maskKeyPool);
+
     ZCCSRMutexDestroy(_kvoLock);
 }
 
@@ -410,6 +409,21 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
         _protocol = negotiatedProtocol;
     }
 
+    NSString *extensions = CFBridgingRelease(CFHTTPMessageCopyHeaderFieldValue(_receivedHTTPHeaders, CFSTR("Sec-WebSocket-Extensions")));
+    if (extensions) {
+        ZCCSRDeflateParameters parameters;
+        ZCCSRDeflateNegotiation negotiation = ZCCSRDeflateParseResponse(extensions.UTF8String, (uint8_t)_compressionWindowBits, &parameters);
+        if (negotiation == ZCCSRDeflateNegotiationInvalid || (negotiation == ZCCSRDeflateNegotiationAccepted && !_compressionEnabled)) {
+            NSError *error = ZCCSRErrorWithCodeDescription(2133, @"Server specified Sec-WebSocket-Extensions that weren't requested.");
+            [self _failWithError:error];
+            return;
+        }
+        if (negotiation == ZCCSRDeflateNegotiationAccepted) {
+            // zlib's default level, messages are short enough for the extra effort to cost only microseconds
+            _deflate = ZCCSRDeflateCreate(&parameters, -1);
+        }
+    }
+
     self.readyState = SR_OPEN;
 
     if (!_didFail) {
@@ -455,6 +469,16 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
                                                           self.requestCookies,
                                                           _requestedProtocols);
 
+    if (_compressionEnabled) {
+        char offer[128];
+        uint8_t windowBits = (uint8_t)MIN(MAX(_compressionWindowBits, (NSUInteger)ZCCSRDeflateMinWindowBits), (NSUInteger)ZCCSRDeflateMaxWindowBits);
+        if (ZCCSRDeflateWriteOffer(offer, sizeof(offer), windowBits) > 0) {
+            CFStringRef value = CFStringCreateWithCString(kCFAllocatorDefault, offer, kCFStringEncodingASCII);
+            CFHTTPMessageSetHeaderFieldValue(message, CFSTR("Sec-WebSocket-Extensions"), value);
+            CFRelease(value);
+        }
+    }
+
     NSData *messageData = CFBridgingRelease(CFHTTPMessageCopySerializedMessage(message));
 
     CFRelease(message);
@@ -581,15 +605,16 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
 {
     [self assertOnWorkQueue];
 
+    // Once closeConnection was called, the streams close as soon as what is already queued is
+    // written, so anything sent later is dropped rather than queued behind the close frame
     if (_closeWhenFinishedWriting) {
         return;
     }
 
-    __block NSData *strongData = data;
-    dispatch_data_t newData = dispatch_data_create(data.bytes, data.length, nil, ^{
-        strongData = nil;
-    });
-    _outputBuffer = dispatch_data_create_concat(_outputBuffer, newData);
+    if (!ZCCSRWriteBufferAppend(&_outputBuffer, (const uint8_t *)data.bytes, data.length)) {
+        [self closeWithCode:ZCCSRStatusCodeMessageTooBig reason:@"Message too big"];
+        return;
+    }
     [self _pumpWriting];
 }
 
@@ -651,6 +676,32 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
     return YES;
 }
 
+- (BOOL)sendDataInPlace:(NSMutableData *)buffer headroom:(NSUInteger)headroom error:(NSError **)error
+{
+    if (headroom < ZCCSRWebSocketFrameHeadroom || buffer.length < headroom) {
+        NSString *message = @"Invalid Argument: Not enough room for the frame header in `sendDataInPlace:headroom:error:`.";
+        if (error) {
+            *error = ZCCSRErrorWithCodeDescription(2147, message);
+        }
+        ZCCSRDebugLog(message);
+        return NO;
+    }
+
+    if (self.readyState != SR_OPEN) {
+        NSString *message = @"Invalid State: Cannot call `sendDataInPlace:headroom:error:` until connection is open.";
+        if (error) {
+            *error = ZCCSRErrorWithCodeDescription(2134, message);
+        }
+        ZCCSRDebugLog(message);
+        return NO;
+    }
+
+    dispatch_async(_workQueue, ^{
+        [self _sendFrameInPlace:buffer headroom:headroom];
+    });
+    return YES;
+}
+
 - (BOOL)sendPing:(nullable NSData *)data error:(NSError **)error
 {
     if (self.readyState != SR_OPEN) {
@@ -693,31 +744,6 @@ NSString *const ZCCSRHTTPResponseErrorKey = @"HTTPResponseStatusCode";
 }
 
 
-static inline BOOL closeCodeIsValid(int closeCode) {
-    if (closeCode < 1000) {
-        return NO;
-    }
-
-    if (closeCode >= 1000 && closeCode <= 1011) {
-        if (closeCode == 1004 ||
-            closeCode == 1005 ||
-            closeCode == 1006) {
-            return NO;
-        }
-        return YES;
-    }
-
-    if (closeCode >= 3000 && closeCode <= 3999) {
-        return YES;
-    }
-
-    if (closeCode >= 4000 && closeCode <= 4999) {
-        return YES;
-    }
-
-    return NO;
-}
-
 //  Note from RFC:
 //
 //  If there is a body, the first two
@@ -741,7 +767,7 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     } else if (dataSize >= 2) {
         [data getBytes:&closeCode length:sizeof(closeCode)];
         _closeCode = CFSwapInt16BigToHost(closeCode);
-        if (!closeCodeIsValid(_closeCode)) {
+        if (!ZCCSRFrameCloseCodeIsValid(_closeCode)) {
             [self _closeWithProtocolError:[NSString stringWithFormat:@"Cannot have close code of %d", _closeCode]];
             return;
         }
@@ -779,6 +805,7 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     // Check that the current data is valid UTF8
 
     BOOL isControlFrame = (opcode == ZCCSROpCodePing || opcode == ZCCSROpCodePong || opcode == ZCCSROpCodeConnectionClose);
+    BOOL isCompressed = !isControlFrame && _currentMessageCompressed;
     if (isControlFrame) {
         //frameData will be copied before passing to handlers
         //otherwise there can be misbehaviours when value at the pointer is changed
@@ -791,6 +818,25 @@ static inline BOOL closeCodeIsValid(int closeCode) {
         [self _readFrameNew];
     }
 
+    if (isCompressed) {
+        const uint8_t *bytes = NULL;
+        size_t length = 0;
+        ZCCSRDeflateResult result = ZCCSRDeflateDecompress(_deflate, (const uint8_t *)frameData.bytes, frameData.length,
+                                                           SRMaxInflatedMessageLength, &bytes, &length);
+        if (result == ZCCSRDeflateResultTooBig) {
+            [self closeWithCode:ZCCSRStatusCodeMessageTooBig reason:@"Message too big"];
+            dispatch_async(_workQueue, ^{
+                [self closeConnection];
+            });
+            return;
+        }
+        if (result != ZCCSRDeflateResultOK) {
+            [self _closeWithProtocolError:@"Invalid compressed message"];
+            return;
+        }
+        frameData = [NSData dataWithBytes:bytes length:length];
+    }
+
     switch (opcode) {
         case ZCCSROpCodeTextFrame: {
             NSString *string = [[NSString alloc] initWithData:frameData encoding:NSUTF8StringEncoding];
@@ -850,7 +896,7 @@ static inline BOOL closeCodeIsValid(int closeCode) {
     }
 }
 
-- (void)_handleFrameHeader:(frame_header)frame_header curData:(NSData *)curData;
+- (void)_handleFrameHeader:(ZCCSRFrameHeader)frame_header curData:(NSData *)curData;
 {
     assert(frame_header.opcode != 0);
 
@@ -858,25 +904,15 @@ static inline BOOL closeCodeIsValid(int closeCode) {
         return;
     }
 
-
-    BOOL isControlFrame = (frame_header.opcode == ZCCSROpCodePing || frame_header.opcode == ZCCSROpCodePong || frame_header.opcode == ZCCSROpCodeConnectionClose);
-
-    if (isControlFrame && !frame_header.fin) {
-        [self _closeWithProtocolError:@"Fragmented control frames not allowed"];
-        return;
-    }
-
-    if (isControlFrame && frame_header.payload_length >= 126) {
-        [self _closeWithProtocolError:@"Control frames cannot have payloads larger than 126 bytes"];
-        return;
-    }
+    // Control frame limits have already been checked by ZCCSRFrameCheckHeader()
+    BOOL isControlFrame = ZCCSRFrameIsControlOpcode(frame_header.opcode);
 
     if (!isControlFrame) {
         _currentFrameOpcode = frame_header.opcode;
         _currentFrameCount += 1;
     }
 
-    if (frame_header.payload_length == 0) {
+    if (frame_header.payloadLength == 0) {
         if (isControlFrame) {
             [self _handleFrameWithData:curData opCode:frame_header.opcode];
         } else {
@@ -888,8 +924,8 @@ static inline BOOL closeCodeIsValid(int closeCode) {
             }
         }
     } else {
-        assert(frame_header.payload_length <= SIZE_T_MAX);
-        [self _addConsumerWithDataLength:(size_t)frame_header.payload_length callback:^(ZCCSRWebSocket *sself, NSData *newData) {
+        assert(frame_header.payloadLength <= SIZE_T_MAX);
+        [self _addConsumerWithDataLength:(size_t)frame_header.payloadLength callback:^(ZCCSRWebSocket *sself, NSData *newData) {
             if (isControlFrame) {
                 [sself _handleFrameWithData:newData opCode:frame_header.opcode];
             } else {
@@ -926,103 +962,66 @@ static inline BOOL closeCodeIsValid(int closeCode) {
  +---------------------------------------------------------------+
  */
 
-static const uint8_t SRFinMask          = 0x80;
-static const uint8_t SROpCodeMask       = 0x0F;
-static const uint8_t SRRsvMask          = 0x70;
-static const uint8_t SRMaskMask         = 0x80;
-static const uint8_t SRPayloadLenMask   = 0x7F;
-
-
 - (void)_readFrameContinue;
 {
     assert((_currentFrameCount == 0 && _currentFrameOpcode == 0) || (_currentFrameCount > 0 && _currentFrameOpcode > 0));
 
-    [self _addConsumerWithDataLength:2 callback:^(ZCCSRWebSocket *sself, NSData *data) {
-        __block frame_header header = {0};
+    [self _addConsumerWithDataLength:ZCCSRFrameMinHeaderLength callback:^(ZCCSRWebSocket *sself, NSData *data) {
+        assert(data.length >= ZCCSRFrameMinHeaderLength);
 
-        const uint8_t *headerBuffer = data.bytes;
-        assert(data.length >= 2);
+        uint8_t headerBuffer[ZCCSRFrameMaxHeaderLength];
+        [data getBytes:headerBuffer length:ZCCSRFrameMinHeaderLength];
 
-        if (headerBuffer[0] & SRRsvMask) {
-            [sself _closeWithProtocolError:@"Server used RSV bits"];
+        size_t headerLength = ZCCSRFrameHeaderLength(headerBuffer);
+        if (headerLength == ZCCSRFrameMinHeaderLength) {
+            [sself _handleFrameHeaderBytes:headerBuffer length:headerLength];
             return;
         }
 
-        uint8_t receivedOpcode = (SROpCodeMask & headerBuffer[0]);
-
-        BOOL isControlFrame = (receivedOpcode == ZCCSROpCodePing || receivedOpcode == ZCCSROpCodePong || receivedOpcode == ZCCSROpCodeConnectionClose);
-
-        if (!isControlFrame && receivedOpcode != 0 && sself->_currentFrameCount > 0) {
-            [sself _closeWithProtocolError:@"all data frames after the initial data frame must have opcode 0"];
-            return;
-        }
-
-        if (receivedOpcode == 0 && sself->_currentFrameCount == 0) {
-            [sself _closeWithProtocolError:@"cannot continue a message"];
-            return;
-        }
-
-        header.opcode = receivedOpcode == 0 ? sself->_currentFrameOpcode : receivedOpcode;
-
-        header.fin = !!(SRFinMask & headerBuffer[0]);
-
-
-        header.masked = !!(SRMaskMask & headerBuffer[1]);
-        header.payload_length = SRPayloadLenMask & headerBuffer[1];
-
-        headerBuffer = NULL;
-
-        if (header.masked) {
-            [sself _closeWithProtocolError:@"Client must receive unmasked data"];
-            return;
-        }
-
-        size_t extra_bytes_needed = header.masked ? sizeof(self->_currentReadMaskKey) : 0;
+        // Blocks can't capture arrays, so carry the first two bytes over by value
+        uint8_t firstByte = headerBuffer[0];
+        uint8_t secondByte = headerBuffer[1];
+        [sself _addConsumerWithDataLength:headerLength - ZCCSRFrameMinHeaderLength callback:^(ZCCSRWebSocket *eself, NSData *edata) {
+            uint8_t fullHeaderBuffer[ZCCSRFrameMaxHeaderLength];
+            fullHeaderBuffer[0] = firstByte;
+            fullHeaderBuffer[1] = secondByte;
+            [edata getBytes:fullHeaderBuffer + ZCCSRFrameMinHeaderLength length:headerLength - ZCCSRFrameMinHeaderLength];
+            [eself _handleFrameHeaderBytes:fullHeaderBuffer length:headerLength];
+        } readToCurrentFrame:NO unmaskBytes:NO];
+    } readToCurrentFrame:NO unmaskBytes:NO];
+}
 
-        if (header.payload_length == 126) {
-            extra_bytes_needed += sizeof(uint16_t);
-        } else if (header.payload_length == 127) {
-            extra_bytes_needed += sizeof(uint64_t);
-        }
+- (void)_handleFrameHeaderBytes:(const uint8_t *)bytes length:(size_t)length;
+{
+    ZCCSRFrameHeader header;
+    if (!ZCCSRFrameParseHeader(bytes, length, &header)) {
+        assert(NO);
+        return;
+    }
 
-        if (extra_bytes_needed == 0) {
-            [sself _handleFrameHeader:header curData:sself->_currentFrameData];
-        } else {
-            [sself _addConsumerWithDataLength:extra_bytes_needed callback:^(ZCCSRWebSocket *eself, NSData *edata) {
-                size_t mapped_size = edata.length;
-#pragma unused (mapped_size)
-                const void *mapped_buffer = edata.bytes;
-                size_t offset = 0;
-
-                if (header.payload_length == 126) {
-                    assert(mapped_size >= sizeof(uint16_t));
-                    uint16_t payloadLength = 0;
-                    memcpy(&payloadLength, mapped_buffer, sizeof(uint16_t));
-                    payloadLength = CFSwapInt16BigToHost(payloadLength);
-
-                    header.payload_length = payloadLength;
-                    offset += sizeof(uint16_t);
-                } else if (header.payload_length == 127) {
-                    assert(mapped_size >= sizeof(uint64_t));
-                    uint64_t payloadLength = 0;
-                    memcpy(&payloadLength, mapped_buffer, sizeof(uint64_t));
-                    payloadLength = CFSwapInt64BigToHost(payloadLength);
-
-                    header.payload_length = payloadLength;
-                    offset += sizeof(uint64_t);
-                } else {
-                    assert(header.payload_length < 126 && header.payload_length >= 0);
-                }
+    uint8_t messageOpcode = _currentFrameCount > 0 ? _currentFrameOpcode : 0;
+    ZCCSRFrameError error = ZCCSRFrameCheckHeader(&header, messageOpcode, YES, _deflate ? ZCCSRDeflateRsv : 0);
+    if (error != ZCCSRFrameErrorNone) {
+        [self _closeWithProtocolError:@(ZCCSRFrameErrorDescription(error))];
+        return;
+    }
+    if (header.rsv && (header.opcode == 0 || ZCCSRFrameIsControlOpcode(header.opcode))) {
+        [self _closeWithProtocolError:@"Only the first frame of a data message may be compressed"];
+        return;
+    }
+    if (header.opcode != 0 && !ZCCSRFrameIsControlOpcode(header.opcode)) {
+        _currentMessageCompressed = (header.rsv != 0);
+    }
 
-                if (header.masked) {
-                    assert(mapped_size >= sizeof(self->_currentReadMaskOffset) + offset);
-                    memcpy(eself->_currentReadMaskKey, ((uint8_t *)mapped_buffer) + offset, sizeof(eself->_currentReadMaskKey));
-                }
+    if (header.masked) {
+        memcpy(_currentReadMaskKey, header.maskKey, sizeof(_currentReadMaskKey));
+        _currentReadMaskOffset = 0;
+    }
+    if (header.opcode == 0) {
+        header.opcode = _currentFrameOpcode;
+    }
 
-                [eself _handleFrameHeader:header curData:eself->_currentFrameData];
-            } readToCurrentFrame:NO unmaskBytes:NO];
-        }
-    } readToCurrentFrame:NO unmaskBytes:NO];
+    [self _handleFrameHeader:header curData:_currentFrameData];
 }
 
 - (void)_readFrameNew;
@@ -1035,50 +1034,58 @@ static const uint8_t SRPayloadLenMask   = 0x7F;
         self->_currentFrameOpcode = 0;
         self->_currentFrameCount = 0;
         self->_readOpCount = 0;
-        self->_currentStringScanPosition = 0;
+        self->_currentMessageCompressed = NO;
+        ZCCSRUTF8StateInit(&self->_currentStringState);
 
         [self _readFrameContinue];
     });
 }
 
+// Sends arrive as separate blocks on the work queue. Flushing after the ones already queued
+// lets a burst of audio packets and commands go out together.
+- (void)_schedulePumpWriting;
+{
+    if (_isWritingScheduled) {
+        return;
+    }
+    _isWritingScheduled = YES;
+    dispatch_async(_workQueue, ^{
+        self->_isWritingScheduled = NO;
+        [self _pumpWriting];
+    });
+}
+
+// Fails the socket if the stream reports an error
+- (NSInteger)_writeBytes:(const uint8_t *)bytes length:(size_t)length;
+{
+    NSInteger bytesWritten = [_outputStream write:bytes maxLength:length];
+    if (bytesWritten == -1) {
+        NSInteger code = 2145;
+        NSString *description = @"Error writing to stream.";
+        NSError *streamError = _outputStream.streamError;
+        NSError *error = streamError ? ZCCSRErrorWithCodeDescriptionUnderlyingError(code, description, streamError) : ZCCSRErrorWithCodeDescription(code, description);
+        [self _failWithError:error];
+    }
+    return bytesWritten;
+}
+
 - (void)_pumpWriting;
 {
     [self assertOnWorkQueue];
 
-    NSUInteger dataLength = dispatch_data_get_size(_outputBuffer);
-    if (dataLength - _outputBufferOffset > 0 && _outputStream.hasSpaceAvailable) {
-        __block NSInteger bytesWritten = 0;
-        __block BOOL streamFailed = NO;
-
-        dispatch_data_t dataToSend = dispatch_data_create_subrange(_outputBuffer, _outputBufferOffset, dataLength - _outputBufferOffset);
-        dispatch_data_apply(dataToSend, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
-            NSInteger sentLength = [_outputStream write:buffer maxLength:size];
-            if (sentLength == -1) {
-                streamFailed = YES;
-                return false;
-            }
-            bytesWritten += sentLength;
-            return (sentLength >= (NSInteger)size); // If we can't write all the data into the stream - bail-out early.
-        });
-        if (streamFailed) {
-            NSInteger code = 2145;
-            NSString *description = @"Error writing to stream.";
-            NSError *streamError = _outputStream.streamError;
-            NSError *error = streamError ? ZCCSRErrorWithCodeDescriptionUnderlyingError(code, description, streamError) : ZCCSRErrorWithCodeDescription(code, description);
-            [self _failWithError:error];
+    // Everything queued since the last wakeup is contiguous, so a burst of frames takes one write
+    size_t pendingLength = ZCCSRWriteBufferPendingLength(&_outputBuffer);
+    if (pendingLength > 0 && _outputStream.hasSpaceAvailable) {
+        NSInteger bytesWritten = [self _writeBytes:ZCCSRWriteBufferPendingBytes(&_outputBuffer) length:pendingLength];
+        if (bytesWritten == -1) {
             return;
         }
 
-        _outputBufferOffset += (NSUInteger)bytesWritten;
-
-        if (_outputBufferOffset > ZCCSRDefaultBufferSize() && _outputBufferOffset > dataLength / 2) {
-            _outputBuffer = dispatch_data_create_subrange(_outputBuffer, _outputBufferOffset, dataLength - _outputBufferOffset);
-            _outputBufferOffset = 0;
-        }
+        ZCCSRWriteBufferConsume(&_outputBuffer, (size_t)bytesWritten);
     }
 
     if (_closeWhenFinishedWriting &&
-        (dispatch_data_get_size(_outputBuffer) - _outputBufferOffset) == 0 &&
+        ZCCSRWriteBufferPendingLength(&_outputBuffer) == 0 &&
         (_inputStream.streamStatus != NSStreamStatusNotOpen &&
          _inputStream.streamStatus != NSStreamStatusClosed) &&
         !_sentClose) {
@@ -1250,10 +1257,7 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
             NSUInteger len = mutableSlice.length;
             uint8_t *bytes = mutableSlice.mutableBytes;
 
-            for (NSUInteger i = 0; i < len; i++) {
-                bytes[i] = bytes[i] ^ _currentReadMaskKey[_currentReadMaskOffset % sizeof(_currentReadMaskKey)];
-                _currentReadMaskOffset += 1;
-            }
+            _currentReadMaskOffset = ZCCSRFrameMask(bytes, len, _currentReadMaskKey, _currentReadMaskOffset);
 
             slice = dispatch_data_create(bytes, len, nil, ^{
                 mutableSlice = nil;
@@ -1261,35 +1265,28 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
         }
 
         if (consumer.readToCurrentFrame) {
+            // Text is validated as it arrives, a character split between reads is carried over in the state.
+            // Compressed text can only be checked once it has been inflated.
+            BOOL validateUTF8 = (_currentFrameOpcode == ZCCSROpCodeTextFrame && !_currentMessageCompressed);
+            __block BOOL validUTF8 = YES;
+            ZCCSRUTF8State *stringState = &_currentStringState;
             dispatch_data_apply(slice, ^bool(dispatch_data_t region, size_t offset, const void *buffer, size_t size) {
                 [_currentFrameData appendBytes:buffer length:size];
+                if (validateUTF8 && !ZCCSRUTF8Validate(stringState, (const uint8_t *)buffer, size)) {
+                    validUTF8 = NO;
+                    return false;
+                }
                 return true;
             });
 
             _readOpCount += 1;
 
-            if (_currentFrameOpcode == ZCCSROpCodeTextFrame) {
-                // Validate UTF8 stuff.
-                size_t currentDataSize = _currentFrameData.length;
-                if (_currentFrameOpcode == ZCCSROpCodeTextFrame && currentDataSize > 0) {
-                    // TODO: Optimize the crap out of this.  Don't really have to copy all the data each time
-
-                    size_t scanSize = currentDataSize - _currentStringScanPosition;
-
-                    NSData *scan_data = [_currentFrameData subdataWithRange:NSMakeRange(_currentStringScanPosition, scanSize)];
-                    int32_t valid_utf8_size = validate_dispatch_data_partial_string(scan_data);
-
-                    if (valid_utf8_size == -1) {
-                        [self closeWithCode:ZCCSRStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8"];
-                        dispatch_async(_workQueue, ^{
-                            [self closeConnection];
-                        });
-                        return didWork;
-                    } else {
-                        _currentStringScanPosition += (unsigned int)valid_utf8_size;
-                    }
-                }
-
+            if (!validUTF8) {
+                [self closeWithCode:ZCCSRStatusCodeInvalidUTF8 reason:@"Text frames must be valid UTF-8"];
+                dispatch_async(_workQueue, ^{
+                    [self closeConnection];
+                });
+                return didWork;
             }
 
             consumer.bytesNeeded -= foundSize;
@@ -1327,78 +1324,112 @@ static const char CRLFCRLFBytes[] = {'\r', '\n', '\r', '\n'};
     _isPumping = NO;
 }
 
-//#define NOMASK
+// Keys come from a ChaCha20 pool; the system RNG is only asked for a seed now and then
+- (BOOL)_nextMaskKey:(uint8_t *)maskKey;
+{
+    if (ZCCSRRandomPoolNeedsSeed(&_maskKeyPool)) {
+        uint8_t seed[ZCCSRRandomPoolSeedLength];
+        if (SecRandomCopyBytes(kSecRandomDefault, sizeof(seed), seed) != errSecSuccess) {
+            return NO;
+        }
+        ZCCSRRandomPoolSeed(&_maskKeyPool, seed);
+    }
+    return ZCCSRRandomPoolRead(&_maskKeyPool, maskKey, 4);
+}
 
-static const size_t SRFrameHeaderOverhead = 32;
+//#define NOMASK
 
 - (void)_sendFrameWithOpcode:(ZCCSROpCode)opCode data:(NSData *)data
 {
     [self assertOnWorkQueue];
 
-    if (!data) {
+    // Dropped while closing, like in _writeData:
+    if (!data || _closeWhenFinishedWriting) {
         return;
     }
 
+    const uint8_t *payload = (const uint8_t *)data.bytes;
     size_t payloadLength = data.length;
+    uint8_t rsv = 0;
+
+    // Binary frames carry Opus audio, which doesn't shrink and isn't worth the CPU
+    if (_deflate && opCode == ZCCSROpCodeTextFrame) {
+        const uint8_t *compressed = NULL;
+        size_t compressedLength = 0;
+        if (ZCCSRDeflateCompress(_deflate, payload, payloadLength, &compressed, &compressedLength)) {
+            payload = compressed;
+            payloadLength = compressedLength;
+            rsv = ZCCSRDeflateRsv;
+        }
+    }
 
-    NSMutableData *frameData = [[NSMutableData alloc] initWithLength:payloadLength + SRFrameHeaderOverhead];
-    if (!frameData) {
+    uint8_t maskKey[4];
+    if (![self _nextMaskKey:maskKey]) {
+        [self _failWithError:ZCCSRErrorWithCodeDescription(2146, @"Failed to generate a frame mask key.")];
+        return;
+    }
+
+    // The frame is assembled right behind whatever is still waiting for the stream
+    size_t headerLength = ZCCSRFrameHeaderSize(payloadLength, YES);
+    uint8_t *frameBuffer = (payloadLength <= SIZE_MAX - headerLength) ? ZCCSRWriteBufferReserve(&_outputBuffer, headerLength + payloadLength) : NULL;
+    if (!frameBuffer) {
         [self closeWithCode:ZCCSRStatusCodeMessageTooBig reason:@"Message too big"];
         return;
     }
-    uint8_t *frameBuffer = (uint8_t *)frameData.mutableBytes;
 
-    // set fin
-    frameBuffer[0] = SRFinMask | (uint8_t)opCode;
+    size_t writtenHeaderLength = ZCCSRFrameWriteHeader(frameBuffer, YES, rsv, (uint8_t)opCode, payloadLength, maskKey);
+#pragma unused (writtenHeaderLength)
+    assert(writtenHeaderLength == headerLength);
 
-    // set the mask and header
-    frameBuffer[1] |= SRMaskMask;
+    // Copy and mask the buffer in one pass
+    ZCCSRFrameMaskCopy(frameBuffer + headerLength, payload, payloadLength, maskKey, 0);
 
-    size_t frameBufferSize = 2;
+    ZCCSRWriteBufferCommit(&_outputBuffer, headerLength + payloadLength);
+    [self _schedulePumpWriting];
+}
 
-    if (payloadLength < 126) {
-        frameBuffer[1] |= payloadLength;
-    } else {
-        uint64_t declaredPayloadLength = 0;
-        size_t declaredPayloadLengthSize = 0;
+- (void)_sendFrameInPlace:(NSMutableData *)buffer headroom:(size_t)headroom
+{
+    [self assertOnWorkQueue];
 
-        if (payloadLength <= UINT16_MAX) {
-            frameBuffer[1] |= 126;
+    // Dropped while closing, like in _writeData:
+    if (_closeWhenFinishedWriting) {
+        return;
+    }
 
-            declaredPayloadLength = CFSwapInt16BigToHost((uint16_t)payloadLength);
-            declaredPayloadLengthSize = sizeof(uint16_t);
-        } else {
-            frameBuffer[1] |= 127;
+    uint8_t maskKey[4];
+    if (![self _nextMaskKey:maskKey]) {
+        [self _failWithError:ZCCSRErrorWithCodeDescription(2146, @"Failed to generate a frame mask key.")];
+        return;
+    }
 
-            declaredPayloadLength = CFSwapInt64BigToHost((uint64_t)payloadLength);
-            declaredPayloadLengthSize = sizeof(uint64_t);
+    // The buffer is ours now; the header goes right in front of the payload, which is masked where it is
+    uint8_t *payload = (uint8_t *)buffer.mutableBytes + headroom;
+    size_t payloadLength = buffer.length - headroom;
+    size_t headerLength = ZCCSRFrameHeaderSize(payloadLength, YES);
+    uint8_t *frame = payload - headerLength;
+    ZCCSRFrameWriteHeader(frame, YES, 0, ZCCSROpCodeBinaryFrame, payloadLength, maskKey);
+    ZCCSRFrameMask(payload, payloadLength, maskKey, 0);
+    size_t frameLength = headerLength + payloadLength;
+
+    // With nothing queued ahead of it, the frame goes to the stream straight from the buffer, and
+    // only what the stream doesn't take is copied into the output buffer
+    size_t bytesWritten = 0;
+    if (ZCCSRWriteBufferPendingLength(&_outputBuffer) == 0 && _outputStream.hasSpaceAvailable) {
+        NSInteger result = [self _writeBytes:frame length:frameLength];
+        if (result == -1) {
+            return;
         }
-
-        memcpy((frameBuffer + frameBufferSize), &declaredPayloadLength, declaredPayloadLengthSize);
-        frameBufferSize += declaredPayloadLengthSize;
+        bytesWritten = (size_t)result;
     }
-
-    const uint8_t *unmaskedPayloadBuffer = (uint8_t *)data.bytes;
-    uint8_t *maskKey = frameBuffer + frameBufferSize;
-
-    size_t randomBytesSize = sizeof(uint32_t);
-    int result = SecRandomCopyBytes(kSecRandomDefault, randomBytesSize, maskKey);
-    if (result != 0) {
-        //TODO: (nlutsenko) Check if there was an error.
+    if (bytesWritten == frameLength) {
+        return;
     }
-    frameBufferSize += randomBytesSize;
-
-    // Copy and unmask the buffer
-    uint8_t *frameBufferPayloadPointer = frameBuffer + frameBufferSize;
-
-    memcpy(frameBufferPayloadPointer, unmaskedPayloadBuffer, payloadLength);
-    ZCCSRMaskBytesSIMD(frameBufferPayloadPointer, payloadLength, maskKey);
-    frameBufferSize += payloadLength;
-
-    assert(frameBufferSize <= frameData.length);
-    frameData.length = frameBufferSize;
-
-    [self _writeData:frameData];
+    if (!ZCCSRWriteBufferAppend(&_outputBuffer, frame + bytesWritten, frameLength - bytesWritten)) {
+        [self closeWithCode:ZCCSRStatusCodeMessageTooBig reason:@"Message too big"];
+        return;
+    }
+    [self _schedulePumpWriting];
 }
 
 - (void)stream:(NSStream *)aStream handleEvent:(NSStreamEvent)eventCode
@@ -1559,70 +1590,3 @@ static const size_t SRFrameHeaderOverhead = 32;
 }
 
 @end
-
-#ifdef HAS_ICU
-
-static inline int32_t validate_dispatch_data_partial_string(NSData *data) {
-    if ([data length] > INT32_MAX) {
-        // INT32_MAX is the limit so long as this Framework is using 32 bit ints everywhere.
-        return -1;
-    }
-
-    int32_t size = (int32_t)[data length];
-
-    const void * contents = [data bytes];
-    const uint8_t *str = (const uint8_t *)contents;
-
-    UChar32 codepoint = 1;
-    int32_t offset = 0;
-    int32_t lastOffset = 0;
-    while(offset < size && codepoint > 0)  {
-        lastOffset = offset;
-        U8_NEXT(str, offset, size, codepoint);
-    }
-
-    if (codepoint == -1) {
-        // Check to see if the last byte is valid or whether it was just continuing
-        if (!U8_IS_LEAD(str[lastOffset]) || U8_COUNT_TRAIL_BYTES(str[lastOffset]) + lastOffset < (int32_t)size) {
-
-            size = -1;
-        } else {
-            uint8_t leadByte = str[lastOffset];
-            U8_MASK_LEAD_BYTE(leadByte, U8_COUNT_TRAIL_BYTES(leadByte));
-
-            for (int i = lastOffset + 1; i < offset; i++) {
-                if (U8_IS_SINGLE(str[i]) || U8_IS_LEAD(str[i]) || !U8_IS_TRAIL(str[i])) {
-                    size = -1;
-                }
-            }
-
-            if (size != -1) {
-                size = lastOffset;
-            }
-        }
-    }
-
-    if (size != -1 && ![[NSString alloc] initWithBytesNoCopy:(char *)[data bytes] length:(NSUInteger)size encoding:NSUTF8StringEncoding freeWhenDone:NO]) {
-        size = -1;
-    }
-
-    return size;
-}
-
-#else
-
-// This is a hack, and probably not optimal
-static inline int32_t validate_dispatch_data_partial_string(NSData *data) {
-    static const int maxCodepointSize = 3;
-
-    for (int i = 0; i < maxCodepointSize; i++) {
-        NSString *str = [[NSString alloc] initWithBytesNoCopy:(char *)data.bytes length:data.length - i encoding:NSUTF8StringEncoding freeWhenDone:NO];
-        if (str) {
-            return (int32_t)data.length - i;
-        }
-    }
-
-    return -1;
-}
-
-#endif
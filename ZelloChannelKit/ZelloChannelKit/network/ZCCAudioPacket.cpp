@@ -0,0 +1,43 @@
+//
+//  ZCCAudioPacket.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCAudioPacket.h"
+
+namespace {
+
+const size_t StreamIdOffset = 1;
+const size_t PacketIdOffset = StreamIdOffset + sizeof(uint32_t);
+
+inline uint32_t load32(const uint8_t *p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+inline void store32(uint8_t *p, uint32_t value) {
+  p[0] = (uint8_t)(value >> 24);
+  p[1] = (uint8_t)(value >> 16);
+  p[2] = (uint8_t)(value >> 8);
+  p[3] = (uint8_t)value;
+}
+
+}
+
+bool ZCCAudioPacketParse(const uint8_t *bytes, size_t length, ZCCAudioPacket *packet) {
+  if (length < ZCCAudioPacketHeaderLength || bytes[0] != ZCCAudioPacketType) {
+    return false;
+  }
+  packet->streamId = load32(bytes + StreamIdOffset);
+  packet->packetId = load32(bytes + PacketIdOffset);
+  packet->audio = bytes + ZCCAudioPacketHeaderLength;
+  packet->audioLength = length - ZCCAudioPacketHeaderLength;
+  return true;
+}
+
+void ZCCAudioPacketWriteHeader(uint8_t *buffer, uint32_t streamId, uint32_t packetId) {
+  buffer[0] = ZCCAudioPacketType;
+  store32(buffer + StreamIdOffset, streamId);
+  store32(buffer + PacketIdOffset, packetId);
+}
@@ -0,0 +1,53 @@
+//
+//  ZCCAudioPacket.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCAudioPacket_h
+#define ZCCAudioPacket_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Binary audio messages: { type(8) = 0x01, stream_id(32), packet_id(32), data[] }, big endian.
+// Parsing only points into the message, and building writes the header in front of audio that
+// is already in place.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  ZCCAudioPacketType = 0x01,
+  ZCCAudioPacketHeaderLength = 9
+};
+
+typedef struct {
+  uint32_t streamId;
+  uint32_t packetId;
+  const uint8_t *audio;       // Points into the parsed message
+  size_t audioLength;
+} ZCCAudioPacket;
+
+/**
+ Decode an audio message without copying it.
+
+ @return false if the message is too short or isn't audio.
+ */
+bool ZCCAudioPacketParse(const uint8_t *bytes, size_t length, ZCCAudioPacket *packet);
+
+/**
+ Encode the header. The audio goes right behind it, at `buffer + ZCCAudioPacketHeaderLength`.
+
+ @param buffer Must have room for `ZCCAudioPacketHeaderLength` bytes.
+ */
+void ZCCAudioPacketWriteHeader(uint8_t *buffer, uint32_t streamId, uint32_t packetId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCAudioPacket_h */
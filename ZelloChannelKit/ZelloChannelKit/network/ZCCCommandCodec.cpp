@@ -0,0 +1,766 @@
+//
+//  ZCCCommandCodec.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCCommandCodec.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const int MaxDepth = 32;
+
+// Perfect hashes over the names the reader knows, (length * a + name[1] + name[length - 1]) & mask.
+// The multipliers are chosen so that no two names share a slot, which the tables check when built.
+struct NameTable {
+  const char *names[32];
+  int values[32];
+  unsigned multiplier;
+  unsigned mask;
+
+  NameTable(unsigned multiplier, unsigned mask) : multiplier(multiplier), mask(mask) {
+    memset(names, 0, sizeof(names));
+    memset(values, 0, sizeof(values));
+  }
+
+  unsigned slot(const char *name, size_t length) const {
+    return ((unsigned)length * multiplier + (unsigned char)name[1] + (unsigned char)name[length - 1]) & mask;
+  }
+
+  void add(const char *name, int value) {
+    unsigned index = slot(name, strlen(name));
+    assert(!names[index]);
+    names[index] = name;
+    values[index] = value;
+  }
+
+  int find(const char *name, size_t length, int missing) const {
+    if (length < 2) {
+      return missing;
+    }
+    unsigned index = slot(name, length);
+    const char *candidate = names[index];
+    if (candidate && strncmp(candidate, name, length) == 0 && candidate[length] == '\0') {
+      return values[index];
+    }
+    return missing;
+  }
+};
+
+enum Key {
+  KeyNone = -1,
+  KeySeq,
+  KeyCommand,
+  KeySuccess,
+  KeyError,
+  KeyStreamId,
+  KeyType,
+  KeyCodec,
+  KeyCodecHeader,
+  KeyPacketDuration,
+  KeyChannel,
+  KeyFrom
+};
+
+const NameTable &commandTable() {
+  static const NameTable table = [] {
+    NameTable t(6, 7);
+    t.add("on_channel_status", ZCCEventKindOnChannelStatus);
+    t.add("on_stream_start", ZCCEventKindOnStreamStart);
+    t.add("on_stream_stop", ZCCEventKindOnStreamStop);
+    t.add("on_error", ZCCEventKindOnError);
+    t.add("on_location", ZCCEventKindOnLocation);
+    t.add("on_text_message", ZCCEventKindOnTextMessage);
+    t.add("on_image", ZCCEventKindOnImage);
+    return t;
+  }();
+  return table;
+}
+
+const NameTable &keyTable() {
+  static const NameTable table = [] {
+    NameTable t(1, 31);
+    t.add("seq", KeySeq);
+    t.add("command", KeyCommand);
+    t.add("success", KeySuccess);
+    t.add("error", KeyError);
+    t.add("stream_id", KeyStreamId);
+    t.add("type", KeyType);
+    t.add("codec", KeyCodec);
+    t.add("codec_header", KeyCodecHeader);
+    t.add("packet_duration", KeyPacketDuration);
+    t.add("channel", KeyChannel);
+    t.add("from", KeyFrom);
+    return t;
+  }();
+  return table;
+}
+
+struct Reader {
+  const char *p;
+  const char *end;
+};
+
+inline void skipSpace(Reader &r) {
+  while (r.p < r.end && (*r.p == ' ' || *r.p == '\t' || *r.p == '\n' || *r.p == '\r')) {
+    r.p++;
+  }
+}
+
+inline int hexValue(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Four hex digits after "\u"
+bool readEscapedUnit(Reader &r, unsigned *unit) {
+  if (r.end - r.p < 4) {
+    return false;
+  }
+  unsigned value = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hexValue(r.p[i]);
+    if (digit < 0) {
+      return false;
+    }
+    value = (value << 4) | (unsigned)digit;
+  }
+  r.p += 4;
+  *unit = value;
+  return true;
+}
+
+// Starts right after the opening quote. Only validates escapes; `escaped` tells the caller that
+// the raw bytes aren't the string's value.
+bool readString(Reader &r, ZCCEventString *string, bool *escaped) {
+  const char *start = r.p;
+  *escaped = false;
+  while (r.p < r.end) {
+    unsigned char c = (unsigned char)*r.p;
+    if (c == '"') {
+      string->bytes = start;
+      string->length = (size_t)(r.p - start);
+      r.p++;
+      return true;
+    }
+    if (c < 0x20) {
+      return false;
+    }
+    r.p++;
+    if (c != '\\') {
+      continue;
+    }
+    *escaped = true;
+    if (r.p == r.end) {
+      return false;
+    }
+    char e = *r.p++;
+    switch (e) {
+      case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+        break;
+      case 'u': {
+        unsigned unit = 0;
+        if (!readEscapedUnit(r, &unit) || (unit >= 0xDC00 && unit <= 0xDFFF)) {
+          return false;
+        }
+        // A high surrogate has to be followed by its low half
+        if (unit >= 0xD800 && unit <= 0xDBFF) {
+          if (r.end - r.p < 2 || r.p[0] != '\\' || r.p[1] != 'u') {
+            return false;
+          }
+          r.p += 2;
+          if (!readEscapedUnit(r, &unit) || unit < 0xDC00 || unit > 0xDFFF) {
+            return false;
+          }
+        }
+        break;
+      }
+      default:
+        return false;
+    }
+  }
+  return false;
+}
+
+inline bool isDigit(char c) {
+  return c >= '0' && c <= '9';
+}
+
+// JSON number grammar. `integral` is set when it has no fraction or exponent and fits in `value`.
+bool readNumber(Reader &r, bool *integral, int64_t *value) {
+  bool negative = false;
+  if (r.p < r.end && *r.p == '-') {
+    negative = true;
+    r.p++;
+  }
+  if (r.p == r.end || !isDigit(*r.p)) {
+    return false;
+  }
+  uint64_t magnitude = 0;
+  bool fits = true;
+  if (*r.p == '0') {
+    r.p++;
+  } else {
+    while (r.p < r.end && isDigit(*r.p)) {
+      unsigned digit = (unsigned)(*r.p - '0');
+      if (magnitude > (UINT64_MAX - digit) / 10) {
+        fits = false;
+      } else {
+        magnitude = magnitude * 10 + digit;
+      }
+      r.p++;
+    }
+  }
+  bool fraction = false;
+  if (r.p < r.end && *r.p == '.') {
+    fraction = true;
+    r.p++;
+    if (r.p == r.end || !isDigit(*r.p)) {
+      return false;
+    }
+    while (r.p < r.end && isDigit(*r.p)) {
+      r.p++;
+    }
+  }
+  if (r.p < r.end && (*r.p == 'e' || *r.p == 'E')) {
+    fraction = true;
+    r.p++;
+    if (r.p < r.end && (*r.p == '+' || *r.p == '-')) {
+      r.p++;
+    }
+    if (r.p == r.end || !isDigit(*r.p)) {
+      return false;
+    }
+    while (r.p < r.end && isDigit(*r.p)) {
+      r.p++;
+    }
+  }
+  uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+  *integral = !fraction && fits && magnitude <= limit;
+  if (*integral) {
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+  }
+  return true;
+}
+
+bool readLiteral(Reader &r, const char *literal, size_t length) {
+  if ((size_t)(r.end - r.p) < length || memcmp(r.p, literal, length) != 0) {
+    return false;
+  }
+  r.p += length;
+  return true;
+}
+
+bool skipValue(Reader &r, int depth);
+
+// Calls `member` with the reader on each value; it has to consume the value
+template <typename Member>
+bool readObject(Reader &r, Member member) {
+  r.p++;
+  skipSpace(r);
+  if (r.p < r.end && *r.p == '}') {
+    r.p++;
+    return true;
+  }
+  for (;;) {
+    if (r.p == r.end || *r.p != '"') {
+      return false;
+    }
+    r.p++;
+    ZCCEventString key;
+    bool escaped = false;
+    if (!readString(r, &key, &escaped)) {
+      return false;
+    }
+    skipSpace(r);
+    if (r.p == r.end || *r.p != ':') {
+      return false;
+    }
+    r.p++;
+    skipSpace(r);
+    if (!member(key, escaped)) {
+      return false;
+    }
+    skipSpace(r);
+    if (r.p == r.end) {
+      return false;
+    }
+    if (*r.p == '}') {
+      r.p++;
+      return true;
+    }
+    if (*r.p != ',') {
+      return false;
+    }
+    r.p++;
+    skipSpace(r);
+  }
+}
+
+bool skipArray(Reader &r, int depth) {
+  r.p++;
+  skipSpace(r);
+  if (r.p < r.end && *r.p == ']') {
+    r.p++;
+    return true;
+  }
+  for (;;) {
+    if (!skipValue(r, depth)) {
+      return false;
+    }
+    skipSpace(r);
+    if (r.p == r.end) {
+      return false;
+    }
+    if (*r.p == ']') {
+      r.p++;
+      return true;
+    }
+    if (*r.p != ',') {
+      return false;
+    }
+    r.p++;
+    skipSpace(r);
+  }
+}
+
+bool skipValue(Reader &r, int depth) {
+  if (r.p == r.end) {
+    return false;
+  }
+  switch (*r.p) {
+    case '{':
+      if (depth >= MaxDepth) {
+        return false;
+      }
+      return readObject(r, [&](const ZCCEventString &, bool) {
+        return skipValue(r, depth + 1);
+      });
+    case '[':
+      if (depth >= MaxDepth) {
+        return false;
+      }
+      return skipArray(r, depth + 1);
+    case '"': {
+      r.p++;
+      ZCCEventString string;
+      bool escaped = false;
+      return readString(r, &string, &escaped);
+    }
+    case 't':
+      return readLiteral(r, "true", 4);
+    case 'f':
+      return readLiteral(r, "false", 5);
+    case 'n':
+      return readLiteral(r, "null", 4);
+    default: {
+      bool integral = false;
+      int64_t value = 0;
+      return readNumber(r, &integral, &value);
+    }
+  }
+}
+
+inline int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') {
+    return c - 'A';
+  }
+  if (c >= 'a' && c <= 'z') {
+    return c - 'a' + 26;
+  }
+  if (c >= '0' && c <= '9') {
+    return c - '0' + 52;
+  }
+  if (c == '+') {
+    return 62;
+  }
+  if (c == '/') {
+    return 63;
+  }
+  return -1;
+}
+
+// Padded base64 only; anything looser is left to the general parser
+bool decodeBase64(const ZCCEventString &string, uint8_t *output, size_t capacity, size_t *length) {
+  const char *s = string.bytes;
+  size_t n = string.length;
+  if (n % 4 != 0) {
+    return false;
+  }
+  size_t padding = 0;
+  if (n > 0 && s[n - 1] == '=') {
+    padding = (n > 1 && s[n - 2] == '=') ? 2 : 1;
+  }
+  size_t decodedLength = n / 4 * 3 - padding;
+  if (decodedLength > capacity) {
+    return false;
+  }
+  size_t out = 0;
+  for (size_t i = 0; i < n; i += 4) {
+    bool last = i + 4 == n;
+    int a = base64Value(s[i]);
+    int b = base64Value(s[i + 1]);
+    int c = (last && padding == 2) ? 0 : base64Value(s[i + 2]);
+    int d = (last && padding >= 1) ? 0 : base64Value(s[i + 3]);
+    if (a < 0 || b < 0 || c < 0 || d < 0) {
+      return false;
+    }
+    uint32_t triple = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | (uint32_t)d;
+    output[out++] = (uint8_t)(triple >> 16);
+    if (out < decodedLength) {
+      output[out++] = (uint8_t)(triple >> 8);
+    }
+    if (out < decodedLength) {
+      output[out++] = (uint8_t)triple;
+    }
+  }
+  *length = decodedLength;
+  return true;
+}
+
+enum FieldResult {
+  FieldInvalid,                 // Not valid JSON
+  FieldFallback,                // Valid, but only the general parser can represent it exactly
+  FieldRead
+};
+
+// Fields of the wrong JSON type are skipped and left out of `fields`, just as a type check on the
+// parsed dictionary would reject them. Numbers and booleans can't be told apart there, though, so
+// those mismatches fall back.
+FieldResult readStringField(Reader &r, ZCCEventString *string, bool *present) {
+  if (r.p < r.end && *r.p == '"') {
+    r.p++;
+    bool escaped = false;
+    if (!readString(r, string, &escaped)) {
+      return FieldInvalid;
+    }
+    if (escaped) {
+      return FieldFallback;
+    }
+    *present = true;
+    return FieldRead;
+  }
+  return skipValue(r, 1) ? FieldRead : FieldInvalid;
+}
+
+FieldResult readIntegerField(Reader &r, int64_t *value, bool *present) {
+  if (r.p < r.end && (*r.p == '-' || isDigit(*r.p))) {
+    bool integral = false;
+    if (!readNumber(r, &integral, value)) {
+      return FieldInvalid;
+    }
+    if (!integral) {
+      return FieldFallback;
+    }
+    *present = true;
+    return FieldRead;
+  }
+  if (r.p < r.end && (*r.p == 't' || *r.p == 'f')) {
+    return skipValue(r, 1) ? FieldFallback : FieldInvalid;
+  }
+  return skipValue(r, 1) ? FieldRead : FieldInvalid;
+}
+
+FieldResult readBoolField(Reader &r, bool *value, bool *present) {
+  if (readLiteral(r, "true", 4)) {
+    *value = true;
+    *present = true;
+    return FieldRead;
+  }
+  if (readLiteral(r, "false", 5)) {
+    *value = false;
+    *present = true;
+    return FieldRead;
+  }
+  if (r.p < r.end && (*r.p == '-' || isDigit(*r.p))) {
+    return skipValue(r, 1) ? FieldFallback : FieldInvalid;
+  }
+  return skipValue(r, 1) ? FieldRead : FieldInvalid;
+}
+
+bool reserve(ZCCJSONWriter *writer, size_t count) {
+  if (writer->failed) {
+    return false;
+  }
+  if (writer->capacity - writer->length >= count) {
+    return true;
+  }
+  size_t capacity = writer->capacity ? writer->capacity : 256;
+  while (capacity - writer->length < count) {
+    capacity *= 2;
+  }
+  char *bytes = (char *)realloc(writer->bytes, capacity);
+  if (!bytes) {
+    writer->failed = true;
+    return false;
+  }
+  writer->bytes = bytes;
+  writer->capacity = capacity;
+  return true;
+}
+
+inline void append(ZCCJSONWriter *writer, const char *bytes, size_t length) {
+  if (reserve(writer, length)) {
+    memcpy(writer->bytes + writer->length, bytes, length);
+    writer->length += length;
+  }
+}
+
+// Values and keys inside an object are separated by commas, but not the value right after a key
+void beginValue(ZCCJSONWriter *writer) {
+  if (writer->needsComma) {
+    append(writer, ",", 1);
+  }
+  writer->needsComma = true;
+}
+
+const char Base64Alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+}
+
+bool ZCCEventParse(const char *json, size_t length, uint8_t *scratch, size_t scratchLength, ZCCEvent *event) {
+  memset(event, 0, sizeof(*event));
+  Reader r = { json, json + length };
+  skipSpace(r);
+  if (r.p == r.end || *r.p != '{') {
+    return false;
+  }
+
+  const NameTable &keys = keyTable();
+  ZCCEventString command = { NULL, 0 };
+  bool hasSeq = false;
+  bool hasCommand = false;
+  uint32_t seen = 0;
+  bool fallback = false;
+  bool valid = readObject(r, [&](const ZCCEventString &key, bool escaped) {
+    int index = escaped ? KeyNone : keys.find(key.bytes, key.length, KeyNone);
+    if (index == KeyNone) {
+      // An escaped key might still spell one we know
+      fallback = fallback || escaped;
+      return skipValue(r, 1);
+    }
+    if (seen & (1u << index)) {
+      // Which of the duplicates wins is up to the general parser
+      fallback = true;
+    }
+    seen |= 1u << index;
+
+    bool present = false;
+    uint32_t field = 0;
+    FieldResult result = FieldRead;
+    switch ((Key)index) {
+      case KeySeq:
+        result = readIntegerField(r, &event->seq, &hasSeq);
+        break;
+      case KeyCommand:
+        result = readStringField(r, &command, &hasCommand);
+        break;
+      case KeySuccess:
+        field = ZCCEventFieldSuccess;
+        result = readBoolField(r, &event->success, &present);
+        break;
+      case KeyError:
+        field = ZCCEventFieldError;
+        result = readStringField(r, &event->error, &present);
+        break;
+      case KeyStreamId:
+        field = ZCCEventFieldStreamId;
+        result = readIntegerField(r, &event->streamId, &present);
+        break;
+      case KeyType:
+        field = ZCCEventFieldType;
+        result = readStringField(r, &event->type, &present);
+        break;
+      case KeyCodec:
+        field = ZCCEventFieldCodec;
+        result = readStringField(r, &event->codec, &present);
+        break;
+      case KeyCodecHeader: {
+        field = ZCCEventFieldCodecHeader;
+        ZCCEventString header = { NULL, 0 };
+        result = readStringField(r, &header, &present);
+        if (result == FieldRead && present) {
+          // Decoded right away, so the event doesn't hold on to the base64
+          if (decodeBase64(header, scratch, scratchLength, &event->codecHeaderLength)) {
+            event->codecHeader = scratch;
+          } else {
+            result = FieldFallback;
+          }
+        }
+        break;
+      }
+      case KeyPacketDuration:
+        field = ZCCEventFieldPacketDuration;
+        result = readIntegerField(r, &event->packetDuration, &present);
+        break;
+      case KeyChannel:
+        field = ZCCEventFieldChannel;
+        result = readStringField(r, &event->channel, &present);
+        break;
+      case KeyFrom:
+        field = ZCCEventFieldFrom;
+        result = readStringField(r, &event->from, &present);
+        break;
+      case KeyNone:
+        break;
+    }
+    if (present) {
+      event->fields |= field;
+    }
+    if (result == FieldFallback) {
+      // The value is still well formed, keep going so it's consumed
+      fallback = true;
+      return true;
+    }
+    return result == FieldRead;
+  });
+  if (!valid || fallback) {
+    return false;
+  }
+  skipSpace(r);
+  if (r.p != r.end) {
+    return false;
+  }
+
+  if (hasSeq) {
+    event->kind = ZCCEventKindResponse;
+  } else if (hasCommand) {
+    event->kind = (ZCCEventKind)commandTable().find(command.bytes, command.length, ZCCEventKindUnknown);
+  }
+  return true;
+}
+
+void ZCCJSONWriterInit(ZCCJSONWriter *writer) {
+  memset(writer, 0, sizeof(*writer));
+}
+
+void ZCCJSONWriterDestroy(ZCCJSONWriter *writer) {
+  free(writer->bytes);
+  ZCCJSONWriterInit(writer);
+}
+
+void ZCCJSONWriterBeginObject(ZCCJSONWriter *writer) {
+  beginValue(writer);
+  append(writer, "{", 1);
+  writer->needsComma = false;
+}
+
+void ZCCJSONWriterEndObject(ZCCJSONWriter *writer) {
+  append(writer, "}", 1);
+  writer->needsComma = true;
+}
+
+void ZCCJSONWriterKey(ZCCJSONWriter *writer, const char *key) {
+  beginValue(writer);
+  size_t length = strlen(key);
+  if (reserve(writer, length + 3)) {
+    char *out = writer->bytes + writer->length;
+    out[0] = '"';
+    memcpy(out + 1, key, length);
+    out[length + 1] = '"';
+    out[length + 2] = ':';
+    writer->length += length + 3;
+  }
+  writer->needsComma = false;
+}
+
+void ZCCJSONWriterString(ZCCJSONWriter *writer, const char *utf8, size_t length) {
+  beginValue(writer);
+  if (!utf8) {
+    writer->failed = true;
+    return;
+  }
+  // Every byte takes at most six, as \u00XX
+  if (length > (SIZE_MAX - 2) / 6 || !reserve(writer, length * 6 + 2)) {
+    writer->failed = true;
+    return;
+  }
+  static const char hex[] = "0123456789abcdef";
+  char *out = writer->bytes + writer->length;
+  *out++ = '"';
+  for (size_t i = 0; i < length; i++) {
+    unsigned char c = (unsigned char)utf8[i];
+    if (c >= 0x20 && c != '"' && c != '\\') {
+      *out++ = (char)c;
+      continue;
+    }
+    *out++ = '\\';
+    switch (c) {
+      case '"': *out++ = '"'; break;
+      case '\\': *out++ = '\\'; break;
+      case '\b': *out++ = 'b'; break;
+      case '\f': *out++ = 'f'; break;
+      case '\n': *out++ = 'n'; break;
+      case '\r': *out++ = 'r'; break;
+      case '\t': *out++ = 't'; break;
+      default:
+        *out++ = 'u';
+        *out++ = '0';
+        *out++ = '0';
+        *out++ = hex[c >> 4];
+        *out++ = hex[c & 0xF];
+    }
+  }
+  *out++ = '"';
+  writer->length = (size_t)(out - writer->bytes);
+}
+
+void ZCCJSONWriterInteger(ZCCJSONWriter *writer, int64_t value) {
+  beginValue(writer);
+  char digits[24];
+  int length = snprintf(digits, sizeof(digits), "%lld", (long long)value);
+  append(writer, digits, (size_t)length);
+}
+
+void ZCCJSONWriterBool(ZCCJSONWriter *writer, bool value) {
+  beginValue(writer);
+  if (value) {
+    append(writer, "true", 4);
+  } else {
+    append(writer, "false", 5);
+  }
+}
+
+void ZCCJSONWriterBase64(ZCCJSONWriter *writer, const uint8_t *bytes, size_t length) {
+  beginValue(writer);
+  size_t encodedLength = (length + 2) / 3 * 4;
+  if (!reserve(writer, encodedLength + 2)) {
+    return;
+  }
+  char *out = writer->bytes + writer->length;
+  *out++ = '"';
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    uint32_t triple = ((uint32_t)bytes[i] << 16) | ((uint32_t)bytes[i + 1] << 8) | bytes[i + 2];
+    *out++ = Base64Alphabet[(triple >> 18) & 0x3F];
+    *out++ = Base64Alphabet[(triple >> 12) & 0x3F];
+    *out++ = Base64Alphabet[(triple >> 6) & 0x3F];
+    *out++ = Base64Alphabet[triple & 0x3F];
+  }
+  if (i < length) {
+    uint32_t triple = (uint32_t)bytes[i] << 16;
+    if (i + 1 < length) {
+      triple |= (uint32_t)bytes[i + 1] << 8;
+    }
+    *out++ = Base64Alphabet[(triple >> 18) & 0x3F];
+    *out++ = Base64Alphabet[(triple >> 12) & 0x3F];
+    *out++ = i + 1 < length ? Base64Alphabet[(triple >> 6) & 0x3F] : '=';
+    *out++ = '=';
+  }
+  *out++ = '"';
+  writer->length = (size_t)(out - writer->bytes);
+}
@@ -0,0 +1,119 @@
+//
+//  ZCCCommandCodec.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCCommandCodec_h
+#define ZCCCommandCodec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Streaming reader and writer for the JSON commands and events of the Zello protocol. The reader
+// makes a single pass over the message and keeps only the fields ZCCSocket acts on, as views into
+// the message; nothing is allocated. The writer appends straight into one growing buffer.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ZCCEventKindUnknown = 0,      // No seq, and a command the reader doesn't know or no command
+  ZCCEventKindResponse,         // Has an integer seq
+  ZCCEventKindOnChannelStatus,
+  ZCCEventKindOnStreamStart,
+  ZCCEventKindOnStreamStop,
+  ZCCEventKindOnError,
+  ZCCEventKindOnLocation,
+  ZCCEventKindOnTextMessage,
+  ZCCEventKindOnImage
+} ZCCEventKind;
+
+// Bits in `ZCCEvent.fields`, set for the fields that were present with the expected type
+enum {
+  ZCCEventFieldSuccess = 1 << 0,
+  ZCCEventFieldError = 1 << 1,
+  ZCCEventFieldStreamId = 1 << 2,
+  ZCCEventFieldType = 1 << 3,
+  ZCCEventFieldCodec = 1 << 4,
+  ZCCEventFieldCodecHeader = 1 << 5,
+  ZCCEventFieldPacketDuration = 1 << 6,
+  ZCCEventFieldChannel = 1 << 7,
+  ZCCEventFieldFrom = 1 << 8
+};
+
+typedef struct {
+  const char *bytes;            // Points into the message, UTF-8
+  size_t length;
+} ZCCEventString;
+
+typedef struct {
+  ZCCEventKind kind;
+  uint32_t fields;
+  int64_t seq;
+  bool success;
+  int64_t streamId;
+  int64_t packetDuration;
+  ZCCEventString error;
+  ZCCEventString type;
+  ZCCEventString codec;
+  ZCCEventString channel;
+  ZCCEventString from;
+  const uint8_t *codecHeader;   // Base64-decoded into the scratch buffer
+  size_t codecHeaderLength;
+} ZCCEvent;
+
+/**
+ Read the fields of an event or response in one pass.
+
+ The reader only takes what it can represent exactly. It gives up on messages that aren't a valid
+ JSON object, and on known fields holding escaped strings, fractional or out of range numbers, or
+ non-canonical base64, so the caller can fall back to a general JSON parser for those.
+
+ @param scratch Receives the decoded codec header. It has to stay valid as long as the event.
+ @return false if the message has to go through the general parser.
+ */
+bool ZCCEventParse(const char *json, size_t length, uint8_t *scratch, size_t scratchLength, ZCCEvent *event);
+
+/**
+ Builds one JSON object. Embed it anywhere and set it up with `ZCCJSONWriterInit()`.
+ */
+typedef struct {
+  char *bytes;
+  size_t length;
+  size_t capacity;
+  bool needsComma;
+  bool failed;                  // Out of memory or a NULL string, the output is unusable
+} ZCCJSONWriter;
+
+void ZCCJSONWriterInit(ZCCJSONWriter *writer);
+void ZCCJSONWriterDestroy(ZCCJSONWriter *writer);
+
+void ZCCJSONWriterBeginObject(ZCCJSONWriter *writer);
+void ZCCJSONWriterEndObject(ZCCJSONWriter *writer);
+
+/**
+ @param key Plain ASCII that needs no escaping, such as the protocol's key constants.
+ */
+void ZCCJSONWriterKey(ZCCJSONWriter *writer, const char *key);
+
+/**
+ Write UTF-8 as a JSON string, escaping it as needed. NULL marks the writer failed.
+ */
+void ZCCJSONWriterString(ZCCJSONWriter *writer, const char *utf8, size_t length);
+void ZCCJSONWriterInteger(ZCCJSONWriter *writer, int64_t value);
+void ZCCJSONWriterBool(ZCCJSONWriter *writer, bool value);
+
+/**
+ Write bytes as a base64 string, with padding.
+ */
+void ZCCJSONWriterBase64(ZCCJSONWriter *writer, const uint8_t *bytes, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCCommandCodec_h */
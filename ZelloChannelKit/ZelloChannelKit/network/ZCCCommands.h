@@ -34,6 +34,12 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (NSData *)messageForAudioData:(NSData *)audioData stream:(NSUInteger)streamId;
 
+/**
+ * The header of audio messages for the stream. Audio data appended to it makes a complete message.
+ * @param streamId must be representable as a 32-bit value
+ */
++ (NSData *)audioMessageHeaderForStream:(NSUInteger)streamId;
+
 + (NSData *)messageForImageData:(ZCCImageMessage *)imageMessage imageId:(UInt32)imageId;
 + (NSData *)messageForImageThumbnailData:(ZCCImageMessage *)imageMessage imageId:(UInt32)imageId;
 
@@ -7,52 +7,83 @@
 //
 
 #import "ZCCCommands.h"
+#import "ZCCAudioPacket.h"
+#import "ZCCCommandCodec.h"
 #import "ZCCImageMessage.h"
 #import "ZCCLocationInfo.h"
 #import "ZCCProtocol.h"
 #import "ZCCStreamParams.h"
 
+static void writeKey(ZCCJSONWriter *writer, NSString *key) {
+  ZCCJSONWriterKey(writer, key.UTF8String);
+}
+
+static void writeString(ZCCJSONWriter *writer, NSString *string) {
+  ZCCJSONWriterString(writer, string.UTF8String, [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+}
+
+static void beginCommand(ZCCJSONWriter *writer, NSString *command, NSInteger sequenceNumber) {
+  ZCCJSONWriterInit(writer);
+  ZCCJSONWriterBeginObject(writer);
+  writeKey(writer, ZCCCommandKey);
+  writeString(writer, command);
+  writeKey(writer, ZCCSeqKey);
+  ZCCJSONWriterInteger(writer, sequenceNumber);
+}
+
+static NSString *finishCommand(ZCCJSONWriter *writer, NSString *command) {
+  ZCCJSONWriterEndObject(writer);
+  NSString *encoded = nil;
+  if (!writer->failed) {
+    encoded = [[NSString alloc] initWithBytes:writer->bytes length:writer->length encoding:NSUTF8StringEncoding];
+  }
+  ZCCJSONWriterDestroy(writer);
+  if (!encoded) {
+    NSLog(@"[ZCC] Error serializing %@", command);
+  }
+  return encoded;
+}
+
 @implementation ZCCCommands
 
 + (NSString *)logonWithSequenceNumber:(NSInteger)sequenceNumber authToken:(NSString *)authToken refreshToken:(NSString *)refreshToken channel:(NSString *)channel username:(NSString *)username password:(NSString *)password {
-  NSMutableDictionary *logon = [@{ZCCCommandKey:ZCCCommandLogon,
-                                  ZCCSeqKey:@(sequenceNumber),
-                                  ZCCChannelNameKey:channel,
-                                  ZCCUsernameKey:username,
-                                  ZCCPasswordKey:password} mutableCopy];
+  ZCCJSONWriter writer;
+  beginCommand(&writer, ZCCCommandLogon, sequenceNumber);
+  writeKey(&writer, ZCCChannelNameKey);
+  writeString(&writer, channel);
+  writeKey(&writer, ZCCUsernameKey);
+  writeString(&writer, username);
+  writeKey(&writer, ZCCPasswordKey);
+  writeString(&writer, password);
   if (authToken) {
-    logon[ZCCAuthTokenKey] = authToken;
+    writeKey(&writer, ZCCAuthTokenKey);
+    writeString(&writer, authToken);
   }
   if (refreshToken) {
-    logon[ZCCRefreshTokenKey] = refreshToken;
+    writeKey(&writer, ZCCRefreshTokenKey);
+    writeString(&writer, refreshToken);
   }
-  NSError *serializationError = nil;
-  NSString *logonCommand = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:logon options:0 error:&serializationError] encoding:NSUTF8StringEncoding];
-  if (!logonCommand) {
-    NSLog(@"[ZCC] Error serializing logon: %@", serializationError);
-  }
-  return logonCommand;
+  return finishCommand(&writer, ZCCCommandLogon);
 }
 
 + (NSString *)sendImage:(ZCCImageMessage *)message sequenceNumber:(NSInteger)sequenceNumber {
-  NSMutableDictionary *command = [@{ZCCCommandKey:ZCCCommandSendImage,
-                                    ZCCSeqKey:@(sequenceNumber),
-                                    ZCCStreamTypeKey:@"jpeg",
-                                    ZCCThumbnailContentLengthKey:@(message.thumbnailLength),
-                                    ZCCImageContentLengthKey:@(message.contentLength),
-                                    ZCCImageWidthKey:@(message.width),
-                                    ZCCImageHeightKey:@(message.height)
-                                    } mutableCopy];
+  ZCCJSONWriter writer;
+  beginCommand(&writer, ZCCCommandSendImage, sequenceNumber);
+  writeKey(&writer, ZCCStreamTypeKey);
+  writeString(&writer, @"jpeg");
+  writeKey(&writer, ZCCThumbnailContentLengthKey);
+  ZCCJSONWriterInteger(&writer, (int64_t)message.thumbnailLength);
+  writeKey(&writer, ZCCImageContentLengthKey);
+  ZCCJSONWriterInteger(&writer, (int64_t)message.contentLength);
+  writeKey(&writer, ZCCImageWidthKey);
+  ZCCJSONWriterInteger(&writer, message.width);
+  writeKey(&writer, ZCCImageHeightKey);
+  ZCCJSONWriterInteger(&writer, message.height);
   if (message.recipient.length > 0) {
-    command[ZCCToUserKey] = message.recipient;
-  }
-
-  NSError *serializationError = nil;
-  NSString *encoded = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:command options:0 error:&serializationError] encoding:NSUTF8StringEncoding];
-  if (!encoded) {
-    NSLog(@"[ZCC] Error serializing send_image: %@", serializationError);
+    writeKey(&writer, ZCCToUserKey);
+    writeString(&writer, message.recipient);
   }
-  return encoded;
+  return finishCommand(&writer, ZCCCommandSendImage);
 }
 
 + (NSString *)sendLocation:(ZCCLocationInfo *)location sequenceNumber:(NSInteger)sequenceNumber recipient:(NSString *)username {
@@ -77,67 +108,62 @@
 }
 
 + (NSString *)sendText:(NSString *)message sequenceNumber:(NSInteger)sequenceNumber recipient:(NSString *)username {
-  NSMutableDictionary *text = [@{ZCCCommandKey:ZCCCommandSendTextMessage,
-                                 ZCCSeqKey:@(sequenceNumber),
-                                 ZCCTextContentKey:message} mutableCopy];
+  ZCCJSONWriter writer;
+  beginCommand(&writer, ZCCCommandSendTextMessage, sequenceNumber);
+  writeKey(&writer, ZCCTextContentKey);
+  writeString(&writer, message);
   if (username.length > 0) {
-    text[ZCCToUserKey] = username;
+    writeKey(&writer, ZCCToUserKey);
+    writeString(&writer, username);
   }
-  NSError *serializationError = nil;
-  NSString *textCommand = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:text options:0 error:&serializationError] encoding:NSUTF8StringEncoding];
-  if (!textCommand) {
-    NSLog(@"[ZCC] Error serializing text: %@", serializationError);
-  }
-  return textCommand;
+  return finishCommand(&writer, ZCCCommandSendTextMessage);
 }
 
 + (NSString *)startStreamWithSequenceNumber:(NSInteger)sequenceNumber params:(ZCCStreamParams *)params recipient:(NSString *)username {
-  NSString *base64Header = [params.codecHeader base64EncodedStringWithOptions:0];
-  NSMutableDictionary *startStream = [@{ZCCCommandKey:ZCCCommandStartStream,
-                                        ZCCSeqKey:@(sequenceNumber),
-                                        ZCCStreamTypeKey:params.type,
-                                        ZCCStreamCodecKey:params.codecName,
-                                        ZCCStreamCodecHeaderKey:base64Header,
-                                        ZCCStreamPacketDurationKey:@(params.packetDuration)} mutableCopy];
+  ZCCJSONWriter writer;
+  beginCommand(&writer, ZCCCommandStartStream, sequenceNumber);
+  writeKey(&writer, ZCCStreamTypeKey);
+  writeString(&writer, params.type);
+  writeKey(&writer, ZCCStreamCodecKey);
+  writeString(&writer, params.codecName);
+  writeKey(&writer, ZCCStreamCodecHeaderKey);
+  ZCCJSONWriterBase64(&writer, (const uint8_t *)params.codecHeader.bytes, params.codecHeader.length);
+  writeKey(&writer, ZCCStreamPacketDurationKey);
+  ZCCJSONWriterInteger(&writer, (int64_t)params.packetDuration);
   if (username.length > 0) {
-    startStream[ZCCToUserKey] = username;
+    writeKey(&writer, ZCCToUserKey);
+    writeString(&writer, username);
   }
-  NSError *error = nil;
-  NSString *command = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:startStream options:0 error:&error] encoding:NSUTF8StringEncoding];
-  if (!command) {
-    NSLog(@"[ZCC] Error serializing start stream: %@", error);
-  }
-  return command;
+  return finishCommand(&writer, ZCCCommandStartStream);
 }
 
 + (NSString *)stopStreamWithSequenceNumber:(NSInteger)sequenceNumber streamId:(NSUInteger)streamId {
-  NSDictionary *stop = @{ZCCCommandKey:ZCCCommandStopStream,
-                         ZCCSeqKey:@(sequenceNumber),
-                         ZCCStreamIDKey:@(streamId)
-                         };
-  NSError *serializationError = nil;
-  NSString *stopCommand = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:stop options:0 error:&serializationError] encoding:NSUTF8StringEncoding];
-  if (!stopCommand) {
-    NSLog(@"[ZCC] Error serializing stop: %@", serializationError);
-  }
-  return stopCommand;
+  ZCCJSONWriter writer;
+  beginCommand(&writer, ZCCCommandStopStream, sequenceNumber);
+  writeKey(&writer, ZCCStreamIDKey);
+  ZCCJSONWriterInteger(&writer, (int64_t)streamId);
+  return finishCommand(&writer, ZCCCommandStopStream);
 }
 
 + (NSData *)messageForAudioData:(NSData *)audioData stream:(NSUInteger)streamId {
   NSAssert(streamId > 0 && streamId <= UINT32_MAX, @"streamId out of range (0 < streamId <= UINT32_MAX)");
 
   // { type(8) = 0x01, stream_id(32), packet_id(32) = 0, data[] }
-  NSMutableData *msg = [NSMutableData data];
-  char type = 0x01; // audio
-  [msg appendBytes:&type length:sizeof(type)];
-  uint32_t stream_id = htonl((uint32_t)streamId);
-  [msg appendBytes:&stream_id length:sizeof(stream_id)];
-  uint32_t packet_id = 0;
-  [msg appendBytes:&packet_id length:sizeof(packet_id)];
-  [msg appendData:audioData];
+  NSMutableData *msg = [NSMutableData dataWithLength:ZCCAudioPacketHeaderLength + audioData.length];
+  uint8_t *bytes = (uint8_t *)msg.mutableBytes;
+  ZCCAudioPacketWriteHeader(bytes, (uint32_t)streamId, 0);
+  [audioData getBytes:bytes + ZCCAudioPacketHeaderLength length:audioData.length];
   return msg;
 }
 
++ (NSData *)audioMessageHeaderForStream:(NSUInteger)streamId {
+  NSAssert(streamId > 0 && streamId <= UINT32_MAX, @"streamId out of range (0 < streamId <= UINT32_MAX)");
+
+  uint8_t header[ZCCAudioPacketHeaderLength];
+  ZCCAudioPacketWriteHeader(header, (uint32_t)streamId, 0);
+  return [NSData dataWithBytes:header length:sizeof(header)];
+}
+
 + (NSData *)messageForImageData:(ZCCImageMessage *)imageMessage imageId:(UInt32)imageId {
   NSMutableData *msg = [NSMutableData data];
   char type = 0x02; // image
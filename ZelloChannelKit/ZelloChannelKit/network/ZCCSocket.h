@@ -126,6 +126,14 @@ typedef void (^ZCCSendImageCallback)(BOOL succeeded, UInt32 imageId, NSString *
 - (void)sendStopStream:(NSUInteger)streamId;
 
 - (void)sendAudioData:(NSData *)data stream:(NSUInteger)streamId;
+/// Room that -sendAudioMessageInPlace: needs in front of a message
+@property (class, nonatomic, readonly) NSUInteger messageHeadroom;
+
+/**
+ * Sends an audio message built in place, as the encoder does: messageHeadroom bytes, then the
+ * message header and the audio. The web socket frames it in that room and takes over the buffer.
+ */
+- (void)sendAudioMessageInPlace:(NSMutableData *)buffer;
 
 - (void)sendImage:(ZCCImageMessage *)message callback:(ZCCSendImageCallback)callback timeoutAfter:(NSTimeInterval)timeout;
 - (void)sendImageData:(ZCCImageMessage *)message imageId:(UInt32)imageId;
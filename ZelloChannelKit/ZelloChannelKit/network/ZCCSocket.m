@@ -9,6 +9,8 @@
 #import "ZCCSRWebSocket.h"
 #import "ZCCChannelInfo.h"
 #import "ZCCSocket.h"
+#import "ZCCAudioPacket.h"
+#import "ZCCCommandCodec.h"
 #import "ZCCCommands.h"
 #import "ZCCErrors.h"
 #import "ZCCImageHeader.h"
@@ -17,8 +19,19 @@
 #import "ZCCProtocol.h"
 #import "ZCCQueueRunner.h"
 #import "ZCCStreamParams.h"
+#import "ZCCTimeoutRunner.h"
 #import "ZCCWebSocketFactory.h"
 
+static NSString *stringFromEventString(ZCCEventString string) {
+  return [[NSString alloc] initWithBytes:string.bytes length:string.length encoding:NSUTF8StringEncoding];
+}
+
+// Outstanding requests live in a ring indexed by sequence number, which grows if it fills up
+static const NSUInteger initialCallbackSlots = 64;
+
+// Request timeouts fire up to this late
+static const NSTimeInterval timeoutResolution = 0.1;
+
 typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
   ZCCSocketRequestTypeLogon = 1,
   ZCCSocketRequestTypeStartStream,
@@ -38,7 +51,8 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
  *          work on a particular queue, it is responsible for dispatching to that queue.
  */
 @property (nonatomic, strong) ZCCSimpleCommandCallback simpleCommandCallback;
-@property (nonatomic, strong) dispatch_block_t timeoutBlock;
+@property (nonatomic, copy) void (^timedOut)(ZCCSocketResponseCallback *responseCallback);
+@property (nonatomic) ZCCTimerId timeout;
 - (instancetype)init NS_UNAVAILABLE;
 - (instancetype)initWithSequenceNumber:(NSInteger)sequenceNumber type:(ZCCSocketRequestType)type NS_DESIGNATED_INITIALIZER;
 @end
@@ -62,7 +76,9 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
 
 @property (nonatomic, strong, readonly) ZCCSRWebSocket *webSocket;
 
-@property (nonatomic, strong) NSMutableDictionary <NSNumber *, ZCCSocketResponseCallback *> *callbacks;
+/// @warning Only access callbacks and timeouts from the workRunner's queue
+@property (nonatomic, strong) NSPointerArray *callbacks;
+@property (nonatomic, strong, readonly) ZCCTimeoutRunner *timeouts;
 
 @property (nonatomic, strong) ZCCQueueRunner *delegateRunner;
 
@@ -79,11 +95,16 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
 - (instancetype)initWithURL:(NSURL *)url socketFactory:(ZCCWebSocketFactory *)factory {
   self = [super init];
   if (self) {
-    _callbacks = [[NSMutableDictionary alloc] init];
+    _callbacks = [NSPointerArray strongObjectsPointerArray];
+    _callbacks.count = initialCallbackSlots;
     _delegateRunner = [[ZCCQueueRunner alloc] initWithName:@"ZCCSocketDelegate"];
     _webSocket = [factory socketWithURL:url];
     _webSocket.delegate = self;
     _workRunner = [[ZCCQueueRunner alloc] initWithName:@"ZCCSocket"];
+    __weak ZCCSocket *weakSelf = self;
+    _timeouts = [[ZCCTimeoutRunner alloc] initWithQueue:_workRunner.queue resolution:timeoutResolution handler:^(ZCCSocketResponseCallback *responseCallback) {
+      [weakSelf requestTimedOut:responseCallback];
+    }];
   }
   return self;
 }
@@ -267,24 +288,13 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
     return;
   }
 
-  dispatch_block_t timeoutBlock = nil;
-  if (timeout > 0) {
-    timeoutBlock = dispatch_block_create(0, ^{
-      ZCCSocketResponseCallback *responseCallback = self.callbacks[@(seqNo)];
-      if (responseCallback) {
-        [self.delegateRunner runAsync:^{
-          timedOut(responseCallback);
-        }];
-        self.callbacks[@(seqNo)] = nil;
-      }
-    });
-    [self.workRunner run:timeoutBlock after:timeout];
-  }
-
   ZCCSocketResponseCallback *responseCallback = [[ZCCSocketResponseCallback alloc] initWithSequenceNumber:seqNo type:requestType];
   prepareCallback(responseCallback);
-  responseCallback.timeoutBlock = timeoutBlock;
-  self.callbacks[@(seqNo)] = responseCallback;
+  if (timeout > 0) {
+    responseCallback.timedOut = timedOut;
+    responseCallback.timeout = [self.timeouts runAfter:timeout object:responseCallback];
+  }
+  [self addCallback:responseCallback];
 }
 
 - (void)sendStopStream:(NSUInteger)streamId {
@@ -308,6 +318,18 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
   }
 }
 
++ (NSUInteger)messageHeadroom {
+  return ZCCSRWebSocketFrameHeadroom;
+}
+
+- (void)sendAudioMessageInPlace:(NSMutableData *)buffer {
+  NSError *error = nil;
+  if (![self.webSocket sendDataInPlace:buffer headroom:ZCCSocket.messageHeadroom error:&error]) {
+    // TODO: Add a way to return error instead of logging and silently failing
+    NSLog(@"[ZCC] Failed to send audio: %@", error);
+  }
+}
+
 #pragma mark - SRWebSocketDelegate
 
 - (void)webSocketDidOpen:(ZCCSRWebSocket *)webSocket {
@@ -350,6 +372,10 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
 
 - (void)webSocket:(ZCCSRWebSocket *)webSocket didReceiveMessageWithString:(NSString *)string {
   [self.workRunner runSync:^{
+    if ([self handleEventFast:string]) {
+      return;
+    }
+
     NSError *error = nil;
     NSData *data = [string dataUsingEncoding:NSUTF8StringEncoding];
     NSDictionary *json = [NSJSONSerialization JSONObjectWithData:data options:0 error:&error];
@@ -412,10 +438,118 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
   }];
 }
 
+/**
+ * Handles the responses and stream events that make up most of the traffic during a voice session
+ * straight from the message text, without building a dictionary first. Returns NO for everything
+ * else, including messages with anything to report, so those still go through the handlers below.
+ */
+- (BOOL)handleEventFast:(NSString *)string {
+  const char *json = string.UTF8String;
+  if (!json) {
+    return NO;
+  }
+  uint8_t scratch[64];
+  ZCCEvent event;
+  if (!ZCCEventParse(json, [string lengthOfBytesUsingEncoding:NSUTF8StringEncoding], scratch, sizeof(scratch), &event)) {
+    return NO;
+  }
+  switch (event.kind) {
+    case ZCCEventKindResponse:
+      return [self handleResponseFast:&event];
+
+    case ZCCEventKindOnStreamStart:
+      return [self handleStreamStartFast:&event];
+
+    case ZCCEventKindOnStreamStop:
+      return [self handleStreamStopFast:&event];
+
+    default:
+      return NO;
+  }
+}
+
+- (BOOL)handleResponseFast:(const ZCCEvent *)event {
+  ZCCSocketResponseCallback *callback = [self callbackForSequenceNumber:(NSInteger)event->seq];
+  if (!callback) {
+    return YES;
+  }
+  BOOL succeeded = (event->fields & ZCCEventFieldSuccess) && event->success;
+  NSString *errorMessage = (event->fields & ZCCEventFieldError) ? stringFromEventString(event->error) : nil;
+  switch (callback.requestType) {
+    case ZCCSocketRequestTypeStartStream: {
+      ZCCStartStreamCallback startStreamCallback = callback.startStreamCallback;
+      if (!startStreamCallback) {
+        return NO;
+      }
+      if (succeeded) {
+        if (!(event->fields & ZCCEventFieldStreamId) || event->streamId < 0 || event->streamId > UINT32_MAX) {
+          return NO;
+        }
+        NSUInteger streamId = (NSUInteger)event->streamId;
+        [self.delegateRunner runAsync:^{
+          startStreamCallback(YES, streamId, nil);
+        }];
+      } else {
+        [self.delegateRunner runAsync:^{
+          startStreamCallback(NO, 0, errorMessage);
+        }];
+      }
+      break;
+    }
+
+    case ZCCSocketRequestTypeTextMessage:
+    case ZCCSocketRequestTypeLocationMessage: {
+      ZCCSimpleCommandCallback simpleCallback = callback.simpleCommandCallback;
+      if (!simpleCallback) {
+        return NO;
+      }
+      if (succeeded) {
+        simpleCallback(YES, nil);
+      } else {
+        simpleCallback(NO, errorMessage ?: @"Unknown server error");
+      }
+      break;
+    }
+
+    default:
+      return NO;
+  }
+  [self finishResponse:callback];
+  return YES;
+}
+
+- (BOOL)handleStreamStartFast:(const ZCCEvent *)event {
+  uint32_t required = ZCCEventFieldType | ZCCEventFieldCodec | ZCCEventFieldCodecHeader | ZCCEventFieldPacketDuration |
+                      ZCCEventFieldStreamId | ZCCEventFieldChannel | ZCCEventFieldFrom;
+  if ((event->fields & required) != required || event->packetDuration < 0 || event->streamId < 0 || event->streamId > UINT32_MAX) {
+    return NO;
+  }
+  ZCCStreamParams *params = [[ZCCStreamParams alloc] init];
+  params.codecName = stringFromEventString(event->codec);
+  params.type = stringFromEventString(event->type);
+  params.codecHeader = [NSData dataWithBytes:event->codecHeader length:event->codecHeaderLength];
+  params.packetDuration = (NSUInteger)event->packetDuration;
+  NSString *channel = stringFromEventString(event->channel);
+  NSString *from = stringFromEventString(event->from);
+  if (!params.codecName || !params.type || !channel || !from) {
+    return NO;
+  }
+  [self reportStreamStart:(NSUInteger)event->streamId params:params channel:channel sender:from];
+  return YES;
+}
+
+- (BOOL)handleStreamStopFast:(const ZCCEvent *)event {
+  if (!(event->fields & ZCCEventFieldStreamId) || event->streamId < 0 || event->streamId > UINT32_MAX) {
+    return NO;
+  }
+  [self reportStreamStop:(NSUInteger)event->streamId];
+  return YES;
+}
+
 - (void)handleResponse:(NSDictionary *)encoded original:(NSString *)original {
   NSNumber *seq = encoded[ZCCSeqKey];
-  ZCCSocketResponseCallback *callback = self.callbacks[seq];
-  if (!callback) {
+  ZCCSocketResponseCallback *callback = [self callbackForSequenceNumber:seq.integerValue];
+  if (!callback || ![seq isEqualToNumber:@(callback.sequenceNumber)]) {
     return;
   }
   switch (callback.requestType) {
@@ -436,10 +570,23 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
       [self handleSendImageResponse:encoded callback:callback original:original];
       break;
   }
-  if (callback.timeoutBlock) {
-    dispatch_block_cancel(callback.timeoutBlock);
+  [self finishResponse:callback];
+}
+
+- (void)finishResponse:(ZCCSocketResponseCallback *)callback {
+  [self.timeouts cancel:callback.timeout];
+  [self removeCallback:callback];
+}
+
+- (void)requestTimedOut:(ZCCSocketResponseCallback *)callback {
+  if ([self callbackForSequenceNumber:callback.sequenceNumber] != callback) {
+    return;
   }
-  self.callbacks[seq] = nil;
+  [self removeCallback:callback];
+  void (^timedOut)(ZCCSocketResponseCallback *) = callback.timedOut;
+  [self.delegateRunner runAsync:^{
+    timedOut(callback);
+  }];
 }
 
 - (void)handleLogonResponse:(NSDictionary *)encoded callback:(ZCCSocketResponseCallback *)callback original:(NSString *)original {
@@ -671,10 +818,14 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
   params.type = type;
   params.codecHeader = headerData;
   params.packetDuration = (NSUInteger)packetDurationValue;
+  [self reportStreamStart:(NSUInteger)streamIdValue params:params channel:channel sender:from];
+}
+
+- (void)reportStreamStart:(NSUInteger)streamId params:(ZCCStreamParams *)params channel:(NSString *)channel sender:(NSString *)sender {
   id<ZCCSocketDelegate> delegate = self.delegate;
   if ([delegate respondsToSelector:@selector(socket:didStartStreamWithId:params:channel:sender:)]) {
     [self.delegateRunner runAsync:^{
-      [delegate socket:self didStartStreamWithId:(NSUInteger)streamIdValue params:params channel:channel sender:from];
+      [delegate socket:self didStartStreamWithId:streamId params:params channel:channel sender:sender];
     }];
   }
 }
@@ -691,11 +842,14 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
     [self reportInvalidJSONInMessage:ZCCEventOnStreamStop key:ZCCStreamIDKey errorDescription:@"stream_id out of range" original:original];
     return;
   }
+  [self reportStreamStop:(NSUInteger)streamIdValue];
+}
 
+- (void)reportStreamStop:(NSUInteger)streamId {
   id<ZCCSocketDelegate> delegate = self.delegate;
   if ([delegate respondsToSelector:@selector(socket:didStopStreamWithId:)]) {
     [self.delegateRunner runAsync:^{
-      [delegate socket:self didStopStreamWithId:(NSUInteger)streamIdValue];
+      [delegate socket:self didStopStreamWithId:streamId];
     }];
   }
 }
@@ -889,8 +1043,8 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
 }
 
 - (void)handleAudioData:(NSData *)data {
-  NSUInteger minValidLength = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t);
-  if (data.length < minValidLength) { // minimum audio data message is 9 bytes
+  ZCCAudioPacket packet;
+  if (!ZCCAudioPacketParse((const uint8_t *)data.bytes, data.length, &packet)) {
     uint8_t type = 0;
     if (data.length >= 1) {
       [data getBytes:&type length:1];
@@ -899,16 +1053,12 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
     return;
   }
 
-  uint32_t streamId = 0;
-  NSUInteger streamIdOffset = 1; // 1 byte for type
-  [data getBytes:&streamId range:NSMakeRange(streamIdOffset, sizeof(streamId))];
-  streamId = ntohl(streamId);
-  uint32_t packetId = 0;
-  NSUInteger packetIdOffset = streamIdOffset + sizeof(streamId);
-  [data getBytes:&packetId range:NSMakeRange(packetIdOffset, sizeof(packetId))];
-  packetId = ntohl(packetId);
-  NSUInteger dataOffset = packetIdOffset + sizeof(packetId);
-  NSData *audio = [data subdataWithRange:NSMakeRange(dataOffset, data.length - dataOffset)];
+  uint32_t streamId = packet.streamId;
+  uint32_t packetId = packet.packetId;
+  // A view into the message, which the deallocator keeps alive for as long as the audio is in use
+  NSData *audio = [[NSData alloc] initWithBytesNoCopy:(void *)packet.audio length:packet.audioLength deallocator:^(void *bytes, NSUInteger length) {
+    (void)data;
+  }];
   id<ZCCSocketDelegate> delegate = self.delegate;
   if ([delegate respondsToSelector:@selector(socket:didReceiveAudioData:streamId:packetId:)]) {
     [self.delegateRunner runAsync:^{
@@ -961,6 +1111,35 @@ typedef NS_ENUM(NSInteger, ZCCSocketRequestType) {
     return self.nextSequenceNumber;
 }
 
+- (nullable ZCCSocketResponseCallback *)callbackForSequenceNumber:(NSInteger)seqNo {
+  NSUInteger index = (NSUInteger)seqNo & (self.callbacks.count - 1);
+  ZCCSocketResponseCallback *callback = (__bridge ZCCSocketResponseCallback *)[self.callbacks pointerAtIndex:index];
+  return callback.sequenceNumber == seqNo ? callback : nil;
+}
+
+- (void)addCallback:(ZCCSocketResponseCallback *)callback {
+  // The slot only stays taken if a request from a full turn of the ring ago is still waiting
+  while ([self.callbacks pointerAtIndex:(NSUInteger)callback.sequenceNumber & (self.callbacks.count - 1)]) {
+    NSPointerArray *callbacks = [NSPointerArray strongObjectsPointerArray];
+    callbacks.count = self.callbacks.count * 2;
+    for (NSUInteger index = 0; index < self.callbacks.count; index++) {
+      ZCCSocketResponseCallback *waiting = (__bridge ZCCSocketResponseCallback *)[self.callbacks pointerAtIndex:index];
+      if (waiting) {
+        [callbacks replacePointerAtIndex:(NSUInteger)waiting.sequenceNumber & (callbacks.count - 1) withPointer:(__bridge void *)waiting];
+      }
+    }
+    self.callbacks = callbacks;
+  }
+  [self.callbacks replacePointerAtIndex:(NSUInteger)callback.sequenceNumber & (self.callbacks.count - 1) withPointer:(__bridge void *)callback];
+}
+
+- (void)removeCallback:(ZCCSocketResponseCallback *)callback {
+  NSUInteger index = (NSUInteger)callback.sequenceNumber & (self.callbacks.count - 1);
+  if ([self.callbacks pointerAtIndex:index] == (__bridge void *)callback) {
+    [self.callbacks replacePointerAtIndex:index withPointer:NULL];
+  }
+}
+
 - (void)reportError:(nonnull NSString *)errorMessage {
   id<ZCCSocketDelegate> delegate = self.delegate;
   if ([delegate respondsToSelector:@selector(socket:didReportError:)]) {
@@ -15,7 +15,10 @@
   self = [super init];
   if (self) {
     _createWebSocket = ^(NSURL *url) {
-      return [[ZCCSRWebSocket alloc] initWithURL:url];
+      ZCCSRWebSocket *socket = [[ZCCSRWebSocket alloc] initWithURL:url];
+      // Commands and events are JSON text and compress well; audio goes out in binary frames untouched
+      socket.compressionEnabled = YES;
+      return socket;
     };
   }
   return self;
@@ -13,6 +13,9 @@
 @interface ZCCIncomingVoiceStream (Internal)
 
 @property (nonatomic) BOOL autoStart;
+/// Set by ZCCStreamArbiter. A demoted stream keeps its packets without starting a decoder until it
+/// is promoted; one demoted while playing keeps time with silence instead of being decoded.
+@property (nonatomic) BOOL demoted;
 
 - (nonnull instancetype)initWith:(NSUInteger)streamId
                           header:(nonnull NSData *)header
@@ -24,4 +27,11 @@
 - (void)onData:(nonnull NSData *)data packetId:(NSUInteger)packetId;
 - (void)onStreamStop;
 
+/**
+ * What each stage up to playback cost, in milliseconds: "buffered" before the decoder was
+ * requested, then "decoderCreated", "decoderPrepared", "decoderReady" and "playbackStarted".
+ * Stages the stream hasn't reached are left out, so a stream that was never played reports none.
+ */
+- (nonnull NSDictionary<NSString *, NSNumber *> *)lifecycleTimings;
+
 @end
@@ -20,6 +20,15 @@ NS_ASSUME_NONNULL_BEGIN
  */
 @property (nonatomic, copy, readonly) NSString *sender;
 
+/**
+ * @abstract Playback volume of the stream, from 0 to 100
+ *
+ * @discussion Defaults to 100. A stream at volume 0 isn't decoded, it only keeps its place, so
+ * muting streams nobody is listening to saves CPU. Setting the volume back up resumes decoding
+ * within a packet or two. Custom voice receivers get silence while the stream is muted.
+ */
+@property (atomic) NSInteger volume;
+
 @end
 
 NS_ASSUME_NONNULL_END
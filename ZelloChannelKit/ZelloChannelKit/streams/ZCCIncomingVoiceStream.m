@@ -17,22 +17,46 @@
 // TODO: Replace this with proper jitter buffer
 static const NSUInteger prebufferPackets = 3;
 
+// Packets waiting to be played are kept in a ring this big, a power of two. At 60 ms per packet
+// it holds 15 seconds, so a stream only loses audio if playback falls that far behind.
+static const uint32_t packetWindowSize = 256;
+
 @interface ZCCIncomingVoiceStream () <ZCCDecoderDelegate>
 
-@property (nonatomic, readonly) ZCCDecoder *decoder;
-@property (nonatomic, readonly) NSMutableArray *audioData;
-// long long because it needs to handle range from 1..UINT32_MAX but also uses -1 as a signal value
-@property (nonatomic) long long firstPacketId;
-@property (nonatomic) NSUInteger playbackPosition;
+/// Created once the stream is about to play, until then packets are only buffered
+@property (nonatomic, strong) ZCCDecoder *decoder;
+@property (nonatomic, readonly) NSData *header;
+@property (nonatomic, readonly) NSUInteger packetDuration;
+@property (nonatomic, readonly, nullable) ZCCIncomingVoiceConfiguration *configuration;
+/// Packets by packetId modulo packetWindowSize, from nextPacketId up to endPacketId
+@property (nonatomic, readonly) NSPointerArray *packetWindow;
+/// Packets stored since the stream started, played or not
+@property (nonatomic) NSUInteger receivedPackets;
+/// Packet IDs count modulo 2^32, compare them by their difference
+@property (nonatomic) uint32_t nextPacketId;
+@property (nonatomic) uint32_t endPacketId;
 @property (nonatomic) BOOL decoderReady;
 @property (nonatomic) BOOL decoderStarted;
 
 @property (nonatomic) BOOL finished;
+/// Stopped for good, or finished without being played. Checked with self locked before a decoder is set.
+@property (nonatomic) BOOL ended;
+
+// Lifecycle timestamps, see -lifecycleTimings
+@property (nonatomic) NSTimeInterval createdAt;
+@property (nonatomic) NSTimeInterval decoderRequestedAt;
+@property (nonatomic) NSTimeInterval decoderCreatedAt;
+@property (nonatomic) NSTimeInterval decoderPreparedAt;
+@property (nonatomic) NSTimeInterval decoderReadyAt;
+@property (nonatomic) NSTimeInterval decoderStartedAt;
+@property (nonatomic) NSTimeInterval playbackStartedAt;
 
 @end
 
 @implementation ZCCIncomingVoiceStream {
   BOOL _autoStart;
+  NSInteger _volume;
+  BOOL _demoted;
 }
 
 - (instancetype)initWith:(NSUInteger)streamId
@@ -44,13 +68,14 @@ static const NSUInteger prebufferPackets = 3;
   self = [super initWithStreamId:streamId channel:channel isIncoming:YES];
   if (self) {
     _sender = user;
-    _audioData = [@[] mutableCopy];
-    _decoder = [[ZCCCodecFactory instance] createDecoderWithConfiguration:configuration stream:self];
-    _firstPacketId = -1;
+    _packetWindow = [NSPointerArray strongObjectsPointerArray];
+    _packetWindow.count = packetWindowSize;
+    _header = [header copy];
+    _packetDuration = duration;
+    _configuration = configuration;
     _decoderReady = NO;
-    _decoder.delegate = self;
-    [_decoder setPacketDuration:duration];
-    [_decoder prepareAsync:header withPlaybackAmplifierGain:0];
+    _volume = 100;
+    _createdAt = [NSProcessInfo processInfo].systemUptime;
   }
   return self;
 }
@@ -65,6 +90,44 @@ static const NSUInteger prebufferPackets = 3;
   _autoStart = autoStart;
 }
 
+- (NSInteger)volume {
+  return _volume;
+}
+
+- (void)setVolume:(NSInteger)volume {
+  @synchronized (self) {
+    _volume = MAX(0, MIN(volume, 100));
+    [self applyVolume];
+  }
+}
+
+- (BOOL)demoted {
+  return _demoted;
+}
+
+- (void)setDemoted:(BOOL)demoted {
+  @synchronized (self) {
+    if (demoted == _demoted) {
+      return;
+    }
+    _demoted = demoted;
+    [self applyVolume];
+  }
+  if (!demoted) {
+    // Whatever waited in the window while demoted starts playing now
+    [self startIfReady];
+  }
+}
+
+/**
+ * Decoders skip decoding at volume 0, which is what a stream demoted while playing plays at. Volume
+ * and demotion change on other queues than the one creating the decoder, so only call with self
+ * locked.
+ */
+- (void)applyVolume {
+  self.decoder.volume = _demoted ? 0 : _volume;
+}
+
 #pragma mark - Internal methods
 
 - (void)start {
@@ -75,57 +138,170 @@ static const NSUInteger prebufferPackets = 3;
 
 - (void)stop {
   [super stop];
+  @synchronized (self) {
+    self.ended = YES;
+  }
   [self.decoder stop];
   self.state = ZCCStreamStateStopped;
 }
 
 - (void)onData:(NSData *)data packetId:(NSUInteger)packetId {
-  if (self.firstPacketId == -1) {
-    self.firstPacketId = (long long)packetId;
-  }
-  NSUInteger first = (NSUInteger)self.firstPacketId;
-  // if (index < 0) return
-  if (first > packetId) {
+  if (![self storePacket:data packetId:(uint32_t)packetId]) {
     return;
   }
-  NSUInteger index = packetId - first;
-  // Fill gaps with NSNull
-  while (index > self.audioData.count) {
-    [self.audioData addObject:[NSNull null]];
-  }
-  if (index == self.audioData.count) {
-    [self.audioData addObject:data];
-  } else if (index < self.audioData.count) {
-    self.audioData[index] = data;
-  }
   [self touch];
+  [self.decoder packetsAvailable];
   [self startIfReady];
 }
 
+/**
+ * Puts a packet into the window. Packets that were already played or skipped are dropped, and so
+ * are duplicates. A packet beyond the end of the window slides it forward, skipping the oldest
+ * packets that weren't played. One further past the newest packet than the window is long means
+ * the sender skipped ahead, so the window starts over from it rather than waiting for the gap.
+ */
+- (BOOL)storePacket:(NSData *)data packetId:(uint32_t)packetId {
+  @synchronized (self.packetWindow) {
+    if (self.receivedPackets == 0) {
+      self.nextPacketId = packetId;
+      self.endPacketId = packetId;
+    }
+    uint32_t ahead = packetId - self.nextPacketId;
+    if (ahead >= UINT32_MAX / 2) {
+      return NO;
+    }
+    if (ahead >= packetWindowSize) {
+      uint32_t skipTo = packetId - packetWindowSize + 1;
+      if ((uint32_t)(packetId - self.endPacketId) >= packetWindowSize) {
+        skipTo = packetId;
+      }
+      for (uint32_t skipped = self.nextPacketId; skipped != skipTo && skipped != self.endPacketId; skipped++) {
+        [self.packetWindow replacePointerAtIndex:skipped & (packetWindowSize - 1) withPointer:NULL];
+      }
+      self.nextPacketId = skipTo;
+      if ((uint32_t)(self.endPacketId - skipTo) >= UINT32_MAX / 2) {
+        self.endPacketId = skipTo;
+      }
+    }
+    NSUInteger index = packetId & (packetWindowSize - 1);
+    if ([self.packetWindow pointerAtIndex:index]) {
+      return NO;
+    }
+    [self.packetWindow replacePointerAtIndex:index withPointer:(__bridge void *)data];
+    if ((uint32_t)(packetId - self.endPacketId) < UINT32_MAX / 2) {
+      self.endPacketId = packetId + 1;
+    }
+    self.receivedPackets++;
+    return YES;
+  }
+}
+
+- (NSUInteger)countReceivedPackets {
+  @synchronized (self.packetWindow) {
+    return self.receivedPackets;
+  }
+}
+
 - (void)onStreamStop {
   self.finished = YES;
   self.state = ZCCStreamStateStopped;
+  BOOL unplayed;
+  @synchronized (self) {
+    unplayed = _demoted && !self.decoder && !self.ended;
+    if (unplayed) {
+      self.ended = YES;
+    }
+  }
+  if (unplayed) {
+    // Demoted all along, so there is no decoder to play it out and tell us when it's done
+    [self.delegate voiceStreamDidStop:self];
+    return;
+  }
+  [self.decoder packetsAvailable];
   [self startIfReady];
 }
 
+/**
+ * Demoted streams don't get a decoder or player. Their packets wait in the window, so a promotion
+ * comes back here and plays them without having to wait for more.
+ */
 - (void)startIfReady {
-  if (!self.decoderStarted && self.decoderReady && (self.audioData.count > prebufferPackets) &&
-      (self.autoStart || self.finished)) {
+  if (self.decoderStarted || (self.countReceivedPackets <= prebufferPackets) || !(self.autoStart || self.finished)) {
+    return;
+  }
+  @synchronized (self) {
+    if (self.ended || (_demoted && !self.decoder)) {
+      return;
+    }
+  }
+  if (!self.decoder) {
+    // Comes back here once the decoder is ready
+    [self prepareDecoder];
+    return;
+  }
+  if (self.decoderReady) {
+    self.decoderStartedAt = [NSProcessInfo processInfo].systemUptime;
     [self.decoder start];
     self.decoderStarted = YES;
   }
 }
 
-- (NSData *)dataForDecoder:(ZCCDecoder *)decoder {
-  if (self.playbackPosition >= self.audioData.count) {
-    if (self.finished) {
-      return ZCCPlayer.stopCookie;
+- (void)prepareDecoder {
+  self.decoderRequestedAt = [NSProcessInfo processInfo].systemUptime;
+  ZCCDecoder *decoder = [[ZCCCodecFactory instance] createDecoderWithConfiguration:self.configuration stream:self];
+  decoder.delegate = self;
+  [decoder setPacketDuration:self.packetDuration];
+  @synchronized (self) {
+    if (self.ended || self.decoder) {
+      // Ended or started by another queue in the meantime
+      return;
+    }
+    self.decoder = decoder;
+    [self applyVolume];
+  }
+  self.decoderCreatedAt = [NSProcessInfo processInfo].systemUptime;
+  [decoder prepareAsync:self.header withPlaybackAmplifierGain:0];
+  self.decoderPreparedAt = [NSProcessInfo processInfo].systemUptime;
+  // Hand over what was buffered while there was no decoder
+  [decoder packetsAvailable];
+}
+
+- (NSDictionary<NSString *, NSNumber *> *)lifecycleTimings {
+  NSMutableDictionary<NSString *, NSNumber *> *timings = [NSMutableDictionary dictionary];
+  if (self.decoderRequestedAt > 0) {
+    timings[@"buffered"] = @((self.decoderRequestedAt - self.createdAt) * 1000);
+    timings[@"decoderCreated"] = @((self.decoderCreatedAt - self.decoderRequestedAt) * 1000);
+    timings[@"decoderPrepared"] = @((self.decoderPreparedAt - self.decoderCreatedAt) * 1000);
+  }
+  if (self.decoderReadyAt > 0) {
+    timings[@"decoderReady"] = @((self.decoderReadyAt - self.decoderCreatedAt) * 1000);
+  }
+  if (self.playbackStartedAt > 0) {
+    timings[@"playbackStarted"] = @((self.playbackStartedAt - self.decoderStartedAt) * 1000);
+  }
+  return timings;
+}
+
+- (NSData *)dataForDecoder:(ZCCDecoder *)decoder skipMissing:(BOOL)skipMissing {
+  NSData *packet = nil;
+  @synchronized (self.packetWindow) {
+    if (self.nextPacketId == self.endPacketId) {
+      if (self.finished) {
+        return ZCCPlayer.stopCookie;
+      }
+      return nil;
+    }
+    // Played packets are released right away
+    NSUInteger index = self.nextPacketId & (packetWindowSize - 1);
+    packet = (__bridge NSData *)[self.packetWindow pointerAtIndex:index];
+    if (!packet && !skipMissing) {
+      // Late, but there is still time for it to arrive
+      return nil;
     }
-    return nil;
+    [self.packetWindow replacePointerAtIndex:index withPointer:NULL];
+    self.nextPacketId++;
   }
-  NSData *packet = self.audioData[self.playbackPosition];
-  ++self.playbackPosition;
-  if (!packet || (NSNull *)packet == [NSNull null]) {
+  if (!packet) {
     packet = [self.decoder getMissingPacket];
   }
 
@@ -141,11 +317,13 @@ static const NSUInteger prebufferPackets = 3;
 }
 
 - (void)decoderDidBecomeReady:(ZCCDecoder *)decoder {
+  self.decoderReadyAt = [NSProcessInfo processInfo].systemUptime;
   self.decoderReady = YES;
   [self startIfReady];
 }
 
 - (void)decoderDidStart:(ZCCDecoder *)decoder {
+  self.playbackStartedAt = [NSProcessInfo processInfo].systemUptime;
   self.state = ZCCStreamStateActive;
   [self.delegate voiceStreamDidStart:self];
 }
@@ -11,6 +11,7 @@
 #import "ZCCAudioHelper.h"
 #import "ZCCAudioUtils.h"
 #import "ZCCCodecFactory.h"
+#import "ZCCCommands.h"
 #import "ZCCEncoder.h"
 #import "ZCCErrors.h"
 #import "ZCCOutgoingVoiceConfiguration.h"
@@ -89,6 +90,9 @@
       return;
     }
     self.streamId = streamId;
+    // The encoder writes each packet right behind the message header, leaving room for the frame
+    self.encoder.packetPrefix = [ZCCCommands audioMessageHeaderForStream:streamId];
+    self.encoder.packetHeadroom = ZCCSocket.messageHeadroom;
     [self.encoder prepareAsync:0];
   };
   ZCCStreamParams *params = [[ZCCStreamParams alloc] initWithType:ZCCStreamTypeAudio encoder:self.encoder];
@@ -104,7 +108,9 @@
 #pragma mark - ZCCEncoderDelegate
 
 - (void)encoder:(ZCCEncoder *)encoder didProduceData:(NSData *)audioData {
-  [self.socket sendAudioData:audioData stream:self.streamId];
+  // Packets come in mutable buffers with the headroom we asked for, the socket frames them there
+  NSMutableData *message = [audioData isKindOfClass:[NSMutableData class]] ? (NSMutableData *)audioData : [audioData mutableCopy];
+  [self.socket sendAudioMessageInPlace:message];
   [self touch];
 
   self.position += encoder.packetDuration / 1000.0; // packetDuration is ms
@@ -0,0 +1,21 @@
+//
+//  ZCCStreamArbiter+Internal.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import "ZCCStreamArbiter.h"
+
+@class ZCCIncomingVoiceStream;
+
+@interface ZCCStreamArbiter (Internal)
+
+/// Called by voice stream managers when a stream starts and when it goes away
+- (void)addStream:(nonnull ZCCIncomingVoiceStream *)stream;
+- (void)removeStream:(nonnull ZCCIncomingVoiceStream *)stream;
+/// Removes the streams before returning, so another arbiter can take them over without this one
+/// undoing its decisions afterwards
+- (void)removeStreamsNow:(nonnull NSArray<ZCCIncomingVoiceStream *> *)streams;
+
+@end
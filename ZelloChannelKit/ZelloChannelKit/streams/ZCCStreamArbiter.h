@@ -0,0 +1,61 @@
+//
+//  ZCCStreamArbiter.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * @abstract Limits how many incoming voice streams are decoded at the same time
+ *
+ * @discussion When you monitor many channels, several of them may be talking at once. A stream
+ * arbiter ranks the incoming streams of every session it is assigned to and only decodes the
+ * <code>maxDecodedStreams</code> most important ones. Streams that haven't started playing yet
+ * only buffer their packets, without a decoder or player, and start from the oldest packet still
+ * buffered once they rank high enough. Streams that were already playing keep playing silence in
+ * step with the server and are decoded again starting with their next packet.
+ *
+ * Streams rank by the sum of their channel's and their sender's priorities, highest first. Streams
+ * with the same priority rank by when they started, newest first.
+ */
+@interface ZCCStreamArbiter : NSObject
+
+/**
+ * @abstract How many incoming streams are decoded at once
+ */
+@property (atomic) NSUInteger maxDecodedStreams;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * @abstract Creates a stream arbiter
+ *
+ * @param count how many incoming streams are decoded at once
+ */
+- (instancetype)initWithMaxDecodedStreams:(NSUInteger)count NS_DESIGNATED_INITIALIZER;
+
+/**
+ * @abstract Sets the priority of streams in a channel
+ *
+ * @param priority added to the priority of every stream in the channel. Channels default to 0.
+ *
+ * @param channel the name of the channel
+ */
+- (void)setPriority:(NSInteger)priority forChannel:(NSString *)channel;
+
+/**
+ * @abstract Sets the priority of streams from a user
+ *
+ * @param priority added to the priority of every stream the user sends. Users default to 0.
+ *
+ * @param sender the username of the speaker
+ */
+- (void)setPriority:(NSInteger)priority forSender:(NSString *)sender;
+
+@end
+
+NS_ASSUME_NONNULL_END
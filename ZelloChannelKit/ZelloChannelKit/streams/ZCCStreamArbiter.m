@@ -0,0 +1,133 @@
+//
+//  ZCCStreamArbiter.m
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import "ZCCStreamArbiter+Internal.h"
+#import "ZCCIncomingVoiceStream+Internal.h"
+#import "ZCCQueueRunner.h"
+
+@implementation ZCCStreamArbiter {
+  ZCCQueueRunner *_runner;
+  NSUInteger _maxDecodedStreams;
+  NSMutableDictionary<NSString *, NSNumber *> *_channelPriorities;
+  NSMutableDictionary<NSString *, NSNumber *> *_senderPriorities;
+  // Oldest first
+  NSMutableArray<ZCCIncomingVoiceStream *> *_streams;
+}
+
+- (instancetype)initWithMaxDecodedStreams:(NSUInteger)count {
+  self = [super init];
+  if (self) {
+    _runner = [[ZCCQueueRunner alloc] initWithName:@"ZCCStreamArbiter"];
+    _maxDecodedStreams = count;
+    _channelPriorities = [[NSMutableDictionary alloc] init];
+    _senderPriorities = [[NSMutableDictionary alloc] init];
+    _streams = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+#pragma mark - Properties
+
+- (NSUInteger)maxDecodedStreams {
+  __block NSUInteger count;
+  [_runner runSync:^{
+    count = self->_maxDecodedStreams;
+  }];
+  return count;
+}
+
+- (void)setMaxDecodedStreams:(NSUInteger)count {
+  [_runner runAsync:^{
+    self->_maxDecodedStreams = count;
+    [self arbitrate];
+  }];
+}
+
+#pragma mark - Public methods
+
+- (void)setPriority:(NSInteger)priority forChannel:(NSString *)channel {
+  [_runner runAsync:^{
+    self->_channelPriorities[channel] = @(priority);
+    [self arbitrate];
+  }];
+}
+
+- (void)setPriority:(NSInteger)priority forSender:(NSString *)sender {
+  [_runner runAsync:^{
+    self->_senderPriorities[sender] = @(priority);
+    [self arbitrate];
+  }];
+}
+
+#pragma mark - Internal
+
+- (void)addStream:(ZCCIncomingVoiceStream *)stream {
+  [_runner runAsync:^{
+    if ([self->_streams indexOfObjectIdenticalTo:stream] != NSNotFound) {
+      return;
+    }
+    [self->_streams addObject:stream];
+    [self arbitrate];
+  }];
+}
+
+- (void)removeStream:(ZCCIncomingVoiceStream *)stream {
+  [_runner runAsync:^{
+    NSUInteger index = [self->_streams indexOfObjectIdenticalTo:stream];
+    if (index == NSNotFound) {
+      return;
+    }
+    [self->_streams removeObjectAtIndex:index];
+    // Decoded as usual if it is handed to another arbiter or none
+    stream.demoted = NO;
+    [self arbitrate];
+  }];
+}
+
+- (void)removeStreamsNow:(NSArray<ZCCIncomingVoiceStream *> *)streams {
+  [_runner runSync:^{
+    for (ZCCIncomingVoiceStream *stream in streams) {
+      NSUInteger index = [self->_streams indexOfObjectIdenticalTo:stream];
+      if (index == NSNotFound) {
+        continue;
+      }
+      [self->_streams removeObjectAtIndex:index];
+      stream.demoted = NO;
+    }
+    [self arbitrate];
+  }];
+}
+
+#pragma mark - Private
+
+- (NSInteger)priorityOf:(ZCCIncomingVoiceStream *)stream {
+  return _channelPriorities[stream.channel].integerValue + _senderPriorities[stream.sender].integerValue;
+}
+
+/**
+ * Decodes the top streams and demotes the rest. There are rarely more than a few dozen streams, so
+ * they are simply ranked again whenever anything changes.
+ *
+ * @warning Only call from runner
+ */
+- (void)arbitrate {
+  // The sort is stable, so streams with the same priority stay newest first
+  NSArray<ZCCIncomingVoiceStream *> *newestFirst = _streams.reverseObjectEnumerator.allObjects;
+  NSArray<ZCCIncomingVoiceStream *> *ranked = [newestFirst sortedArrayWithOptions:NSSortStable usingComparator:^NSComparisonResult(ZCCIncomingVoiceStream *a, ZCCIncomingVoiceStream *b) {
+    NSInteger priorityA = [self priorityOf:a];
+    NSInteger priorityB = [self priorityOf:b];
+    if (priorityA == priorityB) {
+      return NSOrderedSame;
+    }
+    return priorityA > priorityB ? NSOrderedAscending : NSOrderedDescending;
+  }];
+  [ranked enumerateObjectsUsingBlock:^(ZCCIncomingVoiceStream *stream, NSUInteger index, BOOL *stop) {
+    stream.demoted = index >= self->_maxDecodedStreams;
+  }];
+}
+
+@end
@@ -0,0 +1,253 @@
+//
+//  ZCCStreamTable.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCStreamTable.h"
+
+#include <stdlib.h>
+
+namespace {
+
+const uint32_t InitialSlots = 16;
+const uint32_t InitialBuckets = 32;
+
+struct Slot {
+  uint32_t streamId;
+  int32_t prev;                 // Order of addition, kept on removal so a walk can continue
+  int32_t next;
+  int32_t nextFree;
+  bool used;
+  bool keyed;
+};
+
+// Linear probing, kept at most half full. Deletion shifts entries back instead of leaving
+// tombstones, so lookups stop at the first empty bucket.
+struct Bucket {
+  uint32_t streamId;
+  int32_t slot;                 // ZCCStreamTableNoSlot if empty
+};
+
+}
+
+struct ZCCStreamTable {
+  Slot *slots;
+  uint32_t slotCapacity;
+  uint32_t slotsUsed;           // Slots ever handed out
+  int32_t freeSlot;
+  int32_t first;
+  int32_t last;
+  size_t count;
+
+  Bucket *buckets;
+  uint32_t bucketMask;
+  uint32_t bucketShift;
+  uint32_t keyedCount;
+};
+
+namespace {
+
+inline uint32_t home(const ZCCStreamTable *table, uint32_t streamId) {
+  // Fibonacci hashing, server ids are sequential
+  return (streamId * 2654435769u) >> table->bucketShift;
+}
+
+Bucket *allocateBuckets(uint32_t count) {
+  Bucket *buckets = (Bucket *)malloc(count * sizeof(Bucket));
+  if (buckets) {
+    for (uint32_t i = 0; i < count; i++) {
+      buckets[i].slot = ZCCStreamTableNoSlot;
+    }
+  }
+  return buckets;
+}
+
+void insertBucket(ZCCStreamTable *table, uint32_t streamId, int32_t slot) {
+  uint32_t i = home(table, streamId);
+  while (table->buckets[i].slot != ZCCStreamTableNoSlot) {
+    i = (i + 1) & table->bucketMask;
+  }
+  table->buckets[i].streamId = streamId;
+  table->buckets[i].slot = slot;
+}
+
+bool growBuckets(ZCCStreamTable *table) {
+  uint32_t count = (table->bucketMask + 1) * 2;
+  if (count == 0) {
+    return false;
+  }
+  Bucket *buckets = allocateBuckets(count);
+  if (!buckets) {
+    return false;
+  }
+  Bucket *old = table->buckets;
+  uint32_t oldCount = table->bucketMask + 1;
+  table->buckets = buckets;
+  table->bucketMask = count - 1;
+  table->bucketShift--;
+  for (uint32_t i = 0; i < oldCount; i++) {
+    if (old[i].slot != ZCCStreamTableNoSlot) {
+      insertBucket(table, old[i].streamId, old[i].slot);
+    }
+  }
+  free(old);
+  return true;
+}
+
+uint32_t findBucket(const ZCCStreamTable *table, uint32_t streamId) {
+  uint32_t i = home(table, streamId);
+  for (;;) {
+    const Bucket &bucket = table->buckets[i];
+    if (bucket.slot == ZCCStreamTableNoSlot || bucket.streamId == streamId) {
+      return i;
+    }
+    i = (i + 1) & table->bucketMask;
+  }
+}
+
+void removeBucket(ZCCStreamTable *table, uint32_t i) {
+  uint32_t j = i;
+  for (;;) {
+    j = (j + 1) & table->bucketMask;
+    if (table->buckets[j].slot == ZCCStreamTableNoSlot) {
+      break;
+    }
+    // Move the entry back into the hole unless its home lies cyclically in (i, j]
+    uint32_t k = home(table, table->buckets[j].streamId);
+    bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+    if (!stays) {
+      table->buckets[i] = table->buckets[j];
+      i = j;
+    }
+  }
+  table->buckets[i].slot = ZCCStreamTableNoSlot;
+}
+
+int32_t allocateSlot(ZCCStreamTable *table) {
+  if (table->freeSlot != ZCCStreamTableNoSlot) {
+    int32_t slot = table->freeSlot;
+    table->freeSlot = table->slots[slot].nextFree;
+    return slot;
+  }
+  if (table->slotsUsed == table->slotCapacity) {
+    if (table->slotCapacity > INT32_MAX / 2) {
+      return ZCCStreamTableNoSlot;
+    }
+    uint32_t capacity = table->slotCapacity * 2;
+    Slot *slots = (Slot *)realloc(table->slots, capacity * sizeof(Slot));
+    if (!slots) {
+      return ZCCStreamTableNoSlot;
+    }
+    table->slots = slots;
+    table->slotCapacity = capacity;
+  }
+  return (int32_t)table->slotsUsed++;
+}
+
+}
+
+ZCCStreamTable *ZCCStreamTableCreate(void) {
+  ZCCStreamTable *table = (ZCCStreamTable *)calloc(1, sizeof(ZCCStreamTable));
+  if (!table) {
+    return NULL;
+  }
+  table->slots = (Slot *)malloc(InitialSlots * sizeof(Slot));
+  table->buckets = allocateBuckets(InitialBuckets);
+  if (!table->slots || !table->buckets) {
+    ZCCStreamTableDestroy(table);
+    return NULL;
+  }
+  table->slotCapacity = InitialSlots;
+  table->freeSlot = ZCCStreamTableNoSlot;
+  table->first = ZCCStreamTableNoSlot;
+  table->last = ZCCStreamTableNoSlot;
+  table->bucketMask = InitialBuckets - 1;
+  table->bucketShift = 32 - 5;
+  return table;
+}
+
+void ZCCStreamTableDestroy(ZCCStreamTable *table) {
+  if (!table) {
+    return;
+  }
+  free(table->slots);
+  free(table->buckets);
+  free(table);
+}
+
+size_t ZCCStreamTableCount(const ZCCStreamTable *table) {
+  return table->count;
+}
+
+int32_t ZCCStreamTableAdd(ZCCStreamTable *table, uint32_t streamId, bool keyed) {
+  if (keyed) {
+    if (table->buckets[findBucket(table, streamId)].slot != ZCCStreamTableNoSlot) {
+      return ZCCStreamTableNoSlot;
+    }
+    if ((table->keyedCount + 1) * 2 > table->bucketMask + 1 && !growBuckets(table)) {
+      return ZCCStreamTableNoSlot;
+    }
+  }
+  int32_t slot = allocateSlot(table);
+  if (slot == ZCCStreamTableNoSlot) {
+    return ZCCStreamTableNoSlot;
+  }
+  Slot &entry = table->slots[slot];
+  entry.streamId = streamId;
+  entry.used = true;
+  entry.keyed = keyed;
+  entry.nextFree = ZCCStreamTableNoSlot;
+  entry.prev = table->last;
+  entry.next = ZCCStreamTableNoSlot;
+  if (table->last != ZCCStreamTableNoSlot) {
+    table->slots[table->last].next = slot;
+  } else {
+    table->first = slot;
+  }
+  table->last = slot;
+  if (keyed) {
+    insertBucket(table, streamId, slot);
+    table->keyedCount++;
+  }
+  table->count++;
+  return slot;
+}
+
+int32_t ZCCStreamTableFind(const ZCCStreamTable *table, uint32_t streamId) {
+  return table->buckets[findBucket(table, streamId)].slot;
+}
+
+void ZCCStreamTableRemove(ZCCStreamTable *table, int32_t slot) {
+  if (slot < 0 || (uint32_t)slot >= table->slotsUsed || !table->slots[slot].used) {
+    return;
+  }
+  Slot &entry = table->slots[slot];
+  if (entry.keyed) {
+    removeBucket(table, findBucket(table, entry.streamId));
+    table->keyedCount--;
+  }
+  if (entry.prev != ZCCStreamTableNoSlot) {
+    table->slots[entry.prev].next = entry.next;
+  } else {
+    table->first = entry.next;
+  }
+  if (entry.next != ZCCStreamTableNoSlot) {
+    table->slots[entry.next].prev = entry.prev;
+  } else {
+    table->last = entry.prev;
+  }
+  entry.used = false;
+  entry.nextFree = table->freeSlot;
+  table->freeSlot = slot;
+  table->count--;
+}
+
+int32_t ZCCStreamTableFirst(const ZCCStreamTable *table) {
+  return table->first;
+}
+
+int32_t ZCCStreamTableNext(const ZCCStreamTable *table, int32_t slot) {
+  return table->slots[slot].next;
+}
@@ -0,0 +1,70 @@
+//
+//  ZCCStreamTable.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCStreamTable_h
+#define ZCCStreamTable_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Registry of live streams. Every stream gets a slot, a small index for keeping per-stream data in
+// an array, and streams with a server-assigned id can be found by it through an open-addressing
+// hash. Slots are visited in the order they were added, and removing the slot being visited
+// doesn't disturb the walk.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  ZCCStreamTableNoSlot = -1
+};
+
+typedef struct ZCCStreamTable ZCCStreamTable;
+
+/**
+ @return NULL if out of memory.
+ */
+ZCCStreamTable *ZCCStreamTableCreate(void);
+void ZCCStreamTableDestroy(ZCCStreamTable *table);
+
+size_t ZCCStreamTableCount(const ZCCStreamTable *table);
+
+/**
+ Take a slot for a stream.
+
+ @param keyed Whether the stream can be found by `streamId`. Streams that don't have an id from the
+              server yet aren't keyed.
+ @return The slot, or `ZCCStreamTableNoSlot` if a keyed stream already has the id or out of memory.
+ */
+int32_t ZCCStreamTableAdd(ZCCStreamTable *table, uint32_t streamId, bool keyed);
+
+/**
+ @return The slot of the keyed stream with the id, or `ZCCStreamTableNoSlot`.
+ */
+int32_t ZCCStreamTableFind(const ZCCStreamTable *table, uint32_t streamId);
+
+/**
+ Give up a slot. It may be handed out again by the next `ZCCStreamTableAdd()`.
+ */
+void ZCCStreamTableRemove(ZCCStreamTable *table, int32_t slot);
+
+/**
+ Walk the slots in the order they were added. The slot just returned may be removed before asking
+ for the next one, but adding streams during the walk isn't supported.
+
+ @return `ZCCStreamTableNoSlot` at the end.
+ */
+int32_t ZCCStreamTableFirst(const ZCCStreamTable *table);
+int32_t ZCCStreamTableNext(const ZCCStreamTable *table, int32_t slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCStreamTable_h */
@@ -7,6 +7,7 @@
 //
 
 #import "ZCCVoiceStream.h"
+#import "ZCCTimerWheel.h"
 
 @protocol ZCCVoiceStreamDelegate
 - (void)voiceStreamDidStart:(nonnull ZCCVoiceStream *)stream;
@@ -31,6 +32,12 @@
 @property (nonatomic, readonly, getter = isIncoming) BOOL incoming;
 @property (nonatomic, weak, nullable) id<ZCCVoiceStreamDelegate> delegate;
 @property (nonatomic, readonly) BOOL timedOut;
+/// Seconds left before the stream times out for inactivity, negative once it has
+@property (nonatomic, readonly) NSTimeInterval timeUntilTimeout;
+/// Pending inactivity check, owned by the streams manager
+@property (nonatomic) ZCCTimerId inactivityTimeout;
+/// Slot in the streams manager's registry
+@property (nonatomic) int32_t registrySlot;
 
 - (nonnull instancetype)initWithStreamId:(NSUInteger)streamId channel:(nonnull NSString *)channel isIncoming:(BOOL)isIncoming;
 
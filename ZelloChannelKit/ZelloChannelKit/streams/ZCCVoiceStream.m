@@ -19,6 +19,8 @@ static const NSTimeInterval audioStreamTimeout = 10.0;
   BOOL _incoming;
   ZCCStreamState _state;
   NSUInteger _streamId;
+  ZCCTimerId _inactivityTimeout;
+  int32_t _registrySlot;
 }
 
 - (instancetype)initWithStreamId:(NSUInteger)streamId channel:(NSString *)channel isIncoming:(BOOL)isIncoming {
@@ -71,8 +73,28 @@ static const NSTimeInterval audioStreamTimeout = 10.0;
   _streamId = streamId;
 }
 
+- (ZCCTimerId)inactivityTimeout {
+  return _inactivityTimeout;
+}
+
+- (void)setInactivityTimeout:(ZCCTimerId)inactivityTimeout {
+  _inactivityTimeout = inactivityTimeout;
+}
+
+- (int32_t)registrySlot {
+  return _registrySlot;
+}
+
+- (void)setRegistrySlot:(int32_t)registrySlot {
+  _registrySlot = registrySlot;
+}
+
 - (BOOL)timedOut {
-  return [NSDate timeIntervalSinceReferenceDate] - self.lastActive > audioStreamTimeout;
+  return self.timeUntilTimeout < 0;
+}
+
+- (NSTimeInterval)timeUntilTimeout {
+  return audioStreamTimeout - ([NSDate timeIntervalSinceReferenceDate] - self.lastActive);
 }
 
 #pragma mark - Public Methods
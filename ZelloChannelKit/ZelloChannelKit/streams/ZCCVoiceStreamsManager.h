@@ -16,6 +16,7 @@ NS_ASSUME_NONNULL_BEGIN
 @class ZCCIncomingVoiceConfiguration;
 @class ZCCOutgoingVoiceStream;
 @class ZCCSocket;
+@class ZCCStreamArbiter;
 @class ZCCVoiceStreamsManager;
 
 @protocol ZCCVoiceStreamsManagerDelegate <NSObject>
@@ -30,6 +31,8 @@ NS_ASSUME_NONNULL_BEGIN
 
 @property (nonatomic, weak, nullable) id<ZCCVoiceStreamsManagerDelegate> delegate;
 @property (nonatomic) NSTimeInterval requestTimeout;
+/// Incoming streams are handed to the arbiter while they are registered
+@property (nonatomic, strong, nullable) ZCCStreamArbiter *arbiter;
 
 - (ZCCOutgoingVoiceStream *)startStream:(NSString *)channel recipient:(nullable NSString *)username socket:(ZCCSocket *)socket voiceConfiguration:(nullable ZCCOutgoingVoiceConfiguration *)configuration;
 - (void)stopStream;
@@ -12,26 +12,61 @@
 #import "ZCCIncomingVoiceStream+Internal.h"
 #import "ZCCOutgoingVoiceStream+Internal.h"
 #import "ZCCSocket.h"
+#import "ZCCStreamArbiter+Internal.h"
+#import "ZCCStreamTable.h"
+#import "ZCCTimeoutRunner.h"
 #import "ZCCVoiceStream+Internal.h"
-#import "ZCCWeakTimer.h"
 
 static const NSTimeInterval streamsCheckIntervalSec = 1.0;
 
 @interface ZCCVoiceStreamsManager ()
-@property (nonatomic, strong, readonly) NSMutableArray<ZCCVoiceStream *> *streams;
-@property (nonatomic, strong) ZCCWeakTimer *timer;
+/// Streams by their slot in streamTable
+@property (nonatomic, strong, readonly) NSPointerArray *streams;
+@property (nonatomic, strong, readonly) ZCCTimeoutRunner *inactivityTimeouts;
 @end
 
 
-@implementation ZCCVoiceStreamsManager
+@implementation ZCCVoiceStreamsManager {
+  ZCCStreamTable *_streamTable;
+}
 
 - (instancetype)init {
   if (self = [super init]) {
-    _streams = [@[] mutableCopy];
+    _streams = [NSPointerArray strongObjectsPointerArray];
+    _streamTable = ZCCStreamTableCreate();
+    __weak ZCCVoiceStreamsManager *weakSelf = self;
+    _inactivityTimeouts = [[ZCCTimeoutRunner alloc] initWithQueue:self.queue resolution:streamsCheckIntervalSec handler:^(ZCCVoiceStream *stream) {
+      [weakSelf checkStream:stream];
+    }];
   }
   return self;
 }
 
+- (void)dealloc {
+  ZCCStreamTableDestroy(_streamTable);
+}
+
+- (void)setArbiter:(ZCCStreamArbiter *)arbiter {
+  [self runAsync:^{
+    if (arbiter == self->_arbiter) {
+      return;
+    }
+    NSMutableArray<ZCCIncomingVoiceStream *> *incoming = [[NSMutableArray alloc] init];
+    for (int32_t slot = ZCCStreamTableFirst(self->_streamTable); slot != ZCCStreamTableNoSlot; slot = ZCCStreamTableNext(self->_streamTable, slot)) {
+      ZCCVoiceStream *stream = (__bridge ZCCVoiceStream *)[self.streams pointerAtIndex:(NSUInteger)slot];
+      if (stream.incoming) {
+        [incoming addObject:(ZCCIncomingVoiceStream *)stream];
+      }
+    }
+    // The old arbiter lets go first, otherwise its removal could land after the new arbiter ranked the streams
+    [self->_arbiter removeStreamsNow:incoming];
+    for (ZCCIncomingVoiceStream *stream in incoming) {
+      [arbiter addStream:stream];
+    }
+    self->_arbiter = arbiter;
+  }];
+}
+
 - (ZCCOutgoingVoiceStream *)startStream:(NSString *)channel recipient:(NSString *)username socket:(ZCCSocket *)socket voiceConfiguration:(ZCCOutgoingVoiceConfiguration *)configuration {
   [self stopStream];
 
@@ -48,7 +83,8 @@ static const NSTimeInterval streamsCheckIntervalSec = 1.0;
 
 - (void)stopStream {
   [self runAsync:^{
-    for (ZCCVoiceStream *stream in self.streams) {
+    for (int32_t slot = ZCCStreamTableFirst(self->_streamTable); slot != ZCCStreamTableNoSlot; slot = ZCCStreamTableNext(self->_streamTable, slot)) {
+      ZCCVoiceStream *stream = (__bridge ZCCVoiceStream *)[self.streams pointerAtIndex:(NSUInteger)slot];
       if (!stream.incoming) {
         [stream stop];
       }
@@ -58,10 +94,7 @@ static const NSTimeInterval streamsCheckIntervalSec = 1.0;
 
 - (void)onIncomingData:(NSData *)data streamId:(NSUInteger)streamId packetId:(NSUInteger)packetId {
   [self runAsync:^{
-    ZCCVoiceStream *stream = [self streamById:streamId];
-    if (stream.incoming) {
-      [((ZCCIncomingVoiceStream *)stream) onData:data packetId:packetId];
-    }
+    [[self incomingStreamById:streamId] onData:data packetId:packetId];
   }];
 }
 
@@ -72,8 +105,7 @@ static const NSTimeInterval streamsCheckIntervalSec = 1.0;
                          from:(NSString *)user
         receiverConfiguration:(ZCCIncomingVoiceConfiguration *)configuration {
   [self runAsync:^{
-    ZCCVoiceStream *stream = [self streamById:streamId];
-    if (stream && stream.incoming) {
+    if ([self incomingStreamById:streamId]) {
       // TODO: Pass meaningful error to user
       NSLog(@"[ZCC-VSM] Error: Stream ID conflict");
       return;
@@ -92,8 +124,8 @@ static const NSTimeInterval streamsCheckIntervalSec = 1.0;
 
 - (void)onIncomingStreamStop:(NSUInteger)streamId {
   [self runAsync:^{
-    ZCCIncomingVoiceStream *stream = (ZCCIncomingVoiceStream *)[self streamById:streamId];
-    if (!stream.incoming) {
+    ZCCIncomingVoiceStream *stream = [self incomingStreamById:streamId];
+    if (!stream) {
       NSLog(@"[ZCC-VSM] Incoming stream not found, ignoring end");
       return;
     }
@@ -104,61 +136,82 @@ static const NSTimeInterval streamsCheckIntervalSec = 1.0;
 - (NSArray<ZCCVoiceStream *> *)activeStreams {
   __block NSArray<ZCCVoiceStream *> *result = nil;
   [self runSync:^{
-    result = [NSArray arrayWithArray:self.streams];
+    NSMutableArray<ZCCVoiceStream *> *streams = [NSMutableArray arrayWithCapacity:ZCCStreamTableCount(self->_streamTable)];
+    for (int32_t slot = ZCCStreamTableFirst(self->_streamTable); slot != ZCCStreamTableNoSlot; slot = ZCCStreamTableNext(self->_streamTable, slot)) {
+      [streams addObject:(__bridge ZCCVoiceStream *)[self.streams pointerAtIndex:(NSUInteger)slot]];
+    }
+    result = streams;
   }];
   return result;
 }
 
 #pragma mark - Internal methods for use from runner queue only
 
-- (ZCCVoiceStream *)streamById:(NSUInteger)streamId {
-  for (ZCCVoiceStream *stream in self.streams) {
-    if (stream.streamId == streamId) {
-      return stream;
-    }
+// Only incoming streams are registered by id, outgoing ones get theirs from the server later
+- (ZCCIncomingVoiceStream *)incomingStreamById:(NSUInteger)streamId {
+  if (streamId > UINT32_MAX) {
+    return nil;
   }
-  return nil;
+  int32_t slot = ZCCStreamTableFind(_streamTable, (uint32_t)streamId);
+  if (slot == ZCCStreamTableNoSlot) {
+    return nil;
+  }
+  return (__bridge ZCCIncomingVoiceStream *)[self.streams pointerAtIndex:(NSUInteger)slot];
+}
+
+- (BOOL)isRegistered:(ZCCVoiceStream *)stream {
+  int32_t slot = stream.registrySlot;
+  return slot != ZCCStreamTableNoSlot && (NSUInteger)slot < self.streams.count && [self.streams pointerAtIndex:(NSUInteger)slot] == (__bridge void *)stream;
 }
 
 - (void)addStream:(ZCCVoiceStream *)stream {
-  [self.streams addObject:stream];
-  [self checkStreams];
+  int32_t slot = ZCCStreamTableAdd(_streamTable, (uint32_t)stream.streamId, stream.incoming);
+  if (slot == ZCCStreamTableNoSlot) {
+    NSLog(@"[ZCC-VSM] Error: Failed to register stream");
+    return;
+  }
+  if (self.streams.count <= (NSUInteger)slot) {
+    self.streams.count = (NSUInteger)slot + 1;
+  }
+  [self.streams replacePointerAtIndex:(NSUInteger)slot withPointer:(__bridge void *)stream];
+  stream.registrySlot = slot;
+  [self scheduleInactivityCheck:stream];
+  if (stream.incoming) {
+    [self.arbiter addStream:(ZCCIncomingVoiceStream *)stream];
+  }
 }
 
 - (void)removeStream:(ZCCVoiceStream *)stream {
-  if (![self.streams containsObject:stream]) {
+  if (![self isRegistered:stream]) {
     return;
   }
-  [self.streams removeObject:stream];
-  [self checkStreams];
+  [self.inactivityTimeouts cancel:stream.inactivityTimeout];
+  [self unregisterStream:stream];
 }
 
-- (void)checkStreams {
-  // Stop any timed out streams
-  NSMutableArray<ZCCVoiceStream *> *timedOutStreams = [@[] mutableCopy];
-  for (ZCCVoiceStream *stream in self.streams) {
-    if (stream.timedOut) {
-      [stream stop];
-      [timedOutStreams addObject:stream];
-    }
+- (void)unregisterStream:(ZCCVoiceStream *)stream {
+  int32_t slot = stream.registrySlot;
+  ZCCStreamTableRemove(_streamTable, slot);
+  [self.streams replacePointerAtIndex:(NSUInteger)slot withPointer:NULL];
+  stream.registrySlot = ZCCStreamTableNoSlot;
+  if (stream.incoming) {
+    [self.arbiter removeStream:(ZCCIncomingVoiceStream *)stream];
   }
-  if (timedOutStreams.count > 0) {
-    [self.streams removeObjectsInArray:timedOutStreams];
-  }
-  // If we have any streams, keep checking them by timer
-  if (self.streams.count > 0) {
-    if (!self.timer) {
-      self.timer = [ZCCWeakTimer scheduledTimerWithTimeInterval:streamsCheckIntervalSec
-                                                         target:self
-                                                       selector:@selector(checkStreams)
-                                                       userInfo:nil
-                                                        repeats:YES
-                                                  dispatchQueue:self.queue];
-    }
-  } else {
-    [self.timer invalidate];
-    self.timer = nil;
+}
+
+- (void)scheduleInactivityCheck:(ZCCVoiceStream *)stream {
+  stream.inactivityTimeout = [self.inactivityTimeouts runAfter:MAX(stream.timeUntilTimeout, 0.0) object:stream];
+}
+
+// Streams only touch themselves while active, so check when one could have timed out at the
+// earliest and look again later if it has been touched since
+- (void)checkStream:(ZCCVoiceStream *)stream {
+  if (!stream.timedOut) {
+    [self scheduleInactivityCheck:stream];
+    return;
   }
+  [stream stop];
+  [self unregisterStream:stream];
 }
 
 #pragma mark - ZCCAudioStreamDelegate
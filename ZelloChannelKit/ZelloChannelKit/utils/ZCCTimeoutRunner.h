@@ -0,0 +1,44 @@
+//
+//  ZCCTimeoutRunner.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <Foundation/Foundation.h>
+#import "ZCCTimerWheel.h"
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ * Runs timeouts for many objects on a serial queue from a single timer wheel. One dispatch timer
+ * ticks the wheel while any timeout is outstanding, and scheduling or cancelling a timeout doesn't
+ * create blocks or dispatch sources.
+ *
+ * @warning Only use a ZCCTimeoutRunner from its queue.
+ */
+@interface ZCCTimeoutRunner : NSObject
+
+@property (nonatomic, readonly) NSUInteger count;
+
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ * @param resolution How long a tick is. Timeouts fire up to one tick late.
+ * @param handler Called on the queue with the object of each timeout that expires.
+ */
+- (instancetype)initWithQueue:(dispatch_queue_t)queue resolution:(NSTimeInterval)resolution handler:(void (^)(id object))handler NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Calls the handler with object once delay seconds have passed. The runner keeps the object until
+ * then, or until the timeout is cancelled.
+ *
+ * @return 0 if the timeout couldn't be scheduled.
+ */
+- (ZCCTimerId)runAfter:(NSTimeInterval)delay object:(id)object;
+
+- (void)cancel:(ZCCTimerId)timer;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,130 @@
+//
+//  ZCCTimeoutRunner.m
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import "ZCCTimeoutRunner.h"
+
+// Covers 25 seconds in one turn at the socket's 100 ms resolution
+static const uint32_t wheelSlots = 256;
+
+@interface ZCCTimeoutRunner ()
+- (void)fire:(ZCCTimerId)timer;
+@end
+
+static void timeoutFired(void *context, ZCCTimerId timer, uint64_t key) {
+  [(__bridge ZCCTimeoutRunner *)context fire:timer];
+}
+
+@implementation ZCCTimeoutRunner {
+  dispatch_queue_t _queue;
+  NSTimeInterval _resolution;
+  void (^_handler)(id object);
+  ZCCTimerWheel *_wheel;
+  // Objects of the outstanding timeouts, by timer index
+  NSPointerArray *_objects;
+  NSTimeInterval _origin;
+  dispatch_source_t _tickSource;
+}
+
+- (instancetype)initWithQueue:(dispatch_queue_t)queue resolution:(NSTimeInterval)resolution handler:(void (^)(id object))handler {
+  self = [super init];
+  if (self) {
+    _queue = queue;
+    _resolution = resolution;
+    _handler = [handler copy];
+    _wheel = ZCCTimerWheelCreate(wheelSlots);
+    _objects = [NSPointerArray strongObjectsPointerArray];
+    _origin = [NSProcessInfo processInfo].systemUptime;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (_tickSource) {
+    dispatch_source_cancel(_tickSource);
+  }
+  ZCCTimerWheelDestroy(_wheel);
+}
+
+- (NSUInteger)count {
+  return _wheel ? ZCCTimerWheelCount(_wheel) : 0;
+}
+
+- (ZCCTimerId)runAfter:(NSTimeInterval)delay object:(id)object {
+  if (!_wheel) {
+    return 0;
+  }
+  // The wheel lags behind the clock while nothing is outstanding, and when a tick runs late, so
+  // schedule against the clock
+  uint64_t now = ZCCTimerWheelNow(_wheel);
+  uint64_t due = [self currentTick] + (uint64_t)ceil(MAX(delay, 0.0) / _resolution);
+  ZCCTimerId timer = ZCCTimerWheelSchedule(_wheel, due > now ? due - now : 1, 0);
+  if (timer == 0) {
+    return 0;
+  }
+  NSUInteger index = ZCCTimerIdIndex(timer);
+  if (_objects.count <= index) {
+    _objects.count = index + 1;
+  }
+  [_objects replacePointerAtIndex:index withPointer:(__bridge void *)object];
+  [self startTicking];
+  return timer;
+}
+
+- (void)cancel:(ZCCTimerId)timer {
+  if (!_wheel || !ZCCTimerWheelCancel(_wheel, timer)) {
+    return;
+  }
+  [_objects replacePointerAtIndex:ZCCTimerIdIndex(timer) withPointer:NULL];
+  if (ZCCTimerWheelCount(_wheel) == 0) {
+    [self stopTicking];
+  }
+}
+
+#pragma mark - Private
+
+- (uint64_t)currentTick {
+  return (uint64_t)(([NSProcessInfo processInfo].systemUptime - _origin) / _resolution);
+}
+
+- (void)fire:(ZCCTimerId)timer {
+  NSUInteger index = ZCCTimerIdIndex(timer);
+  id object = (__bridge id)[_objects pointerAtIndex:index];
+  [_objects replacePointerAtIndex:index withPointer:NULL];
+  if (object) {
+    _handler(object);
+  }
+}
+
+- (void)tick {
+  ZCCTimerWheelAdvance(_wheel, [self currentTick], timeoutFired, (__bridge void *)self);
+  if (ZCCTimerWheelCount(_wheel) == 0) {
+    [self stopTicking];
+  }
+}
+
+- (void)startTicking {
+  if (_tickSource) {
+    return;
+  }
+  _tickSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+  uint64_t interval = (uint64_t)(_resolution * NSEC_PER_SEC);
+  dispatch_source_set_timer(_tickSource, dispatch_time(DISPATCH_TIME_NOW, (int64_t)interval), interval, interval / 10);
+  __weak ZCCTimeoutRunner *weakSelf = self;
+  dispatch_source_set_event_handler(_tickSource, ^{
+    [weakSelf tick];
+  });
+  dispatch_resume(_tickSource);
+}
+
+- (void)stopTicking {
+  if (_tickSource) {
+    dispatch_source_cancel(_tickSource);
+    _tickSource = nil;
+  }
+}
+
+@end
@@ -0,0 +1,222 @@
+//
+//  ZCCTimerWheel.cpp
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#include "ZCCTimerWheel.h"
+
+#include <stdlib.h>
+
+namespace {
+
+// `list` of entries on the free list
+const uint32_t FreeList = UINT32_MAX;
+
+// Entries live in one array and link into circular lists by index. The first entries are the list
+// heads: one per slot, then the list of timers about to fire.
+struct Entry {
+  uint32_t prev;
+  uint32_t next;
+  uint32_t list;
+  uint32_t generation;
+  uint64_t due;
+  uint64_t key;
+};
+
+}
+
+struct ZCCTimerWheel {
+  Entry *entries;
+  uint32_t capacity;
+  uint32_t used;                // Entries ever handed out, including the heads
+  uint32_t freeEntry;           // Head of the free list, 0 if empty
+  uint32_t mask;
+  uint32_t firing;              // Head of the list of expired timers
+  size_t count;
+  uint64_t now;
+};
+
+namespace {
+
+inline ZCCTimerId makeId(uint32_t index, uint32_t generation) {
+  return ((uint64_t)generation << 32) | index;
+}
+
+inline void initHead(Entry *entries, uint32_t head) {
+  entries[head].prev = head;
+  entries[head].next = head;
+  entries[head].list = head;
+}
+
+inline void linkTail(Entry *entries, uint32_t head, uint32_t index) {
+  Entry &entry = entries[index];
+  entry.list = head;
+  entry.prev = entries[head].prev;
+  entry.next = head;
+  entries[entry.prev].next = index;
+  entries[head].prev = index;
+}
+
+inline void unlink(Entry *entries, uint32_t index) {
+  Entry &entry = entries[index];
+  entries[entry.prev].next = entry.next;
+  entries[entry.next].prev = entry.prev;
+}
+
+uint32_t allocate(ZCCTimerWheel *wheel) {
+  if (wheel->freeEntry != 0) {
+    uint32_t index = wheel->freeEntry;
+    wheel->freeEntry = wheel->entries[index].next;
+    return index;
+  }
+  if (wheel->used == wheel->capacity) {
+    if (wheel->capacity > UINT32_MAX / 2) {
+      return 0;
+    }
+    uint32_t capacity = wheel->capacity * 2;
+    Entry *entries = (Entry *)realloc(wheel->entries, capacity * sizeof(Entry));
+    if (!entries) {
+      return 0;
+    }
+    wheel->entries = entries;
+    wheel->capacity = capacity;
+  }
+  uint32_t index = wheel->used++;
+  wheel->entries[index].generation = 0;
+  return index;
+}
+
+void release(ZCCTimerWheel *wheel, uint32_t index) {
+  Entry &entry = wheel->entries[index];
+  entry.list = FreeList;
+  entry.generation++;
+  entry.next = wheel->freeEntry;
+  wheel->freeEntry = index;
+  wheel->count--;
+}
+
+// Move the timers of one slot that are due by `tick` over to the firing list
+void collect(ZCCTimerWheel *wheel, uint32_t slot, uint64_t tick) {
+  Entry *entries = wheel->entries;
+  uint32_t index = entries[slot].next;
+  while (index != slot) {
+    uint32_t next = entries[index].next;
+    if (entries[index].due <= tick) {
+      unlink(entries, index);
+      linkTail(entries, wheel->firing, index);
+    }
+    index = next;
+  }
+}
+
+size_t fire(ZCCTimerWheel *wheel, ZCCTimerWheelCallback fired, void *context) {
+  size_t firedCount = 0;
+  // Callbacks may cancel timers further down the list or reallocate the entries, so take them
+  // one at a time from the head
+  for (;;) {
+    Entry *entries = wheel->entries;
+    uint32_t index = entries[wheel->firing].next;
+    if (index == wheel->firing) {
+      break;
+    }
+    unlink(entries, index);
+    ZCCTimerId timer = makeId(index, entries[index].generation);
+    uint64_t key = entries[index].key;
+    release(wheel, index);
+    firedCount++;
+    fired(context, timer, key);
+  }
+  return firedCount;
+}
+
+}
+
+ZCCTimerWheel *ZCCTimerWheelCreate(uint32_t slotCount) {
+  uint32_t slots = 1;
+  while (slots < slotCount && slots < (1u << 24)) {
+    slots <<= 1;
+  }
+  ZCCTimerWheel *wheel = (ZCCTimerWheel *)calloc(1, sizeof(ZCCTimerWheel));
+  if (!wheel) {
+    return NULL;
+  }
+  wheel->capacity = slots * 2;
+  wheel->entries = (Entry *)malloc(wheel->capacity * sizeof(Entry));
+  if (!wheel->entries) {
+    free(wheel);
+    return NULL;
+  }
+  wheel->mask = slots - 1;
+  wheel->firing = slots;
+  wheel->used = slots + 1;
+  for (uint32_t head = 0; head < wheel->used; head++) {
+    initHead(wheel->entries, head);
+  }
+  return wheel;
+}
+
+void ZCCTimerWheelDestroy(ZCCTimerWheel *wheel) {
+  if (!wheel) {
+    return;
+  }
+  free(wheel->entries);
+  free(wheel);
+}
+
+uint64_t ZCCTimerWheelNow(const ZCCTimerWheel *wheel) {
+  return wheel->now;
+}
+
+size_t ZCCTimerWheelCount(const ZCCTimerWheel *wheel) {
+  return wheel->count;
+}
+
+ZCCTimerId ZCCTimerWheelSchedule(ZCCTimerWheel *wheel, uint64_t ticks, uint64_t key) {
+  uint32_t index = allocate(wheel);
+  if (index == 0) {
+    return 0;
+  }
+  if (ticks == 0) {
+    ticks = 1;
+  }
+  Entry &entry = wheel->entries[index];
+  entry.due = ticks > UINT64_MAX - wheel->now ? UINT64_MAX : wheel->now + ticks;
+  entry.key = key;
+  linkTail(wheel->entries, (uint32_t)(entry.due & wheel->mask), index);
+  wheel->count++;
+  return makeId(index, entry.generation);
+}
+
+bool ZCCTimerWheelCancel(ZCCTimerWheel *wheel, ZCCTimerId timer) {
+  uint32_t index = ZCCTimerIdIndex(timer);
+  if (index <= wheel->firing || index >= wheel->used) {
+    return false;
+  }
+  Entry &entry = wheel->entries[index];
+  if (entry.list == FreeList || entry.generation != (uint32_t)(timer >> 32)) {
+    return false;
+  }
+  unlink(wheel->entries, index);
+  release(wheel, index);
+  return true;
+}
+
+size_t ZCCTimerWheelAdvance(ZCCTimerWheel *wheel, uint64_t tick, ZCCTimerWheelCallback fired, void *context) {
+  size_t firedCount = 0;
+  while (wheel->now < tick) {
+    if (tick - wheel->now > wheel->mask) {
+      // Every slot comes up at least once on the way, so visit each of them just once
+      for (uint32_t slot = 0; slot <= wheel->mask; slot++) {
+        collect(wheel, slot, tick);
+      }
+      wheel->now = tick;
+    } else {
+      wheel->now++;
+      collect(wheel, (uint32_t)(wheel->now & wheel->mask), wheel->now);
+    }
+    firedCount += fire(wheel, fired, context);
+  }
+  return firedCount;
+}
@@ -0,0 +1,87 @@
+//
+//  ZCCTimerWheel.h
+//  ZelloChannelKit
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#ifndef ZCCTimerWheel_h
+#define ZCCTimerWheel_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Hashed timer wheel. Timers hash into a slot by the tick they are due on, so scheduling and
+// cancelling are O(1) and each tick only looks at one slot. Timers more than one turn of the wheel
+// away stay in their slot until the turn they are due comes around. Time only moves when the owner
+// advances it, typically from a single periodic tick source.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ Identifies a scheduled timer. 0 is never a valid timer.
+
+ The low 32 bits are a dense index that gets reused once the timer fires or is cancelled, so owners
+ can keep per-timer data in an array. See `ZCCTimerIdIndex()`.
+ */
+typedef uint64_t ZCCTimerId;
+
+typedef struct ZCCTimerWheel ZCCTimerWheel;
+
+/**
+ Called for every expired timer. The timer is gone by the time this runs, and the callback may
+ schedule and cancel other timers, but it must not destroy the wheel.
+ */
+typedef void (*ZCCTimerWheelCallback)(void *context, ZCCTimerId timer, uint64_t key);
+
+static inline uint32_t ZCCTimerIdIndex(ZCCTimerId timer) {
+  return (uint32_t)timer;
+}
+
+/**
+ @param slotCount Rounded up to a power of two. Pick it so most timers fit in one turn.
+ @return NULL if out of memory.
+ */
+ZCCTimerWheel *ZCCTimerWheelCreate(uint32_t slotCount);
+void ZCCTimerWheelDestroy(ZCCTimerWheel *wheel);
+
+/**
+ The tick the wheel has been advanced to. Starts at 0.
+ */
+uint64_t ZCCTimerWheelNow(const ZCCTimerWheel *wheel);
+
+/**
+ Number of timers that haven't fired or been cancelled.
+ */
+size_t ZCCTimerWheelCount(const ZCCTimerWheel *wheel);
+
+/**
+ Schedule a timer to fire `ticks` ticks from now, at least one.
+
+ @param key Passed back to the callback.
+ @return 0 if out of memory.
+ */
+ZCCTimerId ZCCTimerWheelSchedule(ZCCTimerWheel *wheel, uint64_t ticks, uint64_t key);
+
+/**
+ @return false if the timer already fired or was cancelled.
+ */
+bool ZCCTimerWheelCancel(ZCCTimerWheel *wheel, ZCCTimerId timer);
+
+/**
+ Move the wheel forward to `tick`, calling `fired` for each timer that comes due on the way. Timers
+ fire tick by tick, and in the order they were scheduled within a tick. A jump of more than one
+ turn is done with a single sweep over all slots instead, which fires whatever is due in slot order.
+
+ @return Number of timers fired.
+ */
+size_t ZCCTimerWheelAdvance(ZCCTimerWheel *wheel, uint64_t tick, ZCCTimerWheelCallback fired, void *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ZCCTimerWheel_h */
@@ -0,0 +1,264 @@
+//
+//  ZCCBufferPoolTests.mm
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <pthread.h>
+#import <unistd.h>
+#import "libopus.h"
+#import "ZCCBufferPool.h"
+
+static const int testBufferSize = 1920;
+
+typedef struct {
+  unsigned char **buffers;
+  int count;
+} ReleaseJob;
+
+static void *releaseAll(void *argument) {
+  ReleaseJob *job = (ReleaseJob *)argument;
+  for (int i = 0; i < job->count; i++) {
+    buffer_pool_nativeRelease(job->buffers[i]);
+  }
+  return NULL;
+}
+
+static void *acquireAndRelease(void *argument) {
+  void *pool = argument;
+  for (int i = 0; i < 10000; i++) {
+    unsigned char *buffer = buffer_pool_nativeAcquire(pool);
+    if (!buffer) {
+      continue;
+    }
+    buffer[0] = (unsigned char)i;
+    buffer[testBufferSize - 1] = (unsigned char)i;
+    buffer_pool_nativeRetain(buffer);
+    buffer_pool_nativeRelease(buffer);
+    buffer_pool_nativeRelease(buffer);
+  }
+  return NULL;
+}
+
+@interface ZCCBufferPoolTests : XCTestCase
+@property (nonatomic) void *pool;
+@end
+
+@implementation ZCCBufferPoolTests
+
+- (void)setUp {
+  [super setUp];
+  self.pool = buffer_pool_nativeCreate(testBufferSize, 2);
+}
+
+- (void)tearDown {
+  buffer_pool_nativeDestroy(self.pool);
+  [super tearDown];
+}
+
+// Verify that a pool can't be made with a bad size, and that a missing pool or buffer is ignored
+- (void)testCreate_BadArguments_Fails {
+  XCTAssertTrue(buffer_pool_nativeCreate(0, 2) == NULL);
+  XCTAssertTrue(buffer_pool_nativeCreate(-1, 2) == NULL);
+  XCTAssertTrue(buffer_pool_nativeCreate(testBufferSize, -1) == NULL);
+  XCTAssertTrue(buffer_pool_nativeAcquire(NULL) == NULL);
+  XCTAssertEqual(buffer_pool_nativeGetBufferSize(NULL), 0);
+  buffer_pool_nativeRetain(NULL);
+  buffer_pool_nativeRelease(NULL);
+  buffer_pool_nativeDestroy(NULL);
+}
+
+// Verify that buffers are the full size, 16-byte aligned and distinct, also past the preallocated ones
+- (void)testAcquire_PastPrealloc_DistinctAlignedBuffers {
+  XCTAssertEqual(buffer_pool_nativeGetBufferSize(self.pool), testBufferSize);
+  unsigned char *buffers[10];
+  for (int i = 0; i < 10; i++) {
+    buffers[i] = buffer_pool_nativeAcquire(self.pool);
+    XCTAssertTrue(buffers[i] != NULL);
+    XCTAssertEqual((uintptr_t)buffers[i] % 16, 0);
+    memset(buffers[i], i, testBufferSize);
+  }
+  for (int i = 0; i < 10; i++) {
+    for (int j = 0; j < testBufferSize; j++) {
+      if (buffers[i][j] != i) {
+        XCTFail(@"Buffer %d was overwritten at %d", i, j);
+        break;
+      }
+    }
+  }
+  for (int i = 0; i < 10; i++) {
+    buffer_pool_nativeRelease(buffers[i]);
+  }
+}
+
+// Verify that a released buffer is handed out again instead of a new one
+- (void)testRelease_BufferReused {
+  unsigned char *first = buffer_pool_nativeAcquire(self.pool);
+  buffer_pool_nativeRelease(first);
+  unsigned char *second = buffer_pool_nativeAcquire(self.pool);
+  XCTAssertTrue(second == first);
+  buffer_pool_nativeRelease(second);
+}
+
+// Verify that a retained buffer only goes back to the pool with its last release
+- (void)testRetain_RecycledOnLastRelease {
+  unsigned char *buffer = buffer_pool_nativeAcquire(self.pool);
+  buffer_pool_nativeRetain(buffer);
+  buffer_pool_nativeRetain(buffer);
+  buffer_pool_nativeRelease(buffer);
+  buffer_pool_nativeRelease(buffer);
+  unsigned char *other = buffer_pool_nativeAcquire(self.pool);
+  XCTAssertTrue(other != buffer);
+  buffer_pool_nativeRelease(other);
+
+  buffer_pool_nativeRelease(buffer);
+  other = buffer_pool_nativeAcquire(self.pool);
+  XCTAssertTrue(other == buffer);
+  buffer_pool_nativeRelease(other);
+}
+
+// Verify that buffers stay usable after their pool is destroyed, and the pool goes with the last one
+- (void)testDestroy_OutstandingBuffers_StayValid {
+  void *pool = buffer_pool_nativeCreate(testBufferSize, 1);
+  unsigned char *first = buffer_pool_nativeAcquire(pool);
+  unsigned char *second = buffer_pool_nativeAcquire(pool);
+  buffer_pool_nativeRetain(second);
+  buffer_pool_nativeDestroy(pool);
+
+  memset(first, 1, testBufferSize);
+  buffer_pool_nativeRelease(first);
+  memset(second, 2, testBufferSize);
+  buffer_pool_nativeRelease(second);
+  XCTAssertEqual(second[testBufferSize - 1], 2);
+  buffer_pool_nativeRelease(second);
+}
+
+// Verify that references dropped on several threads at once recycle the buffer exactly once
+- (void)testRelease_ManyThreads_RecycledOnce {
+  for (int round = 0; round < 100; round++) {
+    unsigned char *buffers[4][16];
+    for (int i = 0; i < 16; i++) {
+      unsigned char *buffer = buffer_pool_nativeAcquire(self.pool);
+      for (int thread = 0; thread < 4; thread++) {
+        if (thread > 0) {
+          buffer_pool_nativeRetain(buffer);
+        }
+        buffers[thread][i] = buffer;
+      }
+    }
+    pthread_t threads[4];
+    ReleaseJob jobs[4];
+    for (int thread = 0; thread < 4; thread++) {
+      jobs[thread].buffers = buffers[thread];
+      jobs[thread].count = 16;
+      pthread_create(&threads[thread], NULL, releaseAll, &jobs[thread]);
+    }
+    for (int thread = 0; thread < 4; thread++) {
+      pthread_join(threads[thread], NULL);
+    }
+    // Each buffer went back once, so the next 16 are the same set and no two are alike
+    unsigned char *again[16];
+    for (int i = 0; i < 16; i++) {
+      again[i] = buffer_pool_nativeAcquire(self.pool);
+      for (int j = 0; j < i; j++) {
+        XCTAssertTrue(again[i] != again[j]);
+      }
+    }
+    for (int i = 0; i < 16; i++) {
+      buffer_pool_nativeRelease(again[i]);
+    }
+  }
+}
+
+// Verify that the pool holds up with several threads acquiring and releasing, and being destroyed
+// while they're at it
+- (void)testAcquire_ManyThreads_DestroyedMeanwhile {
+  void *pool = buffer_pool_nativeCreate(testBufferSize, 4);
+  unsigned char *held = buffer_pool_nativeAcquire(pool);
+  pthread_t threads[4];
+  for (int thread = 0; thread < 4; thread++) {
+    pthread_create(&threads[thread], NULL, acquireAndRelease, pool);
+  }
+  usleep(1000);
+  buffer_pool_nativeDestroy(pool);
+  for (int thread = 0; thread < 4; thread++) {
+    pthread_join(threads[thread], NULL);
+  }
+  // The held buffer kept the pool alive for the threads
+  buffer_pool_nativeRelease(held);
+}
+
+// Verify that pooled data returns its buffer when deallocated
+- (void)testDataWithBuffer_Deallocated_BufferReturned {
+  ZCCBufferPool *pool = [[ZCCBufferPool alloc] initWithBufferLength:testBufferSize preallocate:1];
+  void *buffer = [pool acquireBuffer];
+  @autoreleasepool {
+    NSData *data = [pool dataWithBuffer:buffer length:100];
+    XCTAssertEqual(data.bytes, buffer);
+    XCTAssertEqual(data.length, 100);
+  }
+  void *again = [pool acquireBuffer];
+  XCTAssertEqual(again, buffer);
+  [pool releaseBuffer:again];
+}
+
+// Verify that pooled data keeps its bytes after the pool is gone
+- (void)testDataWithBytes_OutlivesPool {
+  unsigned char bytes[testBufferSize];
+  for (int i = 0; i < testBufferSize; i++) {
+    bytes[i] = (unsigned char)(i * 7);
+  }
+  NSData *data = nil;
+  @autoreleasepool {
+    ZCCBufferPool *pool = [[ZCCBufferPool alloc] initWithBufferLength:testBufferSize preallocate:1];
+    data = [pool dataWithBytes:bytes length:sizeof(bytes)];
+  }
+  XCTAssertEqual(data.length, sizeof(bytes));
+  XCTAssertEqual(memcmp(data.bytes, bytes, sizeof(bytes)), 0);
+}
+
+// Verify that bytes too long for a buffer still come back as data, and an empty buffer goes back
+- (void)testDataWithBytes_TooLong_FallsBack {
+  ZCCBufferPool *pool = [[ZCCBufferPool alloc] initWithBufferLength:16 preallocate:1];
+  unsigned char bytes[32];
+  memset(bytes, 9, sizeof(bytes));
+  NSData *data = [pool dataWithBytes:bytes length:sizeof(bytes)];
+  XCTAssertEqualObjects(data, [NSData dataWithBytes:bytes length:sizeof(bytes)]);
+
+  void *buffer = [pool acquireBuffer];
+  XCTAssertEqual([pool dataWithBuffer:buffer length:0].length, 0);
+  void *again = [pool acquireBuffer];
+  XCTAssertEqual(again, buffer);
+  [pool releaseBuffer:again];
+}
+
+// A decoded packet per frame, wrapped in data and dropped by the player
+- (void)testPerformance_PooledData {
+  ZCCBufferPool *pool = [[ZCCBufferPool alloc] initWithBufferLength:testBufferSize preallocate:4];
+  unsigned char pcm[testBufferSize] = {0};
+  [self measureBlock:^{
+    for (int i = 0; i < 100000; i++) {
+      @autoreleasepool {
+        NSData *data = [pool dataWithBytes:pcm length:sizeof(pcm)];
+        (void)data;
+      }
+    }
+  }];
+}
+
+// The same frames copied into fresh data, as before the pool
+- (void)testPerformance_PlainData {
+  unsigned char pcm[testBufferSize] = {0};
+  [self measureBlock:^{
+    for (int i = 0; i < 100000; i++) {
+      @autoreleasepool {
+        NSData *data = [NSData dataWithBytes:pcm length:sizeof(pcm)];
+        (void)data;
+      }
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,335 @@
+//
+//  ZCCEncodeServiceTests.mm
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <pthread.h>
+#import <time.h>
+#import <unistd.h>
+#import "libopus.h"
+
+static const int testSampleRate = 16000;
+static const int testFrameSize = 60;
+static const int testPacketSamples = testSampleRate * testFrameSize / 1000;
+static const int maxStreamId = 1024;
+
+/// What the service reported, per stream id
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  int packets[maxStreamId];
+  int lastCalls[maxStreamId];
+  int active[maxStreamId];
+  int overlaps;                 // Callbacks for one stream that ran at the same time
+  int afterLast;                // Callbacks for a stream after its last one
+  int badIds;
+  int finished;                 // Streams that got their last callback
+  int holdStream;               // Callbacks for this stream wait until released
+  bool holding;
+  bool released;
+} ServiceLog;
+
+static void servicePacket(void *context, int stream, const unsigned char *packet, int len, int last) {
+  ServiceLog *log = (ServiceLog *)context;
+  pthread_mutex_lock(&log->mutex);
+  if (stream <= 0 || stream >= maxStreamId) {
+    log->badIds++;
+    pthread_mutex_unlock(&log->mutex);
+    return;
+  }
+  if (log->active[stream]++) {
+    log->overlaps++;
+  }
+  if (log->lastCalls[stream]) {
+    log->afterLast++;
+  }
+  if (stream == log->holdStream) {
+    log->holding = true;
+    pthread_cond_broadcast(&log->cond);
+    while (!log->released) {
+      pthread_cond_wait(&log->cond, &log->mutex);
+    }
+  }
+  pthread_mutex_unlock(&log->mutex);
+
+  // Give a second callback for the stream, if there were one, time to run into this one
+  sched_yield();
+
+  pthread_mutex_lock(&log->mutex);
+  if (last) {
+    log->lastCalls[stream]++;
+    log->finished++;
+  } else if (len > 0) {
+    log->packets[stream]++;
+  }
+  log->active[stream]--;
+  pthread_cond_broadcast(&log->cond);
+  pthread_mutex_unlock(&log->mutex);
+}
+
+/// Wait up to ten seconds for the condition, checked with the log locked
+static BOOL waitFor(ServiceLog *log, BOOL (*condition)(ServiceLog *log, int value), int value) {
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 10;
+  pthread_mutex_lock(&log->mutex);
+  BOOL met = condition(log, value);
+  while (!met && pthread_cond_timedwait(&log->cond, &log->mutex, &deadline) == 0) {
+    met = condition(log, value);
+  }
+  met = condition(log, value);
+  pthread_mutex_unlock(&log->mutex);
+  return met;
+}
+
+static BOOL finishedAtLeast(ServiceLog *log, int count) {
+  return log->finished >= count;
+}
+
+static BOOL isHolding(ServiceLog *log, int unused) {
+  return log->holding;
+}
+
+static void releaseHold(ServiceLog *log) {
+  pthread_mutex_lock(&log->mutex);
+  log->released = true;
+  pthread_cond_broadcast(&log->cond);
+  pthread_mutex_unlock(&log->mutex);
+}
+
+/// Encode a packet, waiting while the stream is too far behind. Returns NO once it's closed.
+static BOOL encodePacket(int service, int stream, short *samples) {
+  for (int attempt = 0; attempt < 10000; attempt++) {
+    if (encoder_opus_serviceEncode(service, stream, samples, testPacketSamples, 0)) {
+      return YES;
+    }
+    usleep(100);
+  }
+  return NO;
+}
+
+static void fillAudio(short *samples, int count, int seed) {
+  for (int i = 0; i < count; i++) {
+    samples[i] = (short)((i * (seed + 3) * 37) % 20000 - 10000);
+  }
+}
+
+typedef struct {
+  int service;
+  int stream;
+  short *samples;
+  int encoded;                  // Packets the service took
+  int closed;                   // What Close returned
+} StreamClient;
+
+static void *encodeUntilClosed(void *argument) {
+  StreamClient *client = (StreamClient *)argument;
+  for (int i = 0; i < 30; i++) {
+    if (!encoder_opus_serviceEncode(client->service, client->stream, client->samples, testPacketSamples, 0)) {
+      continue;
+    }
+    client->encoded++;
+  }
+  return NULL;
+}
+
+static void *closeSoon(void *argument) {
+  StreamClient *client = (StreamClient *)argument;
+  usleep((useconds_t)(client->stream % 7) * 100);
+  client->closed = encoder_opus_serviceClose(client->service, client->stream);
+  return NULL;
+}
+
+@interface ZCCEncodeServiceTests : XCTestCase
+@property (nonatomic) ServiceLog *log;
+@property (nonatomic) int service;
+@property (nonatomic) short *samples;
+@end
+
+@implementation ZCCEncodeServiceTests
+
+- (void)setUp {
+  [super setUp];
+  self.log = (ServiceLog *)calloc(1, sizeof(ServiceLog));
+  pthread_mutex_init(&self.log->mutex, NULL);
+  pthread_cond_init(&self.log->cond, NULL);
+  self.service = encoder_opus_serviceStart(4, servicePacket, self.log);
+  self.samples = (short *)malloc(testPacketSamples * sizeof(short));
+  fillAudio(self.samples, testPacketSamples, 1);
+}
+
+- (void)tearDown {
+  // Nothing may be held up at the gate while the workers are joined
+  releaseHold(self.log);
+  encoder_opus_serviceStop(self.service);
+  pthread_mutex_destroy(&self.log->mutex);
+  pthread_cond_destroy(&self.log->cond);
+  free(self.log);
+  free(self.samples);
+  [super tearDown];
+}
+
+// Verify that every packet of every stream is reported, never two at once for a stream, and that
+// each stream ends with exactly one last callback
+- (void)testEncode_ManyStreams_AllPacketsDelivered {
+  XCTAssertNotEqual(self.service, 0);
+  int streams[8];
+  for (int i = 0; i < 8; i++) {
+    streams[i] = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+    XCTAssertGreaterThan(streams[i], 0);
+  }
+  for (int packet = 0; packet < 50; packet++) {
+    for (int i = 0; i < 8; i++) {
+      XCTAssertTrue(encodePacket(self.service, streams[i], self.samples));
+    }
+  }
+  for (int i = 0; i < 8; i++) {
+    XCTAssertEqual(encoder_opus_serviceClose(self.service, streams[i]), 1);
+  }
+  XCTAssertTrue(waitFor(self.log, finishedAtLeast, 8));
+  for (int i = 0; i < 8; i++) {
+    XCTAssertEqual(self.log->packets[streams[i]], 50);
+    XCTAssertEqual(self.log->lastCalls[streams[i]], 1);
+  }
+  XCTAssertEqual(self.log->overlaps, 0);
+  XCTAssertEqual(self.log->afterLast, 0);
+  XCTAssertEqual(self.log->badIds, 0);
+}
+
+// Verify that a stream that falls too far behind refuses more audio instead of queueing it all
+- (void)testEncode_TooFarBehind_Refused {
+  int stream = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+  self.log->holdStream = stream;
+  XCTAssertEqual(encoder_opus_serviceEncode(self.service, stream, self.samples, testPacketSamples, 0), 1);
+  // The worker is stuck reporting the first packet, so the rest pile up
+  XCTAssertTrue(waitFor(self.log, isHolding, 0));
+  int accepted = 0;
+  for (int i = 0; i < 40; i++) {
+    accepted += encoder_opus_serviceEncode(self.service, stream, self.samples, testPacketSamples, 0);
+  }
+  XCTAssertEqual(accepted, 16);
+  // More than a packet at once is refused too
+  short *tooMuch = (short *)calloc(testPacketSamples + 1, sizeof(short));
+  XCTAssertEqual(encoder_opus_serviceEncode(self.service, stream, tooMuch, testPacketSamples + 1, 0), 0);
+  free(tooMuch);
+
+  releaseHold(self.log);
+  XCTAssertEqual(encoder_opus_serviceClose(self.service, stream), 1);
+  XCTAssertTrue(waitFor(self.log, finishedAtLeast, 1));
+  XCTAssertEqual(self.log->packets[stream], 17);
+}
+
+// Verify that nothing is taken after Close, and Close works once
+- (void)testClose_RefusesMoreAudio {
+  int stream = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+  self.log->holdStream = stream;
+  XCTAssertEqual(encoder_opus_serviceClose(self.service, stream), 1);
+  // Held in its last callback, so the id is still valid
+  XCTAssertTrue(waitFor(self.log, isHolding, 0));
+  XCTAssertEqual(encoder_opus_serviceEncode(self.service, stream, self.samples, testPacketSamples, 0), 0);
+  XCTAssertEqual(encoder_opus_serviceClose(self.service, stream), 0);
+  releaseHold(self.log);
+  XCTAssertTrue(waitFor(self.log, finishedAtLeast, 1));
+  XCTAssertEqual(encoder_opus_serviceClose(self.service, stream), 0);
+  XCTAssertEqual(encoder_opus_serviceEncode(self.service, 0, self.samples, testPacketSamples, 0), 0);
+}
+
+// Verify that an id isn't handed out again until its last callback has returned
+- (void)testOpen_IdReusedOnlyAfterLastCallback {
+  int first = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+  self.log->holdStream = first;
+  XCTAssertEqual(encoder_opus_serviceClose(self.service, first), 1);
+  XCTAssertTrue(waitFor(self.log, isHolding, 0));
+  int second = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+  XCTAssertNotEqual(second, first);
+  releaseHold(self.log);
+  XCTAssertTrue(waitFor(self.log, finishedAtLeast, 1));
+}
+
+// Verify that closing while another thread is still encoding ends the stream exactly once, with
+// nothing reported after the last callback. The stream must not be freed under the encoding thread.
+- (void)testClose_RacingEncode_EndsOnce {
+  for (int round = 0; round < 50; round++) {
+    StreamClient clients[8];
+    pthread_t encoders[8];
+    pthread_t closers[8];
+    // All opened first, so no stream gets an id another one of this round has just given up
+    for (int i = 0; i < 8; i++) {
+      clients[i].service = self.service;
+      clients[i].stream = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+      clients[i].samples = self.samples;
+      clients[i].encoded = 0;
+      clients[i].closed = 0;
+    }
+    for (int i = 0; i < 8; i++) {
+      pthread_create(&encoders[i], NULL, encodeUntilClosed, &clients[i]);
+      pthread_create(&closers[i], NULL, closeSoon, &clients[i]);
+    }
+    for (int i = 0; i < 8; i++) {
+      pthread_join(encoders[i], NULL);
+      pthread_join(closers[i], NULL);
+      XCTAssertEqual(clients[i].closed, 1);
+    }
+    XCTAssertTrue(waitFor(self.log, finishedAtLeast, (round + 1) * 8));
+    for (int i = 0; i < 8; i++) {
+      XCTAssertEqual(self.log->lastCalls[clients[i].stream], 1);
+      XCTAssertLessThanOrEqual(self.log->packets[clients[i].stream], clients[i].encoded);
+      // Ready for the next round, which reuses the ids
+      self.log->lastCalls[clients[i].stream] = 0;
+      self.log->packets[clients[i].stream] = 0;
+    }
+  }
+  XCTAssertEqual(self.log->overlaps, 0);
+  XCTAssertEqual(self.log->afterLast, 0);
+}
+
+// Verify that stopping the service ends the streams nobody closed
+- (void)testStop_FinishesOpenStreams {
+  for (int i = 0; i < 3; i++) {
+    int stream = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+    XCTAssertTrue(encodePacket(self.service, stream, self.samples));
+  }
+  encoder_opus_serviceStop(self.service);
+  XCTAssertEqual(self.log->finished, 3);
+  self.service = 0;
+}
+
+// Sixteen streams of three seconds each through the service
+- (void)testPerformance_Service {
+  [self measureBlock:^{
+    int finished = self.log->finished;
+    int streams[16];
+    for (int i = 0; i < 16; i++) {
+      streams[i] = encoder_opus_serviceOpen(self.service, testSampleRate, 1, testFrameSize, -1, 0);
+    }
+    for (int packet = 0; packet < 50; packet++) {
+      for (int i = 0; i < 16; i++) {
+        encodePacket(self.service, streams[i], self.samples);
+      }
+    }
+    for (int i = 0; i < 16; i++) {
+      encoder_opus_serviceClose(self.service, streams[i]);
+    }
+    waitFor(self.log, finishedAtLeast, finished + 16);
+  }];
+}
+
+// The same audio through one encoder at a time on this thread
+- (void)testPerformance_DirectEncoders {
+  unsigned char *packet = (unsigned char *)malloc((size_t)encoder_opus_nativeGetMaxPacketSize(1));
+  [self measureBlock:^{
+    for (int i = 0; i < 16; i++) {
+      void *encoder = encoder_opus_directStart(testSampleRate, 1, testFrameSize, -1, 0);
+      for (int j = 0; j < 50; j++) {
+        encoder_opus_directEncode(encoder, self.samples, testPacketSamples, packet, 0);
+      }
+      encoder_opus_directStop(encoder, packet);
+    }
+  }];
+  free(packet);
+}
+
+@end
@@ -0,0 +1,218 @@
+//
+//  ZCCOpusCodecTests.mm
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <math.h>
+#import "libopus.h"
+
+// The SDK's defaults: 16 kHz, one 60 ms frame per packet
+static const int testSampleRate = 16000;
+static const int testFrameSize = 60;
+static const int testPacketSamples = testSampleRate * testFrameSize / 1000;
+static const int testPacketCount = 100;
+
+/// Speech-like test audio: a few harmonics that drift, so every packet is different
+static void fillAudio(short *samples, int count) {
+  for (int i = 0; i < count; i++) {
+    double t = (double)i / testSampleRate;
+    double pitch = 180.0 + 40.0 * sin(t * 2.0);
+    double value = 0.5 * sin(2.0 * M_PI * pitch * t) + 0.25 * sin(4.0 * M_PI * pitch * t) + 0.1 * sin(6.0 * M_PI * pitch * t);
+    samples[i] = (short)(value * 12000.0);
+  }
+}
+
+@interface ZCCOpusCodecTests : XCTestCase
+@property (nonatomic) unsigned char *header;
+@property (nonatomic) int headerLength;
+/// testPacketCount packets of at most OPUS_MAX_ENCODED_PACKET bytes each
+@property (nonatomic) unsigned char *packets;
+@property (nonatomic) int *packetLengths;
+@property (nonatomic) short *audio;
+@property (nonatomic) short *output;
+@end
+
+@implementation ZCCOpusCodecTests
+
+- (void)setUp {
+  [super setUp];
+  self.header = (unsigned char *)malloc(64);
+  self.headerLength = encoder_opus_nativeGetHeader(testSampleRate, 1, testFrameSize, self.header);
+  self.packets = (unsigned char *)malloc(testPacketCount * OPUS_MAX_ENCODED_PACKET);
+  self.packetLengths = (int *)malloc(testPacketCount * sizeof(int));
+  self.audio = (short *)malloc(testPacketCount * testPacketSamples * sizeof(short));
+  self.output = (short *)malloc(OPUS_MAX_DECODED_PACKET * sizeof(short) * 2);
+  fillAudio(self.audio, testPacketCount * testPacketSamples);
+
+  void *encoder = encoder_opus_directStart(testSampleRate, 1, testFrameSize, -1, 0);
+  for (int i = 0; i < testPacketCount; i++) {
+    self.packetLengths[i] = encoder_opus_directEncode(encoder, self.audio + i * testPacketSamples, testPacketSamples, self.packets + i * OPUS_MAX_ENCODED_PACKET, 0);
+  }
+  unsigned char *rest = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
+  encoder_opus_directStop(encoder, rest);
+  free(rest);
+}
+
+- (void)tearDown {
+  free(self.header);
+  free(self.packets);
+  free(self.packetLengths);
+  free(self.audio);
+  free(self.output);
+  [super tearDown];
+}
+
+- (void)testEncode_EveryPacketProduced {
+  XCTAssertGreaterThan(self.headerLength, 0);
+  for (int i = 0; i < testPacketCount; i++) {
+    XCTAssertGreaterThan(self.packetLengths[i], 1);
+    XCTAssertLessThanOrEqual(self.packetLengths[i], encoder_opus_nativeGetMaxPacketSize(1));
+  }
+}
+
+// Verify that the locked and the single-owner encoder make the same packets
+- (void)testEncode_NativeAndDirect_Identical {
+  int native = encoder_opus_nativeStart(testSampleRate, 1, testFrameSize, -1, 0);
+  XCTAssertNotEqual(native, 0);
+  unsigned char *packet = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
+  for (int i = 0; i < testPacketCount; i++) {
+    int length = encoder_opus_nativeEncode(native, self.audio + i * testPacketSamples, testPacketSamples, packet, 0);
+    XCTAssertEqual(length, self.packetLengths[i]);
+    XCTAssertEqual(memcmp(packet, self.packets + i * OPUS_MAX_ENCODED_PACKET, (size_t)length), 0);
+  }
+  encoder_opus_nativeStop(native, packet);
+  free(packet);
+}
+
+// Verify that the locked and the single-owner decoder, and decoding into the caller's buffer, all
+// produce the same audio, lost packets included
+- (void)testDecode_AllPathsIdentical {
+  int native = decoder_opus_nativeStart(self.header, self.headerLength);
+  void *direct = decoder_opus_directStart(self.header, self.headerLength);
+  void *into = decoder_opus_directStart(self.header, self.headerLength);
+  XCTAssertNotEqual(native, 0);
+  XCTAssertTrue(direct != NULL);
+  XCTAssertEqual(decoder_opus_directGetSampleRate(direct), testSampleRate);
+  XCTAssertEqual(decoder_opus_nativeGetFramesInPacket(native), 1);
+
+  short *expected = self.output;
+  short *actual = self.output + OPUS_MAX_DECODED_PACKET;
+  int decodedPackets = 0;
+  for (int i = 0; i <= testPacketCount; i++) {
+    // Every tenth packet goes missing, and the last call flushes the one still buffered
+    BOOL lost = i == testPacketCount || i % 10 == 9;
+    unsigned char *packet = lost ? NULL : self.packets + i * OPUS_MAX_ENCODED_PACKET;
+    int length = lost ? 0 : self.packetLengths[i];
+
+    int samples = decoder_opus_directDecode(direct, packet, length, expected);
+    XCTAssertEqual(decoder_opus_nativeDecode(native, packet, length, actual), samples);
+    XCTAssertEqual(memcmp(actual, expected, (size_t)samples * sizeof(short)), 0);
+    XCTAssertEqual(decoder_opus_directDecodeInto(into, packet, length, actual, testPacketSamples), samples);
+    XCTAssertEqual(memcmp(actual, expected, (size_t)samples * sizeof(short)), 0);
+    if (samples > 0) {
+      decodedPackets++;
+    }
+  }
+  XCTAssertEqual(decodedPackets, testPacketCount);
+  decoder_opus_nativeStop(native);
+  decoder_opus_directStop(direct);
+  decoder_opus_directStop(into);
+}
+
+// Verify that decoding into a buffer too small for the next packet leaves the packet alone
+- (void)testDecodeInto_TooSmall_KeepsPacket {
+  void *decoder = decoder_opus_directStart(self.header, self.headerLength);
+  // The decoder runs one packet behind, so the first call has nothing to write yet
+  XCTAssertEqual(decoder_opus_directDecodeInto(decoder, self.packets, self.packetLengths[0], self.output, testPacketSamples), 0);
+  unsigned char *second = self.packets + OPUS_MAX_ENCODED_PACKET;
+  XCTAssertEqual(decoder_opus_directDecodeInto(decoder, second, self.packetLengths[1], self.output, testPacketSamples - 1), -1);
+  XCTAssertEqual(decoder_opus_directDecodeInto(decoder, second, self.packetLengths[1], self.output, testPacketSamples), testPacketSamples);
+  decoder_opus_directStop(decoder);
+}
+
+// A stopped handle, or one that was never handed out, does nothing
+- (void)testNativeDecode_StaleHandle_ReturnsZero {
+  int native = decoder_opus_nativeStart(self.header, self.headerLength);
+  decoder_opus_nativeStop(native);
+  XCTAssertEqual(decoder_opus_nativeDecode(native, self.packets, self.packetLengths[0], self.output), 0);
+  XCTAssertEqual(decoder_opus_nativeDecode(0, self.packets, self.packetLengths[0], self.output), 0);
+}
+
+// Per packet cost of the handle table and its lock, against the direct calls below
+- (void)testPerformance_NativeDecode {
+  int native = decoder_opus_nativeStart(self.header, self.headerLength);
+  [self measureBlock:^{
+    for (int round = 0; round < 10; round++) {
+      for (int i = 0; i < testPacketCount; i++) {
+        decoder_opus_nativeDecode(native, self.packets + i * OPUS_MAX_ENCODED_PACKET, self.packetLengths[i], self.output);
+      }
+    }
+  }];
+  decoder_opus_nativeStop(native);
+}
+
+- (void)testPerformance_DirectDecode {
+  void *direct = decoder_opus_directStart(self.header, self.headerLength);
+  [self measureBlock:^{
+    for (int round = 0; round < 10; round++) {
+      for (int i = 0; i < testPacketCount; i++) {
+        decoder_opus_directDecode(direct, self.packets + i * OPUS_MAX_ENCODED_PACKET, self.packetLengths[i], self.output);
+      }
+    }
+  }];
+  decoder_opus_directStop(direct);
+}
+
+// Packets with next to nothing to decode, so the fixed per call cost shows
+- (void)testPerformance_NativeGetPacketSamples {
+  int native = decoder_opus_nativeStart(self.header, self.headerLength);
+  [self measureBlock:^{
+    for (int round = 0; round < 10000; round++) {
+      for (int i = 0; i < testPacketCount; i++) {
+        decoder_opus_nativeGetPacketSamples(native, self.packets + i * OPUS_MAX_ENCODED_PACKET, self.packetLengths[i]);
+      }
+    }
+  }];
+  decoder_opus_nativeStop(native);
+}
+
+- (void)testPerformance_DirectGetPacketSamples {
+  void *direct = decoder_opus_directStart(self.header, self.headerLength);
+  [self measureBlock:^{
+    for (int round = 0; round < 10000; round++) {
+      for (int i = 0; i < testPacketCount; i++) {
+        decoder_opus_directGetPacketSamples(direct, self.packets + i * OPUS_MAX_ENCODED_PACKET, self.packetLengths[i]);
+      }
+    }
+  }];
+  decoder_opus_directStop(direct);
+}
+
+- (void)testPerformance_NativeEncode {
+  int native = encoder_opus_nativeStart(testSampleRate, 1, testFrameSize, -1, 0);
+  unsigned char *packet = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
+  [self measureBlock:^{
+    for (int i = 0; i < testPacketCount; i++) {
+      encoder_opus_nativeEncode(native, self.audio + i * testPacketSamples, testPacketSamples, packet, 0);
+    }
+  }];
+  encoder_opus_nativeStop(native, packet);
+  free(packet);
+}
+
+- (void)testPerformance_DirectEncode {
+  void *direct = encoder_opus_directStart(testSampleRate, 1, testFrameSize, -1, 0);
+  unsigned char *packet = (unsigned char *)malloc(OPUS_MAX_ENCODED_PACKET);
+  [self measureBlock:^{
+    for (int i = 0; i < testPacketCount; i++) {
+      encoder_opus_directEncode(direct, self.audio + i * testPacketSamples, testPacketSamples, packet, 0);
+    }
+  }];
+  encoder_opus_directStop(direct, packet);
+  free(packet);
+}
+
+@end
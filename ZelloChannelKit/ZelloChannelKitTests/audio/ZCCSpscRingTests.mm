@@ -0,0 +1,162 @@
+//
+//  ZCCSpscRingTests.mm
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <pthread.h>
+#import <sched.h>
+#import "spscring.h"
+
+static const unsigned streamLength = 1000000;
+
+/// One side of a ring moving a counting sequence in uneven chunks
+typedef struct {
+  CSpscRing<int> *ring;
+  unsigned count;
+  unsigned mismatches;
+} RingSide;
+
+static void *writeSequence(void *argument) {
+  RingSide *side = (RingSide *)argument;
+  int chunk[257];
+  unsigned next = 0;
+  unsigned size = 1;
+  while (next < side->count) {
+    size = size % 257 + 1;
+    unsigned n = size < side->count - next ? size : side->count - next;
+    for (unsigned i = 0; i < n; i++) {
+      chunk[i] = (int)(next + i);
+    }
+    unsigned written = 0;
+    while (written < n) {
+      unsigned count = side->ring->Write(chunk + written, n - written);
+      if (count == 0) {
+        sched_yield();
+      }
+      written += count;
+    }
+    next += n;
+  }
+  return NULL;
+}
+
+static void *readSequence(void *argument) {
+  RingSide *side = (RingSide *)argument;
+  int chunk[199];
+  unsigned next = 0;
+  unsigned size = 1;
+  while (next < side->count) {
+    size = size % 199 + 1;
+    unsigned n = side->ring->Read(chunk, size);
+    if (n == 0) {
+      sched_yield();
+    }
+    for (unsigned i = 0; i < n; i++) {
+      if (chunk[i] != (int)(next + i)) {
+        side->mismatches++;
+      }
+    }
+    next += n;
+  }
+  return NULL;
+}
+
+static unsigned moveSequence(CSpscRing<int> *ring, unsigned count) {
+  RingSide writer = {ring, count, 0};
+  RingSide reader = {ring, count, 0};
+  pthread_t threads[2];
+  pthread_create(&threads[0], NULL, writeSequence, &writer);
+  pthread_create(&threads[1], NULL, readSequence, &reader);
+  pthread_join(threads[0], NULL);
+  pthread_join(threads[1], NULL);
+  return reader.mismatches;
+}
+
+@interface ZCCSpscRingTests : XCTestCase
+@property (nonatomic) CSpscRing<short> *ring;
+@end
+
+@implementation ZCCSpscRingTests
+
+- (void)setUp {
+  [super setUp];
+  self.ring = new CSpscRing<short>();
+}
+
+- (void)tearDown {
+  delete self.ring;
+  [super tearDown];
+}
+
+// Verify that the capacity is rounded up to a power of two and the ring starts empty
+- (void)testInit_RoundsCapacityUp {
+  XCTAssertTrue(self.ring->Init(1000));
+  XCTAssertEqual(self.ring->GetCapacity(), 1024);
+  XCTAssertEqual(self.ring->GetReadable(), 0);
+  XCTAssertEqual(self.ring->GetWritable(), 1024);
+  XCTAssertTrue(self.ring->Init(1024));
+  XCTAssertEqual(self.ring->GetCapacity(), 1024);
+  XCTAssertTrue(self.ring->Init(1));
+  XCTAssertEqual(self.ring->GetCapacity(), 1);
+}
+
+// Verify that a full ring takes only what fits and a short read returns only what's there
+- (void)testWrite_Full_TakesWhatFits {
+  self.ring->Init(8);
+  short samples[12];
+  for (int i = 0; i < 12; i++) {
+    samples[i] = (short)(i + 1);
+  }
+  XCTAssertEqual(self.ring->Write(samples, 12), 8);
+  XCTAssertEqual(self.ring->GetWritable(), 0);
+  XCTAssertEqual(self.ring->Write(samples, 1), 0);
+  XCTAssertEqual(self.ring->GetReadable(), 8);
+
+  short output[12] = {0};
+  XCTAssertEqual(self.ring->Read(output, 12), 8);
+  for (int i = 0; i < 8; i++) {
+    XCTAssertEqual(output[i], samples[i]);
+  }
+  XCTAssertEqual(self.ring->Read(output, 12), 0);
+}
+
+// Verify that data split across the end of the buffer comes back in order, at every offset
+- (void)testReadWrite_WrapsAround {
+  self.ring->Init(16);
+  short samples[11];
+  short output[11];
+  short next = 0;
+  for (int round = 0; round < 64; round++) {
+    for (int i = 0; i < 11; i++) {
+      samples[i] = next++;
+    }
+    XCTAssertEqual(self.ring->Write(samples, 11), 11);
+    XCTAssertEqual(self.ring->GetReadable(), 11);
+    XCTAssertEqual(self.ring->Read(output, 11), 11);
+    XCTAssertEqual(memcmp(output, samples, sizeof(samples)), 0);
+  }
+}
+
+// Verify that a writer and a reader on their own threads move every value once and in order,
+// through a ring much smaller than what goes through it
+- (void)testReadWrite_TwoThreads_InOrder {
+  CSpscRing<int> ring;
+  ring.Init(64);
+  XCTAssertEqual(moveSequence(&ring, streamLength), 0);
+  XCTAssertEqual(ring.GetReadable(), 0);
+}
+
+// A million samples between a recorder thread and an encoder thread, in uneven chunks
+- (void)testPerformance_TwoThreads {
+  CSpscRing<int> *ring = new CSpscRing<int>();
+  ring->Init(4096);
+  [self measureBlock:^{
+    moveSequence(ring, streamLength);
+  }];
+  delete ring;
+}
+
+@end
@@ -0,0 +1,311 @@
+//
+//  ZCCCommandCodecTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCCommandCodec.h"
+
+typedef struct {
+  const char *json;
+  BOOL fast;                    // Whether the reader should take it, rather than leave it to NSJSONSerialization
+} TraceEntry;
+
+/// Messages recorded from a session on a busy channel, in the order they arrived, plus the odd
+/// ones the reader has to hand back to the general parser
+static const TraceEntry recordedTrace[] = {
+  {"{\"seq\":1,\"success\":true,\"refresh_token\":\"c1a8e7e0f3d94b6a8a3e2a0a5d1c9b7f\"}", YES},
+  {"{\"command\":\"on_channel_status\",\"channel\":\"Warehouse 3\",\"status\":\"online\",\"users_online\":12,\"images_supported\":true,\"texting_supported\":true,\"locations_supported\":true,\"error\":\"\",\"error_type\":\"\"}", YES},
+  {"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23451,\"channel\":\"Warehouse 3\",\"from\":\"forklift-7\",\"for\":\"\"}", YES},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":23451}", YES},
+  {"{\"seq\":2,\"success\":true,\"stream_id\":23452}", YES},
+  {"{\"seq\":3,\"success\":true}", YES},
+  {"{\"command\":\"on_text_message\",\"channel\":\"Warehouse 3\",\"from\":\"forklift-7\",\"for\":\"\",\"message_id\":881,\"text\":\"Pallet 14 is on dock B\"}", YES},
+  {"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23453,\"channel\":\"Warehouse 3\",\"from\":\"\xD0\x9C\xD0\xB0\xD1\x80\xD0\xB8\xD1\x8F\",\"for\":\"\"}", YES},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":23453}", YES},
+  {"{\"command\":\"on_location\",\"channel\":\"Warehouse 3\",\"from\":\"forklift-2\",\"for\":\"\",\"message_id\":882,\"latitude\":47.6101,\"longitude\":-122.2015,\"formatted_address\":\"\",\"accuracy\":12}", YES},
+  {"{\"seq\":4,\"success\":false,\"error\":\"channel is not ready\"}", YES},
+  {" {\n  \"command\" : \"on_error\",\n  \"error\" : \"kicked\"\n} ", YES},
+  {"{\"command\":\"on_image\",\"channel\":\"Warehouse 3\",\"from\":\"forklift-7\",\"for\":null,\"message_id\":883,\"type\":\"jpeg\",\"height\":480,\"width\":640,\"source\":\"camera\",\"extra\":{\"tags\":[1,2.5,\"a\",true,null]}}", YES},
+  {"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23454,\"channel\":\"Warehouse 3\",\"from\":42,\"for\":\"\"}", YES},
+  {"{\"command\":\"on_something_new\",\"stream_id\":1}", YES},
+  {"{\"seq\":5,\"success\":true,\"stream_id\":-1}", YES},
+  {"{}", YES},
+  // Escaped values the reader can't hand out as views
+  {"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23455,\"channel\":\"Warehouse 3\",\"from\":\"Bob \\\"the builder\\\"\",\"for\":\"\"}", NO},
+  {"{\"command\":\"on_error\",\"error\":\"\\u00e9chec \\ud83d\\ude00\"}", NO},
+  {"{\"comm\\u0061nd\":\"on_stream_stop\",\"stream_id\":1}", NO},
+  // Numbers that aren't exact integers, or the wrong type
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":1.0}", NO},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":1e3}", NO},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":99999999999999999999}", NO},
+  {"{\"seq\":6,\"success\":1}", NO},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":true}", NO},
+  // Base64 that NSData would accept or decode differently
+  {"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA\",\"packet_duration\":60,\"stream_id\":1,\"channel\":\"c\",\"from\":\"f\"}", NO},
+  // Which duplicate wins is up to the general parser
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":1,\"stream_id\":2}", NO},
+  // Not JSON at all
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":1", NO},
+  {"{\"command\":\"on_stream_stop\",\"stream_id\":1}}", NO},
+  {"{\"command\":\"on_stream_stop\" \"stream_id\":1}", NO},
+  {"[1,2,3]", NO},
+  {"", NO},
+};
+static const size_t recordedTraceCount = sizeof(recordedTrace) / sizeof(recordedTrace[0]);
+
+static NSDictionary *parseWithFoundation(const char *json) {
+  NSData *data = [NSData dataWithBytes:json length:strlen(json)];
+  id object = [NSJSONSerialization JSONObjectWithData:data options:0 error:NULL];
+  return [object isKindOfClass:[NSDictionary class]] ? object : nil;
+}
+
+static NSString *stringFromEvent(ZCCEventString string) {
+  return [[NSString alloc] initWithBytes:string.bytes length:string.length encoding:NSUTF8StringEncoding];
+}
+
+/// Whether a field the reader took has the value ZCCSocket would find in the parsed dictionary,
+/// and whether a field it left out is missing there or of the wrong type
+static BOOL stringFieldMatches(ZCCEvent *event, uint32_t field, ZCCEventString value, id expected) {
+  if (![expected isKindOfClass:[NSString class]]) {
+    return !(event->fields & field);
+  }
+  return (event->fields & field) && [stringFromEvent(value) isEqualToString:expected];
+}
+
+static BOOL integerFieldMatches(ZCCEvent *event, uint32_t field, int64_t value, id expected) {
+  if (![expected isKindOfClass:[NSNumber class]]) {
+    return !(event->fields & field);
+  }
+  return (event->fields & field) && [expected longLongValue] == value;
+}
+
+static BOOL eventMatchesDictionary(ZCCEvent *event, NSDictionary *json) {
+  id seq = json[@"seq"];
+  if ([seq isKindOfClass:[NSNumber class]]) {
+    if (event->kind != ZCCEventKindResponse || event->seq != [seq longLongValue]) {
+      return NO;
+    }
+  } else {
+    NSDictionary *kinds = @{@"on_channel_status": @(ZCCEventKindOnChannelStatus),
+                            @"on_stream_start": @(ZCCEventKindOnStreamStart),
+                            @"on_stream_stop": @(ZCCEventKindOnStreamStop),
+                            @"on_error": @(ZCCEventKindOnError),
+                            @"on_location": @(ZCCEventKindOnLocation),
+                            @"on_text_message": @(ZCCEventKindOnTextMessage),
+                            @"on_image": @(ZCCEventKindOnImage)};
+    id command = json[@"command"];
+    NSNumber *kind = [command isKindOfClass:[NSString class]] ? kinds[command] : nil;
+    if (event->kind != (kind ? (ZCCEventKind)kind.intValue : ZCCEventKindUnknown)) {
+      return NO;
+    }
+  }
+
+  id success = json[@"success"];
+  if ([success isKindOfClass:[NSNumber class]] != !!(event->fields & ZCCEventFieldSuccess) ||
+      (success && [success boolValue] != event->success)) {
+    return NO;
+  }
+  id codecHeader = json[@"codec_header"];
+  if ([codecHeader isKindOfClass:[NSString class]]) {
+    NSData *expected = [[NSData alloc] initWithBase64EncodedString:codecHeader options:0];
+    NSData *actual = [NSData dataWithBytes:event->codecHeader length:event->codecHeaderLength];
+    if (!(event->fields & ZCCEventFieldCodecHeader) || ![expected isEqualToData:actual]) {
+      return NO;
+    }
+  } else if (event->fields & ZCCEventFieldCodecHeader) {
+    return NO;
+  }
+  return stringFieldMatches(event, ZCCEventFieldError, event->error, json[@"error"]) &&
+         stringFieldMatches(event, ZCCEventFieldType, event->type, json[@"type"]) &&
+         stringFieldMatches(event, ZCCEventFieldCodec, event->codec, json[@"codec"]) &&
+         stringFieldMatches(event, ZCCEventFieldChannel, event->channel, json[@"channel"]) &&
+         stringFieldMatches(event, ZCCEventFieldFrom, event->from, json[@"from"]) &&
+         integerFieldMatches(event, ZCCEventFieldStreamId, event->streamId, json[@"stream_id"]) &&
+         integerFieldMatches(event, ZCCEventFieldPacketDuration, event->packetDuration, json[@"packet_duration"]);
+}
+
+static NSString *finishWriter(ZCCJSONWriter *writer) {
+  NSString *string = writer->failed ? nil : [[NSString alloc] initWithBytes:writer->bytes length:writer->length encoding:NSUTF8StringEncoding];
+  ZCCJSONWriterDestroy(writer);
+  return string;
+}
+
+@interface ZCCCommandCodecTests : XCTestCase
+
+@end
+
+@implementation ZCCCommandCodecTests
+
+// Verify that every message the reader takes reads the same as through NSJSONSerialization, and
+// that it takes the common ones and leaves the rest to the general parser
+- (void)testEventParse_RecordedTrace_MatchesNSJSONSerialization {
+  for (size_t i = 0; i < recordedTraceCount; i++) {
+    const char *json = recordedTrace[i].json;
+    uint8_t scratch[64];
+    ZCCEvent event;
+    BOOL parsed = ZCCEventParse(json, strlen(json), scratch, sizeof(scratch), &event);
+    XCTAssertEqual(parsed, recordedTrace[i].fast, @"%s", json);
+    if (parsed) {
+      NSDictionary *expected = parseWithFoundation(json);
+      XCTAssertNotNil(expected, @"%s", json);
+      XCTAssertTrue(eventMatchesDictionary(&event, expected), @"%s", json);
+    }
+  }
+}
+
+// Verify that the reader never reads past the length it's given
+- (void)testEventParse_Truncated_Rejected {
+  const char *json = recordedTrace[2].json;
+  size_t length = strlen(json);
+  for (size_t prefix = 0; prefix < length; prefix++) {
+    char *copy = malloc(prefix);
+    memcpy(copy, json, prefix);
+    uint8_t scratch[64];
+    ZCCEvent event;
+    XCTAssertFalse(ZCCEventParse(copy, prefix, scratch, sizeof(scratch), &event), @"Took %zu bytes", prefix);
+    free(copy);
+  }
+}
+
+// Verify that a codec header too big for the scratch buffer goes to the general parser
+- (void)testEventParse_CodecHeaderTooBig_FallsBack {
+  const char *json = "{\"command\":\"on_stream_start\",\"codec_header\":\"gD4BPA==\"}";
+  uint8_t scratch[3];
+  ZCCEvent event;
+  XCTAssertFalse(ZCCEventParse(json, strlen(json), scratch, sizeof(scratch), &event));
+  uint8_t roomy[4];
+  XCTAssertTrue(ZCCEventParse(json, strlen(json), roomy, sizeof(roomy), &event));
+  XCTAssertEqual(event.codecHeaderLength, 4);
+  XCTAssertTrue(event.codecHeader == roomy);
+}
+
+// Verify that nesting deeper than the reader allows is rejected rather than recursed into
+- (void)testEventParse_DeepNesting_Rejected {
+  NSMutableString *json = [NSMutableString stringWithString:@"{\"extra\":"];
+  for (int i = 0; i < 100; i++) {
+    [json appendString:@"["];
+  }
+  for (int i = 0; i < 100; i++) {
+    [json appendString:@"]"];
+  }
+  [json appendString:@"}"];
+  uint8_t scratch[64];
+  ZCCEvent event;
+  XCTAssertFalse(ZCCEventParse(json.UTF8String, json.length, scratch, sizeof(scratch), &event));
+}
+
+// Verify that a written command reads back through NSJSONSerialization as the same values
+- (void)testWriter_Command_MatchesNSJSONSerialization {
+  const uint8_t header[] = {0x80, 0x3E, 0x01, 0x3C};
+  ZCCJSONWriter writer;
+  ZCCJSONWriterInit(&writer);
+  ZCCJSONWriterBeginObject(&writer);
+  ZCCJSONWriterKey(&writer, "command");
+  ZCCJSONWriterString(&writer, "start_stream", 12);
+  ZCCJSONWriterKey(&writer, "seq");
+  ZCCJSONWriterInteger(&writer, 4294967297);
+  ZCCJSONWriterKey(&writer, "negative");
+  ZCCJSONWriterInteger(&writer, -2147483649);
+  ZCCJSONWriterKey(&writer, "codec_header");
+  ZCCJSONWriterBase64(&writer, header, sizeof(header));
+  ZCCJSONWriterKey(&writer, "ok");
+  ZCCJSONWriterBool(&writer, true);
+  ZCCJSONWriterKey(&writer, "nested");
+  ZCCJSONWriterBeginObject(&writer);
+  ZCCJSONWriterKey(&writer, "no");
+  ZCCJSONWriterBool(&writer, false);
+  ZCCJSONWriterEndObject(&writer);
+  ZCCJSONWriterKey(&writer, "empty");
+  ZCCJSONWriterString(&writer, "", 0);
+  ZCCJSONWriterEndObject(&writer);
+  NSString *json = finishWriter(&writer);
+
+  NSDictionary *expected = @{@"command": @"start_stream",
+                             @"seq": @4294967297,
+                             @"negative": @-2147483649,
+                             @"codec_header": @"gD4BPA==",
+                             @"ok": @YES,
+                             @"nested": @{@"no": @NO},
+                             @"empty": @""};
+  NSDictionary *actual = parseWithFoundation(json.UTF8String);
+  XCTAssertEqualObjects(actual, expected, @"%@", json);
+}
+
+// Verify that every character that needs escaping survives the trip through NSJSONSerialization
+- (void)testWriter_String_EscapesRoundTrip {
+  char text[128];
+  for (int i = 0; i < 128; i++) {
+    text[i] = (char)(i == 0 ? 'x' : i);
+  }
+  NSMutableData *utf8 = [NSMutableData dataWithBytes:text length:sizeof(text)];
+  [utf8 appendData:[@"é€😀 Мария  " dataUsingEncoding:NSUTF8StringEncoding]];
+  ZCCJSONWriter writer;
+  ZCCJSONWriterInit(&writer);
+  ZCCJSONWriterBeginObject(&writer);
+  ZCCJSONWriterKey(&writer, "text");
+  ZCCJSONWriterString(&writer, utf8.bytes, utf8.length);
+  ZCCJSONWriterEndObject(&writer);
+  NSString *json = finishWriter(&writer);
+
+  NSString *expected = [[NSString alloc] initWithData:utf8 encoding:NSUTF8StringEncoding];
+  XCTAssertEqualObjects(parseWithFoundation(json.UTF8String)[@"text"], expected);
+}
+
+// Verify that base64 matches Foundation's for every padding case
+- (void)testWriter_Base64_MatchesNSData {
+  uint8_t bytes[10] = {0x00, 0xFF, 0x10, 0x83, 0x7E, 0xFB, 0xBF, 0x01, 0xFE, 0x3F};
+  for (size_t length = 0; length <= sizeof(bytes); length++) {
+    ZCCJSONWriter writer;
+    ZCCJSONWriterInit(&writer);
+    ZCCJSONWriterBase64(&writer, bytes, length);
+    NSString *json = finishWriter(&writer);
+    NSString *expected = [[NSData dataWithBytes:bytes length:length] base64EncodedStringWithOptions:0];
+    XCTAssertEqualObjects(json, ([NSString stringWithFormat:@"\"%@\"", expected]));
+  }
+}
+
+- (void)testWriter_NullString_Fails {
+  ZCCJSONWriter writer;
+  ZCCJSONWriterInit(&writer);
+  ZCCJSONWriterBeginObject(&writer);
+  ZCCJSONWriterKey(&writer, "text");
+  ZCCJSONWriterString(&writer, NULL, 0);
+  ZCCJSONWriterEndObject(&writer);
+  XCTAssertTrue(writer.failed);
+  XCTAssertNil(finishWriter(&writer));
+}
+
+// The recorded trace through the reader, as ZCCSocket sees it
+- (void)testPerformance_EventParse {
+  [self measureBlock:^{
+    for (int round = 0; round < 2000; round++) {
+      for (size_t i = 0; i < recordedTraceCount; i++) {
+        uint8_t scratch[64];
+        ZCCEvent event;
+        ZCCEventParse(recordedTrace[i].json, strlen(recordedTrace[i].json), scratch, sizeof(scratch), &event);
+      }
+    }
+  }];
+}
+
+// The same trace through NSJSONSerialization, as before the reader
+- (void)testPerformance_NSJSONSerialization {
+  NSMutableArray<NSData *> *messages = [NSMutableArray array];
+  for (size_t i = 0; i < recordedTraceCount; i++) {
+    [messages addObject:[NSData dataWithBytes:recordedTrace[i].json length:strlen(recordedTrace[i].json)]];
+  }
+  [self measureBlock:^{
+    for (int round = 0; round < 2000; round++) {
+      for (NSData *message in messages) {
+        @autoreleasepool {
+          [NSJSONSerialization JSONObjectWithData:message options:0 error:NULL];
+        }
+      }
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,268 @@
+//
+//  ZCCSRDeflateTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCSRDeflate.h"
+
+/// What the client sends and receives during a busy minute on a channel
+static const char *const commandTrace[] = {
+  "{\"command\":\"logon\",\"seq\":1,\"auth_token\":\"eyJhbGciOiJSUzI1NiIsInR5cCI6IkpXVCJ9.eyJ1aWQiOiJ0ZXN0In0\",\"username\":\"dispatcher\",\"password\":\"\",\"channel\":\"Warehouse 3\"}",
+  "{\"seq\":1,\"success\":true,\"refresh_token\":\"c1a8e7e0f3d94b6a8a3e2a0a5d1c9b7f\"}",
+  "{\"command\":\"on_channel_status\",\"channel\":\"Warehouse 3\",\"status\":\"online\",\"users_online\":12,\"images_supported\":true,\"texting_supported\":true,\"locations_supported\":true,\"error\":\"\",\"error_type\":\"\"}",
+  "{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23451,\"channel\":\"Warehouse 3\",\"from\":\"forklift-7\",\"for\":\"\"}",
+  "{\"command\":\"on_stream_stop\",\"stream_id\":23451}",
+  "{\"command\":\"start_stream\",\"seq\":2,\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60}",
+  "{\"seq\":2,\"success\":true,\"stream_id\":23452}",
+  "{\"command\":\"stop_stream\",\"seq\":3,\"stream_id\":23452}",
+  "{\"seq\":3,\"success\":true}",
+  "{\"command\":\"on_text_message\",\"channel\":\"Warehouse 3\",\"from\":\"forklift-7\",\"for\":\"\",\"message_id\":881,\"text\":\"Pallet 14 is on dock B\"}",
+  "{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"gD4BPA==\",\"packet_duration\":60,\"stream_id\":23453,\"channel\":\"Warehouse 3\",\"from\":\"forklift-2\",\"for\":\"\"}",
+  "{\"command\":\"on_stream_stop\",\"stream_id\":23453}",
+  "{\"command\":\"on_location\",\"channel\":\"Warehouse 3\",\"from\":\"forklift-2\",\"for\":\"\",\"message_id\":882,\"latitude\":47.6101,\"longitude\":-122.2015,\"formatted_address\":\"\",\"accuracy\":12}",
+  "{\"command\":\"on_channel_status\",\"channel\":\"Warehouse 3\",\"status\":\"online\",\"users_online\":13,\"images_supported\":true,\"texting_supported\":true,\"locations_supported\":true,\"error\":\"\",\"error_type\":\"\"}",
+};
+static const size_t commandTraceCount = sizeof(commandTrace) / sizeof(commandTrace[0]);
+
+static ZCCSRDeflateParameters defaultParameters(void) {
+  ZCCSRDeflateParameters parameters;
+  ZCCSRDeflateParseResponse("permessage-deflate", ZCCSRDeflateMaxWindowBits, &parameters);
+  return parameters;
+}
+
+/// Compress with one context and inflate with another, the way the server would see it
+static BOOL roundTrip(ZCCSRDeflate *sender, ZCCSRDeflate *receiver, const uint8_t *bytes, size_t length, size_t *compressedLength) {
+  const uint8_t *compressed;
+  if (!ZCCSRDeflateCompress(sender, bytes, length, &compressed, compressedLength)) {
+    return NO;
+  }
+  const uint8_t *inflated;
+  size_t inflatedLength;
+  if (ZCCSRDeflateDecompress(receiver, compressed, *compressedLength, length, &inflated, &inflatedLength) != ZCCSRDeflateResultOK) {
+    return NO;
+  }
+  return inflatedLength == length && memcmp(inflated, bytes, length) == 0;
+}
+
+@interface ZCCSRDeflateTests : XCTestCase
+
+@end
+
+@implementation ZCCSRDeflateTests
+
+- (void)testWriteOffer {
+  char offer[128];
+  XCTAssertEqual(ZCCSRDeflateWriteOffer(offer, sizeof(offer), 15), strlen("permessage-deflate; client_max_window_bits"));
+  XCTAssertEqual(strcmp(offer, "permessage-deflate; client_max_window_bits"), 0);
+
+  ZCCSRDeflateWriteOffer(offer, sizeof(offer), 12);
+  XCTAssertEqual(strcmp(offer, "permessage-deflate; client_max_window_bits=12; server_max_window_bits=12"), 0);
+  // Windows zlib can't use are raised to the smallest one it can
+  ZCCSRDeflateWriteOffer(offer, sizeof(offer), 4);
+  XCTAssertEqual(strcmp(offer, "permessage-deflate; client_max_window_bits=9; server_max_window_bits=9"), 0);
+
+  XCTAssertEqual(ZCCSRDeflateWriteOffer(offer, 10, 15), 0);
+}
+
+- (void)testParseResponse_Accepted {
+  ZCCSRDeflateParameters parameters;
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate", 15, &parameters), ZCCSRDeflateNegotiationAccepted);
+  XCTAssertEqual(parameters.clientMaxWindowBits, 15);
+  XCTAssertEqual(parameters.serverMaxWindowBits, 15);
+  XCTAssertFalse(parameters.clientNoContextTakeover);
+  XCTAssertFalse(parameters.serverNoContextTakeover);
+
+  XCTAssertEqual(ZCCSRDeflateParseResponse(" permessage-deflate ;client_max_window_bits = \"10\"; server_max_window_bits=11; client_no_context_takeover; server_no_context_takeover ", 15, &parameters), ZCCSRDeflateNegotiationAccepted);
+  XCTAssertEqual(parameters.clientMaxWindowBits, 10);
+  XCTAssertEqual(parameters.serverMaxWindowBits, 11);
+  XCTAssertTrue(parameters.clientNoContextTakeover);
+  XCTAssertTrue(parameters.serverNoContextTakeover);
+}
+
+- (void)testParseResponse_NoHeader_Declined {
+  ZCCSRDeflateParameters parameters;
+  XCTAssertEqual(ZCCSRDeflateParseResponse(NULL, 15, &parameters), ZCCSRDeflateNegotiationDeclined);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("", 15, &parameters), ZCCSRDeflateNegotiationDeclined);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("  ", 15, &parameters), ZCCSRDeflateNegotiationDeclined);
+}
+
+// Verify that a response the client didn't offer fails the handshake instead of being ignored
+- (void)testParseResponse_NotOffered_Invalid {
+  ZCCSRDeflateParameters parameters;
+  XCTAssertEqual(ZCCSRDeflateParseResponse("x-webkit-deflate-frame", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate, permessage-deflate", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; client_max_window_bits=13", 12, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; server_max_window_bits=7", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; server_max_window_bits", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; server_max_window_bits=1x", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; client_no_context_takeover; client_no_context_takeover", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; client_no_context_takeover=1", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+  XCTAssertEqual(ZCCSRDeflateParseResponse("permessage-deflate; mystery", 15, &parameters), ZCCSRDeflateNegotiationInvalid);
+}
+
+// Verify that every command survives the trip and later ones refer back to the earlier ones
+- (void)testRoundTrip_ContextTakeover_ShrinksRepeats {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  size_t firstLength = 0;
+  for (size_t i = 0; i < commandTraceCount; i++) {
+    size_t compressedLength;
+    XCTAssertTrue(roundTrip(sender, receiver, (const uint8_t *)commandTrace[i], strlen(commandTrace[i]), &compressedLength));
+    if (i == 0) {
+      firstLength = compressedLength;
+    }
+  }
+  // The same message again is mostly a reference to the history
+  size_t repeatLength;
+  XCTAssertTrue(roundTrip(sender, receiver, (const uint8_t *)commandTrace[0], strlen(commandTrace[0]), &repeatLength));
+  XCTAssertLessThan(repeatLength, firstLength / 4);
+  ZCCSRDeflateDestroy(sender);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+// Verify that without context takeover every message compresses on its own
+- (void)testRoundTrip_NoContextTakeover_Independent {
+  ZCCSRDeflateParameters parameters;
+  ZCCSRDeflateParseResponse("permessage-deflate; client_no_context_takeover; server_no_context_takeover; client_max_window_bits=10", 15, &parameters);
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  size_t firstLength;
+  size_t repeatLength;
+  XCTAssertTrue(roundTrip(sender, receiver, (const uint8_t *)commandTrace[3], strlen(commandTrace[3]), &firstLength));
+  XCTAssertTrue(roundTrip(sender, receiver, (const uint8_t *)commandTrace[3], strlen(commandTrace[3]), &repeatLength));
+  XCTAssertEqual(firstLength, repeatLength);
+  ZCCSRDeflateDestroy(sender);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+// Verify that messages larger than the internal buffer, and empty ones, are handled
+- (void)testRoundTrip_LargeAndEmpty {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  size_t length = 200000;
+  uint8_t *bytes = malloc(length);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < length; i++) {
+    // Random enough that it doesn't compress much
+    seed = seed * 1103515245 + 12345;
+    bytes[i] = (uint8_t)(seed >> 16);
+  }
+  size_t compressedLength;
+  XCTAssertTrue(roundTrip(sender, receiver, bytes, length, &compressedLength));
+
+  const uint8_t *output;
+  XCTAssertFalse(ZCCSRDeflateCompress(sender, bytes, 0, &output, &compressedLength));
+  // The sender still works after declining
+  XCTAssertTrue(roundTrip(sender, receiver, (const uint8_t *)commandTrace[4], strlen(commandTrace[4]), &compressedLength));
+  free(bytes);
+  ZCCSRDeflateDestroy(sender);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+// Verify that a message inflating past the limit is rejected, and one that fits exactly is not
+- (void)testDecompress_MaxLength {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  parameters.clientNoContextTakeover = YES;
+  parameters.serverNoContextTakeover = YES;
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  size_t length = 100000;
+  uint8_t *zeros = calloc(1, length);
+  const uint8_t *compressed;
+  size_t compressedLength;
+  XCTAssertTrue(ZCCSRDeflateCompress(sender, zeros, length, &compressed, &compressedLength));
+  // A small message that inflates a lot
+  XCTAssertLessThan(compressedLength, 1000);
+  uint8_t *bomb = malloc(compressedLength);
+  memcpy(bomb, compressed, compressedLength);
+
+  const uint8_t *inflated;
+  size_t inflatedLength;
+  XCTAssertEqual(ZCCSRDeflateDecompress(receiver, bomb, compressedLength, length - 1, &inflated, &inflatedLength), ZCCSRDeflateResultTooBig);
+  XCTAssertEqual(ZCCSRDeflateDecompress(receiver, bomb, compressedLength, length, &inflated, &inflatedLength), ZCCSRDeflateResultOK);
+  XCTAssertEqual(inflatedLength, length);
+  free(bomb);
+  free(zeros);
+  ZCCSRDeflateDestroy(sender);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+- (void)testDecompress_Garbage_Invalid {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  const uint8_t garbage[] = {0xFF, 0xFF, 0xFF, 0xFF, 0x12, 0x34};
+  const uint8_t *inflated;
+  size_t inflatedLength;
+  XCTAssertEqual(ZCCSRDeflateDecompress(receiver, garbage, sizeof(garbage), 1000, &inflated, &inflatedLength), ZCCSRDeflateResultInvalid);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+// Verify the bytes saved on the command trace: with context takeover it shrinks to less than a third
+- (void)testCompress_CommandTrace_SavesBytes {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  size_t rawTotal = 0;
+  size_t compressedTotal = 0;
+  for (int round = 0; round < 10; round++) {
+    for (size_t i = 0; i < commandTraceCount; i++) {
+      const uint8_t *compressed;
+      size_t compressedLength;
+      XCTAssertTrue(ZCCSRDeflateCompress(sender, (const uint8_t *)commandTrace[i], strlen(commandTrace[i]), &compressed, &compressedLength));
+      rawTotal += strlen(commandTrace[i]);
+      compressedTotal += compressedLength;
+    }
+  }
+  XCTAssertLessThan(compressedTotal * 3, rawTotal);
+  ZCCSRDeflateDestroy(sender);
+}
+
+- (void)testPerformance_CompressCommands {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  [self measureBlock:^{
+    for (int round = 0; round < 1000; round++) {
+      for (size_t i = 0; i < commandTraceCount; i++) {
+        const uint8_t *compressed;
+        size_t compressedLength;
+        ZCCSRDeflateCompress(sender, (const uint8_t *)commandTrace[i], strlen(commandTrace[i]), &compressed, &compressedLength);
+      }
+    }
+  }];
+  ZCCSRDeflateDestroy(sender);
+}
+
+- (void)testPerformance_DecompressCommands {
+  ZCCSRDeflateParameters parameters = defaultParameters();
+  parameters.clientNoContextTakeover = YES;
+  parameters.serverNoContextTakeover = YES;
+  ZCCSRDeflate *sender = ZCCSRDeflateCreate(&parameters, -1);
+  ZCCSRDeflate *receiver = ZCCSRDeflateCreate(&parameters, -1);
+  // Without context takeover every message inflates on its own, so they can be replayed
+  uint8_t *messages = malloc(commandTraceCount * 512);
+  size_t *lengths = malloc(commandTraceCount * sizeof(size_t));
+  for (size_t i = 0; i < commandTraceCount; i++) {
+    const uint8_t *compressed;
+    ZCCSRDeflateCompress(sender, (const uint8_t *)commandTrace[i], strlen(commandTrace[i]), &compressed, &lengths[i]);
+    memcpy(messages + i * 512, compressed, lengths[i]);
+  }
+  [self measureBlock:^{
+    for (int round = 0; round < 1000; round++) {
+      for (size_t i = 0; i < commandTraceCount; i++) {
+        const uint8_t *inflated;
+        size_t inflatedLength;
+        ZCCSRDeflateDecompress(receiver, messages + i * 512, lengths[i], 4096, &inflated, &inflatedLength);
+      }
+    }
+  }];
+  free(messages);
+  free(lengths);
+  ZCCSRDeflateDestroy(sender);
+  ZCCSRDeflateDestroy(receiver);
+}
+
+@end
@@ -0,0 +1,352 @@
+//
+//  ZCCSRFrameCodecTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCSRFrameCodec.h"
+
+static const uint8_t testMaskKey[4] = {0x12, 0x34, 0x56, 0x78};
+
+/// What a parser made of a stream, collected across all of its events
+typedef struct {
+  NSUInteger headers;
+  NSUInteger ends;
+  uint8_t lastOpcode;
+  BOOL lastFin;
+  uint8_t payload[4096];
+  size_t payloadLength;
+  BOOL failed;
+  ZCCSRFrameError error;
+} ParsedStream;
+
+/// Feeds bytes to the parser step bytes at a time, as they might come off the socket
+static void feed(ZCCSRFrameParser *parser, uint8_t *bytes, size_t length, size_t step, ParsedStream *parsed) {
+  for (size_t start = 0; start < length && !parsed->failed; start += step) {
+    uint8_t *piece = bytes + start;
+    size_t pieceLength = MIN(step, length - start);
+    for (;;) {
+      size_t consumed = 0;
+      uint8_t *payload = NULL;
+      size_t payloadLength = 0;
+      ZCCSRFrameEvent event = ZCCSRFrameParserFeed(parser, piece, pieceLength, &consumed, &payload, &payloadLength);
+      piece += consumed;
+      pieceLength -= consumed;
+      if (event == ZCCSRFrameEventNone) {
+        break;
+      }
+      if (event == ZCCSRFrameEventError) {
+        parsed->failed = YES;
+        parsed->error = parser->error;
+        break;
+      }
+      if (event == ZCCSRFrameEventHeader) {
+        parsed->headers++;
+        parsed->lastOpcode = parser->header.opcode;
+        parsed->lastFin = parser->header.fin;
+      } else if (event == ZCCSRFrameEventPayload) {
+        memcpy(parsed->payload + parsed->payloadLength, payload, payloadLength);
+        parsed->payloadLength += payloadLength;
+      } else if (event == ZCCSRFrameEventEnd) {
+        parsed->ends++;
+      }
+    }
+  }
+}
+
+/// Writes a whole frame and returns its length
+static size_t writeFrame(uint8_t *buffer, BOOL fin, uint8_t opcode, const uint8_t *payload, size_t length, const uint8_t *maskKey) {
+  size_t headerLength = ZCCSRFrameWriteHeader(buffer, fin, 0, opcode, length, maskKey);
+  memcpy(buffer + headerLength, payload, length);
+  if (maskKey) {
+    ZCCSRFrameMask(buffer + headerLength, length, maskKey, 0);
+  }
+  return headerLength + length;
+}
+
+static ZCCSRFrameHeader headerWith(BOOL fin, uint8_t opcode, BOOL masked, uint64_t payloadLength) {
+  ZCCSRFrameHeader header;
+  memset(&header, 0, sizeof(header));
+  header.fin = fin;
+  header.opcode = opcode;
+  header.masked = masked;
+  header.payloadLength = payloadLength;
+  return header;
+}
+
+@interface ZCCSRFrameCodecTests : XCTestCase
+
+@end
+
+@implementation ZCCSRFrameCodecTests
+
+// Verify that headers for every length encoding parse back to what was written
+- (void)testWriteHeader_ParsesBack {
+  const uint64_t lengths[] = {0, 1, 125, 126, 127, 65535, 65536, 1ULL << 32};
+  for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+    for (int masked = 0; masked < 2; masked++) {
+      uint8_t buffer[ZCCSRFrameMaxHeaderLength];
+      size_t written = ZCCSRFrameWriteHeader(buffer, true, 0, 0x2, lengths[i], masked ? testMaskKey : NULL);
+      XCTAssertEqual(written, ZCCSRFrameHeaderSize(lengths[i], masked));
+      XCTAssertEqual(ZCCSRFrameHeaderLength(buffer), written);
+
+      ZCCSRFrameHeader header;
+      XCTAssertEqual(ZCCSRFrameParseHeader(buffer, written, &header), written);
+      XCTAssertTrue(header.fin);
+      XCTAssertEqual(header.opcode, 0x2);
+      XCTAssertEqual(header.masked, masked != 0);
+      XCTAssertEqual(header.payloadLength, lengths[i]);
+      XCTAssertEqual(header.headerLength, written);
+      if (masked) {
+        XCTAssertEqual(memcmp(header.maskKey, testMaskKey, 4), 0);
+      }
+      // One byte short is not a header yet
+      XCTAssertEqual(ZCCSRFrameParseHeader(buffer, written - 1, &header), 0);
+    }
+  }
+}
+
+// Verify the exact bytes of a small masked text frame header, as RFC 6455 lays it out
+- (void)testWriteHeader_Bytes {
+  uint8_t buffer[ZCCSRFrameMaxHeaderLength];
+  XCTAssertEqual(ZCCSRFrameWriteHeader(buffer, true, 0, 0x1, 5, testMaskKey), 6);
+  const uint8_t expected[] = {0x81, 0x85, 0x12, 0x34, 0x56, 0x78};
+  XCTAssertEqual(memcmp(buffer, expected, sizeof(expected)), 0);
+
+  XCTAssertEqual(ZCCSRFrameWriteHeader(buffer, false, 0x40, 0x2, 300, NULL), 4);
+  const uint8_t extended[] = {0x42, 0x7e, 0x01, 0x2c};
+  XCTAssertEqual(memcmp(buffer, extended, sizeof(extended)), 0);
+}
+
+// Verify that each protocol violation is reported as such
+- (void)testCheckHeader_Violations {
+  ZCCSRFrameHeader header = headerWith(YES, 0x1, NO, 10);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorNone);
+
+  header.rsv = 0x40;
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorReservedBits);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0x40), ZCCSRFrameErrorNone);
+
+  header = headerWith(YES, 0x3, NO, 0);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorUnknownOpcode);
+
+  header = headerWith(YES, 0x1, YES, 0);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorMasked);
+  header = headerWith(YES, 0x1, NO, 0);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, false, 0), ZCCSRFrameErrorUnmasked);
+
+  header = headerWith(YES, 0x2, NO, 1ULL << 63);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorLengthTooBig);
+
+  header = headerWith(NO, 0x9, NO, 0);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorFragmentedControl);
+  header = headerWith(YES, 0x9, NO, 126);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorControlTooBig);
+
+  header = headerWith(YES, 0x0, NO, 1);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0, true, 0), ZCCSRFrameErrorUnexpectedContinuation);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0x1, true, 0), ZCCSRFrameErrorNone);
+  header = headerWith(YES, 0x2, NO, 1);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0x1, true, 0), ZCCSRFrameErrorExpectedContinuation);
+  // Control frames may come between the fragments of a message
+  header = headerWith(YES, 0xA, NO, 0);
+  XCTAssertEqual(ZCCSRFrameCheckHeader(&header, 0x1, true, 0), ZCCSRFrameErrorNone);
+}
+
+// Verify that control frames are written whole and refuse payloads they can't carry
+- (void)testWriteControl {
+  uint8_t buffer[ZCCSRFrameMaxControlFrameLength];
+  uint8_t payload[ZCCSRFrameMaxControlPayloadLength + 1];
+  memset(payload, 'p', sizeof(payload));
+  XCTAssertEqual(ZCCSRFrameWriteControl(buffer, 0x9, payload, ZCCSRFrameMaxControlPayloadLength, testMaskKey), ZCCSRFrameMaxControlFrameLength - 8);
+  XCTAssertEqual(ZCCSRFrameWriteControl(buffer, 0x9, payload, sizeof(payload), testMaskKey), 0);
+
+  size_t length = ZCCSRFrameWriteControl(buffer, 0xA, payload, 3, NULL);
+  const uint8_t expected[] = {0x8a, 0x03, 'p', 'p', 'p'};
+  XCTAssertEqual(length, sizeof(expected));
+  XCTAssertEqual(memcmp(buffer, expected, sizeof(expected)), 0);
+}
+
+// Verify that a close reason that doesn't fit is cut before a character, not in the middle of one
+- (void)testWriteClose_LongReason_CutAtCharacter {
+  // 61 two-byte characters, 122 bytes, then one more that would straddle the 123 byte limit
+  char reason[128];
+  size_t reasonLength = 0;
+  for (int i = 0; i < 62; i++) {
+    reason[reasonLength++] = (char)0xC3;
+    reason[reasonLength++] = (char)0xA9;
+  }
+  uint8_t buffer[ZCCSRFrameMaxControlFrameLength];
+  size_t length = ZCCSRFrameWriteClose(buffer, 1000, reason, reasonLength, NULL);
+  XCTAssertEqual(length, 2 + 2 + 122);
+  XCTAssertEqual(buffer[0], 0x88);
+  XCTAssertEqual(buffer[2], 0x03);
+  XCTAssertEqual(buffer[3], 0xE8);
+  XCTAssertEqual(memcmp(buffer + 4, reason, 122), 0);
+
+  XCTAssertEqual(ZCCSRFrameWriteClose(buffer, 1001, NULL, 10, NULL), 4);
+}
+
+- (void)testCloseCodeIsValid {
+  XCTAssertTrue(ZCCSRFrameCloseCodeIsValid(1000));
+  XCTAssertTrue(ZCCSRFrameCloseCodeIsValid(1011));
+  XCTAssertTrue(ZCCSRFrameCloseCodeIsValid(3000));
+  XCTAssertTrue(ZCCSRFrameCloseCodeIsValid(4999));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(999));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(1004));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(1005));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(1006));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(1012));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(2999));
+  XCTAssertFalse(ZCCSRFrameCloseCodeIsValid(5000));
+}
+
+// Verify that a fragmented message with a ping in between comes out the same whatever pieces it arrives in
+- (void)testParser_FragmentedMessage_AnyPieceSize {
+  const char *text = "The quick brown fox jumps over the lazy dog, and then some more to fill a frame.";
+  size_t textLength = strlen(text);
+  uint8_t stream[512];
+  size_t length = 0;
+  length += writeFrame(stream + length, NO, 0x1, (const uint8_t *)text, 30, NULL);
+  length += writeFrame(stream + length, YES, 0x9, (const uint8_t *)"ping", 4, NULL);
+  length += writeFrame(stream + length, YES, 0x0, (const uint8_t *)text + 30, textLength - 30, NULL);
+
+  for (size_t step = 1; step <= length; step++) {
+    ZCCSRFrameParser parser;
+    ZCCSRFrameParserInit(&parser, true, 0);
+    ParsedStream parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    feed(&parser, stream, length, step, &parsed);
+    XCTAssertFalse(parsed.failed);
+    XCTAssertEqual(parsed.headers, 3);
+    XCTAssertEqual(parsed.ends, 3);
+    XCTAssertEqual(parsed.payloadLength, textLength + 4);
+    XCTAssertEqual(memcmp(parsed.payload, text, 30), 0);
+    XCTAssertEqual(memcmp(parsed.payload + 30, "ping", 4), 0);
+    XCTAssertEqual(memcmp(parsed.payload + 34, text + 30, textLength - 30), 0);
+    XCTAssertEqual(parser.messageOpcode, 0);
+  }
+}
+
+// Verify that masked payloads are unmasked on the server side, wherever the pieces split them
+- (void)testParser_MaskedPayload_Unmasked {
+  uint8_t payload[300];
+  for (size_t i = 0; i < sizeof(payload); i++) {
+    payload[i] = (uint8_t)i;
+  }
+  uint8_t stream[400];
+  size_t length = writeFrame(stream, YES, 0x2, payload, sizeof(payload), testMaskKey);
+
+  for (size_t step = 1; step < 40; step++) {
+    uint8_t copy[400];
+    memcpy(copy, stream, length);
+    ZCCSRFrameParser parser;
+    ZCCSRFrameParserInit(&parser, false, 0);
+    ParsedStream parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    feed(&parser, copy, length, step, &parsed);
+    XCTAssertFalse(parsed.failed);
+    XCTAssertEqual(parsed.ends, 1);
+    XCTAssertEqual(parsed.payloadLength, sizeof(payload));
+    XCTAssertEqual(memcmp(parsed.payload, payload, sizeof(payload)), 0);
+  }
+}
+
+// Verify that an empty frame ends without any input after its header
+- (void)testParser_EmptyFrame_Ends {
+  uint8_t stream[2] = {0x8a, 0x00};
+  ZCCSRFrameParser parser;
+  ZCCSRFrameParserInit(&parser, true, 0);
+  ParsedStream parsed;
+  memset(&parsed, 0, sizeof(parsed));
+  feed(&parser, stream, sizeof(stream), sizeof(stream), &parsed);
+  XCTAssertEqual(parsed.headers, 1);
+  XCTAssertEqual(parsed.ends, 1);
+  XCTAssertEqual(parsed.lastOpcode, 0xA);
+  XCTAssertEqual(parsed.payloadLength, 0);
+}
+
+// Verify that the parser stays failed after a protocol violation
+- (void)testParser_Violation_StaysFailed {
+  uint8_t stream[16];
+  size_t length = writeFrame(stream, YES, 0x0, (const uint8_t *)"x", 1, NULL);
+  ZCCSRFrameParser parser;
+  ZCCSRFrameParserInit(&parser, true, 0);
+  ParsedStream parsed;
+  memset(&parsed, 0, sizeof(parsed));
+  feed(&parser, stream, length, length, &parsed);
+  XCTAssertTrue(parsed.failed);
+  XCTAssertEqual(parsed.error, ZCCSRFrameErrorUnexpectedContinuation);
+  XCTAssertTrue(strlen(ZCCSRFrameErrorDescription(parsed.error)) > 0);
+
+  length = writeFrame(stream, YES, 0x1, (const uint8_t *)"x", 1, NULL);
+  size_t consumed = 0;
+  uint8_t *payload = NULL;
+  size_t payloadLength = 0;
+  XCTAssertEqual(ZCCSRFrameParserFeed(&parser, stream, length, &consumed, &payload, &payloadLength), ZCCSRFrameEventError);
+  XCTAssertEqual(consumed, 0);
+}
+
+// Random input must only ever end in an error or in waiting for more, never read out of bounds
+- (void)testParser_RandomInput_Survives {
+  uint32_t seed = 1;
+  uint8_t stream[1024];
+  for (int round = 0; round < 2000; round++) {
+    for (size_t i = 0; i < sizeof(stream); i++) {
+      seed = seed * 1103515245 + 12345;
+      stream[i] = (uint8_t)(seed >> 16);
+    }
+    ZCCSRFrameParser parser;
+    ZCCSRFrameParserInit(&parser, round % 2 == 0, (uint8_t)(round % 3 == 0 ? 0x40 : 0));
+    ParsedStream parsed;
+    memset(&parsed, 0, sizeof(parsed));
+    feed(&parser, stream, sizeof(stream), 1 + round % 64, &parsed);
+    XCTAssertLessThanOrEqual(parsed.payloadLength, sizeof(stream));
+    XCTAssertLessThanOrEqual(parsed.ends, parsed.headers);
+  }
+}
+
+// Parses a burst of 60 ms audio frames with a command in between, as a client receives them
+- (void)testPerformance_ParseAudioBurst {
+  uint8_t audio[120];
+  uint8_t command[400];
+  memset(audio, 0xA5, sizeof(audio));
+  memset(command, '{', sizeof(command));
+  static uint8_t stream[64 * 1024];
+  size_t length = 0;
+  size_t burstLength = 16 * (ZCCSRFrameHeaderSize(sizeof(audio), false) + sizeof(audio)) + ZCCSRFrameHeaderSize(sizeof(command), false) + sizeof(command);
+  while (length + burstLength <= sizeof(stream)) {
+    for (int i = 0; i < 16; i++) {
+      length += writeFrame(stream + length, YES, 0x2, audio, sizeof(audio), NULL);
+    }
+    length += writeFrame(stream + length, YES, 0x1, command, sizeof(command), NULL);
+  }
+  [self measureBlock:^{
+    for (int round = 0; round < 200; round++) {
+      ZCCSRFrameParser parser;
+      ZCCSRFrameParserInit(&parser, true, 0);
+      ParsedStream parsed;
+      memset(&parsed, 0, sizeof(parsed));
+      // Payloads aren't collected here, only counted
+      uint8_t *piece = stream;
+      size_t pieceLength = length;
+      for (;;) {
+        size_t consumed = 0;
+        uint8_t *payload = NULL;
+        size_t payloadLength = 0;
+        ZCCSRFrameEvent event = ZCCSRFrameParserFeed(&parser, piece, pieceLength, &consumed, &payload, &payloadLength);
+        piece += consumed;
+        pieceLength -= consumed;
+        if (event == ZCCSRFrameEventNone || event == ZCCSRFrameEventError) {
+          break;
+        }
+        parsed.ends += event == ZCCSRFrameEventEnd;
+      }
+      XCTAssertGreaterThan(parsed.ends, 0);
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,166 @@
+//
+//  ZCCSRFrameMaskTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCSRFrameCodec.h"
+#import "ZCCSRSIMDHelpers.h"
+
+static const uint8_t testMaskKey[4] = {0xA1, 0xB2, 0xC3, 0xD4};
+
+/// Masks one byte at a time, straight from RFC 6455
+static void referenceMask(uint8_t *dst, const uint8_t *src, size_t length, const uint8_t *maskKey, size_t offset) {
+  for (size_t i = 0; i < length; i++) {
+    dst[i] = src[i] ^ maskKey[(offset + i) % 4];
+  }
+}
+
+static void fillPattern(uint8_t *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    bytes[i] = (uint8_t)(i * 7 + 3);
+  }
+}
+
+@interface ZCCSRFrameMaskTests : XCTestCase
+/// Big enough for every length and alignment below, plus a guard band on each side
+@property (nonatomic) uint8_t *source;
+@property (nonatomic) uint8_t *destination;
+@property (nonatomic) uint8_t *expected;
+@end
+
+@implementation ZCCSRFrameMaskTests
+
+- (void)setUp {
+  [super setUp];
+  self.source = malloc(4096);
+  self.destination = malloc(4096);
+  self.expected = malloc(4096);
+}
+
+- (void)tearDown {
+  free(self.source);
+  free(self.destination);
+  free(self.expected);
+  [super tearDown];
+}
+
+// Verify that masking in place matches the byte loop for every length, alignment and key offset,
+// which covers the unaligned head, all vector widths and the tail
+- (void)testMask_MatchesReference {
+  for (size_t alignment = 0; alignment < 32; alignment++) {
+    for (size_t length = 0; length <= 300; length++) {
+      for (size_t offset = 0; offset < 4; offset++) {
+        uint8_t *bytes = self.destination + 64 + alignment;
+        fillPattern(bytes, length);
+        referenceMask(self.expected, bytes, length, testMaskKey, offset);
+        XCTAssertEqual(ZCCSRFrameMask(bytes, length, testMaskKey, offset), (offset + length) % 4);
+        if (memcmp(bytes, self.expected, length) != 0) {
+          XCTFail(@"Masked wrong: length %zu, alignment %zu, offset %zu", length, alignment, offset);
+          return;
+        }
+      }
+    }
+  }
+}
+
+// Verify that copying and masking matches the byte loop with source and destination aligned differently
+- (void)testMaskCopy_MatchesReference_LeavesRestAlone {
+  for (size_t sourceAlignment = 0; sourceAlignment < 8; sourceAlignment++) {
+    for (size_t alignment = 0; alignment < 32; alignment++) {
+      for (size_t length = 0; length <= 300; length += 1 + length / 16) {
+        uint8_t *src = self.source + 64 + sourceAlignment;
+        uint8_t *dst = self.destination + 64 + alignment;
+        fillPattern(src, length);
+        memset(self.destination, 0xEE, 4096);
+        referenceMask(self.expected, src, length, testMaskKey, 1);
+        ZCCSRFrameMaskCopy(dst, src, length, testMaskKey, 1);
+        if (memcmp(dst, self.expected, length) != 0) {
+          XCTFail(@"Copied wrong: length %zu, alignment %zu/%zu", length, sourceAlignment, alignment);
+          return;
+        }
+        // Nothing written before or after the destination
+        XCTAssertEqual(dst[-1], 0xEE);
+        XCTAssertEqual(dst[length], 0xEE);
+      }
+    }
+  }
+}
+
+// Verify that a payload masked in pieces comes out as if it was masked at once
+- (void)testMask_InPieces_MatchesWhole {
+  size_t length = 1000;
+  fillPattern(self.source, length);
+  referenceMask(self.expected, self.source, length, testMaskKey, 0);
+  for (size_t piece = 1; piece < 70; piece++) {
+    memcpy(self.destination, self.source, length);
+    size_t offset = 0;
+    for (size_t start = 0; start < length; start += piece) {
+      offset = ZCCSRFrameMask(self.destination + start, MIN(piece, length - start), testMaskKey, offset);
+    }
+    if (memcmp(self.destination, self.expected, length) != 0) {
+      XCTFail(@"Masked wrong in pieces of %zu", piece);
+      return;
+    }
+  }
+}
+
+// Verify that masking twice gives back the original bytes
+- (void)testMask_Twice_RestoresBytes {
+  fillPattern(self.source, 1500);
+  memcpy(self.destination, self.source, 1500);
+  ZCCSRFrameMask(self.destination + 3, 1497, testMaskKey, 0);
+  ZCCSRFrameMask(self.destination + 3, 1497, testMaskKey, 0);
+  XCTAssertEqual(memcmp(self.destination, self.source, 1500), 0);
+}
+
+// Verify that the new kernel agrees with the one it replaces
+- (void)testMask_MatchesPreviousImplementation {
+  for (size_t alignment = 0; alignment < 32; alignment++) {
+    uint8_t *bytes = self.destination + 64 + alignment;
+    uint8_t *previous = self.source + 64 + alignment;
+    fillPattern(bytes, 1000);
+    fillPattern(previous, 1000);
+    ZCCSRFrameMask(bytes, 1000, testMaskKey, 0);
+    ZCCSRMaskBytesSIMD(previous, 1000, (uint8_t *)testMaskKey);
+    XCTAssertEqual(memcmp(bytes, previous, 1000), 0);
+  }
+}
+
+// Masking 60 ms audio frames and occasional large commands, the sizes the client sends
+- (void)testPerformance_Mask {
+  fillPattern(self.destination, 4096);
+  [self measureBlock:^{
+    for (int round = 0; round < 20000; round++) {
+      ZCCSRFrameMask(self.destination + 1, 120, testMaskKey, 0);
+      ZCCSRFrameMask(self.destination + 3, 4000, testMaskKey, 0);
+    }
+  }];
+}
+
+- (void)testPerformance_MaskCopy {
+  fillPattern(self.source, 4096);
+  [self measureBlock:^{
+    for (int round = 0; round < 20000; round++) {
+      ZCCSRFrameMaskCopy(self.destination + 14, self.source, 120, testMaskKey, 0);
+      ZCCSRFrameMaskCopy(self.destination + 14, self.source, 4000, testMaskKey, 0);
+    }
+  }];
+}
+
+// The same work with the previous implementation, and the memcpy it needed before masking
+- (void)testPerformance_PreviousImplementation {
+  fillPattern(self.source, 4096);
+  [self measureBlock:^{
+    for (int round = 0; round < 20000; round++) {
+      memcpy(self.destination + 14, self.source, 120);
+      ZCCSRMaskBytesSIMD(self.destination + 14, 120, (uint8_t *)testMaskKey);
+      memcpy(self.destination + 14, self.source, 4000);
+      ZCCSRMaskBytesSIMD(self.destination + 14, 4000, (uint8_t *)testMaskKey);
+    }
+  }];
+}
+
+@end
@@ -0,0 +1,177 @@
+//
+//  ZCCSRRandomPoolTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import <Security/Security.h>
+#import "ZCCSRRandomPool.h"
+
+static void seedWithByte(ZCCSRRandomPool *pool, uint8_t value) {
+  uint8_t seed[ZCCSRRandomPoolSeedLength];
+  memset(seed, value, sizeof(seed));
+  ZCCSRRandomPoolSeed(pool, seed);
+}
+
+static BOOL isZero(const uint8_t *bytes, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    if (bytes[i] != 0) {
+      return NO;
+    }
+  }
+  return YES;
+}
+
+@interface ZCCSRRandomPoolTests : XCTestCase
+@property (nonatomic) ZCCSRRandomPool *pool;
+@end
+
+@implementation ZCCSRRandomPoolTests
+
+- (void)setUp {
+  [super setUp];
+  self.pool = malloc(sizeof(ZCCSRRandomPool));
+  ZCCSRRandomPoolInit(self.pool);
+}
+
+- (void)tearDown {
+  free(self.pool);
+  [super tearDown];
+}
+
+// Verify that nothing comes out before the pool is seeded
+- (void)testRead_Unseeded_Fails {
+  XCTAssertTrue(ZCCSRRandomPoolNeedsSeed(self.pool));
+  uint8_t key[4] = {1, 2, 3, 4};
+  XCTAssertFalse(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+  XCTAssertEqual(key[0], 1);
+  XCTAssertEqual(key[3], 4);
+}
+
+// Verify that the seed is wiped once it's in the key
+- (void)testSeed_WipesSeed {
+  uint8_t seed[ZCCSRRandomPoolSeedLength];
+  memset(seed, 0x5A, sizeof(seed));
+  ZCCSRRandomPoolSeed(self.pool, seed);
+  XCTAssertFalse(ZCCSRRandomPoolNeedsSeed(self.pool));
+  XCTAssertTrue(isZero(seed, sizeof(seed)));
+}
+
+// Verify the keystream against RFC 7539 A.1 test vector #1: the first 32 bytes of each refill
+// become the next key, so output starts at byte 32 of the block
+- (void)testRead_ZeroSeed_MatchesChaCha20Vector {
+  const uint8_t expected[32] = {
+    0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d, 0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+    0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c, 0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86
+  };
+  seedWithByte(self.pool, 0);
+  uint8_t bytes[32];
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, bytes, sizeof(bytes)));
+  XCTAssertEqual(memcmp(bytes, expected, sizeof(expected)), 0);
+}
+
+// Verify that the same seed gives the same keys however the reads are split, across several refills
+- (void)testRead_SameSeed_SameOutput {
+  size_t length = ZCCSRRandomPoolBufferSize * 3 + 100;
+  uint8_t *whole = malloc(length);
+  uint8_t *pieces = malloc(length);
+  seedWithByte(self.pool, 7);
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, whole, length));
+  seedWithByte(self.pool, 7);
+  for (size_t position = 0; position < length; position += 4) {
+    XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, pieces + position, MIN((size_t)4, length - position)));
+  }
+  XCTAssertEqual(memcmp(whole, pieces, length), 0);
+
+  seedWithByte(self.pool, 8);
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, pieces, length));
+  XCTAssertNotEqual(memcmp(whole, pieces, length), 0);
+  free(whole);
+  free(pieces);
+}
+
+// Verify that bytes handed out don't stay behind in the buffer
+- (void)testRead_WipesHandedOutBytes {
+  seedWithByte(self.pool, 1);
+  uint8_t key[4];
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+  XCTAssertTrue(isZero(self.pool->buffer, self.pool->position));
+  XCTAssertFalse(isZero(self.pool->buffer + self.pool->position, ZCCSRRandomPoolBufferSize - self.pool->position));
+}
+
+// Verify that the pool stops after the reseed interval and works again with a new seed
+- (void)testRead_AfterReseedInterval_NeedsSeed {
+  seedWithByte(self.pool, 2);
+  size_t length = 64 * 1024;
+  uint8_t *bytes = malloc(length);
+  for (size_t total = 0; total < ZCCSRRandomPoolReseedInterval; total += length) {
+    XCTAssertFalse(ZCCSRRandomPoolNeedsSeed(self.pool));
+    XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, bytes, length));
+  }
+  XCTAssertTrue(ZCCSRRandomPoolNeedsSeed(self.pool));
+  uint8_t key[4];
+  XCTAssertFalse(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+
+  seedWithByte(self.pool, 3);
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+  free(bytes);
+}
+
+// Verify that a wiped pool holds nothing and needs a seed
+- (void)testWipe_ClearsState {
+  seedWithByte(self.pool, 4);
+  uint8_t key[4];
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+  ZCCSRRandomPoolWipe(self.pool);
+  XCTAssertTrue(ZCCSRRandomPoolNeedsSeed(self.pool));
+  XCTAssertTrue(isZero((const uint8_t *)self.pool->key, sizeof(self.pool->key)));
+  XCTAssertTrue(isZero(self.pool->buffer, sizeof(self.pool->buffer)));
+  XCTAssertFalse(ZCCSRRandomPoolRead(self.pool, key, sizeof(key)));
+}
+
+// Verify that every byte value turns up about as often as the others
+- (void)testRead_Distribution_Flat {
+  seedWithByte(self.pool, 5);
+  size_t length = 256 * 4096;
+  uint8_t *bytes = malloc(length);
+  XCTAssertTrue(ZCCSRRandomPoolRead(self.pool, bytes, length - 1));
+  size_t counts[256] = {0};
+  for (size_t i = 0; i < length - 1; i++) {
+    counts[bytes[i]]++;
+  }
+  for (int value = 0; value < 256; value++) {
+    // About 7 standard deviations either way
+    XCTAssertGreaterThan(counts[value], 3650);
+    XCTAssertLessThan(counts[value], 4550);
+  }
+  free(bytes);
+}
+
+// One mask key per frame, as the socket reads them
+- (void)testPerformance_MaskKeys {
+  uint8_t key[4];
+  [self measureBlock:^{
+    for (int round = 0; round < 100000; round++) {
+      if (ZCCSRRandomPoolNeedsSeed(self.pool)) {
+        uint8_t seed[ZCCSRRandomPoolSeedLength];
+        SecRandomCopyBytes(kSecRandomDefault, sizeof(seed), seed);
+        ZCCSRRandomPoolSeed(self.pool, seed);
+      }
+      ZCCSRRandomPoolRead(self.pool, key, sizeof(key));
+    }
+  }];
+}
+
+// The same keys straight from the system, as before the pool
+- (void)testPerformance_SecRandomCopyBytes {
+  uint8_t key[4];
+  [self measureBlock:^{
+    for (int round = 0; round < 100000; round++) {
+      SecRandomCopyBytes(kSecRandomDefault, sizeof(key), key);
+    }
+  }];
+}
+
+@end
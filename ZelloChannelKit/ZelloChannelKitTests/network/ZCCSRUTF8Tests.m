@@ -0,0 +1,191 @@
+//
+//  ZCCSRUTF8Tests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCSRUTF8.h"
+
+static BOOL validate(const char *bytes, size_t length) {
+  ZCCSRUTF8State state;
+  ZCCSRUTF8StateInit(&state);
+  return ZCCSRUTF8Validate(&state, (const uint8_t *)bytes, length) && ZCCSRUTF8IsComplete(&state);
+}
+
+/// Decodes one character at a time, as RFC 3629 spells it out. Returns whether the bytes are valid UTF-8.
+static BOOL referenceValidate(const uint8_t *bytes, size_t length) {
+  size_t i = 0;
+  while (i < length) {
+    uint8_t lead = bytes[i];
+    size_t count;
+    uint32_t codePoint;
+    if (lead < 0x80) {
+      i++;
+      continue;
+    } else if ((lead & 0xE0) == 0xC0) {
+      count = 1;
+      codePoint = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+      count = 2;
+      codePoint = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+      count = 3;
+      codePoint = lead & 0x07;
+    } else {
+      return NO;
+    }
+    if (i + count >= length) {
+      return NO;
+    }
+    for (size_t j = 1; j <= count; j++) {
+      if ((bytes[i + j] & 0xC0) != 0x80) {
+        return NO;
+      }
+      codePoint = (codePoint << 6) | (bytes[i + j] & 0x3F);
+    }
+    const uint32_t smallest[] = {0, 0x80, 0x800, 0x10000};
+    if (codePoint < smallest[count] || codePoint > 0x10FFFF || (codePoint >= 0xD800 && codePoint <= 0xDFFF)) {
+      return NO;
+    }
+    i += count + 1;
+  }
+  return YES;
+}
+
+@interface ZCCSRUTF8Tests : XCTestCase
+
+@end
+
+@implementation ZCCSRUTF8Tests
+
+- (void)testValidate_WellFormed {
+  XCTAssertTrue(validate("", 0));
+  XCTAssertTrue(validate("{\"command\":\"on_stream_start\"}", 29));
+  XCTAssertTrue(validate("\xC3\xA9", 2));                   // é
+  XCTAssertTrue(validate("\xD0\x9F\xD1\x80\xD0\xB8", 6));   // При
+  XCTAssertTrue(validate("\xE2\x82\xAC", 3));               // €
+  XCTAssertTrue(validate("\xED\x9F\xBF", 3));               // U+D7FF, just below the surrogates
+  XCTAssertTrue(validate("\xEE\x80\x80", 3));               // U+E000, just above them
+  XCTAssertTrue(validate("\xF0\x9F\x98\x80", 4));           // 😀
+  XCTAssertTrue(validate("\xF4\x8F\xBF\xBF", 4));           // U+10FFFF
+}
+
+- (void)testValidate_IllFormed {
+  XCTAssertFalse(validate("\x80", 1));                      // Continuation without a lead byte
+  XCTAssertFalse(validate("\xC0\x80", 2));                  // Overlong NUL
+  XCTAssertFalse(validate("\xC1\xBF", 2));                  // Overlong ASCII
+  XCTAssertFalse(validate("\xE0\x80\x80", 3));              // Overlong three bytes
+  XCTAssertFalse(validate("\xE0\x9F\xBF", 3));
+  XCTAssertFalse(validate("\xED\xA0\x80", 3));              // High surrogate
+  XCTAssertFalse(validate("\xED\xBF\xBF", 3));              // Low surrogate
+  XCTAssertFalse(validate("\xF0\x8F\xBF\xBF", 4));          // Overlong four bytes
+  XCTAssertFalse(validate("\xF4\x90\x80\x80", 4));          // Above U+10FFFF
+  XCTAssertFalse(validate("\xF5\x80\x80\x80", 4));
+  XCTAssertFalse(validate("\xFF", 1));
+  XCTAssertFalse(validate("\xC3\x28", 2));                  // Lead byte followed by ASCII
+  XCTAssertFalse(validate("\xE2\x82", 2));                  // Cut short
+  XCTAssertFalse(validate("abc\xF0\x9F\x98", 6));
+}
+
+// Verify that a character split between two frames is accepted, and an unfinished one is reported
+- (void)testValidate_SplitAnywhere_MatchesWhole {
+  const char *text = "a\xC3\xA9 \xE2\x82\xAC \xF0\x9F\x98\x80 \xD0\x9F\xD1\x80\xD0\xB8 z";
+  size_t length = strlen(text);
+  for (size_t split = 0; split <= length; split++) {
+    ZCCSRUTF8State state;
+    ZCCSRUTF8StateInit(&state);
+    XCTAssertTrue(ZCCSRUTF8Validate(&state, (const uint8_t *)text, split));
+    XCTAssertTrue(ZCCSRUTF8Validate(&state, (const uint8_t *)text + split, length - split));
+    XCTAssertTrue(ZCCSRUTF8IsComplete(&state));
+  }
+
+  ZCCSRUTF8State state;
+  ZCCSRUTF8StateInit(&state);
+  XCTAssertTrue(ZCCSRUTF8Validate(&state, (const uint8_t *)"\xF0\x9F", 2));
+  XCTAssertFalse(ZCCSRUTF8IsComplete(&state));
+  // The rest of the character has to be in range for its lead byte, even in the next piece
+  XCTAssertFalse(ZCCSRUTF8Validate(&state, (const uint8_t *)"\x28", 1));
+
+  ZCCSRUTF8StateInit(&state);
+  XCTAssertTrue(ZCCSRUTF8Validate(&state, (const uint8_t *)"\xED", 1));
+  XCTAssertFalse(ZCCSRUTF8Validate(&state, (const uint8_t *)"\xA0\x80", 2));
+}
+
+// Verify that a bad byte is found wherever it sits in a long ASCII run, in the vector lanes or the tail
+- (void)testValidate_BadByteInASCIIRun_Found {
+  char text[200];
+  for (size_t position = 0; position < sizeof(text); position++) {
+    memset(text, 'a', sizeof(text));
+    text[position] = (char)0x80;
+    XCTAssertFalse(validate(text, sizeof(text)), @"Missed the bad byte at %zu", position);
+    text[position] = (char)0xC3;
+    if (position + 1 < sizeof(text)) {
+      text[position + 1] = (char)0xA9;
+      XCTAssertTrue(validate(text, sizeof(text)), @"Rejected é at %zu", position);
+    }
+  }
+}
+
+// Verify against the reference decoder on random byte strings that are mostly, but not always, valid
+- (void)testValidate_Random_MatchesReference {
+  uint32_t seed = 7;
+  uint8_t bytes[64];
+  for (int round = 0; round < 100000; round++) {
+    size_t length = 0;
+    while (length < sizeof(bytes) - 4) {
+      seed = seed * 1103515245 + 12345;
+      uint32_t random = seed >> 8;
+      switch (random % 6) {
+        case 0: bytes[length++] = (uint8_t)(random >> 8) & 0x7F; break;
+        case 1: bytes[length++] = (uint8_t)(0xC0 | ((random >> 8) & 0x1F)); bytes[length++] = (uint8_t)(0x80 | ((random >> 16) & 0x3F)); break;
+        case 2: bytes[length++] = (uint8_t)(0xE0 | ((random >> 8) & 0x0F)); bytes[length++] = (uint8_t)(0x80 | ((random >> 12) & 0x3F)); bytes[length++] = (uint8_t)(0x80 | ((random >> 18) & 0x3F)); break;
+        case 3: bytes[length++] = (uint8_t)(0xF0 | ((random >> 8) & 0x07)); bytes[length++] = (uint8_t)(0x80 | ((random >> 11) & 0x3F)); bytes[length++] = 0x80; bytes[length++] = 0xBF; break;
+        default: bytes[length++] = (uint8_t)(random >> 8); break;
+      }
+    }
+    BOOL expected = referenceValidate(bytes, length);
+    if (validate((const char *)bytes, length) != expected) {
+      XCTFail(@"Disagrees with the reference in round %d", round);
+      return;
+    }
+  }
+}
+
+// A channel status sized JSON payload, almost all ASCII
+- (void)testPerformance_ASCII {
+  size_t length = 1024 * 1024;
+  uint8_t *json = malloc(length);
+  for (size_t i = 0; i < length; i++) {
+    json[i] = (uint8_t)"{\"command\":\"on_channel_status\",\"users_online\":12}"[i % 50];
+  }
+  [self measureBlock:^{
+    for (int round = 0; round < 20; round++) {
+      ZCCSRUTF8State state;
+      ZCCSRUTF8StateInit(&state);
+      XCTAssertTrue(ZCCSRUTF8Validate(&state, json, length));
+    }
+  }];
+  free(json);
+}
+
+// Text messages in Cyrillic, two bytes per letter
+- (void)testPerformance_Multibyte {
+  size_t length = 1024 * 1024;
+  uint8_t *text = malloc(length);
+  for (size_t i = 0; i + 1 < length; i += 2) {
+    text[i] = 0xD0;
+    text[i + 1] = (uint8_t)(0x90 + i / 2 % 32);
+  }
+  [self measureBlock:^{
+    for (int round = 0; round < 20; round++) {
+      ZCCSRUTF8State state;
+      ZCCSRUTF8StateInit(&state);
+      XCTAssertTrue(ZCCSRUTF8Validate(&state, text, length));
+    }
+  }];
+  free(text);
+}
+
+@end
@@ -0,0 +1,133 @@
+//
+//  ZCCSRWebSocketTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <objc/runtime.h>
+#import <XCTest/XCTest.h>
+#import "ZCCSRConstants.h"
+#import "ZCCSRFrameCodec.h"
+#import "ZCCSRWebSocket.h"
+#import "ZCCSRWriteBuffer.h"
+
+@interface ZCCSRWebSocket (Testing)
+- (void)_writeData:(NSData *)data;
+- (void)_sendFrameWithOpcode:(ZCCSROpCode)opCode data:(NSData *)data;
+- (void)_sendFrameInPlace:(NSMutableData *)buffer headroom:(size_t)headroom;
+@end
+
+@interface ZCCSRWebSocketTests : XCTestCase
+/// Never opened, so it has no streams and everything sent stays in its output buffer
+@property (nonatomic, strong) ZCCSRWebSocket *webSocket;
+@end
+
+@implementation ZCCSRWebSocketTests
+
+- (void)setUp {
+  [super setUp];
+  self.webSocket = [[ZCCSRWebSocket alloc] initWithURL:[NSURL URLWithString:@"wss://example.com/"]];
+}
+
+- (void)tearDown {
+  self.webSocket = nil;
+  [super tearDown];
+}
+
+/// Runs block on the socket's work queue, where its sends run
+- (void)onWorkQueue:(dispatch_block_t)block {
+  dispatch_queue_t workQueue = [self.webSocket valueForKey:@"workQueue"];
+  dispatch_sync(workQueue, block);
+}
+
+- (ZCCSRWriteBuffer *)outputBuffer {
+  Ivar ivar = class_getInstanceVariable([ZCCSRWebSocket class], "_outputBuffer");
+  return (ZCCSRWriteBuffer *)((uint8_t *)(__bridge void *)self.webSocket + ivar_getOffset(ivar));
+}
+
+- (NSData *)queuedBytes {
+  __block NSData *queued = nil;
+  [self onWorkQueue:^{
+    ZCCSRWriteBuffer *buffer = [self outputBuffer];
+    queued = [NSData dataWithBytes:ZCCSRWriteBufferPendingBytes(buffer) length:ZCCSRWriteBufferPendingLength(buffer)];
+  }];
+  return queued;
+}
+
+/// Unmasks the frame at the start of bytes and returns its payload
+- (NSData *)payloadOfFrame:(NSData *)bytes opcode:(uint8_t)opcode {
+  ZCCSRFrameHeader header;
+  size_t headerLength = ZCCSRFrameParseHeader(bytes.bytes, bytes.length, &header);
+  XCTAssertGreaterThan(headerLength, 0);
+  XCTAssertTrue(header.fin);
+  XCTAssertTrue(header.masked);
+  XCTAssertEqual(header.opcode, opcode);
+  XCTAssertLessThanOrEqual(headerLength + header.payloadLength, bytes.length);
+  NSMutableData *payload = [[bytes subdataWithRange:NSMakeRange(headerLength, (NSUInteger)header.payloadLength)] mutableCopy];
+  ZCCSRFrameMask(payload.mutableBytes, payload.length, header.maskKey, 0);
+  return payload;
+}
+
+// Verify that frames are queued, masked, one behind the other
+- (void)testSendFrame_QueuesMaskedFramesInOrder {
+  NSData *first = [@"first" dataUsingEncoding:NSUTF8StringEncoding];
+  NSData *second = [@"second" dataUsingEncoding:NSUTF8StringEncoding];
+  [self onWorkQueue:^{
+    [self.webSocket _sendFrameWithOpcode:ZCCSROpCodeBinaryFrame data:first];
+    [self.webSocket _sendFrameWithOpcode:ZCCSROpCodeBinaryFrame data:second];
+  }];
+
+  NSData *queued = [self queuedBytes];
+  size_t firstLength = ZCCSRFrameHeaderSize(first.length, true) + first.length;
+  XCTAssertEqual(queued.length, firstLength + ZCCSRFrameHeaderSize(second.length, true) + second.length);
+  XCTAssertEqualObjects([self payloadOfFrame:queued opcode:ZCCSROpCodeBinaryFrame], first);
+  NSData *rest = [queued subdataWithRange:NSMakeRange(firstLength, queued.length - firstLength)];
+  XCTAssertEqualObjects([self payloadOfFrame:rest opcode:ZCCSROpCodeBinaryFrame], second);
+}
+
+// Verify that a frame built in place is queued while the stream can't take it
+- (void)testSendFrameInPlace_NoStream_QueuesFrame {
+  NSData *audio = [@"audio" dataUsingEncoding:NSUTF8StringEncoding];
+  NSMutableData *buffer = [NSMutableData dataWithLength:ZCCSRWebSocketFrameHeadroom];
+  [buffer appendData:audio];
+  [self onWorkQueue:^{
+    [self.webSocket _sendFrameInPlace:buffer headroom:ZCCSRWebSocketFrameHeadroom];
+  }];
+
+  NSData *queued = [self queuedBytes];
+  XCTAssertEqual(queued.length, ZCCSRFrameHeaderSize(audio.length, true) + audio.length);
+  XCTAssertEqualObjects([self payloadOfFrame:queued opcode:ZCCSROpCodeBinaryFrame], audio);
+}
+
+// Verify that nothing is queued once the connection is closing, since the streams close as soon as
+// what is already queued has been written
+- (void)testSend_AfterCloseConnection_DropsData {
+  NSData *data = [@"late" dataUsingEncoding:NSUTF8StringEncoding];
+  NSMutableData *buffer = [NSMutableData dataWithLength:ZCCSRWebSocketFrameHeadroom];
+  [buffer appendData:data];
+  [self onWorkQueue:^{
+    [self.webSocket setValue:@YES forKey:@"closeWhenFinishedWriting"];
+    [self.webSocket _sendFrameWithOpcode:ZCCSROpCodeTextFrame data:data];
+    [self.webSocket _sendFrameInPlace:buffer headroom:ZCCSRWebSocketFrameHeadroom];
+    [self.webSocket _writeData:data];
+  }];
+
+  XCTAssertEqual([self queuedBytes].length, 0);
+}
+
+// Verify that what was queued before the connection started closing stays queued
+- (void)testSend_BeforeCloseConnection_KeepsQueuedData {
+  NSData *data = [@"early" dataUsingEncoding:NSUTF8StringEncoding];
+  [self onWorkQueue:^{
+    [self.webSocket _sendFrameWithOpcode:ZCCSROpCodeBinaryFrame data:data];
+    [self.webSocket setValue:@YES forKey:@"closeWhenFinishedWriting"];
+    [self.webSocket _sendFrameWithOpcode:ZCCSROpCodeBinaryFrame data:data];
+  }];
+
+  NSData *queued = [self queuedBytes];
+  XCTAssertEqual(queued.length, ZCCSRFrameHeaderSize(data.length, true) + data.length);
+  XCTAssertEqualObjects([self payloadOfFrame:queued opcode:ZCCSROpCodeBinaryFrame], data);
+}
+
+@end
@@ -0,0 +1,126 @@
+//
+//  ZCCSRWriteBufferTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCSRWriteBuffer.h"
+
+@interface ZCCSRWriteBufferTests : XCTestCase
+@property (nonatomic) ZCCSRWriteBuffer *buffer;
+@end
+
+@implementation ZCCSRWriteBufferTests
+
+- (void)setUp {
+  [super setUp];
+  self.buffer = malloc(sizeof(ZCCSRWriteBuffer));
+  ZCCSRWriteBufferInit(self.buffer);
+}
+
+- (void)tearDown {
+  ZCCSRWriteBufferDestroy(self.buffer);
+  free(self.buffer);
+  [super tearDown];
+}
+
+// Verify that appended bytes come out in order, as one contiguous run
+- (void)testAppend_QueuesContiguously {
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 0);
+  XCTAssertTrue(ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"hello ", 6));
+  XCTAssertTrue(ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"world", 5));
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 11);
+  XCTAssertEqual(memcmp(ZCCSRWriteBufferPendingBytes(self.buffer), "hello world", 11), 0);
+}
+
+// Verify that nothing is queued until the reserved space is committed, and then only what was committed
+- (void)testReserve_QueuesOnlyCommittedBytes {
+  uint8_t *space = ZCCSRWriteBufferReserve(self.buffer, 16);
+  XCTAssertTrue(space != NULL);
+  memcpy(space, "abc", 3);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 0);
+  ZCCSRWriteBufferCommit(self.buffer, 3);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 3);
+  XCTAssertEqual(memcmp(ZCCSRWriteBufferPendingBytes(self.buffer), "abc", 3), 0);
+}
+
+// Verify that a partial write leaves the rest at the front of the queue, ahead of anything appended later
+- (void)testConsume_PartialWriteKeepsOrder {
+  ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"0123456789", 10);
+  ZCCSRWriteBufferConsume(self.buffer, 4);
+  ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"ab", 2);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 8);
+  XCTAssertEqual(memcmp(ZCCSRWriteBufferPendingBytes(self.buffer), "456789ab", 8), 0);
+
+  ZCCSRWriteBufferConsume(self.buffer, 8);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 0);
+}
+
+// Verify that pending bytes survive the buffer growing, and moving to the front when the stream lags
+- (void)testReserve_GrowsAndCompactsWithoutLosingBytes {
+  uint8_t chunk[1000];
+  size_t written = 0;
+  size_t queued = 0;
+  for (NSUInteger round = 0; round < 200; round++) {
+    for (size_t i = 0; i < sizeof(chunk); i++) {
+      chunk[i] = (uint8_t)(queued + i);
+    }
+    XCTAssertTrue(ZCCSRWriteBufferAppend(self.buffer, chunk, sizeof(chunk)));
+    queued += sizeof(chunk);
+
+    // The stream takes a bit less than what is queued each time
+    size_t take = MIN(ZCCSRWriteBufferPendingLength(self.buffer), 700 + round % 5 * 100);
+    const uint8_t *pending = ZCCSRWriteBufferPendingBytes(self.buffer);
+    for (size_t i = 0; i < take; i++) {
+      if (pending[i] != (uint8_t)(written + i)) {
+        XCTFail(@"Byte %zu came out wrong", written + i);
+        return;
+      }
+    }
+    ZCCSRWriteBufferConsume(self.buffer, take);
+    written += take;
+  }
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), queued - written);
+}
+
+// Verify that an empty buffer can be reused after a large message was written out
+- (void)testConsume_LargeMessageThenSmall {
+  size_t length = 1024 * 1024;
+  uint8_t *space = ZCCSRWriteBufferReserve(self.buffer, length);
+  XCTAssertTrue(space != NULL);
+  memset(space, 0x5a, length);
+  ZCCSRWriteBufferCommit(self.buffer, length);
+  ZCCSRWriteBufferConsume(self.buffer, length);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 0);
+
+  XCTAssertTrue(ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"x", 1));
+  XCTAssertEqual(*ZCCSRWriteBufferPendingBytes(self.buffer), 'x');
+}
+
+// Verify that a length that can't be represented is refused
+- (void)testReserve_Overflow_Fails {
+  ZCCSRWriteBufferAppend(self.buffer, (const uint8_t *)"abc", 3);
+  XCTAssertTrue(ZCCSRWriteBufferReserve(self.buffer, SIZE_MAX) == NULL);
+  XCTAssertEqual(ZCCSRWriteBufferPendingLength(self.buffer), 3);
+}
+
+// A burst as the socket sees it: a second of 60 ms audio frames and a few commands, then one write
+- (void)testPerformance_AudioBurst {
+  uint8_t audio[100];
+  uint8_t command[300];
+  memset(audio, 1, sizeof(audio));
+  memset(command, 2, sizeof(command));
+  [self measureBlock:^{
+    for (NSUInteger burst = 0; burst < 10000; burst++) {
+      for (NSUInteger frame = 0; frame < 16; frame++) {
+        ZCCSRWriteBufferAppend(self.buffer, audio, sizeof(audio));
+      }
+      ZCCSRWriteBufferAppend(self.buffer, command, sizeof(command));
+      ZCCSRWriteBufferConsume(self.buffer, ZCCSRWriteBufferPendingLength(self.buffer));
+    }
+  }];
+}
+
+@end
@@ -10,6 +10,7 @@
 #import "ZCCSRWebSocket.h"
 #import <XCTest/XCTest.h>
 #import "ZCCAudioSource.h"
+#import "ZCCCommands.h"
 #import "ZCCErrors.h"
 #import "ZCCEncoder.h"
 #import "ZCCEncoderOpus.h"
@@ -791,6 +792,42 @@ static BOOL messageIsEqualToDictionary(NSString *message, NSDictionary *expected
   OCMVerifyAll(self.socketDelegate);
 }
 
+// Verify that we pass the stream start event to the delegate
+- (void)testOnStreamStart_sendsParamsToDelegate {
+  NSString *command = [[NSString alloc] initWithData:[NSJSONSerialization dataWithJSONObject:self.onStreamStartEvent options:0 error:NULL] encoding:NSUTF8StringEncoding];
+
+  XCTestExpectation *startedStream = [[XCTestExpectation alloc] initWithDescription:@"called delegate"];
+  OCMExpect([self.socketDelegate socket:self.socket didStartStreamWithId:12345 params:[OCMArg checkWithBlock:^BOOL(ZCCStreamParams *params) {
+    NSData *header = [[NSData alloc] initWithBase64EncodedString:@"Ym9ndXNoZWFkZXIK" options:0];
+    return [params.type isEqualToString:@"audio"] && [params.codecName isEqualToString:@"opus"] && [params.codecHeader isEqualToData:header] && params.packetDuration == 5;
+  }] channel:@"test" sender:@"bogusSender"]).andDo(^(NSInvocation *invocation) {
+    [startedStream fulfill];
+  });
+
+  [self.socket webSocket:self.webSocket didReceiveMessageWithString:command];
+
+  XCTAssertEqual([XCTWaiter waitForExpectations:@[startedStream] timeout:2.0], XCTWaiterResultCompleted);
+  OCMVerifyAll(self.socketDelegate);
+}
+
+// Verify that escaped strings in the stream start event reach the delegate unescaped
+- (void)testOnStreamStart_escapedStrings_startsStream {
+  NSString *command = @"{\"command\":\"on_stream_start\",\"type\":\"audio\",\"codec\":\"opus\",\"codec_header\":\"Ym9ndXNoZWFkZXIK\",\"packet_duration\":5,\"stream_id\":12345,\"channel\":\"te\\/st\",\"from\":\"bogus\\u0053ender\"}";
+
+  XCTestExpectation *startedStream = [[XCTestExpectation alloc] initWithDescription:@"called delegate"];
+  OCMExpect([self.socketDelegate socket:self.socket didStartStreamWithId:12345 params:[OCMArg checkWithBlock:^BOOL(ZCCStreamParams *params) {
+    NSData *header = [[NSData alloc] initWithBase64EncodedString:@"Ym9ndXNoZWFkZXIK" options:0];
+    return [params.type isEqualToString:@"audio"] && [params.codecName isEqualToString:@"opus"] && [params.codecHeader isEqualToData:header] && params.packetDuration == 5;
+  }] channel:@"te/st" sender:@"bogusSender"]).andDo(^(NSInvocation *invocation) {
+    [startedStream fulfill];
+  });
+
+  [self.socket webSocket:self.webSocket didReceiveMessageWithString:command];
+
+  XCTAssertEqual([XCTWaiter waitForExpectations:@[startedStream] timeout:2.0], XCTWaiterResultCompleted);
+  OCMVerifyAll(self.socketDelegate);
+}
+
 - (void)testOnStreamStart_missingPacketDuration_reportsError {
   NSString *command = [self onStreamStartEventWithoutKey:@"packet_duration"];
   [self verifyInvalidCommand:@"on_stream_start" message:command reportsErrorForKey:@"packet_duration" description:@"packet_duration missing or not a number"];
@@ -848,6 +885,67 @@ static BOOL messageIsEqualToDictionary(NSString *message, NSDictionary *expected
   [self verifyInvalidCommand:@"on_stream_stop" message:command reportsErrorForKey:@"stream_id" description:@"stream_id out of range"];
 }
 
+// Verify that audio messages are framed with the stream id
+- (void)testSendAudioData_sendsDataMessage {
+  uint8_t adata[] = { 1, 2, 3, 4, 5 };
+  uint8_t amessage[] = { 0x01, 0, 0, 1, 2, 0, 0, 0, 0, 1, 2, 3, 4, 5 };
+  NSData *expected = [NSData dataWithBytes:amessage length:sizeof(amessage)];
+
+  [self.socket sendAudioData:[NSData dataWithBytes:adata length:sizeof(adata)] stream:258];
+
+  OCMVerify([self.webSocket sendData:expected error:(NSError * __autoreleasing *)[OCMArg anyPointer]]);
+}
+
+// Verify that messages built in place go to the web socket with their headroom
+- (void)testSendAudioMessageInPlace_sendsBufferInPlace {
+  NSMutableData *buffer = [NSMutableData dataWithLength:ZCCSocket.messageHeadroom];
+  [buffer appendData:[ZCCCommands messageForAudioData:[NSData dataWithBytes:"\x01\x02\x03" length:3] stream:258]];
+
+  [self.socket sendAudioMessageInPlace:buffer];
+
+  OCMVerify([self.webSocket sendDataInPlace:buffer headroom:ZCCSocket.messageHeadroom error:(NSError * __autoreleasing *)[OCMArg anyPointer]]);
+}
+
+// Verify that the encoder's header prefix matches the messages we build
+- (void)testAudioMessageHeader_matchesAudioMessage {
+  uint8_t adata[] = { 1, 2, 3, 4, 5 };
+  NSData *audio = [NSData dataWithBytes:adata length:sizeof(adata)];
+  NSMutableData *message = [[ZCCCommands audioMessageHeaderForStream:258] mutableCopy];
+  [message appendData:audio];
+
+  XCTAssertEqualObjects(message, [ZCCCommands messageForAudioData:audio stream:258]);
+}
+
+// Verify that we propagate audio data events
+- (void)testReceiveAudioData_sendsToDelegate {
+  uint8_t amessage[] = { 0x01, 0, 0, 1, 2, 0, 0, 0, 7, 1, 2, 3, 4, 5 };
+  NSData *adata = [NSData dataWithBytes:amessage length:sizeof(amessage)];
+  uint8_t expectedBytes[] = { 1, 2, 3, 4, 5 };
+  NSData *expectedAudio = [NSData dataWithBytes:expectedBytes length:sizeof(expectedBytes)];
+  XCTestExpectation *receivedAudio = [[XCTestExpectation alloc] initWithDescription:@"Called delegate for audio"];
+  OCMExpect([self.socketDelegate socket:self.socket didReceiveAudioData:expectedAudio streamId:258 packetId:7]).andDo(^(NSInvocation *invocation) {
+    [receivedAudio fulfill];
+  });
+
+  [self.socket webSocket:self.webSocket didReceiveMessageWithData:adata];
+
+  XCTAssertEqual([XCTWaiter waitForExpectations:@[receivedAudio] timeout:3.0], XCTWaiterResultCompleted);
+  OCMVerifyAll(self.socketDelegate);
+}
+
+// Verify that truncated audio messages are reported instead of delivered
+- (void)testReceiveAudioData_tooShort_reportsError {
+  uint8_t amessage[] = { 0x01, 0, 0, 1, 2, 0, 0, 0 };
+  XCTestExpectation *reportedError = [[XCTestExpectation alloc] initWithDescription:@"reported error"];
+  OCMExpect([self.socketDelegate socket:self.socket didEncounterErrorParsingMessage:OCMOCK_ANY]).andDo(^(NSInvocation *invocation) {
+    [reportedError fulfill];
+  });
+
+  [self.socket webSocket:self.webSocket didReceiveMessageWithData:[NSData dataWithBytes:amessage length:sizeof(amessage)]];
+
+  XCTAssertEqual([XCTWaiter waitForExpectations:@[reportedError] timeout:3.0], XCTWaiterResultCompleted);
+}
+
 #pragma mark Locations
 
 // Verify we send location
@@ -1034,6 +1132,21 @@ static BOOL messageIsEqualToDictionary(NSString *message, NSDictionary *expected
   OCMVerifyAll(self.webSocket);
 }
 
+// Verify that we escape quotes, backslashes and control characters in texts
+- (void)testSendText_specialCharacters_sendsCommand {
+  NSString *text = @"\"quoted\" \\ line\nbreak\t\u00e9\U0001F600";
+  NSDictionary *expected = @{@"command":@"send_text_message",
+                             @"seq":@(1),
+                             @"text":text};
+  OCMExpect([self.webSocket sendString:[OCMArg checkWithBlock:^BOOL(NSString *message) {
+    return messageIsEqualToDictionary(message, expected);
+  }] error:(NSError * __autoreleasing *)[OCMArg anyPointer]]).andReturn(YES);
+
+  [self.socket sendTextMessage:text recipient:nil timeoutAfter:30.0];
+
+  OCMVerifyAll(self.webSocket);
+}
+
 // Verify that we report an error if the websocket fails to send
 - (void)testSendText_errorSending_reportsError {
   NSDictionary *expected = @{@"command":@"send_text_message",
@@ -1076,6 +1189,28 @@ static BOOL messageIsEqualToDictionary(NSString *message, NSDictionary *expected
   OCMVerifyAll(self.webSocket);
 }
 
+// Verify that responses reach the right request while many requests are outstanding
+- (void)testSendText_manyOutstandingRequests_matchesResponses {
+  OCMStub([self.webSocket sendString:OCMOCK_ANY error:(NSError * __autoreleasing *)[OCMArg anyPointer]]).andReturn(YES);
+  XCTestExpectation *firstFailed = [[XCTestExpectation alloc] initWithDescription:@"first request failed"];
+  XCTestExpectation *lastFailed = [[XCTestExpectation alloc] initWithDescription:@"last request failed"];
+  OCMExpect([self.socketDelegate socket:self.socket didReportError:@"Error 1"]).andDo(^(NSInvocation *invocation) {
+    [firstFailed fulfill];
+  });
+  OCMExpect([self.socketDelegate socket:self.socket didReportError:@"Error 200"]).andDo(^(NSInvocation *invocation) {
+    [lastFailed fulfill];
+  });
+
+  for (NSInteger i = 0; i < 200; i++) {
+    [self.socket sendTextMessage:@"test message" recipient:nil timeoutAfter:30.0];
+  }
+  [self.socket webSocket:self.webSocket didReceiveMessageWithString:@"{\"seq\":200,\"success\":false,\"error\":\"Error 200\"}"];
+  [self.socket webSocket:self.webSocket didReceiveMessageWithString:@"{\"seq\":1,\"success\":false,\"error\":\"Error 1\"}"];
+
+  XCTAssertEqual([XCTWaiter waitForExpectations:@[firstFailed, lastFailed] timeout:3.0], XCTWaiterResultCompleted);
+  OCMVerifyAll(self.socketDelegate);
+}
+
 // Verify that we report an error if the server times out
 - (void)testSendText_timeout_reportsError {
   NSDictionary *expected = @{@"command":@"send_text_message",
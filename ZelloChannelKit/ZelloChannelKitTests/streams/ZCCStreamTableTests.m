@@ -0,0 +1,219 @@
+//
+//  ZCCStreamTableTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCStreamTable.h"
+
+/// Slots in walk order
+static size_t walk(ZCCStreamTable *table, int32_t *slots, size_t capacity) {
+  size_t count = 0;
+  for (int32_t slot = ZCCStreamTableFirst(table); slot != ZCCStreamTableNoSlot; slot = ZCCStreamTableNext(table, slot)) {
+    if (count < capacity) {
+      slots[count] = slot;
+    }
+    count++;
+  }
+  return count;
+}
+
+@interface ZCCStreamTableTests : XCTestCase
+@property (nonatomic) ZCCStreamTable *table;
+@end
+
+@implementation ZCCStreamTableTests
+
+- (void)setUp {
+  [super setUp];
+  self.table = ZCCStreamTableCreate();
+}
+
+- (void)tearDown {
+  ZCCStreamTableDestroy(self.table);
+  [super tearDown];
+}
+
+- (void)testAdd_Find_Remove {
+  int32_t a = ZCCStreamTableAdd(self.table, 100, true);
+  int32_t b = ZCCStreamTableAdd(self.table, 200, true);
+  XCTAssertNotEqual(a, ZCCStreamTableNoSlot);
+  XCTAssertNotEqual(b, ZCCStreamTableNoSlot);
+  XCTAssertNotEqual(a, b);
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 2);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 100), a);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 200), b);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 300), ZCCStreamTableNoSlot);
+
+  ZCCStreamTableRemove(self.table, a);
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 1);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 100), ZCCStreamTableNoSlot);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 200), b);
+  // Removing twice, or a slot never handed out, does nothing
+  ZCCStreamTableRemove(self.table, a);
+  ZCCStreamTableRemove(self.table, 1000);
+  ZCCStreamTableRemove(self.table, ZCCStreamTableNoSlot);
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 1);
+}
+
+// Verify that a second keyed stream with the same id is refused, while unkeyed ones don't collide
+- (void)testAdd_DuplicateId_Refused {
+  XCTAssertNotEqual(ZCCStreamTableAdd(self.table, 7, true), ZCCStreamTableNoSlot);
+  XCTAssertEqual(ZCCStreamTableAdd(self.table, 7, true), ZCCStreamTableNoSlot);
+  int32_t unkeyed = ZCCStreamTableAdd(self.table, 7, false);
+  XCTAssertNotEqual(unkeyed, ZCCStreamTableNoSlot);
+  XCTAssertNotEqual(ZCCStreamTableFind(self.table, 7), unkeyed);
+  XCTAssertNotEqual(ZCCStreamTableAdd(self.table, 0, false), ZCCStreamTableNoSlot);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 0), ZCCStreamTableNoSlot);
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 3);
+}
+
+// Verify that a removed slot is handed out again before the table grows
+- (void)testRemove_SlotReused {
+  int32_t slots[4];
+  for (uint32_t i = 0; i < 4; i++) {
+    slots[i] = ZCCStreamTableAdd(self.table, i + 1, true);
+  }
+  ZCCStreamTableRemove(self.table, slots[1]);
+  int32_t reused = ZCCStreamTableAdd(self.table, 50, true);
+  XCTAssertEqual(reused, slots[1]);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 50), reused);
+  XCTAssertEqual(ZCCStreamTableFind(self.table, 2), ZCCStreamTableNoSlot);
+}
+
+// Verify that the walk follows the order of addition, including a reused slot, which goes last
+- (void)testWalk_OrderOfAddition {
+  int32_t a = ZCCStreamTableAdd(self.table, 1, true);
+  int32_t b = ZCCStreamTableAdd(self.table, 2, false);
+  int32_t c = ZCCStreamTableAdd(self.table, 3, true);
+  ZCCStreamTableRemove(self.table, a);
+  int32_t d = ZCCStreamTableAdd(self.table, 4, true);
+  XCTAssertEqual(d, a);
+  int32_t order[8];
+  XCTAssertEqual(walk(self.table, order, 8), 3);
+  XCTAssertEqual(order[0], b);
+  XCTAssertEqual(order[1], c);
+  XCTAssertEqual(order[2], d);
+}
+
+// Verify that removing the slot being visited, as a stream stopping from its own callback would,
+// doesn't skip or repeat any other
+- (void)testWalk_RemoveCurrent_Continues {
+  for (uint32_t i = 0; i < 10; i++) {
+    ZCCStreamTableAdd(self.table, i, true);
+  }
+  size_t visited = 0;
+  int32_t slot = ZCCStreamTableFirst(self.table);
+  while (slot != ZCCStreamTableNoSlot) {
+    int32_t current = slot;
+    visited++;
+    if (current % 2 == 0) {
+      ZCCStreamTableRemove(self.table, current);
+    }
+    slot = ZCCStreamTableNext(self.table, current);
+  }
+  XCTAssertEqual(visited, 10);
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 5);
+  int32_t order[10];
+  XCTAssertEqual(walk(self.table, order, 10), 5);
+  for (size_t i = 0; i < 5; i++) {
+    XCTAssertEqual(order[i] % 2, 1);
+  }
+}
+
+// Verify that lookups still find every stream after removals from the middle of probe runs. There
+// are no tombstones; entries shift back into the hole, so this is what would break if they didn't.
+- (void)testRemove_MidCluster_OthersStillFound {
+  // Sequential ids fill neighbouring buckets once the table has grown a few times
+  for (uint32_t id = 1; id <= 1000; id++) {
+    XCTAssertNotEqual(ZCCStreamTableAdd(self.table, id, true), ZCCStreamTableNoSlot);
+  }
+  for (uint32_t id = 1; id <= 1000; id += 3) {
+    ZCCStreamTableRemove(self.table, ZCCStreamTableFind(self.table, id));
+  }
+  for (uint32_t id = 1; id <= 1000; id++) {
+    int32_t slot = ZCCStreamTableFind(self.table, id);
+    if (id % 3 == 1) {
+      XCTAssertEqual(slot, ZCCStreamTableNoSlot);
+    } else if (slot == ZCCStreamTableNoSlot) {
+      XCTFail(@"Lost stream %u", id);
+      return;
+    }
+  }
+  XCTAssertEqual(ZCCStreamTableCount(self.table), 666);
+}
+
+// Verify against a plain array on a long run of random adds and removes over a few ids
+- (void)testRandomOperations_MatchModel {
+  int32_t model[64];
+  for (int i = 0; i < 64; i++) {
+    model[i] = ZCCStreamTableNoSlot;
+  }
+  size_t modelCount = 0;
+  uint32_t seed = 3;
+  for (int step = 0; step < 100000; step++) {
+    seed = seed * 1103515245 + 12345;
+    uint32_t id = (seed >> 16) % 64;
+    // Spread the ids out so they hash apart, and then some collide anyway
+    uint32_t streamId = id * 977 + 1;
+    if (model[id] == ZCCStreamTableNoSlot) {
+      model[id] = ZCCStreamTableAdd(self.table, streamId, true);
+      XCTAssertNotEqual(model[id], ZCCStreamTableNoSlot);
+      modelCount++;
+    } else {
+      ZCCStreamTableRemove(self.table, model[id]);
+      model[id] = ZCCStreamTableNoSlot;
+      modelCount--;
+    }
+    if (step % 97 == 0) {
+      for (uint32_t other = 0; other < 64; other++) {
+        if (ZCCStreamTableFind(self.table, other * 977 + 1) != model[other]) {
+          XCTFail(@"Stream %u is in the wrong slot at step %d", other, step);
+          return;
+        }
+      }
+    }
+  }
+  XCTAssertEqual(ZCCStreamTableCount(self.table), modelCount);
+  int32_t order[64];
+  XCTAssertEqual(walk(self.table, order, 64), modelCount);
+}
+
+// Routing packets to 1000 live streams by id, as the socket does for every audio packet
+- (void)testPerformance_FindAcrossManyStreams {
+  uint32_t streamCount = 1000;
+  for (uint32_t i = 0; i < streamCount; i++) {
+    ZCCStreamTableAdd(self.table, 50000 + i, true);
+  }
+  __block int64_t found = 0;
+  [self measureBlock:^{
+    uint32_t seed = 1;
+    for (int packet = 0; packet < 1000000; packet++) {
+      seed = seed * 1103515245 + 12345;
+      found += ZCCStreamTableFind(self.table, 50000 + (seed >> 16) % streamCount);
+    }
+  }];
+  XCTAssertGreaterThan(found, 0);
+}
+
+// Streams starting and stopping while others keep running
+- (void)testPerformance_AddRemoveChurn {
+  uint32_t streamCount = 1000;
+  int32_t *slots = malloc(streamCount * sizeof(int32_t));
+  for (uint32_t i = 0; i < streamCount; i++) {
+    slots[i] = ZCCStreamTableAdd(self.table, i, true);
+  }
+  __block uint32_t nextId = streamCount;
+  [self measureBlock:^{
+    for (int round = 0; round < 100000; round++) {
+      uint32_t victim = (uint32_t)round % streamCount;
+      ZCCStreamTableRemove(self.table, slots[victim]);
+      slots[victim] = ZCCStreamTableAdd(self.table, nextId++, true);
+    }
+  }];
+  free(slots);
+}
+
+@end
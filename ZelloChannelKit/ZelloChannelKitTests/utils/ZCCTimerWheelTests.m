@@ -0,0 +1,208 @@
+//
+//  ZCCTimerWheelTests.m
+//  ZelloChannelKitTests
+//
+//  Copyright © 2018 Zello. All rights reserved.
+//
+
+#import <XCTest/XCTest.h>
+#import "ZCCTimerWheel.h"
+
+/// Keys in the order the wheel fired them, and when
+typedef struct {
+  ZCCTimerWheel *wheel;
+  uint64_t keys[256];
+  uint64_t ticks[256];
+  size_t count;
+  ZCCTimerId cancelOnFire;      // Cancelled from the first callback, if set
+  uint64_t rescheduleTicks;     // Each fired timer schedules another this far out, if set
+} FiredLog;
+
+static void recordFired(void *context, ZCCTimerId timer, uint64_t key) {
+  FiredLog *log = context;
+  if (log->count < 256) {
+    log->keys[log->count] = key;
+    log->ticks[log->count] = ZCCTimerWheelNow(log->wheel);
+  }
+  log->count++;
+  if (log->cancelOnFire) {
+    ZCCTimerWheelCancel(log->wheel, log->cancelOnFire);
+    log->cancelOnFire = 0;
+  }
+  if (log->rescheduleTicks) {
+    ZCCTimerWheelSchedule(log->wheel, log->rescheduleTicks, key + 1000);
+  }
+}
+
+static void countFired(void *context, ZCCTimerId timer, uint64_t key) {
+  (*(size_t *)context)++;
+}
+
+@interface ZCCTimerWheelTests : XCTestCase
+@property (nonatomic) ZCCTimerWheel *wheel;
+@property (nonatomic) FiredLog *log;
+@end
+
+@implementation ZCCTimerWheelTests
+
+- (void)setUp {
+  [super setUp];
+  self.wheel = ZCCTimerWheelCreate(8);
+  self.log = calloc(1, sizeof(FiredLog));
+  self.log->wheel = self.wheel;
+}
+
+- (void)tearDown {
+  ZCCTimerWheelDestroy(self.wheel);
+  free(self.log);
+  [super tearDown];
+}
+
+// Verify that a timer fires on the tick it's due and not before
+- (void)testAdvance_FiresWhenDue {
+  ZCCTimerId timer = ZCCTimerWheelSchedule(self.wheel, 5, 42);
+  XCTAssertNotEqual(timer, 0);
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 1);
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 4, recordFired, self.log), 0);
+  XCTAssertEqual(ZCCTimerWheelNow(self.wheel), 4);
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 5, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->keys[0], 42);
+  XCTAssertEqual(self.log->ticks[0], 5);
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 0);
+  // Advancing to the past does nothing
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 3, recordFired, self.log), 0);
+  XCTAssertEqual(ZCCTimerWheelNow(self.wheel), 5);
+}
+
+// Verify that a timer scheduled for now waits for the next tick
+- (void)testSchedule_ZeroTicks_FiresNextTick {
+  ZCCTimerWheelAdvance(self.wheel, 10, recordFired, self.log);
+  ZCCTimerWheelSchedule(self.wheel, 0, 1);
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 11, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->ticks[0], 11);
+}
+
+// Verify that timers fire tick by tick, and in the order they were scheduled within a tick
+- (void)testAdvance_FiresInOrder {
+  ZCCTimerWheelSchedule(self.wheel, 3, 30);
+  ZCCTimerWheelSchedule(self.wheel, 1, 10);
+  ZCCTimerWheelSchedule(self.wheel, 3, 31);
+  ZCCTimerWheelSchedule(self.wheel, 2, 20);
+  ZCCTimerWheelSchedule(self.wheel, 3, 32);
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 6, recordFired, self.log), 5);
+  uint64_t expected[] = {10, 20, 30, 31, 32};
+  for (size_t i = 0; i < 5; i++) {
+    XCTAssertEqual(self.log->keys[i], expected[i]);
+  }
+  XCTAssertEqual(self.log->ticks[0], 1);
+  XCTAssertEqual(self.log->ticks[4], 3);
+}
+
+// Verify that timers several turns out share a slot with nearer ones but wait for their own turn
+- (void)testAdvance_SeveralTurnsOut_WaitsForItsTurn {
+  ZCCTimerWheelSchedule(self.wheel, 3, 1);
+  ZCCTimerWheelSchedule(self.wheel, 3 + 8, 2);
+  ZCCTimerWheelSchedule(self.wheel, 3 + 8 * 5, 3);
+  for (uint64_t tick = 1; tick <= 50; tick++) {
+    ZCCTimerWheelAdvance(self.wheel, tick, recordFired, self.log);
+  }
+  XCTAssertEqual(self.log->count, 3);
+  XCTAssertEqual(self.log->ticks[0], 3);
+  XCTAssertEqual(self.log->ticks[1], 11);
+  XCTAssertEqual(self.log->ticks[2], 43);
+}
+
+// Verify that a jump of several turns fires everything due, and nothing that isn't
+- (void)testAdvance_LongJump_SweepsAllSlots {
+  for (uint64_t i = 1; i <= 40; i++) {
+    ZCCTimerWheelSchedule(self.wheel, i, i);
+  }
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 30, recordFired, self.log), 30);
+  XCTAssertEqual(ZCCTimerWheelNow(self.wheel), 30);
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 10);
+  for (size_t i = 0; i < 30; i++) {
+    XCTAssertLessThanOrEqual(self.log->keys[i], 30);
+  }
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 31, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->keys[30], 31);
+}
+
+// Verify that a cancelled timer doesn't fire and can't be cancelled twice
+- (void)testCancel_DoesNotFire {
+  ZCCTimerId cancelled = ZCCTimerWheelSchedule(self.wheel, 2, 1);
+  ZCCTimerId kept = ZCCTimerWheelSchedule(self.wheel, 2, 2);
+  XCTAssertTrue(ZCCTimerWheelCancel(self.wheel, cancelled));
+  XCTAssertFalse(ZCCTimerWheelCancel(self.wheel, cancelled));
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 1);
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 2, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->keys[0], 2);
+  XCTAssertFalse(ZCCTimerWheelCancel(self.wheel, kept));
+  XCTAssertFalse(ZCCTimerWheelCancel(self.wheel, 0));
+  XCTAssertFalse(ZCCTimerWheelCancel(self.wheel, 12345));
+}
+
+// Verify that an index is reused once its timer is gone, and the old id can't touch the new timer
+- (void)testCancel_StaleId_LeavesReusedIndexAlone {
+  ZCCTimerId first = ZCCTimerWheelSchedule(self.wheel, 5, 1);
+  XCTAssertTrue(ZCCTimerWheelCancel(self.wheel, first));
+  ZCCTimerId second = ZCCTimerWheelSchedule(self.wheel, 5, 2);
+  XCTAssertEqual(ZCCTimerIdIndex(first), ZCCTimerIdIndex(second));
+  XCTAssertNotEqual(first, second);
+  XCTAssertFalse(ZCCTimerWheelCancel(self.wheel, first));
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 5, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->keys[0], 2);
+}
+
+// Verify that a callback can cancel a timer due on the same tick, and schedule new ones
+- (void)testAdvance_CallbackCancelsAndSchedules {
+  ZCCTimerWheelSchedule(self.wheel, 1, 1);
+  self.log->cancelOnFire = ZCCTimerWheelSchedule(self.wheel, 1, 2);
+  self.log->rescheduleTicks = 2;
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 1, recordFired, self.log), 1);
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 1);
+  self.log->rescheduleTicks = 0;
+  XCTAssertEqual(ZCCTimerWheelAdvance(self.wheel, 3, recordFired, self.log), 1);
+  XCTAssertEqual(self.log->keys[1], 1001);
+  XCTAssertEqual(self.log->ticks[1], 3);
+}
+
+// Verify that the wheel grows past its initial capacity and every timer still fires once
+- (void)testSchedule_Many_AllFireOnce {
+  size_t fired = 0;
+  for (uint64_t i = 0; i < 10000; i++) {
+    XCTAssertNotEqual(ZCCTimerWheelSchedule(self.wheel, 1 + i % 100, i), 0);
+  }
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 10000);
+  for (uint64_t tick = 1; tick <= 100; tick++) {
+    ZCCTimerWheelAdvance(self.wheel, tick, countFired, &fired);
+  }
+  XCTAssertEqual(fired, 10000);
+  XCTAssertEqual(ZCCTimerWheelCount(self.wheel), 0);
+}
+
+// Thousands of stream timeouts outstanding, most of them cancelled and rescheduled as packets
+// arrive, with a 20 ms tick over a 1024 slot wheel
+- (void)testPerformance_ManyOutstandingTimers {
+  ZCCTimerWheel *wheel = ZCCTimerWheelCreate(1024);
+  size_t timerCount = 5000;
+  ZCCTimerId *timers = malloc(timerCount * sizeof(ZCCTimerId));
+  for (size_t i = 0; i < timerCount; i++) {
+    timers[i] = ZCCTimerWheelSchedule(wheel, 50 + i % 200, i);
+  }
+  __block size_t fired = 0;
+  [self measureBlock:^{
+    for (int round = 0; round < 200; round++) {
+      for (size_t i = 0; i < timerCount; i++) {
+        if ((i + (size_t)round) % 4 != 0) {
+          ZCCTimerWheelCancel(wheel, timers[i]);
+          timers[i] = ZCCTimerWheelSchedule(wheel, 50 + i % 200, i);
+        }
+      }
+      ZCCTimerWheelAdvance(wheel, ZCCTimerWheelNow(wheel) + 1, countFired, &fired);
+    }
+  }];
+  free(timers);
+  ZCCTimerWheelDestroy(wheel);
+}
+
+@end